@@ -24,7 +24,6 @@ __copyright__ = "Copyright 2011-2017, Damon Lynch"
 import pickle
 import os
 import errno
-import hashlib
 from datetime import datetime
 import shutil
 import logging
@@ -39,8 +38,8 @@ from typing import Optional, Tuple
 
 
 from raphodo.interprocess import (BackupFileData, BackupResults, BackupArguments,
-                          WorkerInPublishPullPipeline)
-from raphodo.copyfiles import FileCopy
+                          WorkerInPublishPullPipeline, run_worker)
+from raphodo.copyfiles import FileCopy, file_md5
 from raphodo.constants import (FileType, DownloadStatus, BackupStatus)
 from raphodo.rpdfile import RPDFile
 from raphodo.cache import FdoCacheNormal, FdoCacheLarge
@@ -48,7 +47,7 @@ from raphodo.cache import FdoCacheNormal, FdoCacheLarge
 from raphodo.copyfiles import copy_file_metadata
 from raphodo.problemnotification import (
     BackingUpProblems, BackupSubfolderCreationProblem, make_href, BackupOverwrittenProblem,
-    BackupAlreadyExistsProblem, FileWriteProblem
+    BackupAlreadyExistsProblem, FileWriteProblem, BackupVerificationProblem
 )
 from raphodo.storage import get_uri
 
@@ -58,22 +57,6 @@ class BackupFilesWorker(WorkerInPublishPullPipeline, FileCopy):
         self.problems = BackingUpProblems()
         super().__init__('BackupFiles')
 
-    def update_progress(self, amount_downloaded, total):
-        self.amount_downloaded = amount_downloaded
-        chunk_downloaded = amount_downloaded - self.bytes_downloaded
-        if (chunk_downloaded > self.batch_size_bytes) or (amount_downloaded == total):
-            self.bytes_downloaded = amount_downloaded
-            self.content= pickle.dumps(BackupResults(
-                scan_id=self.scan_id,
-                device_id=self.device_id,
-                total_downloaded=self.total_downloaded + amount_downloaded,
-                chunk_downloaded=chunk_downloaded),
-               pickle.HIGHEST_PROTOCOL)
-            self.send_message_to_sink()
-
-            # if amount_downloaded == total:
-            #     self.bytes_downloaded = 0
-
     def backup_associate_file(self, dest_dir: str, full_file_name: str) -> None:
         """
         Backs up small files like XMP or THM files
@@ -95,6 +78,50 @@ class BackupFilesWorker(WorkerInPublishPullPipeline, FileCopy):
             # ignore any metadata copying errors
             copy_file_metadata(full_file_name, full_dest_name)
 
+    def verify_backup(self, rpd_file: RPDFile, backup_full_file_name: str) -> bool:
+        """
+        Verify the backup by reading it back from the backup device, comparing its md5
+        digest with the digest generated when the file was downloaded.
+
+        Memory use is constant regardless of the file size, and the downloaded file
+        is not read again.
+
+        :param rpd_file: the photo or video that was backed up
+        :param backup_full_file_name: the backup of the photo or video
+        :return: True if the backup is identical to the downloaded file, else False
+        """
+
+        if rpd_file.md5 is None:
+            logging.warning(
+                "Cannot verify backup %s: digest of the downloaded file is unknown",
+                backup_full_file_name
+            )
+            return True
+
+        try:
+            md5 = file_md5(
+                backup_full_file_name, self.io_buffer, from_media=True,
+                check_for_command=self.check_for_controller_directive
+            )
+        except OSError as e:
+            logging.error("Could not read backup %s to verify it: %s", backup_full_file_name, e)
+            md5 = None
+
+        if md5 == rpd_file.md5:
+            logging.debug("Verified backup %s", backup_full_file_name)
+            return True
+
+        logging.error(
+            "Backup %s is not identical to the downloaded file %s",
+            backup_full_file_name, rpd_file.download_full_file_name
+        )
+        self.problems.append(
+            BackupVerificationProblem(
+                name=rpd_file.download_name, uri=get_uri(full_file_name=backup_full_file_name)
+            )
+        )
+        return False
+
     def do_backup(self, data: BackupFileData) -> None:
         rpd_file = data.rpd_file
         backup_succeeded = False
@@ -190,11 +217,13 @@ class BackupFilesWorker(WorkerInPublishPullPipeline, FileCopy):
                               data.download_count, self.device_name)
                 source = rpd_file.download_full_file_name
                 destination = backup_full_file_name
-                backup_succeeded = self.copy_from_filesystem(source, destination, rpd_file)
+                with self.metrics.time('backup'):
+                    backup_succeeded = self.copy_from_filesystem(source, destination, rpd_file)
+                if backup_succeeded:
+                    self.metrics.add_bytes('backup', rpd_file.size)
                 if backup_succeeded and self.verify_file:
-                    md5 = hashlib.md5(open(backup_full_file_name).read()).hexdigest()
-                    if md5 != rpd_file.md5:
-                        pass
+                    with self.metrics.time('backup verification'):
+                        backup_succeeded = self.verify_backup(rpd_file, backup_full_file_name)
                 if backup_succeeded:
                     logging.debug("...backing up file %s on device %s succeeded",
                                   data.download_count, self.device_name)
@@ -219,23 +248,18 @@ class BackupFilesWorker(WorkerInPublishPullPipeline, FileCopy):
                 if rpd_file.download_log_full_name:
                     self.backup_associate_file(dest_dir, rpd_file.download_log_full_name)
 
-        self.total_downloaded += rpd_file.size
-        bytes_not_downloaded = rpd_file.size - self.amount_downloaded
-        if bytes_not_downloaded and data.do_backup:
-            self.content = pickle.dumps(
-                BackupResults(
-                    scan_id=self.scan_id, device_id=self.device_id,
-                    total_downloaded=self.total_downloaded, chunk_downloaded=bytes_not_downloaded
-                ),
-                pickle.HIGHEST_PROTOCOL
-            )
-            self.send_message_to_sink()
+        if data.do_backup:
+            self.file_copy_finished(rpd_file.size)
+            total_downloaded, chunk_downloaded = self.unreported_progress()
+        else:
+            total_downloaded = chunk_downloaded = None
 
         self.content = pickle.dumps(
             BackupResults(
                 scan_id=self.scan_id, device_id=self.device_id, backup_succeeded=backup_succeeded,
                 do_backup=data.do_backup, rpd_file=rpd_file,
-                backup_full_file_name=backup_full_file_name, mdata_exceptions=mdata_exceptions
+                backup_full_file_name=backup_full_file_name, mdata_exceptions=mdata_exceptions,
+                total_downloaded=total_downloaded, chunk_downloaded=chunk_downloaded
             ),
             pickle.HIGHEST_PROTOCOL
         )
@@ -280,12 +304,12 @@ class BackupFilesWorker(WorkerInPublishPullPipeline, FileCopy):
                 self.reset_problems()
             elif data.message == BackupStatus.backup_completed:
                 self.send_problems()
+                self.publish_metrics()
             else:
-                self.amount_downloaded = 0
                 self.init_copy_progress()
 
                 self.do_backup(data=data)
 
 
 if __name__ == "__main__":
-    backup = BackupFilesWorker()
\ No newline at end of file
+    run_worker(BackupFilesWorker)
\ No newline at end of file
@@ -29,6 +29,11 @@ Rapid Photo Downloader deals with three types of cache:
    Location: /home/USER/.cache/rapid-photo-downloader/thumbnails/
    (Actual location may vary depending on value of environment variable
    XDG_CACHE_HOME)
+   Thumbnails are appended to pack files, whose names are like
+   thumbnails_00001.pack, rather than each being saved in its own file. The
+   location of each thumbnail in the pack files is recorded in the cache's
+   database. Older versions of the program saved each thumbnail in its own file,
+   which are moved into pack files when the cache is optimized.
 
 2. A cache of actual full files downloaded from a camera, which are then used
    to extract the thumbnail from. Since these same files could be downloaded,
@@ -53,24 +58,33 @@ import os
 import sys
 import logging
 import hashlib
+import fcntl
+import mmap
+import re
 from urllib.request import pathname2url
 import time
 import shutil
 from collections import namedtuple
-from typing import Optional, Tuple, Union
+from typing import Optional, Tuple, Union, Dict, List, Iterator, Callable
 import sqlite3
 
-from PyQt5.QtCore import QSize
+from PyQt5.QtCore import QSize, QBuffer, QIODevice, QObject, QTimer, pyqtSignal, pyqtSlot
 from PyQt5.QtGui import QImage
 
 from raphodo.storage import get_program_cache_directory, get_fdo_cache_thumb_base_directory
 from raphodo.utilities import GenerateRandomFileName, format_size_for_user
-from raphodo.constants import ThumbnailCacheDiskStatus
-from raphodo.rpdsql import CacheSQL
+from raphodo.constants import ThumbnailCacheDiskStatus, ThumbnailCacheMaintenanceStage
+from raphodo.rpdsql import CacheSQL, InCache, PackEntry
 
 
 GetThumbnail = namedtuple('GetThumbnail', 'disk_status, thumbnail, path')
 GetThumbnailPath = namedtuple('GetThumbnailPath', 'disk_status, path, mdatatime, orientation_unknown')
+GetThumbnailData = namedtuple(
+    'GetThumbnailData', 'disk_status, data, mdatatime, orientation_unknown'
+)
+CacheMaintenanceProgress = namedtuple(
+    'CacheMaintenanceProgress', 'stage, done, total, reclaimed'
+)
 
 class MD5Name:
     """Generate MD5 hashes for file names."""
@@ -366,9 +380,155 @@ class FdoCacheLarge(Cache):
         super().__init__(cache_dir, failure_dir)
 
 
+class ThumbnailPacks:
+    """
+    Append-only pack files holding the JPEG data of thumbnails in the Thumbnail Cache.
+
+    Several processes can append to the pack files at the same time: each append is
+    done while holding an exclusive lock on the pack file. Only the highest numbered
+    pack file is appended to. Once a pack file reaches its maximum size, a new one is
+    started. Pack files are read using memory maps.
+    """
+
+    max_pack_size = 32 * 1024 * 1024
+    pack_name_re = re.compile(r'^thumbnails_(\d{5})\.pack$')
+
+    def __init__(self, cache_dir: str) -> None:
+        self.cache_dir = cache_dir
+        self.pack = None  # type: Optional[int]
+        self.fd = None  # type: Optional[int]
+        # pack: memory map
+        self.maps = {}  # type: Dict[int, mmap.mmap]
+
+    def pack_name(self, pack: int) -> str:
+        return os.path.join(self.cache_dir, 'thumbnails_{:05d}.pack'.format(pack))
+
+    def packs(self) -> List[int]:
+        """
+        :return: the pack files in the cache, in ascending order
+        """
+
+        packs = []
+        for name in os.listdir(self.cache_dir):
+            match = self.pack_name_re.match(name)
+            if match is not None:
+                packs.append(int(match.group(1)))
+        packs.sort()
+        return packs
+
+    def is_pack_name(self, name: str) -> bool:
+        return self.pack_name_re.match(name) is not None
+
+    def _open(self, pack: int) -> None:
+        self.close_writer()
+        self.fd = os.open(self.pack_name(pack), os.O_WRONLY | os.O_APPEND | os.O_CREAT, 0o600)
+        self.pack = pack
+
+    def append(self, data: bytes) -> Tuple[int, int]:
+        """
+        Append the data to the current pack file
+
+        :param data: data to append
+        :return: the pack file and offset the data was written to
+        """
+
+        if self.fd is None:
+            packs = self.packs()
+            self._open(packs[-1] if packs else 1)
+
+        while True:
+            fcntl.flock(self.fd, fcntl.LOCK_EX)
+            stat = os.fstat(self.fd)
+            if stat.st_nlink and stat.st_size < self.max_pack_size:
+                break
+            # The pack file is full, or was removed when the cache was optimized
+            fcntl.flock(self.fd, fcntl.LOCK_UN)
+            packs = self.packs()
+            pack = packs[-1] if packs else 1
+            if stat.st_nlink and pack == self.pack:
+                pack += 1
+            self._open(pack)
+
+        try:
+            offset = stat.st_size
+            view = memoryview(data)
+            while view:
+                written = os.write(self.fd, view)
+                view = view[written:]
+        finally:
+            fcntl.flock(self.fd, fcntl.LOCK_UN)
+
+        return self.pack, offset
+
+    def read(self, pack: int, offset: int, length: int) -> Optional[bytes]:
+        """
+        Read a thumbnail from a pack file
+
+        :return: the thumbnail JPEG data, or None if it could not be read
+        """
+
+        m = self.maps.get(pack)
+        if m is None or offset + length > len(m):
+            if m is not None:
+                m.close()
+                del self.maps[pack]
+            try:
+                with open(self.pack_name(pack), 'rb') as f:
+                    m = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+            except (OSError, ValueError):
+                return None
+            self.maps[pack] = m
+            if offset + length > len(m):
+                return None
+
+        data = m[offset:offset + length]
+        # JPEG start of image marker
+        if data[:2] != b'\xff\xd8':
+            return None
+        return data
+
+    def size(self, pack: int) -> int:
+        try:
+            return os.path.getsize(self.pack_name(pack))
+        except OSError:
+            return 0
+
+    def remove(self, pack: int) -> None:
+        m = self.maps.pop(pack, None)
+        if m is not None:
+            m.close()
+        if pack == self.pack:
+            self.close_writer()
+        try:
+            os.remove(self.pack_name(pack))
+        except OSError:
+            logging.error("Failed to remove thumbnail pack file %s", self.pack_name(pack))
+
+    def close_writer(self) -> None:
+        if self.fd is not None:
+            os.close(self.fd)
+            self.fd = self.pack = None
+
+    def close(self) -> None:
+        self.close_writer()
+        for m in self.maps.values():
+            m.close()
+        self.maps = {}
+
+
 class ThumbnailCacheSql:
 
     not_found = GetThumbnailPath(ThumbnailCacheDiskStatus.not_found, None, None, None)
+    not_found_data = GetThumbnailData(ThumbnailCacheDiskStatus.not_found, None, None, None)
+
+    # Don't record the time a thumbnail was read more often than this, in seconds
+    access_time_granularity = 60 * 60 * 24
+
+    # Compact a pack file when less than this proportion of it is in use
+    compact_threshold = 0.5
+
+    # Maximum number of thumbnails processed in each slice of cache maintenance
+    maintenance_slice_size = 500
 
     def __init__(self, create_table_if_not_exists: bool) -> None:
         self.cache_dir = get_program_cache_directory(create_if_not_exist=True)
@@ -393,12 +553,11 @@ class ThumbnailCacheSql:
             )
             self.valid = False
             self.cache_dir = None
-            self.random_filename = None
             self.fs_encoding = None
         else:
-            self.random_filename = GenerateRandomFileName()
             self.md5 = MD5Name()
             self.thumb_db = CacheSQL(self.cache_dir, create_table_if_not_exists)
+            self.packs = ThumbnailPacks(self.cache_dir)
 
     def save_thumbnail(self, full_file_name: str, size: int,
                        mtime: float,
@@ -424,7 +583,7 @@ class ThumbnailCacheSql:
          resized. Will be ignored if generation_failed is True.
         :param camera_model: optional camera model. If the thumbnail is
          not from a camera, then should be None.
-        :return the path of the saved file, else None if operation
+        :return the md5 name of the saved thumbnail, else None if operation
         failed
         """
 
@@ -436,34 +595,63 @@ class ThumbnailCacheSql:
 
         if generation_failed:
             logging.debug("Marking thumbnail for %s as 'generation failed'", uri)
+            pack = pack_offset = pack_length = None
         else:
             logging.debug("Saving thumbnail for %s in RPD thumbnail cache", uri)
+            buffer = QBuffer()
+            buffer.open(QIODevice.WriteOnly)
+            if not thumbnail.save(buffer, 'JPG', quality=75):
+                return None
+            data = bytes(buffer.data())
+            try:
+                pack, pack_offset = self.packs.append(data)
+            except OSError as e:
+                logging.error("Failed to save thumbnail for %s: %s", uri, e)
+                return None
+            pack_length = len(data)
 
         try:
             self.thumb_db.add_thumbnail(uri=uri, size=size, mtime=mtime,
                                     mdatatime=mdatatime,
                                     md5_name=md5_name, orientation_unknown=orientation_unknown,
-                                    failure=generation_failed)
+                                    failure=generation_failed, pack=pack,
+                                    pack_offset=pack_offset, pack_length=pack_length)
         except sqlite3.OperationalError as e:
             logging.error("Database error adding thumbnail for %s: %s. Will not retry.", uri, e)
             return None
 
         if generation_failed:
             return None
+        return md5_name
 
-        md5_full_name = os.path.join(self.cache_dir, md5_name)
+    def _in_cache(self, full_file_name: str, mtime, size: int,
+                  camera_model: Optional[str]) -> Optional[InCache]:
+        uri = self.md5.get_uri(full_file_name, camera_model)
+        in_cache = self.thumb_db.have_thumbnail(uri, size, mtime)
+        if (in_cache is not None and not in_cache.failure and
+                time.time() - (in_cache.last_access or 0) > self.access_time_granularity):
+            self.thumb_db.update_last_access([in_cache.rowid])
+        return in_cache
 
-        temp_path = os.path.join(self.cache_dir, self.random_filename.name(extension='jpg'))
+    def _read_thumbnail(self, in_cache: InCache) -> Optional[bytes]:
+        """
+        :return: the thumbnail's JPEG data, or None if it is missing, in which case
+         it is removed from the database
+        """
 
-        if thumbnail.save(temp_path, format='jpg', quality=75):
+        data = None
+        if in_cache.pack is not None:
+            data = self.packs.read(in_cache.pack, in_cache.pack_offset, in_cache.pack_length)
+        else:
             try:
-                os.rename(temp_path, md5_full_name)
-                os.chmod(md5_full_name, 0o600)
+                with open(os.path.join(self.cache_dir, in_cache.md5_name), 'rb') as thumbnail:
+                    data = thumbnail.read()
             except OSError:
-                return None
+                pass
 
-            return md5_full_name
-        return None
+        if data is None:
+            self.thumb_db.delete_rowids([in_cache.rowid])
+        return data
 
     def get_thumbnail_path(self, full_file_name: str, mtime, size: int,
                            camera_model: str=None) -> GetThumbnailPath:
@@ -480,16 +668,16 @@ class ThumbnailCacheSql:
          not from a camera, then should be None.
         :return a GetThumbnailPath tuple of (1) ThumbnailCacheDiskStatus,
          to indicate whether the thumbnail was found, a failure, or
-         missing, (2) the path (including the md5 name), else None,
-         (3) the file's metadata time, and (4) a bool indicating whether
-         the orientation of the thumbnail is unknown
+         missing, (2) the path (including the md5 name) if the thumbnail
+         is stored in its own file, else None, (3) the file's metadata time,
+         and (4) a bool indicating whether the orientation of the thumbnail
+         is unknown
         """
 
         if not self.valid:
             return self.not_found
 
-        uri = self.md5.get_uri(full_file_name, camera_model)
-        in_cache = self.thumb_db.have_thumbnail(uri, size, mtime)
+        in_cache = self._in_cache(full_file_name, mtime, size, camera_model)
 
         if in_cache is None:
             return self.not_found
@@ -498,47 +686,364 @@ class ThumbnailCacheSql:
             return GetThumbnailPath(ThumbnailCacheDiskStatus.failure, None,
                                     in_cache.mdatatime, None)
 
-        path = os.path.join(self.cache_dir, in_cache.md5_name)
-        if not os.path.exists(path):
-            self.thumb_db.delete_thumbnails([in_cache.md5_name])
-            return self.not_found
+        if in_cache.pack is not None:
+            path = None
+            if in_cache.pack_offset + in_cache.pack_length > self.packs.size(in_cache.pack):
+                self.thumb_db.delete_rowids([in_cache.rowid])
+                return self.not_found
+        else:
+            path = os.path.join(self.cache_dir, in_cache.md5_name)
+            if not os.path.exists(path):
+                self.thumb_db.delete_thumbnails([in_cache.md5_name])
+                return self.not_found
 
         return GetThumbnailPath(ThumbnailCacheDiskStatus.found, path,
                                 in_cache.mdatatime, in_cache.orientation_unknown)
 
+    def get_thumbnail_data(self, full_file_name: str, mtime, size: int,
+                           camera_model: str=None) -> GetThumbnailData:
+        """
+        Attempt to get a thumbnail from the thumbnail cache.
+
+        Parameters are identical to get_thumbnail_path()
+
+        :return a GetThumbnailData tuple of (1) ThumbnailCacheDiskStatus,
+         to indicate whether the thumbnail was found, a failure, or
+         missing, (2) the thumbnail JPEG data, else None, (3) the file's metadata
+         time, and (4) a bool indicating whether the orientation of the thumbnail
+         is unknown
+        """
+
+        if not self.valid:
+            return self.not_found_data
+
+        in_cache = self._in_cache(full_file_name, mtime, size, camera_model)
+
+        if in_cache is None:
+            return self.not_found_data
+
+        if in_cache.failure:
+            return GetThumbnailData(ThumbnailCacheDiskStatus.failure, None,
+                                    in_cache.mdatatime, None)
+
+        data = self._read_thumbnail(in_cache)
+        if data is None:
+            return self.not_found_data
+
+        return GetThumbnailData(ThumbnailCacheDiskStatus.found, data,
+                                in_cache.mdatatime, in_cache.orientation_unknown)
 
     def cleanup_cache(self, days: int=30) -> None:
         """
         Remove all thumbnails that have not been accessed for x days
 
+        Runs every stage of cache maintenance except optimization. To avoid
+        blocking the caller, use ThumbnailCacheMaintenance instead.
+
         :param how many days to remove from
         """
-        time_period = 60 * 60 * 24 * days
-        if self.valid:
-            i = 0
-            now = time.time()
-            deleted_thumbnails = []
-            for name in os.listdir(self.cache_dir):
-                thumbnail = os.path.join(self.cache_dir, name)
-                if (os.path.isfile(thumbnail) and
-                        os.path.getatime(thumbnail) < now - time_period):
-                    os.remove(thumbnail)
-                    deleted_thumbnails.append(name)
-            if len(deleted_thumbnails):
-                if self.thumb_db.cache_exists():
-                    self.thumb_db.delete_thumbnails(deleted_thumbnails)
+
+        reclaimed = 0
+        for progress in self.maintain(days=days, max_size=0):
+            reclaimed = progress.reclaimed
+        if reclaimed:
+            logging.debug(
+                'Reclaimed %s from thumbnails that had not been accessed for %s or more days',
+                format_size_for_user(reclaimed), days
+            )
+
+    def maintain(self, days: int,
+                 max_size: int,
+                 optimize: bool=False,
+                 slice_size: Optional[int]=None,
+                 should_stop: Optional[Callable[[], bool]]=None
+                 ) -> Iterator[CacheMaintenanceProgress]:
+        """
+        Maintain the cache one bounded slice of work at a time, yielding after each slice.
+
+        The stages are:
+        1. Move thumbnails saved in their own file into pack files, removing those
+           that have not been accessed for x days
+        2. Remove thumbnails in pack files that have not been accessed for x days
+        3. Remove the least recently accessed thumbnails until the thumbnails in the
+           pack files use no more than the maximum size
+        4. Compact pack files, one pack file per slice
+        5. If optimizing, remove thumbnails in the db that are not on the file system and
+           files on the file system that are not in the db
+        6. If optimizing, vacuum the db
+
+        Each stage determines what work remains from the db and the file system, so
+        maintenance that is stopped part way through continues where it left off the
+        next time it is run.
+
+        :param days: remove thumbnails not accessed for this many days. If zero, never
+         remove thumbnails because of their age.
+        :param max_size: maximum size in bytes of the thumbnails in the pack files. If
+         zero, the size is not limited.
+        :param optimize: if True, check the db against the file system and vacuum the db
+        :param slice_size: maximum number of thumbnails to process in each slice. If None,
+         use the default.
+        :param should_stop: if not None, called during slices of work whose length
+         depends on the size of a pack file or the cache directory. If it returns True,
+         the slice ends early and maintenance stops.
+        :return: generator of stage, work done, total work (None if not known in advance)
+         and bytes reclaimed so far
+        """
+
+        if not self.valid:
+            return
+
+        if slice_size is None:
+            slice_size = self.maintenance_slice_size
+        if should_stop is None:
+            should_stop = lambda: False
+
+        cutoff = time.time() - 60 * 60 * 24 * days if days else None
+        reclaimed = 0
+
+        stage = ThumbnailCacheMaintenanceStage.loose_thumbnails
+        done = 0
+        while True:
+            entries = self.thumb_db.unpacked_entries(limit=slice_size)
+            if not entries:
+                break
+            try:
+                moved, removed = self._pack_entries(entries, cutoff)
+            except OSError as e:
+                logging.error("Failed to move thumbnails into pack files: %s", e)
+                break
+            reclaimed += removed
+            done += len(entries)
+            yield CacheMaintenanceProgress(stage, done, None, reclaimed)
+
+        if cutoff is not None:
+            stage = ThumbnailCacheMaintenanceStage.expire
+            done = 0
+            while True:
+                count = self.thumb_db.delete_packed_not_accessed_since(cutoff, limit=slice_size)
+                if not count:
+                    break
+                done += count
+                yield CacheMaintenanceProgress(stage, done, None, reclaimed)
+            if done:
+                logging.debug(
+                    'Removed %s thumbnails that had not been accessed for %s or more days',
+                    done, days
+                )
+
+        if max_size:
+            stage = ThumbnailCacheMaintenanceStage.size_budget
+            excess = self.thumb_db.packed_size() - max_size
+            done = 0
+            while done < excess:
+                rowids = []
+                for rowid, length in self.thumb_db.least_recently_accessed(slice_size):
+                    if done >= excess:
+                        break
+                    rowids.append(rowid)
+                    done += length
+                if not rowids:
+                    break
+                self.thumb_db.delete_rowids(rowids)
+                yield CacheMaintenanceProgress(stage, done, excess, reclaimed)
+            if done:
                 logging.debug(
-                    'Deleted {} thumbnail files that had not been accessed for {} or more days'.format(
-                        len(deleted_thumbnails), days
-                    )
+                    'Removed %s of least recently accessed thumbnails to keep the cache '
+                    'within %s', format_size_for_user(done), format_size_for_user(max_size)
                 )
 
+        stage = ThumbnailCacheMaintenanceStage.compact
+        # The highest numbered pack file is never compacted, because other processes
+        # may be appending to it.
+        packs = self.packs.packs()[:-1]
+        usage = self.thumb_db.pack_usage()
+        for done, pack in enumerate(packs, start=1):
+            try:
+                reclaimed += self._compact_pack(
+                    pack, usage.get(pack, 0), self.compact_threshold, should_stop
+                )
+            except OSError as e:
+                logging.error("Failed to compact thumbnail pack %s: %s", pack, e)
+                break
+            if should_stop():
+                return
+            yield CacheMaintenanceProgress(stage, done, len(packs), reclaimed)
+
+        if not optimize:
+            return
+
+        stage = ThumbnailCacheMaintenanceStage.orphans
+        # Thumbnails in pack files that no longer exist
+        missing = set(usage.keys()) - set(self.packs.packs())
+        for done, pack in enumerate(missing, start=1):
+            entries = self.thumb_db.pack_entries(pack)
+            self.thumb_db.delete_rowids([entry.rowid for entry in entries])
+            yield CacheMaintenanceProgress(stage, done, len(missing), reclaimed)
+
+        # When every thumbnail in the db is in a pack file, any other file that is not
+        # part of the db is left over from an earlier version of the program
+        if self.thumb_db.unpacked_entries(limit=1):
+            return
+        db_name = self.thumb_db.db_fs_name()
+        removed = []
+        with os.scandir(self.cache_dir) as entries:
+            for entry in entries:
+                if should_stop():
+                    break
+                if (self.packs.is_pack_name(entry.name) or entry.name.startswith(db_name) or
+                        not entry.is_file()):
+                    continue
+                try:
+                    size = entry.stat().st_size
+                    os.remove(entry.path)
+                except OSError:
+                    continue
+                reclaimed += size
+                removed.append(entry.name)
+                if len(removed) % slice_size == 0:
+                    yield CacheMaintenanceProgress(stage, len(removed), None, reclaimed)
+        if removed:
+            logging.info("Removed %s thumbnails from file system", len(removed))
+        if should_stop():
+            return
+
+        stage = ThumbnailCacheMaintenanceStage.vacuum
+        size = self.db_size()
+        if self.thumb_db.vacuum():
+            reclaimed += size - self.db_size()
+            yield CacheMaintenanceProgress(stage, 1, 1, reclaimed)
+
+    def _pack_entries(self, entries: List[PackEntry], cutoff: Optional[float]) -> Tuple[int, int]:
+        """
+        Move thumbnails saved in their own file into pack files
+
+        :param entries: the thumbnails to move
+        :param cutoff: if not None, remove instead of moving thumbnails that have not
+         been accessed since this time
+        :return: the number of thumbnails moved, and bytes of thumbnails removed
+        """
+
+        locations = []
+        access_times = []
+        to_delete = []
+        moved = []
+        removed = 0
+        for entry in entries:
+            path = os.path.join(self.cache_dir, entry.md5_name)
+            try:
+                stat = os.stat(path)
+                if cutoff is not None and stat.st_atime < cutoff:
+                    os.remove(path)
+                    to_delete.append(entry.rowid)
+                    removed += stat.st_size
+                    continue
+                with open(path, 'rb') as thumbnail:
+                    data = thumbnail.read()
+            except OSError:
+                to_delete.append(entry.rowid)
+                continue
+            pack, offset = self.packs.append(data)
+            locations.append((pack, offset, len(data), entry.rowid))
+            access_times.append((stat.st_atime, entry.rowid))
+            moved.append(path)
+
+        self.thumb_db.set_pack_locations(locations)
+        self.thumb_db.set_last_access(access_times)
+        self.thumb_db.delete_rowids(to_delete)
+        # Only remove the individual files once the database records their new location
+        for path in moved:
+            try:
+                os.remove(path)
+            except OSError:
+                pass
+        return len(moved), removed
+
+    def _compact_pack(self, pack: int,
+                      used: int,
+                      threshold: float,
+                      should_stop: Optional[Callable[[], bool]]=None) -> int:
+        """
+        Rewrite the pack file if much of its space is used by thumbnails no longer in the
+        database, appending the thumbnails still in use to the current pack file.
+
+        :param pack: pack file to compact
+        :param used: bytes in the pack file used by thumbnails in the database
+        :param threshold: compact the pack file if less than this proportion of the file
+         is in use
+        :param should_stop: if not None, called before each thumbnail is moved. If it
+         returns True, the thumbnails already moved stay moved and the pack file is kept,
+         to be compacted further the next time.
+        :return: the reduction in size of the pack files, in bytes
+        """
+
+        size = self.packs.size(pack)
+        if size and used >= size * threshold:
+            return 0
+
+        locations = []
+        missing = []
+        stopped = False
+        for entry in self.thumb_db.pack_entries(pack):
+            if should_stop is not None and should_stop():
+                stopped = True
+                break
+            data = self.packs.read(pack, entry.pack_offset, entry.pack_length)
+            if data is None:
+                missing.append(entry.rowid)
+            else:
+                new_pack, new_offset = self.packs.append(data)
+                locations.append((new_pack, new_offset, len(data), entry.rowid))
+        self.thumb_db.set_pack_locations(locations)
+        self.thumb_db.delete_rowids(missing)
+        if stopped:
+            logging.debug(
+                "Stopped compacting thumbnail pack %s after moving %s thumbnails",
+                pack, len(locations)
+            )
+            return 0
+        self.packs.remove(pack)
+        logging.debug("Compacted thumbnail pack %s: moved %s thumbnails", pack, len(locations))
+        return size - used
+
+    def compact_packs(self, threshold: Optional[float]=None) -> int:
+        """
+        Rewrite pack files in which much of the space is used by thumbnails no longer
+        in the database, appending the thumbnails still in use to the current pack file.
+
+        The highest numbered pack file is never compacted, because other processes
+        may be appending to it.
+
+        :param threshold: compact pack files in which less than this proportion
+         of the file is in use. If None, use the default.
+        :return: the reduction in size of the pack files, in bytes
+        """
+
+        if threshold is None:
+            threshold = self.compact_threshold
+
+        packs = self.packs.packs()[:-1]
+        if not packs:
+            return 0
+
+        usage = self.thumb_db.pack_usage()
+        return sum(self._compact_pack(pack, usage.get(pack, 0), threshold) for pack in packs)
+
+    def pack_unpacked_thumbnails(self) -> int:
+        """
+        Move thumbnails saved in their own file into pack files
+
+        :return: the number of thumbnails moved
+        """
+
+        return self._pack_entries(self.thumb_db.unpacked_entries(), None)[0]
+
     def purge_cache(self) -> None:
         """
         Delete the entire cache of all contents and remove the
         directory
         """
         if self.valid:
+            self.packs.close()
             if self.cache_dir is not None and os.path.isdir(self.cache_dir):
                 # Delete the sqlite3 database too
                 shutil.rmtree(self.cache_dir)
@@ -574,38 +1079,104 @@ class ThumbnailCacheSql:
             return 0
         return os.path.getsize(self.thumb_db.db)
 
-    def optimize(self) -> Tuple[int, int, int]:
+    def optimize(self) -> int:
         """
-        Check for any thumbnails in the db that are not in the file system
-        Check for any thumbnails exist on the file system that are not in the db
-        Vacuum the db
+        Run every stage of cache maintenance, including checking the db against
+        the file system and vacuuming the db. To avoid blocking the caller, use
+        ThumbnailCacheMaintenance instead.
 
-        :return db rows removed, file system photos removed, db size reduction in bytes
+        :return: the reduction in size of the cache in bytes
         """
 
-        rows = self.thumb_db.md5_names()
-        rows = {row[0] for row in rows}
-        cwd = os.getcwd()
-        os.chdir(self.cache_dir)
+        reclaimed = 0
+        for progress in self.maintain(days=0, max_size=0, optimize=True):
+            reclaimed = progress.reclaimed
+        return reclaimed
 
-        to_delete_from_db = {md5 for md5 in rows if not os.path.exists(md5)}
-        if len(to_delete_from_db):
-            self.thumb_db.delete_thumbnails(list(to_delete_from_db))
 
-        md5s = {md5 for md5 in os.listdir('.')} - {self.thumb_db.db_fs_name()}
-        to_delete_from_fs = md5s - rows
-        if len(to_delete_from_fs):
-            for md5 in to_delete_from_fs:
-                os.remove(md5)
+class ThumbnailCacheMaintenance(QObject):
+    """
+    Maintain the Thumbnail Cache in a worker thread, one slice of work at a time, so
+    that program initialization is never blocked.
+
+    To stop maintenance, call interrupt() and request interruption of the thread. Any
+    work that was not done will be done the next time maintenance is run, except
+    optimization, which is done only if it is requested again. When finished, whether
+    the db was vacuumed is reported, so the caller can request optimization again if
+    it was not.
+    """
 
-        os.chdir(cwd)
+    progress = pyqtSignal('PyQt_PyObject')  # CacheMaintenanceProgress
+    # bytes reclaimed, a python int, and whether optimization was completed
+    finished = pyqtSignal('PyQt_PyObject', bool)
 
-        size = self.db_size()
-        self.thumb_db.vacuum()
+    # Pause between slices of work, in milliseconds
+    slice_interval = 20
+
+    def __init__(self, days: int, max_size: int, optimize: bool) -> None:
+        """
+        :param days: remove thumbnails not accessed for this many days, or zero to
+         keep them forever
+        :param max_size: maximum size of the cache in bytes, or zero for no limit
+        :param optimize: if True, check the db against the file system and vacuum it
+        """
+
+        super().__init__()
+        self.days = days
+        self.max_size = max_size
+        self.optimize = optimize
+        self.reclaimed = 0
+        self.optimized = False
+
+    def interrupt(self) -> None:
+        """
+        Interrupt a vacuum of the db being run in the worker thread. Safe to call
+        from any thread.
+        """
+
+        thumbnail_cache = getattr(self, 'thumbnail_cache', None)
+        if thumbnail_cache is not None and thumbnail_cache.valid:
+            thumbnail_cache.thumb_db.interrupt_vacuum()
+
+    @pyqtSlot()
+    def start(self) -> None:
+        self.thumbnail_cache = ThumbnailCacheSql(create_table_if_not_exists=True)
+        self.steps = self.thumbnail_cache.maintain(
+            days=self.days, max_size=self.max_size, optimize=self.optimize,
+            should_stop=self.thread().isInterruptionRequested
+        )
+        QTimer.singleShot(0, self.doSlice)
+
+    @pyqtSlot()
+    def doSlice(self) -> None:
+        if self.thread().isInterruptionRequested():
+            logging.debug("Thumbnail cache maintenance interrupted")
+            self.finish()
+            return
+
+        try:
+            progress = next(self.steps)
+        except StopIteration:
+            self.finish()
+            return
+        except (sqlite3.Error, OSError) as e:
+            logging.error("Error maintaining thumbnail cache: %s", e)
+            self.finish()
+            return
+
+        self.reclaimed = progress.reclaimed
+        if progress.stage == ThumbnailCacheMaintenanceStage.vacuum:
+            self.optimized = True
+        self.progress.emit(progress)
+        QTimer.singleShot(self.slice_interval, self.doSlice)
 
-        return len(to_delete_from_db), len(to_delete_from_fs), size - self.db_size()
+    def finish(self) -> None:
+        self.steps.close()
+        if self.thumbnail_cache.valid:
+            self.thumbnail_cache.packs.close()
+        self.finished.emit(self.reclaimed, self.optimized)
 
 
 if __name__ == '__main__':
     db = ThumbnailCacheSql(create_table_if_not_exists=True)
-    db.optimize()
\ No newline at end of file
+    db.optimize()
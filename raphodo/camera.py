@@ -25,14 +25,18 @@ __copyright__ = "Copyright 2015-2020, Damon Lynch. Copyright 2012-2015 Jim Easte
 import logging
 import os
 import io
+import hashlib
 from collections import namedtuple
 import re
-from typing import Optional, List, Tuple, Union
+from typing import Dict, Optional, List, Sequence, Tuple, Union
 
 import gphoto2 as gp
 from raphodo.storage import StorageSpace
 from raphodo.constants import CameraErrorCode
 from raphodo.utilities import format_size_for_user
+from raphodo.fingerprint import fingerprint
+from raphodo.camerareader import CameraFileReader
+from raphodo.simulatedcamera import SimulatedCamera, is_simulated_camera_port, simulated_cameras
 
 
 def python_gphoto2_version():
@@ -67,15 +71,22 @@ def autodetect_cameras(context: gp.Context,
     Removed Context.camera_autodetect method.
     Was quickly reintroduced in 2.2.1, but is due for removal.
 
+    Simulated cameras listed in the environment are appended to the cameras
+    that are detected. See simulatedcamera.py.
+
     :return: CameraList of model and port
     """
 
     try:
-        return gp.check_result(gp.gp_camera_autodetect(context))
+        cameras = gp.check_result(gp.gp_camera_autodetect(context))
     except Exception:
         if not suppress_errors:
             raise
-        return []
+        cameras = []
+    simulated = simulated_cameras()
+    if simulated:
+        return [(model, port) for model, port in cameras] + simulated
+    return cameras
 
 
 # convert error codes to error names
@@ -135,6 +146,19 @@ class CameraProblemEx(CameraError):
             return str(super())
 
 
+def storage_of_path(path: str) -> str:
+    """
+    Storage on the camera a path is on, as libgphoto2 names it.
+
+    >>> storage_of_path('/store_00010001/DCIM/100CANON')
+    '/store_00010001'
+    >>> storage_of_path('/store_00020001')
+    '/store_00020001'
+    """
+
+    return '/' + path.lstrip('/').split('/', 1)[0]
+
+
 def generate_devname(camera_port: str) -> Optional[str]:
     """
      Generate udev DEVNAME.
@@ -157,7 +181,10 @@ def generate_devname(camera_port: str) -> Optional[str]:
 
 class Camera:
 
-    """Access a camera via libgphoto2."""
+    """
+    Access a camera via libgphoto2, or a simulated camera when the port is a
+    simulated camera port. See simulatedcamera.py.
+    """
 
     def __init__(self, model: str,
                  port:str,
@@ -187,6 +214,8 @@ class Camera:
         # needed
         self.display_name = model
         self.camera_config = None
+        self._camera_config_failed = False
+        self._serial_number = None  # type: Optional[str]
 
         if context is None:
             self.context = gp.Context()
@@ -194,6 +223,12 @@ class Camera:
             self.context = context
 
         self._select_camera(model, port)
+        # Whether the information of every file in a folder can be retrieved at once
+        self._bulk_file_info = hasattr(self.camera, 'folder_list_files_info')
+        # libgphoto2 services one request to a camera at a time, as does PTP
+        self._concurrent_storage_requests = getattr(
+            self.camera, 'concurrent_storage_requests', False
+        )
 
         self.specific_folders = None  # type: Optional[List[str]]
         self.specific_folder_located = False
@@ -320,6 +355,64 @@ class Camera:
         size = info.file.size
         return modification_time, size
 
+    def get_folder_file_info(self, folder: str,
+                             file_names: Sequence[str],
+                             check_for_command=None) -> Tuple[Dict[str, Tuple[int, int]],
+                                                              Dict[str, int]]:
+        """
+        Returns modification time and file size of many files in one folder.
+
+        If the camera can list the information of every file in a folder at
+        once, like PTP's GetObjectPropList, it is retrieved in one request.
+        Otherwise each file's information is requested in turn, which over
+        PTP / MTP costs a round trip per file.
+
+        :param folder: full path where the files are located
+        :param file_names: the files whose information is needed
+        :param check_for_command: if not None, a function with which to check
+         to see if the execution should pause, resume or stop, called before
+         each file's information is requested
+        :return: dictionary of file name to tuple of modification time and
+         file size, and dictionary of file name to gphoto2 error code for
+         the files whose information could not be retrieved
+        """
+
+        if self._bulk_file_info:
+            try:
+                listing = self.camera.folder_list_files_info(folder, self.context)
+            except gp.GPhoto2Error as e:
+                if e.code == gp.GP_ERROR_NOT_SUPPORTED:
+                    logging.debug(
+                        "%s cannot list file information in bulk", self.display_name
+                    )
+                    self._bulk_file_info = False
+                else:
+                    logging.warning(
+                        "Unable to list file information in %s on %s: %s. Retrieving it "
+                        "file by file.", folder, self.display_name, gphoto2_named_error(e.code)
+                    )
+            else:
+                folder_info = {name: (mtime, size) for name, mtime, size in listing}
+                info = {}  # type: Dict[str, Tuple[int, int]]
+                errors = {}  # type: Dict[str, int]
+                for file_name in file_names:
+                    if file_name in folder_info:
+                        info[file_name] = folder_info[file_name]
+                    else:
+                        errors[file_name] = gp.GP_ERROR_FILE_NOT_FOUND
+                return info, errors
+
+        info = {}
+        errors = {}
+        for file_name in file_names:
+            if check_for_command is not None:
+                check_for_command()
+            try:
+                info[file_name] = self.get_file_info(folder, file_name)
+            except gp.GPhoto2Error as e:
+                errors[file_name] = e.code
+        return info, errors
+
     def get_exif_extract(self, folder: str,
                          file_name: str,
                          size_in_bytes: int=200) -> bytearray:
@@ -351,6 +444,35 @@ class Camera:
         else:
             return buffer
 
+    def get_fingerprint(self, folder: str, file_name: str, size: int) -> Optional[str]:
+        """
+        Generate the file's content fingerprint by reading only the parts of the
+        file the fingerprint needs. See fingerprint.py.
+
+        :param folder: directory on the camera the file is stored
+        :param file_name: the photo or video's file name
+        :param size: the size of the file in bytes
+        :return: the fingerprint, or None if the file could not be read
+        """
+
+        def read(offset: int, length: int) -> bytes:
+            view = memoryview(bytearray(length))
+            gp.check_result(
+                self.camera.file_read(
+                    folder, file_name, gp.GP_FILE_TYPE_NORMAL, offset, view, self.context
+                )
+            )
+            return view.tobytes()
+
+        try:
+            return fingerprint(size, read)
+        except gp.GPhoto2Error as e:
+            logging.error(
+                "Unable to read portions of %s from camera %s: %s",
+                os.path.join(folder, file_name), self.display_name, gphoto2_named_error(e.code)
+            )
+            return None
+
     def get_exif_extract_from_jpeg(self, folder: str, file_name: str) -> bytearray:
         """
         Extract strictly the app1 (exif) section of a jpeg.
@@ -370,7 +492,7 @@ class Camera:
         camera_file = self._get_file(folder, file_name, None, gp.GP_FILE_TYPE_EXIF)
 
         try:
-            exif_data = gp.check_result(gp.gp_file_get_data_and_size(camera_file))
+            exif_data = camera_file.get_data_and_size()
         except gp.GPhoto2Error as ex:
             logging.error(
                 'Error getting exif info for %s from camera %s: %s',
@@ -409,21 +531,15 @@ class Camera:
         exif_header_length = 8
         read0_size = soi_marker_length + marker_length + exif_header_length
 
-        view = memoryview(bytearray(read0_size))
+        # Each step reads a few bytes of the file. The reader gets them from the
+        # block it read from the camera at the start of the file, so the whole
+        # header is normally read in one request.
+        reader = self.open_file(folder, file_name)
         try:
-            bytes_read = gp.check_result(self.camera.file_read(
-                folder, file_name, gp.GP_FILE_TYPE_NORMAL,
-                0, view, self.context))
-        except gp.GPhoto2Error as ex:
-            logging.error(
-                'Error reading %s from camera: %s',
-                os.path.join(folder, file_name), gphoto2_named_error(ex.code)
-            )
+            jpeg_header = reader.pread(0, read0_size)
+        except CameraProblemEx:
             return None
 
-        jpeg_header = view.tobytes()
-        view.release()
-
         if jpeg_header[0:2] != b'\xff\xd8':
             logging.error("%s not a jpeg image: no SOI marker", file_name)
             return None
@@ -439,18 +555,10 @@ class Camera:
             # Now we want to download the rest of the APP1, along with the app0 marker
             # and the app0 exif header
             read1_size = app0_data_length + 2
-            app0_view = memoryview(bytearray(read1_size))
             try:
-                bytes_read = gp.check_result(self.camera.file_read(
-                    folder, file_name, gp.GP_FILE_TYPE_NORMAL,
-                    read0_size, app0_view, self.context))
-            except gp.GPhoto2Error as ex:
-                logging.error(
-                    'Error reading %s from camera: %s',
-                    os.path.join(folder, file_name), gphoto2_named_error(ex.code)
-                )
-            app0 = app0_view.tobytes()
-            app0_view.release()
+                app0 = reader.pread(read0_size, read1_size)
+            except CameraProblemEx:
+                app0 = bytes(read1_size)
             app_marker = app0[(exif_header_length + 2) * -1:exif_header_length * -1]
             exif_header = app0[exif_header_length * -1:]
             jpeg_header = jpeg_header + app0
@@ -469,20 +577,49 @@ class Camera:
         app1_data_length = exif_header[0] * 256 + exif_header[1]
 
         # Step 4: read APP1
-        view = memoryview(bytearray(app1_data_length))
         try:
-            bytes_read = gp.check_result(
+            app1 = reader.pread(offset, app1_data_length)
+        except CameraProblemEx:
+            return None
+        return jpeg_header + app1
+
+    def read_file_range(self, folder: str, file_name: str, offset: int, buffer) -> int:
+        """
+        Read part of a file on the camera.
+
+        :param folder: directory on the camera the file is stored
+        :param file_name: the photo or video
+        :param offset: where in the file to start reading
+        :param buffer: writable buffer to read into, whose length is how
+         many bytes to read
+        :return: the number of bytes read
+        """
+
+        try:
+            return gp.check_result(
                 self.camera.file_read(
-                    folder, file_name, gp.GP_FILE_TYPE_NORMAL, offset, view, self.context
+                    folder, file_name, gp.GP_FILE_TYPE_NORMAL, offset, buffer, self.context
                 )
             )
         except gp.GPhoto2Error as ex:
             logging.error(
-                'Error reading %s from camera: %s',
-                os.path.join(folder, file_name), gphoto2_named_error(ex.code)
+                'Error reading %s from camera %s: %s',
+                os.path.join(folder, file_name), self.display_name, gphoto2_named_error(ex.code)
             )
-            return None
-        return jpeg_header + view.tobytes()
+            raise CameraProblemEx(code=CameraErrorCode.read, gp_exception=ex)
+
+    def open_file(self, folder: str,
+                  file_name: str,
+                  size: Optional[int]=None) -> CameraFileReader:
+        """
+        :param folder: directory on the camera the file is stored
+        :param file_name: the photo or video
+        :param size: the size of the file in bytes, if known
+        :return: a read-only file object for the file, which caches what it
+         reads from the camera
+        """
+
+        return CameraFileReader(self, folder, file_name, size)
 
     def _get_file(self, dir_name: str,
                   file_name: str,
@@ -490,9 +627,7 @@ class Camera:
                   file_type: int=gp.GP_FILE_TYPE_NORMAL) -> gp.CameraFile:
 
         try:
-            camera_file = gp.check_result(
-                gp.gp_camera_file_get(self.camera, dir_name, file_name, file_type, self.context)
-            )
+            camera_file = self.camera.file_get(dir_name, file_name, file_type, self.context)
         except gp.GPhoto2Error as ex:
             logging.error(
                 'Error reading %s from camera %s: %s',
@@ -502,7 +637,7 @@ class Camera:
 
         if dest_full_filename is not None:
             try:
-                gp.check_result(gp.gp_file_save(camera_file, dest_full_filename))
+                camera_file.save(dest_full_filename)
             except gp.GPhoto2Error as ex:
                 logging.error(
                     'Error saving %s from camera %s: %s',
@@ -531,7 +666,7 @@ class Camera:
                         file_name: str,
                         chunk_size_in_bytes: int,
                         dest_full_filename: str,
-                        mtime: int=None) -> None:
+                        mtime: int=None) -> int:
         """
         Save the file from the camera to a local destination.
 
@@ -542,16 +677,29 @@ class Camera:
         :param dest_full_filename: full path including filename where
         the file will be saved.
         :param mtime: if specified, set the file modification time to this value
+        :return: the number of bytes read and saved, which is less than
+         chunk_size_in_bytes if the camera returned less
         """
 
-        # get_exif_extract() can raise CameraProblemEx(code=CameraErrorCode.read):
-        buffer = self.get_exif_extract(dir_name, file_name, chunk_size_in_bytes)
+        buffer = bytearray(chunk_size_in_bytes)
+        try:
+            bytes_read = gp.check_result(
+                self.camera.file_read(
+                    dir_name, file_name, gp.GP_FILE_TYPE_NORMAL, 0, buffer, self.context
+                )
+            )
+        except gp.GPhoto2Error as e:
+            logging.error(
+                "Unable to extract portion of file from camera %s: %s",
+                self.display_name, gphoto2_named_error(e.code)
+            )
+            raise CameraProblemEx(code=CameraErrorCode.read, gp_exception=e)
 
         view = memoryview(buffer)
         dest_file = None
         try:
             dest_file = io.open(dest_full_filename, 'wb')
-            src_bytes = view.tobytes()
+            src_bytes = view[:bytes_read].tobytes()
             dest_file.write(src_bytes)
             dest_file.close()
             if mtime is not None:
@@ -564,6 +712,7 @@ class Camera:
             if dest_file is not None:
                 dest_file.close()
             raise CameraProblemEx(code=CameraErrorCode.write, py_exception=ex)
+        return bytes_read
 
     def save_file_by_chunks(self, dir_name: str,
                             file_name: str,
@@ -571,9 +720,16 @@ class Camera:
                             dest_full_filename: str,
                             progress_callback,
                             check_for_command,
-                            return_file_bytes = False,
-                            chunk_size=1048576) -> Optional[bytes]:
+                            return_md5: bool=False,
+                            chunk_size=1048576,
+                            start: int=0) -> Optional[str]:
         """
+        Save the file from the camera one chunk at a time, so that no more
+        than one chunk of it is held in memory.
+
+        If the file cannot be read or saved, or copying is stopped, the
+        destination is left as it was before.
+
         :param dir_name: directory on the camera
         :param file_name: the photo or video
         :param size: the size of the file in bytes
@@ -583,57 +739,96 @@ class Camera:
          copy progress
         :param check_for_command: a function with which to check to see
          if the execution should pause, resume or stop
-        :param return_file_bytes: if True, return a copy of the file's
-         bytes, else make that part of the return value None
+        :param return_md5: if True, return the md5 digest of the file,
+         generated from each chunk as it is saved
         :param chunk_size: the size of the chunks to copy. The default
          is 1MB.
-        :return: True if the file was successfully saved, else False,
-         and the bytes that were copied
+        :param start: how many bytes at the start of the file have already
+         been saved in dest_full_filename, e.g. from the Download Cache. Only
+         the rest of the file is read from the camera.
+        :return: the md5 hex digest of the file if return_md5 is True,
+         else None
         """
 
-        src_bytes = None
-        view = memoryview(bytearray(size))
-        amount_downloaded = 0
-        for offset in range(0, size, chunk_size):
-            check_for_command()
-            stop = min(offset + chunk_size, size)
+        md5 = hashlib.md5() if return_md5 else None
+        view = memoryview(bytearray(min(chunk_size, max(size - start, 0))))
+        amount_downloaded = start
+        dest_file = None
+        try:
             try:
-                bytes_read = gp.check_result(
-                    self.camera.file_read(
-                        dir_name, file_name, gp.GP_FILE_TYPE_NORMAL, offset, view[offset:stop],
-                        self.context
-                    )
-                )
-                amount_downloaded += bytes_read
-                if progress_callback is not None:
-                    progress_callback(amount_downloaded, size)
-            except gp.GPhoto2Error as ex:
+                if start:
+                    dest_file = io.open(dest_full_filename, 'r+b')
+                    if md5 is not None:
+                        # Include the start of the file already saved in the digest
+                        remaining = start
+                        while remaining:
+                            chunk = dest_file.read(min(chunk_size, remaining))
+                            if not chunk:
+                                break
+                            md5.update(chunk)
+                            remaining -= len(chunk)
+                    dest_file.seek(start)
+                    dest_file.truncate()
+                else:
+                    dest_file = io.open(dest_full_filename, 'wb')
+
+                while amount_downloaded < size:
+                    check_for_command()
+                    offset = amount_downloaded
+                    chunk = view[:min(chunk_size, size - offset)]
+                    try:
+                        bytes_read = gp.check_result(
+                            self.camera.file_read(
+                                dir_name, file_name, gp.GP_FILE_TYPE_NORMAL, offset, chunk,
+                                self.context
+                            )
+                        )
+                    except gp.GPhoto2Error as ex:
+                        logging.error(
+                            'Error copying file %s from camera %s: %s',
+                            os.path.join(dir_name, file_name), self.display_name,
+                            gphoto2_named_error(ex.code)
+                        )
+                        if progress_callback is not None:
+                            progress_callback(size, size)
+                        raise CameraProblemEx(code=CameraErrorCode.read, gp_exception=ex)
+                    if not bytes_read:
+                        logging.error(
+                            'Error copying file %s from camera %s: read %s of %s bytes',
+                            os.path.join(dir_name, file_name), self.display_name,
+                            amount_downloaded, size
+                        )
+                        if progress_callback is not None:
+                            progress_callback(size, size)
+                        raise CameraProblemEx(code=CameraErrorCode.read)
+                    # The camera can return less than was asked for
+                    chunk = chunk[:bytes_read]
+                    dest_file.write(chunk)
+                    if md5 is not None:
+                        md5.update(chunk)
+                    amount_downloaded += bytes_read
+                    if progress_callback is not None:
+                        progress_callback(amount_downloaded, size)
+                dest_file.close()
+            except (OSError, PermissionError) as ex:
                 logging.error(
-                    'Error copying file %s from camera %s: %s',
-                    os.path.join(dir_name, file_name), self.display_name,
-                    gphoto2_named_error(ex.code)
+                    'Error saving file %s from camera %s. Error %s: %s',
+                    os.path.join(dir_name, file_name), self.display_name, ex.errno, ex.strerror
                 )
-                if progress_callback is not None:
-                    progress_callback(size, size)
-                raise CameraProblemEx(code=CameraErrorCode.read, gp_exception=ex)
-
-        dest_file = None
-        try:
-            dest_file = io.open(dest_full_filename, 'wb')
-            src_bytes = view.tobytes()
-            dest_file.write(src_bytes)
-            dest_file.close()
-        except (OSError, PermissionError) as ex:
-            logging.error(
-                'Error saving file %s from camera %s. Error %s: %s',
-                os.path.join(dir_name, file_name), self.display_name, ex.errno, ex.strerror
-            )
+                raise CameraProblemEx(code=CameraErrorCode.write, py_exception=ex)
+        except BaseException:
             if dest_file is not None:
-                dest_file.close()
-            raise CameraProblemEx(code=CameraErrorCode.write, py_exception=ex)
+                try:
+                    dest_file.truncate(start)
+                    dest_file.close()
+                    if not start:
+                        os.remove(dest_full_filename)
+                except OSError:
+                    pass
+            raise
 
-        if return_file_bytes:
-            return src_bytes
+        if md5 is not None:
+            return md5.hexdigest()
 
     def get_thumbnail(self, dir_name: str,
                       file_name: str,
@@ -660,7 +855,7 @@ class Camera:
         )
 
         try:
-            thumbnail_data = gp.check_result(gp.gp_file_get_data_and_size(camera_file))
+            thumbnail_data = camera_file.get_data_and_size()
         except gp.GPhoto2Error as ex:
             logging.error(
                 'Error getting image %s from camera %s: %s',
@@ -683,7 +878,7 @@ class Camera:
         dir_name, file_name = os.path.split(full_THM_name)
         camera_file = self._get_file(dir_name, file_name)
         try:
-            thumbnail_data = gp.check_result(gp.gp_file_get_data_and_size(camera_file))
+            thumbnail_data = camera_file.get_data_and_size()
         except gp.GPhoto2Error as ex:
             logging.error(
                 'Error getting THM file %s from camera %s: %s',
@@ -696,6 +891,11 @@ class Camera:
             return data.tobytes()
 
     def _select_camera(self, model, port_name)  -> None:
+        if is_simulated_camera_port(port_name):
+            # Serves a directory tree instead of using libgphoto2
+            self.camera = SimulatedCamera(model, port_name)
+            return
+
         # Code from Jim Easterbrook's Photoini
         # initialise camera
         self.camera = gp.Camera()
@@ -728,7 +928,19 @@ class Camera:
          information, e.g. in the case above, a Nexus 4. Empty string
          if not found.
         """
+
+        return self._status_value('cameramodel')
+
+    def _status_value(self, name: str) -> str:
+        """
+        :param name: name of a value in the status section of the camera's
+         configuration, e.g. cameramodel or serialnumber
+        :return: the value, or empty string if not found
+        """
+
         if self.camera_config is None:
+            if self._camera_config_failed:
+                return ''
             try:
                 self.camera_config = self.camera.get_config(self.context)
             except gp.GPhoto2Error as e:
@@ -742,6 +954,7 @@ class Camera:
                         "Unknown error getting camera configuration for %s",
                         self.display_name
                     )
+                self._camera_config_failed = True
                 return ''
 
         # Here we really see the difference between C and python!
@@ -753,10 +966,52 @@ class Camera:
                 child1_count = child1.count_children()
                 for j in range(child1_count):
                     child2 = child1.get_child(j)
-                    if child2.get_name() == 'cameramodel':
+                    if child2.get_name() == name:
                         return child2.get_value()
         return ''
 
+    @property
+    def serial_number(self) -> str:
+        """
+        :return: the camera's serial number, or empty string if it does not
+         report one
+        """
+
+        if self._serial_number is None:
+            self._serial_number = self._status_value('serialnumber').strip()
+        return self._serial_number
+
+    @property
+    def content_id(self) -> Optional[str]:
+        """
+        :return: identifier of the camera in the camera content index, or None
+         if the camera cannot be identified because it does not report its
+         serial number
+        """
+
+        if not self.serial_number:
+            return None
+        return '{}:{}'.format(self.model, self.serial_number)
+
+    @property
+    def bulk_file_info(self) -> bool:
+        """
+        :return: True if the information of every file in a folder can be
+         retrieved in one request. See get_folder_file_info().
+        """
+
+        return self._bulk_file_info
+
+    @property
+    def concurrent_storage_requests(self) -> bool:
+        """
+        :return: True if requests to the camera's different storages can be
+         made from different threads at the same time, and are serviced
+         concurrently. Never the case for cameras accessed using libgphoto2.
+        """
+
+        return self._concurrent_storage_requests
+
     def get_storage_media_capacity(self, refresh: bool=False) -> List[StorageSpace]:
         """
         Determine the bytes free and bytes total (media capacity)
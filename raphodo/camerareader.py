@@ -0,0 +1,190 @@
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+A read-only file object over a photo or video on a camera, for parsers that
+seek around a file reading small parts of it, e.g. to follow the markers of a
+jpeg or the offsets of a TIFF.
+
+The file is read from the camera in blocks, which are kept in a least recently
+used cache, so that a parser reading a header one field at a time makes one
+request to the camera rather than one per field. Consecutive blocks that are
+not cached are read in one request.
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+from collections import OrderedDict
+import io
+from typing import List, Optional, Tuple
+
+default_block_size = 64 * 1024
+default_max_blocks = 64
+
+
+def missing_runs(first: int, last: int, cached) -> List[Tuple[int, int]]:
+    """
+    :param first: first block needed
+    :param last: last block needed
+    :param cached: blocks already cached
+    :return: first and last block of each run of consecutive blocks not cached
+
+    >>> missing_runs(0, 5, {1, 2, 4})
+    [(0, 0), (3, 3), (5, 5)]
+    >>> missing_runs(0, 3, set())
+    [(0, 3)]
+    >>> missing_runs(2, 3, {2, 3})
+    []
+    """
+
+    runs = []  # type: List[Tuple[int, int]]
+    start = None
+    for block in range(first, last + 1):
+        if block in cached:
+            if start is not None:
+                runs.append((start, block - 1))
+                start = None
+        elif start is None:
+            start = block
+    if start is not None:
+        runs.append((start, last))
+    return runs
+
+
+class CameraFileReader(io.RawIOBase):
+    """
+    Read a file on a camera as if it were a local file.
+
+    Raises CameraProblemEx if the camera cannot be read.
+    """
+
+    def __init__(self, camera,
+                 folder: str,
+                 file_name: str,
+                 size: Optional[int]=None,
+                 block_size: int=default_block_size,
+                 max_blocks: int=default_max_blocks) -> None:
+        """
+        :param camera: the camera.Camera the file is on
+        :param folder: directory on the camera the file is stored
+        :param file_name: the photo or video
+        :param size: the size of the file in bytes, if known
+        :param block_size: how much of the file is read at a time
+        :param max_blocks: most blocks to cache
+        """
+
+        super().__init__()
+        self.camera = camera
+        self.folder = folder
+        self.file_name = file_name
+        self.size = size
+        self.block_size = block_size
+        self.max_blocks = max_blocks
+        self.position = 0
+        self.blocks = OrderedDict()  # type: OrderedDict
+        self.requests = 0
+        self.bytes_read = 0
+
+    def readable(self) -> bool:
+        return True
+
+    def seekable(self) -> bool:
+        return True
+
+    def tell(self) -> int:
+        return self.position
+
+    def seek(self, offset: int, whence: int=io.SEEK_SET) -> int:
+        if whence == io.SEEK_SET:
+            position = offset
+        elif whence == io.SEEK_CUR:
+            position = self.position + offset
+        elif whence == io.SEEK_END and self.size is not None:
+            position = self.size + offset
+        else:
+            raise ValueError('Invalid whence: {}'.format(whence))
+        if position < 0:
+            raise ValueError('Negative seek position {}'.format(position))
+        self.position = position
+        return position
+
+    def _fetch(self, first: int, last: int) -> None:
+        """
+        Read blocks first to last inclusive from the camera in one request
+        """
+
+        start = first * self.block_size
+        stop = (last + 1) * self.block_size
+        if self.size is not None:
+            stop = min(stop, self.size)
+        buffer = bytearray(stop - start)
+        bytes_read = self.camera.read_file_range(self.folder, self.file_name, start, buffer)
+        self.requests += 1
+        self.bytes_read += bytes_read
+        data = memoryview(buffer)[:bytes_read]
+        for block in range(first, last + 1):
+            offset = (block - first) * self.block_size
+            self.blocks[block] = data[offset:offset + self.block_size].tobytes()
+            self.blocks.move_to_end(block)
+        while len(self.blocks) > self.max_blocks:
+            self.blocks.popitem(last=False)
+
+    def pread(self, offset: int, length: int) -> bytes:
+        """
+        :return: up to length bytes starting at offset, without changing the
+         position in the file
+        """
+
+        if self.size is not None:
+            length = min(length, self.size - offset)
+        if length <= 0:
+            return b''
+        first = offset // self.block_size
+        last = (offset + length - 1) // self.block_size
+        if last - first + 1 > self.max_blocks:
+            # More than the cache holds: read it directly
+            buffer = bytearray(length)
+            bytes_read = self.camera.read_file_range(
+                self.folder, self.file_name, offset, buffer
+            )
+            self.requests += 1
+            self.bytes_read += bytes_read
+            return bytes(buffer[:bytes_read])
+
+        # Mark the cached blocks as recently used, so reading the missing
+        # blocks does not evict them
+        for block in range(first, last + 1):
+            if block in self.blocks:
+                self.blocks.move_to_end(block)
+        for run_first, run_last in missing_runs(first, last, self.blocks):
+            self._fetch(run_first, run_last)
+        parts = []
+        for block in range(first, last + 1):
+            self.blocks.move_to_end(block)
+            parts.append(self.blocks[block])
+        data = b''.join(parts)
+        start = offset - first * self.block_size
+        return data[start:start + length]
+
+    def readinto(self, buffer) -> int:
+        view = memoryview(buffer).cast('B')
+        data = self.pread(self.position, len(view))
+        view[:len(data)] = data
+        self.position += len(data)
+        return len(data)
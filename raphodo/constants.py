@@ -146,6 +146,15 @@ class ThumbnailCacheDiskStatus(Enum):
     unknown = 4
 
 
+class ThumbnailCacheMaintenanceStage(Enum):
+    loose_thumbnails = 1
+    expire = 2
+    size_budget = 3
+    compact = 4
+    orphans = 5
+    vacuum = 6
+
+
 class ThumbnailCacheOrigin(Enum):
     thumbnail_cache = 1
     fdo_cache = 2
@@ -241,6 +250,17 @@ class BackupStatus(Enum):
     backup_completed = 2
 
 
+class DownloadStage(IntEnum):
+    """
+    Stages of the download pipeline whose throughput is tracked, in the order a
+    file passes through them
+    """
+
+    copy = 1
+    rename = 2
+    backup = 3
+
+
 class ThumbnailSize(IntEnum):
     width = 160
     height = 120
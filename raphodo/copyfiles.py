@@ -30,6 +30,7 @@ import stat
 import hashlib
 import logging
 import pickle
+import time
 from operator import attrgetter
 from itertools import chain
 from collections import defaultdict
@@ -47,7 +48,8 @@ from raphodo.camera import (
     Camera, CameraProblemEx, gphoto2_python_logging
 )
 from raphodo.interprocess import (
-    WorkerInPublishPullPipeline, CopyFilesArguments, CopyFilesResults
+    WorkerInPublishPullPipeline, CopyFilesArguments, CopyFilesResults, pack_copy_progress,
+    run_worker
 )
 from raphodo.constants import (FileType, DownloadStatus, CameraErrorCode)
 from raphodo.utilities import (GenerateRandomFileName, create_temp_dirs, same_device)
@@ -59,6 +61,7 @@ from raphodo.problemnotification import (
 from raphodo.storage import get_uri
 from raphodo.preferences import Preferences
 from raphodo.rescan import RescanCamera
+from raphodo.fingerprint import FingerprintAccumulator, file_fingerprint
 
 
 def copy_file_metadata(src: str, dst: str) -> Optional[Tuple]:
@@ -122,17 +125,73 @@ def copy_camera_file_metadata(mtime: float, dst: str) -> Optional[Tuple]:
         return inst,  # note the comma: return a Tuple
 
 
+def file_md5(full_file_name: str,
+             chunk_size: int,
+             from_media: bool=False,
+             check_for_command=None) -> str:
+    """
+    Generate the md5 digest of a file, reading it in chunks so that memory
+    use is constant regardless of the file size.
+
+    Raises OSError if the file cannot be read.
+
+    :param full_file_name: file to read
+    :param chunk_size: how much of the file to read at a time
+    :param from_media: if True, ensure the file is read from the storage media
+     it is saved on, rather than from the operating system's page cache. Any data
+     not yet written to the media is written first.
+    :param check_for_command: optional function with which to check to see
+     if the execution should pause, resume or stop
+    :return: the md5 hex digest
+    """
+
+    h = hashlib.md5()
+    with io.open(full_file_name, 'rb', buffering=0) as f:
+        fd = f.fileno()
+        if from_media:
+            os.fsync(fd)
+            try:
+                os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+            except (AttributeError, OSError):
+                # Not available on this platform or file system: the file will
+                # most likely be read from the page cache
+                pass
+        else:
+            try:
+                os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_SEQUENTIAL)
+            except (AttributeError, OSError):
+                pass
+        buffer = bytearray(chunk_size)
+        view = memoryview(buffer)
+        while True:
+            if check_for_command is not None:
+                check_for_command()
+            bytes_read = f.readinto(buffer)
+            if not bytes_read:
+                break
+            h.update(view[:bytes_read])
+    return h.hexdigest()
+
+
 class FileCopy:
     """
     Used by classes CopyFilesWorker and BackupFilesWorker
     """
     def __init__(self):
         self.io_buffer = 1024 * 1024
-        self.batch_size_bytes = 5 * 1024 * 1024
+        # Report progress to the main process at most this many times a second.
+        # Progress not yet reported when a file finishes is sent along with the
+        # file's results.
+        self.progress_updates_per_second = 4
+        self.next_progress_update = 0.0
         self.dest = self.src = None
 
+        # Bytes of the current file copied
         self.bytes_downloaded = 0
+        # Bytes of the files already copied
         self.total_downloaded = 0
+        # Value of self.total_downloaded + self.bytes_downloaded last reported
+        self.bytes_reported = 0
 
     def cleanup_pre_stop(self):
         if self.dest is not None:
@@ -143,13 +202,76 @@ class FileCopy:
     def init_copy_progress(self) -> None:
         self.bytes_downloaded = 0
 
+    def file_copy_finished(self, size: int) -> None:
+        """
+        Count the entire file as copied, regardless of whether the copy actually
+        succeeded or not. It's necessary to keep the user informed.
+
+        :param size: file size in bytes
+        """
+
+        self.total_downloaded += size
+        self.bytes_downloaded = 0
+
+    def unreported_progress(self) -> Tuple[Optional[int], Optional[int]]:
+        """
+        Mark as reported the bytes copied since progress was last reported
+
+        :return: bytes copied in total and since progress was last reported,
+         or None and None if there is no change
+        """
+
+        total_downloaded = self.total_downloaded + self.bytes_downloaded
+        chunk_downloaded = total_downloaded - self.bytes_reported
+        if not chunk_downloaded:
+            return None, None
+        self.bytes_reported = total_downloaded
+        return total_downloaded, chunk_downloaded
+
+    def update_progress(self, amount_downloaded: int, total: int) -> None:
+        """
+        Update the main process about how many bytes have been copied, if enough
+        time has passed since it was last updated
+
+        :param amount_downloaded: the size in bytes of the file that
+         has been copied
+        :param total: the size of the file in bytes
+        """
+
+        self.bytes_downloaded = amount_downloaded
+        now = time.monotonic()
+        if now >= self.next_progress_update:
+            self.next_progress_update = now + 1 / self.progress_updates_per_second
+            total_downloaded, chunk_downloaded = self.unreported_progress()
+            if chunk_downloaded is not None:
+                self.send_progress_to_sink(
+                    pack_copy_progress(self.scan_id, total_downloaded, chunk_downloaded)
+                )
+
     def copy_from_filesystem(self, source: str, destination: str, rpd_file: RPDFile) -> bool:
-        src_chunks = []
+        """
+        Copy a file, generating its md5 digest and content fingerprint from the data
+        as it is copied, if they are not already known
+
+        :param source: file to copy
+        :param destination: file to copy to
+        :param rpd_file: the photo or video being copied
+        :return: True if the copy succeeded, else False
+        """
+
         try:
             self.dest = io.open(destination, 'wb', self.io_buffer)
             self.src = io.open(source, 'rb', self.io_buffer)
             total = rpd_file.size
             amount_downloaded = 0
+            if rpd_file.fingerprint is None:
+                fingerprint = FingerprintAccumulator(total)
+            else:
+                fingerprint = None
+            if self.verify_file and rpd_file.md5 is None:
+                md5 = hashlib.md5()
+            else:
+                md5 = None
 
             while True:
                 # first check if process is being stopped or paused
@@ -158,8 +280,10 @@ class FileCopy:
                 chunk = self.src.read(self.io_buffer)
                 if chunk:
                     self.dest.write(chunk)
-                    if self.verify_file:
-                        src_chunks.append(chunk)
+                    if md5 is not None:
+                        md5.update(chunk)
+                    if fingerprint is not None:
+                        fingerprint.update(chunk)
                     amount_downloaded += len(chunk)
                     self.update_progress(amount_downloaded, total)
                 else:
@@ -167,9 +291,11 @@ class FileCopy:
             self.dest.close()
             self.src.close()
 
-            if self.verify_file:
-                src_bytes = b''.join(src_chunks)
-                rpd_file.md5 = hashlib.md5(src_bytes).hexdigest()
+            if fingerprint is not None:
+                rpd_file.fingerprint = fingerprint.hexdigest()
+
+            if md5 is not None:
+                rpd_file.md5 = md5.hexdigest()
 
             return True
         except (OSError, FileNotFoundError, PermissionError) as e:
@@ -241,40 +367,22 @@ class CopyFilesWorker(WorkerInPublishPullPipeline, FileCopy):
         )
         self.send_message_to_sink()
 
-    def update_progress(self, amount_downloaded: int, total: int) -> None:
+    def copy_from_camera(self, rpd_file: RPDFile, start: int=0) -> bool:
         """
-        Update the main process about how many bytes have been copied
-
-        :param amount_downloaded: the size in bytes of the file that
-         has been copied
-        :param total: the size of the file in bytes
+        :param start: how many bytes at the start of the file are already in
+         its temporary file, from the Download Cache
         """
 
-        chunk_downloaded = amount_downloaded - self.bytes_downloaded
-        if (chunk_downloaded > self.batch_size_bytes) or (amount_downloaded == total):
-            self.bytes_downloaded = amount_downloaded
-            self.content = pickle.dumps(
-                CopyFilesResults(
-                    scan_id=self.scan_id,
-                    total_downloaded=self.total_downloaded + amount_downloaded,
-                    chunk_downloaded=chunk_downloaded),
-               pickle.HIGHEST_PROTOCOL)
-            self.send_message_to_sink()
-
-            # if amount_downloaded == total:
-            #     self.bytes_downloaded = 0
-
-    def copy_from_camera(self, rpd_file: RPDFile) -> bool:
-
         try:
-            src_bytes = self.camera.save_file_by_chunks(
+            md5 = self.camera.save_file_by_chunks(
                 dir_name=rpd_file.path,
                 file_name=rpd_file.name,
                 size=rpd_file.size,
                 dest_full_filename=rpd_file.temp_full_file_name,
                 progress_callback=self.update_progress,
                 check_for_command=self.check_for_controller_directive,
-                return_file_bytes=self.verify_file
+                return_md5=self.verify_file,
+                start=start
             )
         except CameraProblemEx as e:
             name = rpd_file.name
@@ -289,10 +397,36 @@ class CopyFilesWorker(WorkerInPublishPullPipeline, FileCopy):
             return False
 
         if self.verify_file:
-            rpd_file.md5 = hashlib.md5(src_bytes).hexdigest()
+            rpd_file.md5 = md5
 
         return True
 
+    def move_cached_chunk(self, rpd_file: RPDFile) -> int:
+        """
+        Move the start of the file cached in the Download Cache while
+        generating thumbnails into the file's temporary file, so that only the
+        rest of the file need be read from the camera.
+
+        :return: the number of bytes moved, or 0 if none
+        """
+
+        chunk = rpd_file.temp_cache_full_file_chunk
+        rpd_file.temp_cache_full_file_chunk = ''
+        try:
+            size = os.path.getsize(chunk)
+            if not 0 < size <= rpd_file.size:
+                os.remove(chunk)
+                return 0
+            # Moves across file systems if need be
+            shutil.move(chunk, rpd_file.temp_full_file_name)
+        except OSError as e:
+            logging.warning(
+                "Could not use the cached start of %s (%s). Reading it all from the %s.",
+                rpd_file.full_file_name, e, self.display_name
+            )
+            return 0
+        return size
+
     def copy_associate_file(self, rpd_file: RPDFile, temp_name: str,
                             dest_dir: str, associate_file_fullname: str,
                             file_type: str) -> Optional[str]:
@@ -354,6 +488,15 @@ class CopyFilesWorker(WorkerInPublishPullPipeline, FileCopy):
 
         self.camera = None
 
+        for rpd_file in args.files:
+            if rpd_file.cache_full_file_name and not os.path.isfile(
+                    rpd_file.cache_full_file_name):
+                logging.warning(
+                    "Cached file %s for %s is missing", rpd_file.cache_full_file_name,
+                    rpd_file.full_file_name
+                )
+                rpd_file.cache_full_file_name = ''
+
         # To workaround a bug in iOS and possibly other devices, check if need to rescan the files
         # on the device
         rescan_check = [
@@ -429,13 +572,22 @@ class CopyFilesWorker(WorkerInPublishPullPipeline, FileCopy):
             # Three scenarios:
             # 1. Downloading from device with file system we can directly
             #    access
-            # 2. Downloading from camera using libgphoto2
+            # 2. Downloading from camera using libgphoto2, possibly
+            #    starting with the start of the file from the Download Cache
             # 3. Downloading from camera where we've already cached at
             #    least some of the files in the Download Cache
 
             self.init_copy_progress()
+            start = time.perf_counter()
 
-            if rpd_file.cache_full_file_name and os.path.isfile(rpd_file.cache_full_file_name):
+            if rpd_file.from_camera:
+                self.metrics.cache_lookup(
+                    'download cache', hit=bool(rpd_file.cache_full_file_name)
+                )
+                if rpd_file.cache_full_file_name:
+                    self.metrics.add_bytes('download cache', rpd_file.size)
+
+            if rpd_file.cache_full_file_name:
                 # Scenario 3
                 temp_file_name = os.path.basename(rpd_file.cache_full_file_name)
                 temp_name = os.path.splitext(temp_file_name)[0]
@@ -459,10 +611,8 @@ class CopyFilesWorker(WorkerInPublishPullPipeline, FileCopy):
                                 name=rpd_file.name, uri=rpd_file.get_uri(), exception=inst
                             )
                         )
-                    if self.verify_file:
-                        rpd_file.md5 = hashlib.md5(
-                            open(temp_full_file_name, 'rb').read()
-                        ).hexdigest()
+                    if self.verify_file and copy_succeeded:
+                        rpd_file.md5 = file_md5(temp_full_file_name, self.io_buffer)
                     self.update_progress(rpd_file.size, rpd_file.size)
                 else:
                     # The download folder changed since the scan occurred, and is now
@@ -510,16 +660,21 @@ class CopyFilesWorker(WorkerInPublishPullPipeline, FileCopy):
                         #                                            uri=rpd_file.get_uri()))
                         self.update_progress(rpd_file.size, rpd_file.size)
                     else:
-                        copy_succeeded = self.copy_from_camera(rpd_file)
+                        cached_bytes = 0
+                        if rpd_file.temp_cache_full_file_chunk:
+                            cached_bytes = self.move_cached_chunk(rpd_file)
+                            self.metrics.add_bytes('download cache', cached_bytes)
+                        copy_succeeded = self.copy_from_camera(rpd_file, cached_bytes)
                 else:
                     # Scenario 1
                     source = rpd_file.full_file_name
                     destination = rpd_file.temp_full_file_name
                     copy_succeeded = self.copy_from_filesystem(source, destination, rpd_file)
 
-            # increment this amount regardless of whether the copy actually
-            # succeeded or not. It's necessary to keep the user informed.
-            self.total_downloaded += rpd_file.size
+            self.file_copy_finished(rpd_file.size)
+            self.metrics.record_latency('copy', time.perf_counter() - start)
+            if copy_succeeded:
+                self.metrics.add_bytes('copy', rpd_file.size)
 
             mdata_exceptions = None
 
@@ -527,6 +682,19 @@ class CopyFilesWorker(WorkerInPublishPullPipeline, FileCopy):
                 rpd_file.status = DownloadStatus.download_failed
                 logging.debug("Download failed for %s", rpd_file.full_file_name)
             else:
+                if rpd_file.fingerprint is None:
+                    # The file was copied from a camera or moved from the Download Cache.
+                    # The parts of the file needed are almost certainly still in the
+                    # operating system's page cache.
+                    try:
+                        rpd_file.fingerprint = file_fingerprint(
+                            temp_full_file_name, rpd_file.size
+                        )
+                    except OSError as e:
+                        logging.warning(
+                            "Could not generate fingerprint for %s: %s", temp_full_file_name, e
+                        )
+
                 if rpd_file.from_camera:
                     mdata_exceptions = copy_camera_file_metadata(
                         float(rpd_file.modification_time), temp_full_file_name
@@ -564,8 +732,13 @@ class CopyFilesWorker(WorkerInPublishPullPipeline, FileCopy):
 
             download_count = idx + 1
 
+            total_downloaded, chunk_downloaded = self.unreported_progress()
+
             self.content = pickle.dumps(
                 CopyFilesResults(
+                    scan_id=self.scan_id,
+                    total_downloaded=total_downloaded,
+                    chunk_downloaded=chunk_downloaded,
                     copy_succeeded=copy_succeeded,
                     rpd_file=rpd_file,
                     download_count=download_count,
@@ -588,5 +761,5 @@ class CopyFilesWorker(WorkerInPublishPullPipeline, FileCopy):
 
 
 if __name__ == "__main__":
-    copy = CopyFilesWorker()
+    run_worker(CopyFilesWorker)
 
@@ -53,6 +53,7 @@ from raphodo.storage import (
     ValidatedFolder, CameraDetails, get_uri, fs_device_details
 )
 from raphodo.camera import generate_devname, autodetect_cameras
+from raphodo.simulatedcamera import is_simulated_camera_port
 from raphodo.utilities import (
     number, make_internationalized_list, stdchannel_redirected, same_device
 )
@@ -214,7 +215,7 @@ class Device:
                 self.is_mtp_device = udev_attr.is_mtp_device
                 self.udev_name = udev_attr.model
                 self.display_name = udev_attr.model
-        else:
+        elif not is_simulated_camera_port(camera_port):
             logging.error("Could not determine udev values for %s %s",
                           self.camera_model, camera_port)
 
@@ -439,6 +440,9 @@ class DeviceCollection:
         # Track which devices are thumbnailing, by scan_id
         self.thumbnailing = set()  # type: Set[int]
 
+        # Track which cameras files are being prefetched from, by scan_id
+        self.prefetching = set()  # type: Set[int]
+
         # Track the unmounting of unscanned cameras by port and model
         # port: model
         self.cameras_to_gvfs_unmount_for_scan = {}  # type: Dict[str, str]
@@ -446,6 +450,7 @@ class DeviceCollection:
         # Which scanned cameras need to be unmounted for a download to start, by scan_id
         self.cameras_to_gvfs_unmount_for_download = set()  # type: Set[int]
         self.cameras_to_stop_thumbnailing = set()
+        self.cameras_to_stop_prefetching = set()  # type: Set[int]
 
         # Automatically detected devices where the user has explicitly said to ignore it
         # port: model
@@ -482,11 +487,18 @@ class DeviceCollection:
 
     def download_start_blocked(self) -> bool:
         """
-        Determine if a camera needs to be unmounted or thumbnailing needs to be
-        terminated for a camera in order for a download to proceed
+        Determine if a camera needs to be unmounted or thumbnailing or prefetching
+        needs to be terminated for a camera in order for a download to proceed
         :return: True if so, else False
         """
 
+        if len(self.cameras_to_stop_prefetching) > 0:
+            logging.debug(
+                "Download is blocked because %s camera(s) are having their prefetching "
+                "stopped", len(self.cameras_to_stop_prefetching)
+            )
+            return True
+
         if len(self.cameras_to_gvfs_unmount_for_download) > 0 and len(
                 self.cameras_to_stop_thumbnailing):
             logging.debug(
@@ -538,6 +550,11 @@ class DeviceCollection:
             logging.debug("Thumbnailing: %s", thumbnailing)
         else:
             logging.debug("No devices thumbnailing")
+        if len(self.prefetching):
+            prefetching = (
+                    '%s' % ', '.join(self[scan_id].display_name for scan_id in self.prefetching)
+            )
+            logging.debug("Prefetching: %s", prefetching)
 
     def add_device(self, device: Device, on_startup: bool=False) -> int:
         """
@@ -846,6 +863,8 @@ class DeviceCollection:
             self.cameras_to_gvfs_unmount_for_download.remove(scan_id)
         if scan_id in self.cameras_to_stop_thumbnailing:
             self.cameras_to_stop_thumbnailing.remove(scan_id)
+        self.prefetching.discard(scan_id)
+        self.cameras_to_stop_prefetching.discard(scan_id)
         if scan_id in self.this_computer:
             self.this_computer.remove(scan_id)
         if scan_id in self.volumes_and_cameras:
@@ -0,0 +1,203 @@
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+The Download Cache: photos and videos, or the start of them, that were read
+from a camera to generate their thumbnails, kept so that the download does not
+read the same bytes from the camera again. Files marked for download are also
+copied into it in the background before the download starts (see prefetch.py).
+
+The cache directories are created in the download folders when they are valid
+(see ThumbnailDisplay.getCacheLocations()), so that when a file is downloaded,
+what is cached is moved into place rather than copied.
+
+What is cached for a file is recorded in its RPDFile:
+
+ - cache_full_file_name: the complete file
+ - temp_cache_full_file_chunk: the start of the file. The chunk's size is how
+   many bytes of the file are cached, and the download reads only the rest of
+   the file from the camera.
+
+The cache has a budget. A file that would take the cache over budget is not
+kept: it is deleted once its thumbnail has been generated.
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+import logging
+import os
+from typing import Dict, Optional, Set
+
+from raphodo.constants import FileType
+from raphodo.utilities import GenerateRandomFileName, format_size_for_user
+
+# The most the Download Cache of one device can hold
+default_download_cache_budget = 8 * 1024 ** 3
+# The proportion of the free space on the cache's file system it can use
+download_cache_free_space_fraction = 0.5
+
+
+def download_cache_budget(cache_dir: str,
+                          maximum: int=default_download_cache_budget,
+                          free_space_fraction: float=download_cache_free_space_fraction) -> int:
+    """
+    :param cache_dir: the directory the cache is in
+    :param maximum: the most the cache can hold
+    :param free_space_fraction: the proportion of the free space on the file
+     system that the cache can use
+    :return: the cache budget in bytes
+    """
+
+    try:
+        stat = os.statvfs(cache_dir)
+    except OSError:
+        logging.warning("Could not determine the free space available for %s", cache_dir)
+        return 0
+    return min(maximum, int(stat.f_bavail * stat.f_frsize * free_space_fraction))
+
+
+def cache_dir_name(device_name: str) -> str:
+    """Generate a directory name for a temporary file cache"""
+    return 'rpd-cache-{}-'.format(device_name[:10].replace(' ', '_'))
+
+
+class DownloadCache:
+    """
+    The Download Cache of one device, used by the process generating its
+    thumbnails.
+
+    >>> import tempfile
+    >>> from types import SimpleNamespace
+    >>> d = tempfile.mkdtemp()
+    >>> cache = DownloadCache(d, d, budget=100)
+    >>> photo = SimpleNamespace(file_type=FileType.photo, extension='jpg')
+    >>> name = cache.new_file_name(photo)
+    >>> os.path.dirname(name) == d, name.endswith('.jpg')
+    (True, True)
+    >>> cache.retain(name, 60)
+    True
+    >>> cache.retain(cache.new_file_name(photo), 60)
+    False
+    >>> cache.retains(name), cache.size
+    (True, 60)
+    >>> cache.has_room(40), cache.has_room(41)
+    (True, False)
+    """
+
+    def __init__(self, photo_cache_dir: str,
+                 video_cache_dir: str,
+                 budget: Optional[int]=None) -> None:
+        """
+        :param photo_cache_dir: directory in which to cache photos
+        :param video_cache_dir: directory in which to cache videos
+        :param budget: most bytes the cache can hold. If None, determined
+         from the free space where photos are cached.
+        """
+
+        self.photo_cache_dir = photo_cache_dir
+        self.video_cache_dir = video_cache_dir
+        if budget is None:
+            budget = download_cache_budget(photo_cache_dir)
+        self.budget = budget
+        self.size = 0
+        # Full file name: bytes cached
+        self.files = {}  # type: Dict[str, int]
+        self.over_budget = set()  # type: Set[str]
+        self.random_file_name = GenerateRandomFileName()
+        logging.debug(
+            "Download Cache budget for %s: %s", photo_cache_dir, format_size_for_user(budget)
+        )
+
+    def cache_dir(self, file_type: FileType) -> str:
+        if file_type == FileType.photo:
+            return self.photo_cache_dir
+        return self.video_cache_dir
+
+    def new_file_name(self, rpd_file) -> str:
+        """
+        :param rpd_file: the photo or video about to be read from the camera
+        :return: the full file name in which to save it
+        """
+
+        return os.path.join(
+            self.cache_dir(rpd_file.file_type),
+            self.random_file_name.name(extension=rpd_file.extension)
+        )
+
+    def retain(self, full_file_name: str, size: int) -> bool:
+        """
+        Keep a file saved in the cache, if the budget allows
+
+        :param full_file_name: the file, named using new_file_name()
+        :param size: bytes in the file, or bytes added to a file already kept
+        :return: True if the file is kept for the download, else False, in
+         which case it should be deleted once it has been used
+        """
+
+        if not self.has_room(size):
+            if not self.over_budget:
+                logging.info(
+                    "Download Cache in %s is full (%s)", os.path.dirname(full_file_name),
+                    format_size_for_user(self.size)
+                )
+            self.over_budget.add(full_file_name)
+            return False
+        self.files[full_file_name] = self.files.get(full_file_name, 0) + size
+        self.size += size
+        return True
+
+    def has_room(self, size: int) -> bool:
+        """
+        :return: True if a file of this size can be kept without taking the
+         cache over budget
+        """
+
+        return self.size + size <= self.budget
+
+    def add_existing_files(self) -> None:
+        """
+        Account for the files already in the cache directories, e.g. those
+        kept by another process
+        """
+
+        for cache_dir in {self.photo_cache_dir, self.video_cache_dir}:
+            try:
+                names = os.listdir(cache_dir)
+            except OSError:
+                continue
+            for name in names:
+                full_file_name = os.path.join(cache_dir, name)
+                if full_file_name not in self.files:
+                    try:
+                        size = os.path.getsize(full_file_name)
+                    except OSError:
+                        continue
+                    self.files[full_file_name] = size
+                    self.size += size
+
+    def retains(self, full_file_name: str) -> bool:
+        return full_file_name in self.files
+
+    def is_over_budget(self, full_file_name: str) -> bool:
+        """
+        :return: True if the file was saved in the cache, but is not being kept
+         because it would have taken the cache over budget
+        """
+
+        return full_file_name in self.over_budget
@@ -19,14 +19,14 @@
 __author__ = 'Damon Lynch'
 __copyright__ = "Copyright 2011-2020, Damon Lynch"
 
-from collections import defaultdict
+from collections import defaultdict, deque
 import time
 import math
 import locale
 import logging
 from typing import Optional, Dict, List, Tuple, Set
 
-from raphodo.constants import DownloadStatus, FileType, DownloadUpdateSeconds
+from raphodo.constants import DownloadStatus, FileType, DownloadUpdateSeconds, DownloadStage
 from raphodo.thumbnaildisplay import DownloadStats
 from raphodo.rpdfile import RPDFile
 
@@ -383,6 +383,77 @@ class DownloadTracker:
         self._refresh_values()
 
 
+# Seconds of recent activity used to measure the rate at which work is done
+RateWindowSeconds = 10.0
+
+
+class WindowedRate:
+    """
+    Measure the rate at which work is done across a sliding window of time
+
+    >>> r = WindowedRate(start=0.0, window=10.0)
+    >>> r.add(100, now=1.0)
+    >>> r.add(100, now=2.0)
+    >>> r.rate(now=2.0)
+    100.0
+    >>> r.rate(now=4.0)
+    50.0
+    >>> r.rate(now=30.0)
+    0.0
+    >>> r.restart(now=30.0)
+    >>> r.rate(now=30.0) is None
+    True
+    """
+
+    def __init__(self, start: Optional[float]=None, window: float=RateWindowSeconds) -> None:
+        """
+        :param start: time the work started, defaulting to now
+        :param window: seconds of recent activity to measure the rate across
+        """
+
+        self.window = window
+        self.total = 0
+        self.restart(now=start)
+
+    def restart(self, now: Optional[float]=None) -> None:
+        """
+        Discard measurements made so far, e.g. when resuming a paused download
+
+        :param now: time the work resumed, defaulting to now
+        """
+
+        if now is None:
+            now = time.time()
+        # Times and cumulative totals of work done
+        self.samples = deque([(now, self.total)])
+
+    def _prune(self, now: float) -> None:
+        # Keep one sample from before the window began, to anchor the measurement
+        while len(self.samples) > 1 and self.samples[1][0] <= now - self.window:
+            self.samples.popleft()
+
+    def add(self, amount: float, now: Optional[float]=None) -> None:
+        if now is None:
+            now = time.time()
+        self.total += amount
+        self.samples.append((now, self.total))
+        self._prune(now)
+
+    def rate(self, now: Optional[float]=None) -> Optional[float]:
+        """
+        :return: work done per second, or None if no time has elapsed
+        """
+
+        if now is None:
+            now = time.time()
+        self._prune(now)
+        start, start_total = self.samples[0]
+        elapsed = now - start
+        if elapsed <= 0:
+            return None
+        return (self.total - start_total) / elapsed
+
+
 class TimeCheck:
     """
     Record times downloads commence and pause - used in calculating time
@@ -405,16 +476,17 @@ class TimeCheck:
         self.mark_set = False
         self.total_downloaded_so_far = 0
         self.total_download_size = 0
-        self.size_mark = 0
-        self.smoothed_speed = None  # type: Optional[float]
+        self.download_rate = WindowedRate()
 
     def increment(self, bytes_downloaded):
         self.total_downloaded_so_far += bytes_downloaded
+        self.download_rate.add(bytes_downloaded)
 
     def set_download_mark(self):
         if not self.mark_set:
             self.mark_set = True
             self.time_mark = time.time()
+            self.download_rate.restart(now=self.time_mark)
 
     def pause(self):
         self.mark_set = False
@@ -424,34 +496,99 @@ class TimeCheck:
         updated = now > (self.time_gap + self.time_mark)
 
         if updated:
-            amt_time = now - self.time_mark
             self.time_mark = now
-            amt_downloaded = self.total_downloaded_so_far - self.size_mark
-            self.size_mark = self.total_downloaded_so_far
-            speed = amt_downloaded / 1048576 / amt_time
-            if self.smoothed_speed is None:
-                self.smoothed_speed = speed
-            else:
-                # smooth speed across fifteen readings
-                self.smoothed_speed = (self.smoothed_speed * 14 + speed) / 15
-            download_speed = "%1.1f %s" % (self.smoothed_speed, self.mpbs)
+            speed = self.download_rate.rate(now=now) or 0.0
+            download_speed = "%1.1f %s" % (speed / 1048576, self.mpbs)
         else:
             download_speed = None
 
         return (updated, download_speed)
 
 
+class StageProgress:
+    """
+    Track the work remaining for one stage of the download pipeline for a device
+    """
+
+    def __init__(self, stage: DownloadStage, size: int, start: float) -> None:
+        """
+        :param stage: the download stage
+        :param size: work the stage must do, in bytes, or for renaming, files
+        :param start: time the download started
+        """
+
+        self.stage = stage
+        self.size = size
+        self.done = 0
+        self.rate = WindowedRate(start=start)
+
+    @property
+    def remaining(self) -> int:
+        return max(self.size - self.done, 0)
+
+    def time_remaining(self, now: float) -> Optional[float]:
+        """
+        :return: seconds the stage needs to finish at its current rate, or None
+         if the stage is not doing any work
+        """
+
+        if not self.remaining:
+            return 0.0
+        rate = self.rate.rate(now=now)
+        if not rate:
+            return None
+        return self.remaining / rate
+
+    def __str__(self) -> str:
+        rate = self.rate.rate() or 0.0
+        if self.stage == DownloadStage.rename:
+            return '%s %.1f files/s (%s left)' % (self.stage.name, rate, self.remaining)
+        return '%s %.1f MB/s (%.1f MB left)' % (
+            self.stage.name, rate / 1048576, self.remaining / 1048576
+        )
+
+
 class TimeForDownload:
-    def __init__(self, size: int) -> None:
-        self.time_remaining = Infinity  # type: float
+    """
+    Model the throughput of each stage of the download pipeline for a device.
 
-        self.total_downloaded_so_far = 0   # type: int
-        self.total_download_size = size  # type: int
-        self.size_mark = 0  # type: int
-        self.smoothed_speed = None  # type: Optional[float]
+    Stages run concurrently, with each file passing through them in turn, so the
+    time remaining is that of the slowest stage, i.e. the bottleneck.
+    """
+
+    def __init__(self, copy_size: int, backup_size: int, no_files: int) -> None:
+        self.time_remaining = Infinity  # type: float
+        self.bottleneck = None  # type: Optional[DownloadStage]
 
         self.time_mark = time.time()  # type: float
-        self.smoothed_speed = None  # type: Optional[float]
+
+        self.stages = {
+            DownloadStage.copy: StageProgress(DownloadStage.copy, copy_size, self.time_mark),
+            DownloadStage.rename: StageProgress(DownloadStage.rename, no_files, self.time_mark)
+        }  # type: Dict[DownloadStage, StageProgress]
+        if backup_size:
+            self.stages[DownloadStage.backup] = StageProgress(
+                DownloadStage.backup, backup_size, self.time_mark
+            )
+
+    def estimate(self, now: float) -> Tuple[Optional[float], Optional[DownloadStage]]:
+        """
+        :return: seconds remaining until the slowest stage finishes, and that stage,
+         or None and None if no stage that has work remaining is doing any work
+        """
+
+        estimates = [
+            (self.stages[stage].time_remaining(now), stage) for stage in sorted(self.stages)
+            if self.stages[stage].remaining
+        ]
+        if not estimates or estimates[0][0] is None:
+            # The earliest stage with work remaining is not doing any
+            return None, None
+        # Later stages not yet doing any work are waiting for an earlier stage
+        return max(estimate for estimate in estimates if estimate[0] is not None)
+
+    def stats(self) -> str:
+        return ', '.join(str(stage) for stage in self.stages.values())
 
 
 class TimeRemaining:
@@ -460,55 +597,63 @@ class TimeRemaining:
     
     Runs in tandem with TimeCheck, above.
     
-    The smoothed speed for each device is independent of the smoothed
-    speed for the download as a whole.
+    The rates for each device are independent of the download speed for the
+    download as a whole.
     """
 
     def __init__(self) -> None:
         self.clear()
 
-    def __setitem__(self, scan_id: int, size: int) -> None:
-        t = TimeForDownload(size)
-        self.times[scan_id] = t
+    def add_device(self, scan_id: int, copy_size: int, backup_size: int, no_files: int) -> None:
+        """
+        :param scan_id: device being downloaded from
+        :param copy_size: size in bytes of the files being downloaded
+        :param backup_size: size in bytes of all the backups of the files
+        :param no_files: number of files being downloaded
+        """
 
-    def update(self, scan_id, bytes_downloaded) -> None:
+        self.times[scan_id] = TimeForDownload(copy_size, backup_size, no_files)
+
+    def update(self, scan_id: int, stage: DownloadStage, amount: int) -> None:
+        """
+        :param scan_id: device being downloaded from
+        :param stage: the stage that did the work
+        :param amount: work done, in bytes, or for renaming, files
+        """
 
         if not scan_id in self.times:
             return
 
         t = self.times[scan_id]  # type: TimeForDownload
+        progress = t.stages.get(stage)
+        if progress is None:
+            return
 
-        t.total_downloaded_so_far += bytes_downloaded
         now = time.time()
-        tm = t.time_mark
-        amt_time = now - tm
+        progress.done += amount
+        progress.rate.add(amount, now=now)
 
-        if amt_time > DownloadUpdateSeconds:
-
-            amt_downloaded = t.total_downloaded_so_far - t.size_mark
-            t.size_mark = t.total_downloaded_so_far
+        if now - t.time_mark > DownloadUpdateSeconds:
             t.time_mark = now
 
-            speed = amt_downloaded / amt_time
+            time_remaining, bottleneck = t.estimate(now)
+            if bottleneck != t.bottleneck and bottleneck is not None:
+                logging.debug("Download bottleneck for scan id %s: %s", scan_id, t.stats())
+            t.bottleneck = bottleneck
 
-            if t.smoothed_speed is None:
-                t.smoothed_speed = speed
-            else:
-                # smooth speed across ten readings
-                t.smoothed_speed = t.smoothed_speed * .9 + speed * .1
-
-            amt_to_download = t.total_download_size - t.total_downloaded_so_far
-
-            if not t.smoothed_speed:
+            if time_remaining is None:
                 t.time_remaining = Infinity
+            elif math.isinf(t.time_remaining):
+                t.time_remaining = time_remaining
             else:
-                time_remaining = amt_to_download / t.smoothed_speed
                 # Use the previous value to help determine the current value,
                 # which avoids values that jump around
-                if math.isinf(t.time_remaining):
-                    t.time_remaining = time_remaining
-                else:
-                    t.time_remaining = get_time_left(time_remaining, t.time_remaining)
+                t.time_remaining = get_time_left(time_remaining, t.time_remaining)
+
+    def _slowest(self) -> Optional[TimeForDownload]:
+        if not self.times:
+            return None
+        return max(self.times.values(), key=lambda t: t.time_remaining)
 
     def time_remaining(self, detailed_time_remaining: bool) -> Optional[str]:
         """
@@ -521,11 +666,11 @@ class TimeRemaining:
         time remaining is unknown.
         """
 
-        time_remaining = max(t.time_remaining for t in self.times.values())
-        if math.isinf(time_remaining):
+        slowest = self._slowest()
+        if slowest is None or math.isinf(slowest.time_remaining):
             return None
 
-        time_remaining =  round(time_remaining)  # type: int
+        time_remaining =  round(slowest.time_remaining)  # type: int
         if time_remaining < 4:
             # Be friendly in the last few seconds
             return _('A few seconds')
@@ -533,17 +678,49 @@ class TimeRemaining:
             # Format the string using the one or two largest units
             return formatTime(time_remaining, limit_precision=not detailed_time_remaining)
 
+    def bottleneck(self) -> Optional[DownloadStage]:
+        """
+        :return: the stage limiting the device that will take longest to download
+        """
+
+        slowest = self._slowest()
+        if slowest is None:
+            return None
+        return slowest.bottleneck
+
+    def log_stats(self, scan_id: int) -> None:
+        if scan_id in self.times:
+            logging.debug(
+                "Download throughput for scan id %s: %s", scan_id, self.times[scan_id].stats()
+            )
+
     def set_time_mark(self, scan_id):
         if scan_id in self.times:
-            self.times[scan_id].time_mark = time.time()
+            t = self.times[scan_id]
+            t.time_mark = time.time()
+            for stage in t.stages.values():
+                stage.rate.restart(now=t.time_mark)
 
     def clear(self):
-        self.times = {}
+        self.times = {}  # type: Dict[int, TimeForDownload]
 
     def __delitem__(self, scan_id):
         del self.times[scan_id]
 
 
+def download_stage_name(stage: DownloadStage) -> str:
+    """
+    :return: the stage in a form suitable to display to the user
+    """
+
+    if stage == DownloadStage.copy:
+        return _('copying')
+    elif stage == DownloadStage.rename:
+        return _('renaming')
+    else:
+        return _('backing up')
+
+
 def get_time_left(aSeconds: float, aLastSec: Optional[float]=None) -> float:
     """
     Generate a "time left" string given an estimate on the time left and the
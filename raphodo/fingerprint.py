@@ -0,0 +1,160 @@
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+Content fingerprints of photos and videos, used to detect files that have been
+downloaded before even when their name or modification time has changed.
+
+A fingerprint is an md5 hash of the file size and three blocks of the file: its
+head, middle and tail. Small files are hashed in their entirety. Reading three
+blocks is much cheaper than reading the entire file, yet the blocks are very
+unlikely to be identical in two different photos or videos of the same size.
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+import hashlib
+from typing import List, Tuple, Callable, Optional, Sequence
+
+fingerprint_block_size = 64 * 1024
+
+
+def fingerprint_regions(size: int,
+                        block_size: int=fingerprint_block_size) -> List[Tuple[int, int]]:
+    """
+    Determine which parts of a file are used in its fingerprint
+
+    :param size: file size in bytes
+    :param block_size: size of each block
+    :return: list of start and end offsets of the blocks
+
+    >>> fingerprint_regions(100, 64)
+    [(0, 100)]
+    >>> fingerprint_regions(192, 64)
+    [(0, 192)]
+    >>> fingerprint_regions(1000, 64)
+    [(0, 64), (468, 532), (936, 1000)]
+    """
+
+    if size <= block_size * 3:
+        return [(0, size)]
+    middle = size // 2 - block_size // 2
+    return [(0, block_size), (middle, middle + block_size), (size - block_size, size)]
+
+
+def fingerprint_digest(size: int, blocks: Sequence[bytes]) -> str:
+    """
+    :param size: file size in bytes
+    :param blocks: the file's blocks, as determined by fingerprint_regions()
+    :return: the fingerprint
+    """
+
+    h = hashlib.md5(str(size).encode())
+    for block in blocks:
+        h.update(block)
+    return h.hexdigest()
+
+
+def fingerprint(size: int, read: Callable[[int, int], bytes]) -> str:
+    """
+    Generate a fingerprint using a function that reads part of the file
+
+    :param size: file size in bytes
+    :param read: function taking a start offset and a length that returns those
+     bytes of the file
+    :return: the fingerprint
+
+    >>> fingerprint(3, lambda start, length: b'abc'[start:start + length])
+    '2f4fe09bb4f6bb9ad8ee6e7579e8f5e1'
+    """
+
+    return fingerprint_digest(
+        size, [read(start, end - start) for start, end in fingerprint_regions(size)]
+    )
+
+
+def file_fingerprint(full_file_name: str, size: int) -> str:
+    """
+    Generate a fingerprint for a file on the file system.
+
+    Raises OSError if the file cannot be read.
+
+    :param full_file_name: path of the file
+    :param size: file size in bytes
+    :return: the fingerprint
+    """
+
+    with open(full_file_name, 'rb') as f:
+        def read(start: int, length: int) -> bytes:
+            f.seek(start)
+            return f.read(length)
+
+        return fingerprint(size, read)
+
+
+class FingerprintAccumulator:
+    """
+    Generate a fingerprint from a file's data as it is copied, without
+    needing to read the file again.
+
+    >>> data = bytes(range(256)) * 1024
+    >>> fp = FingerprintAccumulator(len(data))
+    >>> for i in range(0, len(data), 1000):
+    ...     fp.update(data[i:i + 1000])
+    >>> fp.hexdigest() == fingerprint(len(data), lambda s, l: data[s:s + l])
+    True
+    >>> fp = FingerprintAccumulator(len(data))
+    >>> fp.update(data[:10])
+    >>> fp.hexdigest() is None
+    True
+    """
+
+    def __init__(self, size: int) -> None:
+        """
+        :param size: file size in bytes
+        """
+
+        self.size = size
+        self.regions = fingerprint_regions(size)
+        self.blocks = [bytearray() for region in self.regions]
+        self.offset = 0
+
+    def update(self, chunk: bytes) -> None:
+        """
+        :param chunk: the next part of the file
+        """
+
+        start = self.offset
+        end = start + len(chunk)
+        for (region_start, region_end), block in zip(self.regions, self.blocks):
+            lower = max(region_start, start)
+            upper = min(region_end, end)
+            if lower < upper:
+                block += chunk[lower - start:upper - start]
+        self.offset = end
+
+    def hexdigest(self) -> Optional[str]:
+        """
+        :return: the fingerprint, or None if the amount of data passed to update()
+         does not match the file size
+        """
+
+        if self.offset != self.size:
+            return None
+        return fingerprint_digest(self.size, self.blocks)
@@ -36,8 +36,9 @@ __copyright__ = "Copyright 2016, Damon Lynch"
 
 import os
 from collections import namedtuple, defaultdict
+import datetime
 import logging
-from typing import Tuple, Set, Sequence, Dict, Optional, List
+from typing import Tuple, Set, Sequence, Dict, Optional, List, Any
 from pprint import pprint
 
 from PyQt5.QtWidgets import QFileSystemModel
@@ -45,6 +46,10 @@ from PyQt5.QtWidgets import QFileSystemModel
 from raphodo.rpdfile import RPDFile
 from raphodo.constants import FileType
 import raphodo.generatename as gn
+from raphodo.generatenameconfig import (
+    DATE_TIME, IMAGE_DATE, VIDEO_DATE, SUBSECONDS, TODAY, YESTERDAY, DOWNLOAD_TIME, FILENAME,
+    EXTENSION
+)
 from raphodo.storage import validate_download_folder
 from raphodo.filebrowse import FileSystemModel
 
@@ -55,6 +60,225 @@ DownloadDestination = namedtuple(
 )
 
 
+# A file type, and the values of a file that its preview subfolder is generated from
+SubfolderKey = Tuple[FileType, Tuple[Any, ...]]
+
+
+class PreviewFile:
+    """
+    Stands in for the files sharing a SubfolderPreviewKeys key when their preview
+    subfolder is generated. It has only the attributes that subfolder generation
+    without metadata uses.
+    """
+
+    __slots__ = (
+        'ctime', 'modification_time', 'name', 'full_file_name', 'download_start_time',
+        'strip_characters', 'job_code', 'name_generation_problem'
+    )
+
+    def __init__(self, ctime: Optional[float],
+                 modification_time: Optional[float],
+                 name: Optional[str],
+                 download_start_time: Optional[datetime.datetime],
+                 strip_characters: bool) -> None:
+        """
+        :param ctime: creation time, if the subfolder generation preferences use it
+        :param modification_time: modification time, if the preferences use it
+        :param name: file name, or if the preferences use only the extension, any
+         name with that extension
+        :param download_start_time: when the download started, if the preferences
+         use it
+        :param strip_characters: value from user prefs
+        """
+
+        self.ctime = ctime
+        self.modification_time = modification_time
+        self.name = name
+        # Used only in log messages
+        self.full_file_name = name
+        self.download_start_time = download_start_time
+        self.strip_characters = strip_characters
+        # Job codes are not assigned until files are downloaded
+        self.job_code = None
+        # Set by the name generator
+        self.name_generation_problem = False
+
+
+class SubfolderPreviewKeys:
+    """
+    Preview subfolders are generated without metadata, which means they depend on
+    only a few values of each file: its name, creation time and so on. Files that
+    share the values the subfolder generation preferences use share a key, and a
+    subfolder need only be generated once per key.
+
+    Where the preferences use only the date component of the creation time, the
+    key contains the date, not the time.
+    """
+
+    def __init__(self, pref_list: List[str], file_type: FileType) -> None:
+        self.pref_list = tuple(pref_list)
+        self.file_type = file_type
+
+        if file_type == FileType.photo:
+            self.generator = gn.PhotoSubfolder(pref_list, no_metadata=True)
+        else:
+            self.generator = gn.VideoSubfolder(pref_list, no_metadata=True)
+        self.generator.compile()
+
+        self.uses_ctime = self.uses_mtime = self.uses_name = self.uses_extension = False
+        self.uses_today = self.uses_download_time = False
+        self.date_only = True
+
+        for i in range(0, len(self.generator.pref_list), 3):
+            value, l1, l2 = self.generator.pref_list[i:i + 3]
+            if value == DATE_TIME:
+                if l1 in (IMAGE_DATE, VIDEO_DATE):
+                    if l2 == SUBSECONDS:
+                        self.uses_mtime = True
+                    else:
+                        self.uses_ctime = True
+                        time_format = gn.convert_date_for_strftime(l2)
+                        if '%H' in time_format or '%M' in time_format or '%S' in time_format:
+                            self.date_only = False
+                elif l1 in (TODAY, YESTERDAY):
+                    self.uses_today = True
+                elif l1 == DOWNLOAD_TIME:
+                    self.uses_download_time = True
+            elif value == FILENAME:
+                if l1 == EXTENSION:
+                    self.uses_extension = True
+                else:
+                    self.uses_name = True
+
+    def key(self, rpd_file: RPDFile) -> Tuple[Any, ...]:
+        """
+        :param rpd_file: file to generate the key for
+        :return: the values of the file used in subfolder generation
+        """
+
+        if not self.uses_ctime or rpd_file.ctime is None:
+            ctime = None
+        elif self.date_only:
+            ctime = datetime.datetime.fromtimestamp(rpd_file.ctime).toordinal()
+        else:
+            ctime = rpd_file.ctime
+
+        if self.uses_name:
+            name = rpd_file.name
+        elif self.uses_extension:
+            name = os.path.splitext(rpd_file.name)[1]
+        else:
+            name = None
+
+        return (
+            ctime,
+            rpd_file.modification_time if self.uses_mtime else None,
+            name,
+            rpd_file.download_start_time if self.uses_download_time else None,
+            datetime.date.today().toordinal() if self.uses_today else None
+        )
+
+    def generate(self, key: Tuple[Any, ...], strip_characters: bool) -> str:
+        """
+        Generate the subfolder for files sharing the key
+
+        :param key: key generated by key()
+        :param strip_characters: value from user prefs
+        :return: the subfolder
+        """
+
+        ctime, mtime, name, download_start_time, today = key
+        if ctime is not None and self.date_only:
+            # Midday avoids any problem with daylight saving time transitions
+            ctime = datetime.datetime.combine(
+                datetime.date.fromordinal(ctime), datetime.time(12)
+            ).timestamp()
+        if name is not None and not self.uses_name:
+            name = 'file{}'.format(name)
+
+        preview_file = PreviewFile(
+            ctime=ctime, modification_time=mtime, name=name,
+            download_start_time=download_start_time, strip_characters=strip_characters
+        )
+        return self.generator.generate_name(preview_file)
+
+
+class FoldersPreviewDelta:
+    """
+    Changes made to a FoldersPreview while generating subfolders, so that they alone
+    need to be sent back to the main process
+    """
+
+    def __init__(self) -> None:
+        # Whether the subfolder is for photos, the subfolder, and its scan ids
+        self.generated = []  # type: List[Tuple[bool, str, Set[int]]]
+        # Whether the path is for photos, its level, the path, and if the path
+        # was created, the scan ids it was created for
+        self.created = []  # type: List[Tuple[bool, int, str, Optional[Set[int]]]]
+        self.existing = []  # type: List[str]
+
+    def __len__(self) -> int:
+        return len(self.generated) + len(self.created) + len(self.existing)
+
+    def __repr__(self) -> str:
+        return 'FoldersPreviewDelta(%s generated, %s created, %s existing)' % (
+            len(self.generated), len(self.created), len(self.existing)
+        )
+
+
+class SubfolderGenerationData:
+    """
+    What the offload process needs to generate subfolders for the main process's
+    FoldersPreview: the keys to generate subfolders for, the download folders and
+    subfolder generation preferences, and the subfolders already generated and
+    created, so that they are not generated or created again
+    """
+
+    def __init__(self, folders_preview: 'FoldersPreview',
+                 subfolder_keys: Dict[SubfolderKey, Set[int]],
+                 strip_characters: bool) -> None:
+        """
+        :param folders_preview: the main process's FoldersPreview
+        :param subfolder_keys: keys returned by FoldersPreview.subfolder_keys()
+        :param strip_characters: value from user prefs
+        """
+
+        self.subfolder_keys = subfolder_keys
+        self.strip_characters = strip_characters
+        self.destination = DownloadDestination(
+            photo_download_folder=folders_preview.photo_download_folder,
+            video_download_folder=folders_preview.video_download_folder,
+            photo_subfolder=folders_preview.photo_subfolder,
+            video_subfolder=folders_preview.video_subfolder
+        )
+        self.photo_download_folder_valid = folders_preview.photo_download_folder_valid
+        self.video_download_folder_valid = folders_preview.video_download_folder_valid
+        self.generated_photo_subfolders = folders_preview.generated_photo_subfolders
+        self.generated_video_subfolders = folders_preview.generated_video_subfolders
+        self.created_photo_subfolders = folders_preview.created_photo_subfolders
+        self.created_video_subfolders = folders_preview.created_video_subfolders
+
+    def folders_preview(self) -> 'FoldersPreview':
+        """
+        Called in the offload process.
+
+        :return: a FoldersPreview with which to generate the subfolders
+        """
+
+        folders_preview = FoldersPreview()
+        folders_preview.photo_download_folder = self.destination.photo_download_folder
+        folders_preview.video_download_folder = self.destination.video_download_folder
+        folders_preview.photo_subfolder = self.destination.photo_subfolder
+        folders_preview.video_subfolder = self.destination.video_subfolder
+        folders_preview.photo_download_folder_valid = self.photo_download_folder_valid
+        folders_preview.video_download_folder_valid = self.video_download_folder_valid
+        folders_preview.generated_photo_subfolders = self.generated_photo_subfolders
+        folders_preview.generated_video_subfolders = self.generated_video_subfolders
+        folders_preview.created_photo_subfolders = self.created_photo_subfolders
+        folders_preview.created_video_subfolders = self.created_video_subfolders
+        return folders_preview
+
+
 class FoldersPreview:
     """
     Core tasks of this class are to be able to handle these scenarios:
@@ -109,6 +333,11 @@ class FoldersPreview:
         # Track whether some change was made to the file system
         self.dirty = False
 
+        # Keys of files whose subfolders have already been generated, with their
+        # scan ids. Used only in the main process.
+        self.generated_keys = set()  # type: Set[Tuple[FileType, Tuple[Any, ...], int]]
+        self._preview_keys = {}  # type: Dict[FileType, SubfolderPreviewKeys]
+
     def __repr__(self):
         return 'FoldersPreview(%s photo dirs, %s video dirs)' % (
             len(
@@ -222,6 +451,9 @@ class FoldersPreview:
             self.created_photo_subfolders = defaultdict(set)  # type: Dict[int, Set[str]]
             self.generated_photo_subfolders = set()  # type: Set[str]
             self.generated_photo_subfolders_scan_ids = defaultdict(set)  # type: Dict[str, Set[int]]
+            self.generated_keys = {
+                key for key in self.generated_keys if key[0] != FileType.photo
+            }
 
         if destination.video_subfolder != self.video_subfolder:
             self.dirty = True
@@ -233,36 +465,123 @@ class FoldersPreview:
             self.created_video_subfolders = defaultdict(set)  # type: Dict[int, Set[str]]
             self.generated_video_subfolders = set()  # type: Set[str]
             self.generated_video_subfolders_scan_ids = defaultdict(set)  # type: Dict[str, Set[int]]
+            self.generated_keys = {
+                key for key in self.generated_keys if key[0] != FileType.video
+            }
+
+    def subfolder_preview_keys(self, file_type: FileType) -> SubfolderPreviewKeys:
+        """
+        :param file_type: photo or video
+        :return: the key generator for the file type's current subfolder
+         generation preferences
+        """
 
-    def generate_subfolders(self, rpd_files: Sequence[RPDFile], strip_characters: bool) -> None:
+        if file_type == FileType.photo:
+            pref_list = self.photo_subfolder
+        else:
+            pref_list = self.video_subfolder
+        preview_keys = self._preview_keys.get(file_type)
+        if preview_keys is None or preview_keys.pref_list != tuple(pref_list):
+            preview_keys = SubfolderPreviewKeys(pref_list=pref_list, file_type=file_type)
+            self._preview_keys[file_type] = preview_keys
+        return preview_keys
+
+    def subfolder_keys(self, rpd_files: Sequence[RPDFile]) -> Dict[SubfolderKey, Set[int]]:
         """
-        Generate subfolder names for each rpd_file, and create on the file system
+        Determine the keys of files whose subfolders have not yet been generated.
+
+        Called in the main process. The keys are marked as generated.
+
+        :param rpd_files: rpd_files to generate subfolders for
+        :return: keys and the scan ids of the files that share them
+        """
+
+        photo_keys = self.subfolder_preview_keys(FileType.photo)
+        video_keys = self.subfolder_preview_keys(FileType.video)
+        subfolder_keys = defaultdict(set)  # type: Dict[SubfolderKey, Set[int]]
+        for rpd_file in rpd_files:  # type: RPDFile
+            if rpd_file.file_type == FileType.photo:
+                key = (FileType.photo, photo_keys.key(rpd_file))
+            else:
+                key = (FileType.video, video_keys.key(rpd_file))
+            generated_key = key + (rpd_file.scan_id, )
+            if generated_key not in self.generated_keys:
+                self.generated_keys.add(generated_key)
+                subfolder_keys[key].add(rpd_file.scan_id)
+        return subfolder_keys
+
+    def generate_subfolders(self, subfolder_keys: Dict[SubfolderKey, Set[int]],
+                            strip_characters: bool,
+                            cache: Dict[Tuple, str]) -> FoldersPreviewDelta:
+        """
+        Generate subfolder names for each key, and create on the file system
         if necessary the subfolders that will be used for the download (assuming
         the subfolder generation config doesn't change, of course).
 
-        :param rpd_files: rpd_files to generate names for
+        Called in the offload process.
+
+        :param subfolder_keys: keys to generate subfolders for, and their scan ids
         :param strip_characters: value from user prefs.
+        :param cache: subfolders previously generated, which is updated with any
+         newly generated subfolders
+        :return: the changes made
         """
 
-        for rpd_file in rpd_files:  # type: RPDFile
-            photo = rpd_file.file_type == FileType.photo
-            rpd_file.strip_characters = strip_characters
+        delta = FoldersPreviewDelta()
+
+        for (file_type, key), scan_ids in subfolder_keys.items():
+            preview_keys = self.subfolder_preview_keys(file_type)
+            cache_key = (file_type, preview_keys.pref_list, strip_characters, key)
+            value = cache.get(cache_key)
+            if value is None:
+                value = preview_keys.generate(key=key, strip_characters=strip_characters)
+                cache[cache_key] = value
+
+            photo = file_type == FileType.photo
             if photo:
-                generator = gn.PhotoSubfolder(self.photo_subfolder, no_metadata=True)
                 generated_subfolders = self.generated_photo_subfolders
                 generated_subfolder_scan_ids = self.generated_photo_subfolders_scan_ids
             else:
-                generator = gn.VideoSubfolder(self.video_subfolder, no_metadata=True)
                 generated_subfolders = self.generated_video_subfolders
                 generated_subfolder_scan_ids = self.generated_video_subfolders_scan_ids
-            value = generator.generate_name(rpd_file)
             if value:
                 if value not in generated_subfolders:
                     generated_subfolders.add(value)
-                    generated_subfolder_scan_ids[value].add(rpd_file.scan_id)
-                    self.create_path(path=value, photos=photo, scan_ids={rpd_file.scan_id})
+                    generated_subfolder_scan_ids[value].update(scan_ids)
+                    delta.generated.append((photo, value, set(scan_ids)))
+                    self.create_path(path=value, photos=photo, scan_ids=scan_ids, delta=delta)
                     self.dirty = True
 
+        return delta
+
+    def apply_delta(self, delta: FoldersPreviewDelta) -> None:
+        """
+        Apply the changes made by the offload process while generating subfolders
+
+        :param delta: the changes
+        """
+
+        for photo, value, scan_ids in delta.generated:
+            if photo:
+                self.generated_photo_subfolders.add(value)
+                self.generated_photo_subfolders_scan_ids[value].update(scan_ids)
+            else:
+                self.generated_video_subfolders.add(value)
+                self.generated_video_subfolders_scan_ids[value].update(scan_ids)
+
+        for photo, level, path, scan_ids in delta.created:
+            if photo:
+                self.created_photo_subfolders[level].add(path)
+            else:
+                self.created_video_subfolders[level].add(path)
+            if scan_ids is not None:
+                self.scan_ids_for_created_subfolders[(level, path)].update(scan_ids)
+
+        self.existing_subfolders.update(delta.existing)
+
+        if len(delta):
+            self.dirty = True
+
     def move_subfolders(self, photos: bool, fsmodel: QFileSystemModel) -> None:
         """
         Handle case where the user has chosen a different download directory
@@ -361,6 +680,7 @@ class FoldersPreview:
         self.generated_video_subfolders = set()  # type: Set[str]
         self.generated_photo_subfolders_scan_ids = defaultdict(set)  # type: Dict[str, Set[int]]
         self.generated_video_subfolders_scan_ids = defaultdict(set)  # type: Dict[str, Set[int]]
+        self.generated_keys = set()  # type: Set[Tuple[FileType, Tuple[Any, ...], int]]
 
     def clean_generated_folders_for_scan_id(self, scan_id: int, fsmodel: QFileSystemModel) -> None:
 
@@ -393,7 +713,10 @@ class FoldersPreview:
             if not self.generated_video_subfolders_scan_ids[subfolder]:
                 del self.generated_video_subfolders_scan_ids[subfolder]
 
-    def create_path(self, path: str, photos: bool, scan_ids: Set[int]) -> None:
+        self.generated_keys = {key for key in self.generated_keys if key[2] != scan_id}
+
+    def create_path(self, path: str, photos: bool, scan_ids: Set[int],
+                    delta: Optional[FoldersPreviewDelta]=None) -> None:
         """
         Create folders on the actual file system if they don't already exist
 
@@ -402,6 +725,7 @@ class FoldersPreview:
         :param path: folder structure to create
         :param photos: whether working on photos (True) or videos (False)
         :param scan_ids: scan ids of devices associated with this subfolder
+        :param delta: if not None, where to record the changes made
         """
 
         components = ''
@@ -441,6 +765,8 @@ class FoldersPreview:
                 # for the other file type, so record the fact that we're creating it for
                 # this file type.
                 creating[level].add(p)
+                if delta is not None:
+                    delta.created.append((photos, level, p, None))
             elif not os.path.isdir(p):
                 creating[level].add(p)
                 try:
@@ -449,8 +775,14 @@ class FoldersPreview:
                 except OSError as e:
                     logging.error("Failed to create download directory %s", p)
                     logging.exception("Traceback:")
+                    if delta is not None:
+                        delta.created.append((photos, level, p, None))
                     return
+                if delta is not None:
+                    delta.created.append((photos, level, p, set(scan_ids)))
                 # logging.debug("Created provisional download folder: %s", p)
             else:
                 self.existing_subfolders.add(p)
+                if delta is not None:
+                    delta.existing.append(p)
                 # logging.debug("Provisional download folder already exists: %s", p)
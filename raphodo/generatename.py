@@ -27,7 +27,7 @@ from datetime import datetime, timedelta
 import string
 from collections import namedtuple
 import logging
-from typing import Sequence, Optional, List, Union
+from typing import Sequence, Optional, List, Union, Callable, Iterator
 import locale
 try:
     # Use the default locale as defined by the LANG variable
@@ -119,10 +119,23 @@ class NameGeneration:
         self.L1 = ''
         self.L2 = ''
 
+        # Assigned when the preference list is compiled
+        self.components = None  # type: Optional[List[Callable[[], str]]]
+        self.date_format = None  # type: Optional[str]
+
     def _get_values_from_pref_list(self):
         for i in range(0, len(self.pref_list), 3):
             yield (self.pref_list[i], self.pref_list[i + 1], self.pref_list[i + 2])
 
+    def _strftime_format(self) -> str:
+        """
+        :return: the strftime format for the date time component being generated
+        """
+
+        if self.date_format is not None:
+            return self.date_format
+        return convert_date_for_strftime(self.L2)
+
     def _get_date_component(self) -> str:
         """
         Returns portion of new file / subfolder name based on date time.
@@ -166,7 +179,7 @@ class NameGeneration:
         # step 2: if have a value, try to convert it to string format
         if d:
             try:
-                return d.strftime(convert_date_for_strftime(self.L2))
+                return d.strftime(self._strftime_format())
             except Exception as e:
                 logging.warning(
                     "Problem converting date/time value for file %s", self.rpd_file.full_file_name
@@ -190,7 +203,7 @@ class NameGeneration:
             return ''
 
         try:
-            return d.strftime(convert_date_for_strftime(self.L2))
+            return d.strftime(self._strftime_format())
         except:
             logging.error(
                 "Both file modification time and metadata date & time are invalid for file %s",
@@ -417,6 +430,71 @@ class NameGeneration:
             self.problem.component_exception = e
             return ''
 
+    def _compile_component(self, L0: str, L1: str, L2: str) -> Callable[[], str]:
+        """
+        Create a function that generates one component of the name
+
+        :return: function taking no arguments that returns the component
+        """
+
+        if L0 == TEXT:
+            return lambda: L1
+        if L0 == SEPARATOR:
+            return lambda: os.sep
+
+        if L0 == DATE_TIME:
+            get_value = self._get_date_component
+        elif L0 == FILENAME:
+            get_value = self._get_filename_component
+        elif L0 == METADATA:
+            get_value = self._get_metadata_component
+        elif L0 == SEQUENCES:
+            get_value = self._get_sequences_component
+        elif L0 == JOB_CODE:
+            get_value = lambda: self.rpd_file.job_code
+        else:
+            return lambda: None
+
+        if L0 == DATE_TIME and L2 in LIST_DATE_TIME_L2:
+            date_format = convert_date_for_strftime(L2)
+        else:
+            date_format = None
+
+        def component() -> str:
+            self.L0, self.L1, self.L2 = L0, L1, L2
+            self.date_format = date_format
+            try:
+                return get_value()
+            except Exception as e:
+                self.problem.component_problem = _(L0)
+                self.problem.component_exception = e
+                return ''
+
+        return component
+
+    def compile(self) -> None:
+        """
+        Convert the preference list into a list of functions, one for each
+        component of the name, with date time formats already converted to
+        their strftime equivalents.
+
+        A compiled generator can be used to generate the names of many files,
+        without interpreting the preference list again for each file.
+        """
+
+        self.components = [
+            self._compile_component(L0, L1, L2) for L0, L1, L2 in self._get_values_from_pref_list()
+        ]
+
+    def _interpret_pref_list(self) -> Iterator[str]:
+        """
+        Generate each component of the name by interpreting the preference list
+        """
+
+        self.date_format = None
+        for self.L0, self.L1, self.L2 in self._get_values_from_pref_list():
+            yield self._get_component()
+
     def filter_strip_characters(self, name: str) -> str:
         """
         Filter out unwanted chacters from file and subfolder names
@@ -463,8 +541,14 @@ class NameGeneration:
         else:
             name = ''
 
-        for self.L0, self.L1, self.L2 in self._get_values_from_pref_list():
-            v = self._get_component()
+        if self.components is not None:
+            # A compiled generator is used for many files, so start afresh
+            self.problem = self.problem.__class__()
+            values = (component() for component in self.components)
+        else:
+            values = self._interpret_pref_list()
+
+        for v in values:
             if parts:
                 name.append(self.filter_strip_characters(v))
             elif v:
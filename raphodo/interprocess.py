@@ -25,6 +25,7 @@ import logging
 import pickle
 import os
 import shlex
+import struct
 import time
 from collections import deque, namedtuple
 from typing import Optional, Set, List, Dict, Sequence, Any, Tuple, Union
@@ -57,8 +58,12 @@ from raphodo.constants import (
 from raphodo.proximity import TemporalProximityGroups
 from raphodo.storage import StorageSpace
 from raphodo.iplogging import ZeroMQSocketHandler
+import raphodo.metrics as metrics
 from raphodo.viewutils import ThumbnailDataForProximity
-from raphodo.folderspreview import DownloadDestination, FoldersPreview
+from raphodo.thumbnailrows import ThumbnailRow, thumbnail_row
+from raphodo.folderspreview import (
+    DownloadDestination, FoldersPreviewDelta, SubfolderGenerationData
+)
 from raphodo.problemnotification import (
     ScanProblems, CopyingProblems, RenamingProblems, BackingUpProblems
 )
@@ -132,10 +137,35 @@ def create_inproc_msg(cmd: bytes,
     return [cmd, worker_id, data]
 
 
+# Scan id, bytes copied in total, and bytes copied since the previous progress message
+copy_progress_layout = struct.Struct('<iqq')
+
+
+def pack_copy_progress(scan_id: int, total_downloaded: int, chunk_downloaded: int) -> bytes:
+    """
+    Copy and backup workers report their progress in a fixed binary layout, which is
+    much cheaper to create and read than pickling their results.
+
+    >>> unpack_copy_progress(pack_copy_progress(2, 5000000000, 1024))
+    (2, 5000000000, 1024)
+    """
+
+    return copy_progress_layout.pack(scan_id, total_downloaded, chunk_downloaded)
+
+
+def unpack_copy_progress(content: bytes) -> Tuple[int, int, int]:
+    """
+    :return: scan id, bytes copied in total, and bytes copied since the previous message
+    """
+
+    return copy_progress_layout.unpack(content)
+
+
 class ThreadNames:
     rename = 'rename'
     scan = 'scan'
     copy = 'copy'
+    prefetch = 'prefetch'
     backup = 'backup'
     thumbnail_daemon = 'thumbnail_daemon'
     thumbnailer = 'thumbnailer'
@@ -161,6 +191,10 @@ class ProcessManager:
         # Monitor which workers we have running
         self.workers = []  # type: List[int]
 
+        # Worker processes kept running to be reused for new jobs, by their
+        # identity. See PublishPullPipelineManager.
+        self.warm_processes = {}  # type: Dict[bytes, psutil.Process]
+
     def _get_cmd(self) -> str:
         return '{} {}'.format(
             sys.executable, os.path.join(
@@ -176,7 +210,13 @@ class ProcessManager:
 
     def add_worker(self, worker_id: int) -> None:
 
-        command_line = self._get_command_line(worker_id)
+        proc = self._start_process(self._get_command_line(worker_id))
+
+        # Add to list of running workers
+        self.workers.append(worker_id)
+        self.processes[worker_id] = proc
+
+    def _start_process(self, command_line: str) -> psutil.Popen:
         args = shlex.split(command_line)
 
         # run command immediately, without waiting a reply, and instruct the Linux
@@ -192,22 +232,23 @@ class ProcessManager:
                 )
             sys.exit(1)
         logging.debug("Started '%s' with pid %s", command_line, proc.pid)
-
-        # Add to list of running workers
-        self.workers.append(worker_id)
-        self.processes[worker_id] = proc
+        return proc
 
     def forcefully_terminate(self) -> None:
         """
         Forcefully terminate any running child processes.
         """
 
+        # A warm worker working on a job is in both
+        processes = {p.pid: p for p in self.processes.values()}
+        processes.update((p.pid, p) for p in self.warm_processes.values())
+
         zombie_processes = [
-            p for p in self.processes.values()
+            p for p in processes.values()
             if p.is_running() and p.status() == psutil.STATUS_ZOMBIE
         ]
         running_processes = [
-            p for p in self.processes.values()
+            p for p in processes.values()
             if p.is_running() and p.status() != psutil.STATUS_ZOMBIE
         ]
         if hasattr(self, '_process_name'):
@@ -288,6 +329,9 @@ class PullPipelineManager(ProcessManager, QObject):
         self.thread_controller = context.socket(zmq.PAIR)
         self.thread_controller.connect('inproc://{}'.format(self.thread_name))
 
+        # Socket for warm workers to ask for jobs, if the subclass uses them
+        self.pool_socket = None  # type: Optional[zmq.Socket]
+
         self.terminating = False
 
     @pyqtSlot()
@@ -299,15 +343,25 @@ class PullPipelineManager(ProcessManager, QObject):
         poller = zmq.Poller()
         poller.register(self.receiver_socket, zmq.POLLIN)
         poller.register(self.thread_controller, zmq.POLLIN)
+        if self.pool_socket is not None:
+            poller.register(self.pool_socket, zmq.POLLIN)
 
         self.receiverPortSignal.emit(self.receiver_port)
         self.sinkStarted.emit()
 
         while True:
+            timeout = self.sink_poll_timeout()
+            pool_timeout = self.pool_poll_timeout()
+            if pool_timeout is not None and (timeout is None or pool_timeout < timeout):
+                poll_timeout = pool_timeout
+            else:
+                poll_timeout = timeout
             try:
-                socks = dict(poller.poll())
+                socks = dict(poller.poll(poll_timeout))
             except KeyboardInterrupt:
                 break
+            if not socks and poll_timeout == timeout:
+                self.process_sink_timeout()
             if self.receiver_socket in socks:
                 # Receive messages from the workers
                 # (or the terminate socket)
@@ -326,6 +380,7 @@ class PullPipelineManager(ProcessManager, QObject):
                     # This worker is done; remove from monitored workers and
                     # continue
                     worker_id = int(worker_id)
+                    self.flush_sink_data()
                     if command == b"STOPPED":
                         logging.debug("%s worker %s has stopped", self._process_name, worker_id)
                         self.workerStopped.emit(worker_id)
@@ -339,6 +394,8 @@ class PullPipelineManager(ProcessManager, QObject):
                     if not self.workers and self.terminating:
                         logging.debug("{} is exiting".format(self._process_name))
                         break
+                elif directive == b'progress':
+                    self.process_sink_progress(content)
                 else:
                     assert directive == b'data'
                     self.content = content
@@ -348,6 +405,12 @@ class PullPipelineManager(ProcessManager, QObject):
                 # Receive messages from the main Rapid Photo Downloader thread
                 self.process_thread_directive()
 
+            if self.pool_socket in socks:
+                self.process_pool_message()
+
+            if pool_timeout is not None:
+                self.process_pool_timeout()
+
     def process_thread_directive(self) -> None:
         directive, worker_id, data = self.thread_controller.recv_multipart()
 
@@ -375,6 +438,73 @@ class PullPipelineManager(ProcessManager, QObject):
         data = pickle.loads(self.content)
         self.message.emit(data)
 
+    def process_sink_progress(self, content: bytes) -> None:
+        """
+        Handle progress reported using pack_copy_progress()
+
+        Implement in child class if needed.
+        """
+
+        logging.critical("%s received unexpected progress message", self._process_name)
+
+    def process_pool_message(self) -> None:
+        """
+        Handle a message from a warm worker
+
+        Implement in child class if needed.
+        """
+
+        pass
+
+    def pool_poll_timeout(self) -> Optional[int]:
+        """
+        :return: milliseconds after which process_pool_timeout() should be
+         called, or None if it need not be
+
+        Implement in child class if needed.
+        """
+
+        return None
+
+    def process_pool_timeout(self) -> None:
+        """
+        Called after each message is handled, and when no message was received
+        within pool_poll_timeout(), while it does not return None
+
+        Implement in child class if needed.
+        """
+
+        pass
+
+    def sink_poll_timeout(self) -> Optional[int]:
+        """
+        :return: milliseconds to wait for a message before calling
+         process_sink_timeout(), or None to wait indefinitely
+
+        Implement in child class if needed.
+        """
+
+        return None
+
+    def process_sink_timeout(self) -> None:
+        """
+        Called when no message was received within sink_poll_timeout()
+
+        Implement in child class if needed.
+        """
+
+        pass
+
+    def flush_sink_data(self) -> None:
+        """
+        Emit any data being held back, before a worker is reported as having
+        finished or stopped
+
+        Implement in child class if needed.
+        """
+
+        pass
+
     def terminate_sink(self) -> None:
         self.terminate_socket.send_multipart([b'0', b'cmd', b'KILL'])
 
@@ -443,6 +573,82 @@ class PullPipelineManager(ProcessManager, QObject):
         self.terminate_sink()
 
 
+# How often the number of load balanced workers is tuned, in seconds
+worker_tuning_interval = 2.0
+# The fewest load balanced workers tuning reduces them to
+min_tuned_workers = 2
+# Add a worker when workers were busy for more than this proportion of the
+# time, work waited for one for more than this proportion of the time, and
+# the CPUs are less busy than this percentage
+tuning_busy_to_add = 0.9
+tuning_waiting_to_add = 0.5
+tuning_cpu_percent_to_add = 85.0
+# Remove a worker when there was work for more than this proportion of the
+# time, yet workers were busy for less than this proportion of it, e.g.
+# because work arrives only as fast as a slow memory card can be read
+tuning_active_to_remove = 0.9
+tuning_busy_to_remove = 0.5
+
+
+def tuned_worker_count(workers: int,
+                       min_workers: int,
+                       max_workers: int,
+                       busy: float,
+                       waiting: float,
+                       active: float,
+                       cpu_percent: float,
+                       memory_pressure: bool) -> int:
+    """
+    Determine how many load balanced workers to run, changing the number by
+    at most one at a time.
+
+    Workers are not removed merely because there was no work, so that the
+    workers are ready when it comes.
+
+    :param workers: how many workers are running
+    :param min_workers: fewest workers to run
+    :param max_workers: most workers to run
+    :param busy: proportion of the time the workers were working
+    :param waiting: proportion of the time work waited for a worker
+    :param active: proportion of the time at least one worker was working
+    :param cpu_percent: how busy the system's CPUs were
+    :param memory_pressure: True if the system is low on memory
+    :return: how many workers to run
+
+    >>> tuned_worker_count(4, 2, 8, busy=0.95, waiting=0.6, active=1.0, cpu_percent=50,
+    ...                    memory_pressure=False)
+    5
+    >>> tuned_worker_count(4, 2, 8, busy=0.95, waiting=0.6, active=1.0, cpu_percent=95,
+    ...                    memory_pressure=False)
+    4
+    >>> tuned_worker_count(4, 2, 8, busy=0.3, waiting=0.0, active=1.0, cpu_percent=50,
+    ...                    memory_pressure=False)
+    3
+    >>> tuned_worker_count(4, 2, 8, busy=0.0, waiting=0.0, active=0.0, cpu_percent=5,
+    ...                    memory_pressure=False)
+    4
+    >>> tuned_worker_count(4, 2, 8, busy=0.1, waiting=0.0, active=0.3, cpu_percent=5,
+    ...                    memory_pressure=False)
+    4
+    >>> tuned_worker_count(4, 2, 8, busy=0.95, waiting=0.6, active=1.0, cpu_percent=50,
+    ...                    memory_pressure=True)
+    3
+    >>> tuned_worker_count(2, 2, 8, busy=0.1, waiting=0.0, active=1.0, cpu_percent=50,
+    ...                    memory_pressure=True)
+    2
+    >>> tuned_worker_count(8, 2, 8, busy=1.0, waiting=1.0, active=1.0, cpu_percent=10,
+    ...                    memory_pressure=False)
+    8
+    """
+
+    if memory_pressure or (active > tuning_active_to_remove and busy < tuning_busy_to_remove):
+        return max(min_workers, workers - 1)
+    if busy > tuning_busy_to_add and waiting > tuning_waiting_to_add and \
+            cpu_percent < tuning_cpu_percent_to_add:
+        return min(max_workers, workers + 1)
+    return workers
+
+
 class LoadBalancerWorkerManager(ProcessManager):
     def __init__(self, no_workers: int,
                  backend_port: int,
@@ -452,6 +658,10 @@ class LoadBalancerWorkerManager(ProcessManager):
         self.no_workers = no_workers
         self.backend_port = backend_port
         self.sink_port = sink_port
+        self.next_worker_id = no_workers
+        # Workers that have been stopped to reduce their number, but whose
+        # processes may not yet have exited
+        self.retired = []  # type: List[psutil.Process]
 
     def _get_command_line(self, worker_id: int) -> str:
         cmd = self._get_cmd()
@@ -474,9 +684,148 @@ class LoadBalancerWorkerManager(ProcessManager):
             if self.processes[worker_id].status() == psutil.STATUS_ZOMBIE
         ]
 
+    def add_tuned_worker(self) -> None:
+        self.add_worker(self.next_worker_id)
+        self.next_worker_id += 1
+
+    def retire_worker(self, worker_id: int) -> None:
+        """
+        Stop monitoring a worker that was stopped to reduce their number
+        """
+
+        self.workers.remove(worker_id)
+        self.retired.append(self.processes.pop(worker_id))
+
+    def reap_retired_workers(self) -> None:
+        for proc in self.retired[:]:
+            try:
+                proc.wait(timeout=0)
+            except psutil.TimeoutExpired:
+                continue
+            self.retired.remove(proc)
+
+    def rss(self) -> List[int]:
+        """
+        :return: resident memory of each worker in bytes
+        """
+
+        rss = []
+        for worker_id in self.workers:
+            try:
+                rss.append(self.processes[worker_id].memory_info().rss)
+            except psutil.Error:
+                pass
+        return rss
+
+
+class WorkerPoolMonitor:
+    """
+    Measure how much of the time load balanced workers are working, how much
+    of the time at least one of them is working, and how much of the time
+    work waits for a worker because none is free
+
+    >>> monitor = WorkerPoolMonitor(start=0.0)
+    >>> monitor.dispatched(b'w1', when=0.0)
+    >>> monitor.returned(b'w1', when=1.0)
+    >>> monitor.blocked(when=1.0)
+    >>> monitor.unblocked(when=1.5)
+    >>> monitor.sample(workers=2, when=2.0)
+    (0.25, 0.25, 0.5)
+    >>> monitor.dispatched(b'w2', when=2.0)
+    >>> monitor.sample(workers=1, when=3.0)
+    (1.0, 0.0, 1.0)
+    >>> monitor.dispatched(b'w1', when=3.5)
+    >>> monitor.returned(b'w2', when=4.0)
+    >>> monitor.returned(b'w1', when=4.0)
+    >>> monitor.sample(workers=2, when=5.0)
+    (0.375, 0.0, 0.5)
+    """
+
+    def __init__(self, start: Optional[float]=None) -> None:
+        if start is None:
+            start = time.monotonic()
+        self.interval_start = start
+        # Worker identity: when its work started, or the interval started
+        self.working = {}  # type: Dict[bytes, float]
+        self.busy_time = 0.0
+        # When at least one worker started working, or the interval started
+        self.active_since = None  # type: Optional[float]
+        self.active_time = 0.0
+        self.blocked_since = None  # type: Optional[float]
+        self.waiting_time = 0.0
+
+    def dispatched(self, identity: bytes, when: Optional[float]=None) -> None:
+        now = time.monotonic() if when is None else when
+        self.working[identity] = now
+        if self.active_since is None:
+            self.active_since = now
+
+    def returned(self, identity: bytes, when: Optional[float]=None) -> None:
+        started = self.working.pop(identity, None)
+        if started is not None:
+            now = time.monotonic() if when is None else when
+            self.busy_time += now - started
+            if not self.working:
+                self.active_time += now - self.active_since
+                self.active_since = None
+
+    def blocked(self, when: Optional[float]=None) -> None:
+        """
+        No worker is free to take more work
+        """
+
+        if self.blocked_since is None:
+            self.blocked_since = time.monotonic() if when is None else when
+
+    def unblocked(self, when: Optional[float]=None) -> None:
+        if self.blocked_since is not None:
+            self.waiting_time += (time.monotonic() if when is None else when) - \
+                                 self.blocked_since
+            self.blocked_since = None
+
+    def sample(self, workers: int, when: Optional[float]=None) -> Tuple[float, float, float]:
+        """
+        Start a new interval
+
+        :param workers: how many workers there were during the interval
+        :return: proportion of the interval the workers were working,
+         proportion of it in which no worker was free, and proportion of it
+         in which at least one worker was working
+        """
+
+        now = time.monotonic() if when is None else when
+        elapsed = now - self.interval_start
+        busy_time = self.busy_time + sum(now - started for started in self.working.values())
+        waiting_time = self.waiting_time
+        if self.blocked_since is not None:
+            waiting_time += now - self.blocked_since
+            self.blocked_since = now
+        active_time = self.active_time
+        if self.active_since is not None:
+            active_time += now - self.active_since
+            self.active_since = now
+        for identity in self.working:
+            self.working[identity] = now
+        self.busy_time = self.waiting_time = self.active_time = 0.0
+        self.interval_start = now
+        if elapsed <= 0 or not workers:
+            return 0.0, 0.0, 0.0
+        return (
+            min(1.0, busy_time / (elapsed * workers)), min(1.0, waiting_time / elapsed),
+            min(1.0, active_time / elapsed)
+        )
+
 
 class LRUQueue:
-    """LRUQueue class using ZMQStream/IOLoop for event dispatching"""
+    """
+    LRUQueue class using ZMQStream/IOLoop for event dispatching
+
+    The number of workers is tuned as they work, between min_tuned_workers
+    and the number the load balancer was started with: reduced when they are
+    often idle even though there is work, or the system is low on memory, and
+    increased again when work waits for them and the CPUs have capacity to
+    spare.
+    """
 
     def __init__(self, backend_socket: zmq.Socket,
                  frontend_socket: zmq.Socket,
@@ -490,6 +839,14 @@ class LRUQueue:
         self.terminating = False
         self.terminating_workers = set()  # type: Set[bytes]
         self.stopped_workers = set()  # type: Set[int]
+        # Workers being stopped to reduce their number
+        self.retiring_workers = set()  # type: Set[bytes]
+
+        self.max_workers = process_manager.no_workers
+        self.min_workers = min(min_tuned_workers, self.max_workers)
+        self.monitor = WorkerPoolMonitor()
+        # Start measuring CPU usage
+        psutil.cpu_percent()
 
         self.backend = ZMQStream(backend_socket)
         self.frontend = ZMQStream(frontend_socket)
@@ -498,6 +855,60 @@ class LRUQueue:
         self.controller.on_recv(self.handle_controller)
 
         self.loop = ioloop.IOLoop.instance()
+        self.loop.add_timeout(time.time() + worker_tuning_interval, self.tune_workers)
+
+    def tune_workers(self) -> None:
+        """
+        Add or remove a worker, depending on how busy the workers and the
+        system are
+        """
+
+        if self.terminating:
+            return
+
+        self.process_manager.reap_retired_workers()
+        workers = len(self.process_manager.workers) - len(self.retiring_workers)
+        busy, waiting, active = self.monitor.sample(workers)
+        cpu_percent = psutil.cpu_percent()
+        rss = self.process_manager.rss()
+        memory = psutil.virtual_memory()
+        # Keep enough memory available for two more workers, and a tenth of memory
+        reserve = max(2 * max(rss, default=0), memory.total // 10)
+        memory_pressure = memory.available < reserve
+
+        target = tuned_worker_count(
+            workers=workers, min_workers=self.min_workers,
+            max_workers=self.max_workers, busy=busy, waiting=waiting, active=active,
+            cpu_percent=cpu_percent, memory_pressure=memory_pressure
+        )
+        change = target - workers
+        if change:
+            logging.info(
+                "%s workers: %s -> %s (busy %.0f%%, waiting %.0f%%, active %.0f%%, CPU %.0f%%, "
+                "workers using %s MiB, %s MiB available)", self.worker_type, workers, target,
+                busy * 100, waiting * 100, active * 100, cpu_percent, sum(rss) // 1024 ** 2,
+                memory.available // 1024 ** 2
+            )
+        if change > 0:
+            self.process_manager.add_tuned_worker()
+        elif change < 0 and self.workers:
+            # Stop the worker idle the longest
+            worker_identity = self.workers.popleft()
+            self.backend.send_multipart([worker_identity, b'', b'cmd', b'STOP'])
+            self.retiring_workers.add(worker_identity)
+            if not self.workers:
+                self.stop_receiving()
+
+        self.loop.add_timeout(time.time() + worker_tuning_interval, self.tune_workers)
+
+    def stop_receiving(self) -> None:
+        # stop receiving until workers become available again
+        self.frontend.stop_on_recv()
+        self.monitor.blocked()
+
+    def start_receiving(self) -> None:
+        self.frontend.on_recv(self.handle_frontend)
+        self.monitor.unblocked()
 
     def handle_controller(self, msg):
         self.terminating = True
@@ -518,6 +929,16 @@ class LRUQueue:
         # Queue worker address for LRU routing
         worker_identity, empty, client_addr = msg[:3]
 
+        # Second frame is empty
+        assert empty == b''
+
+        self.monitor.returned(worker_identity)
+
+        if msg[-1] == b'STOPPED' and worker_identity in self.retiring_workers:
+            self.retiring_workers.remove(worker_identity)
+            self.process_manager.retire_worker(get_worker_id_from_identity(worker_identity))
+            return
+
         # add worker back to the list of workers
         self.workers.append(worker_identity)
 
@@ -525,9 +946,6 @@ class LRUQueue:
         if zw:
             logging.critical("%s dead thumbnail extractors", len(zw))
 
-        # Second frame is empty
-        assert empty == b''
-
         if msg[-1] == b'STOPPED' and self.terminating:
             worker_id = get_worker_id_from_identity(worker_identity)
             self.stopped_workers.add(worker_id)
@@ -549,7 +967,7 @@ class LRUQueue:
 
         if len(self.workers) == 1:
             # on first recv, start accepting frontend messages
-            self.frontend.on_recv(self.handle_frontend)
+            self.start_receiving()
 
     def handle_frontend(self, request):
         #  Dequeue and drop the next worker address
@@ -557,9 +975,9 @@ class LRUQueue:
 
         message = [worker_identity, b''] + request
         self.backend.send_multipart(message)
+        self.monitor.dispatched(worker_identity)
         if len(self.workers) == 0:
-            # stop receiving until workers become available again
-            self.frontend.stop_on_recv()
+            self.stop_receiving()
 
 
 class LoadBalancer:
@@ -675,6 +1093,9 @@ class LoadBalancerManager(ProcessManager, QObject):
 
 DAEMON_WORKER_ID = 0
 
+# Minimum time in seconds between a daemon's publication of its metrics as it sends results
+DAEMON_METRICS_INTERVAL = 60.0
+
 
 class PushPullDaemonManager(PullPipelineManager):
     """
@@ -744,8 +1165,23 @@ class PublishPullPipelineManager(PullPipelineManager):
 
     Because there are multiple worker process, a Publish-Subscribe model is
     most suitable for sending data to workers.
+
+    If _warm_workers is set, worker processes are started before they are
+    needed, and kept running after their job to be reused for new jobs, so a
+    job does not wait for a process to start and import its modules. Each
+    warm worker asks for a job using a REQ socket connected to the pool
+    socket, and is replied to with the id of the job's worker, which it uses
+    from then on as if it had been started for that job. See run_worker().
+    A job for which no warm worker is idle waits in a queue, and is assigned
+    when a worker reports it is ready, so the sink never blocks waiting for
+    one. Workers that finish their job are kept for the next, so as many
+    workers as ever worked at once, plus _warm_workers, can be idle.
     """
 
+    # How many idle worker processes to keep ready for new jobs. If zero, a
+    # process is started for each job.
+    _warm_workers = 0
+
     def _start_sockets(self) -> None:
 
         super()._start_sockets()
@@ -764,6 +1200,27 @@ class PublishPullPipelineManager(PullPipelineManager):
         self.controller_socket = context.socket(zmq.PUB)
         self.controller_port = self.controller_socket.bind_to_random_port("tcp://*")
 
+        if self._warm_workers:
+            self.pool_socket = context.socket(zmq.ROUTER)
+            # Raise an error when replying to a worker that is no longer running
+            self.pool_socket.setsockopt(zmq.ROUTER_MANDATORY, 1)
+            self.pool_port = self.pool_socket.bind_to_random_port("tcp://*")
+            self.idle_workers = deque()  # type: deque
+            self.busy_workers = set()  # type: Set[bytes]
+            # Jobs waiting for a warm worker to be ready: (worker id, data, and
+            # any messages sent to the worker while it waits)
+            self.pending_jobs = deque()  # type: deque
+            # When to next check for warm workers that stopped while jobs are waiting
+            self.warm_workers_check = 0.0
+            # How many times in a row a warm worker stopped before it could be
+            # assigned a job
+            self.warm_worker_failures = 0
+            # Set when warm workers fail to start, after which a process is
+            # started for each job
+            self.warm_workers_failed = False
+            self.add_warm_workers()
+        self.paused = False
+
     def stop(self) -> None:
         """
         Permanently stop all the workers and terminate
@@ -771,6 +1228,14 @@ class PublishPullPipelineManager(PullPipelineManager):
 
         logging.debug("{} halting".format(self._process_name))
         self.terminating = True
+        if self.pool_socket is not None:
+            if self.pending_jobs:
+                logging.debug(
+                    "%s discarding %s jobs waiting for a worker", self._process_name,
+                    len(self.pending_jobs)
+                )
+                self.pending_jobs.clear()
+            self.terminate_warm_workers()
         if self.workers:
             # Signal workers they must immediately stop
             termination_signal_sent = False
@@ -800,10 +1265,37 @@ class PublishPullPipelineManager(PullPipelineManager):
             self.controller_socket.send_multipart(message)
             message = [worker_id, b'cmd', b'STOP']
             self.ventilator_socket.send_multipart(message)
+        elif self.pool_socket is not None:
+            for job in self.pending_jobs:
+                if job[0] == worker_id:
+                    # The job never started, so it is stopped by not starting it
+                    self.pending_jobs.remove(job)
+                    logging.debug(
+                        "%s worker %s stopped before being assigned a process",
+                        self._process_name, int(worker_id)
+                    )
+                    self.workerStopped.emit(int(worker_id))
+                    break
 
     def start_worker(self, worker_id: bytes, data: bytes) -> None:
 
-        self.add_worker(int(worker_id))
+        if self._warm_workers and not self.warm_workers_failed:
+            self.pending_jobs.append((worker_id, data, []))
+            self.assign_pending_jobs()
+        else:
+            self.add_worker(int(worker_id))
+            self.start_job(worker_id=worker_id, data=data)
+
+    def start_job(self, worker_id: bytes,
+                  data: bytes,
+                  messages: Optional[List[bytes]]=None) -> None:
+        """
+        Synchronize with the job's worker, and send it the data to work on
+
+        :param worker_id: the id of the job's worker, which must be running
+        :param data: what the worker is to work on
+        :param messages: data sent to the worker while the job waited for it
+        """
 
         # Send START commands until scan worker indicates it is ready to
         # receive data
@@ -824,20 +1316,191 @@ class PublishPullPipelineManager(PullPipelineManager):
 
         # Send data to process to tell it what to work on
         self.send_message_to_worker(data=data, worker_id=worker_id)
+        for message in messages or []:
+            self.send_message_to_worker(data=message, worker_id=worker_id)
+
+        if self.paused:
+            self.controller_socket.send_multipart(
+                [make_filter_from_worker_id(int(worker_id)), b'PAUSE']
+            )
+
+    def send_message_to_worker(self, data: bytes, worker_id: Optional[bytes]=None) -> None:
+        if worker_id and self.pool_socket is not None and not self.terminating:
+            for job in self.pending_jobs:
+                if job[0] == worker_id:
+                    # Sent once the job is assigned a worker
+                    job[2].append(data)
+                    return
+        super().send_message_to_worker(data=data, worker_id=worker_id)
+
+    def _get_command_line(self, worker_id: Optional[int]) -> str:
+        """
+        :param worker_id: the worker's id, or None for a warm worker, which is
+         told its id when it is assigned a job
+        """
 
-    def _get_command_line(self, worker_id: int) -> str:
         cmd = self._get_cmd()
 
-        return '{} --receive {} --send {} --controller {} --syncclient {} --filter {} --logging '\
-               '{}'.format(
+        command_line = '{} --receive {} --send {} --controller {} --syncclient {} --logging '\
+                       '{}'.format(
             cmd,
             self.ventilator_port,
             self.receiver_port,
             self.controller_port,
             self.sync_service_port,
-            worker_id,
             self.logging_port
         )
+        if worker_id is None:
+            return '{} --pool {}'.format(command_line, self.pool_port)
+        return '{} --filter {}'.format(command_line, worker_id)
+
+    def add_warm_workers(self) -> None:
+        """
+        Start warm workers until there are enough idle or starting for the jobs
+        waiting for a worker, plus _warm_workers
+        """
+
+        wanted = self._warm_workers + len(self.pending_jobs)
+        while len(self.warm_processes) - len(self.busy_workers) < wanted:
+            proc = self._start_process(self._get_command_line(None))
+            self.warm_processes[str(proc.pid).encode()] = proc
+
+    def remove_stopped_warm_workers(self) -> int:
+        """
+        :return: how many warm workers are no longer running
+        """
+
+        stopped = 0
+        for identity, proc in list(self.warm_processes.items()):
+            try:
+                running = proc.is_running() and proc.status() != psutil.STATUS_ZOMBIE
+            except psutil.NoSuchProcess:
+                running = False
+            if not running:
+                logging.debug(
+                    "%s warm worker with pid %s is no longer running", self._process_name,
+                    proc.pid
+                )
+                del self.warm_processes[identity]
+                self.busy_workers.discard(identity)
+                stopped += 1
+        return stopped
+
+    def terminate_warm_workers(self) -> None:
+        """
+        Terminate the warm workers that are not working on a job, whether
+        idle or still starting. Those working on a job exit once it is
+        stopped.
+        """
+
+        self.idle_workers.clear()
+        processes = []
+        for identity, proc in list(self.warm_processes.items()):
+            if identity not in self.busy_workers:
+                del self.warm_processes[identity]
+                try:
+                    proc.terminate()
+                except psutil.NoSuchProcess:
+                    continue
+                processes.append(proc)
+        if processes:
+            logging.debug(
+                "%s terminating %s warm workers", self._process_name, len(processes)
+            )
+            psutil.wait_procs(processes, timeout=1)
+
+    def send_to_warm_worker(self, identity: bytes, message: bytes) -> bool:
+        """
+        :return: True if the message was sent, else False if the worker is
+         no longer running
+        """
+
+        try:
+            self.pool_socket.send_multipart([identity, b'', message])
+        except zmq.ZMQError:
+            self.warm_processes.pop(identity, None)
+            self.busy_workers.discard(identity)
+            return False
+        return True
+
+    def process_pool_message(self) -> None:
+        identity, empty, message = self.pool_socket.recv_multipart()
+        self.busy_workers.discard(identity)
+        if message == b'READY':
+            if self.terminating:
+                self.send_to_warm_worker(identity, b'EXIT')
+            else:
+                self.idle_workers.append(identity)
+                if self.pending_jobs:
+                    self.assign_pending_jobs()
+        else:
+            assert message == b'EXITING'
+            # The worker is being recycled
+            self.warm_processes.pop(identity, None)
+            if not self.terminating:
+                self.add_warm_workers()
+
+    def assign_pending_jobs(self) -> None:
+        """
+        Assign the jobs waiting for a worker to idle warm workers, and start
+        warm workers for those jobs still waiting
+        """
+
+        while self.pending_jobs and self.idle_workers:
+            identity = self.idle_workers.popleft()
+            worker_id, data, messages = self.pending_jobs[0]
+            if (identity not in self.warm_processes or
+                    not self.send_to_warm_worker(identity, worker_id)):
+                self.warm_worker_failures += 1
+                continue
+            self.pending_jobs.popleft()
+            self.warm_worker_failures = 0
+            self.busy_workers.add(identity)
+            self.workers.append(int(worker_id))
+            self.processes[int(worker_id)] = self.warm_processes[identity]
+            self.start_job(worker_id=worker_id, data=data, messages=messages)
+
+        if self.warm_worker_failures >= warm_worker_max_failures:
+            self.abandon_warm_workers()
+            return
+
+        # Have another warm worker ready for the next job
+        self.add_warm_workers()
+
+    def abandon_warm_workers(self) -> None:
+        """
+        Start a process for each job, including those waiting for a worker,
+        because warm workers repeatedly stopped before being assigned a job
+        """
+
+        logging.error(
+            "%s warm workers stopped %s times before being assigned a job. Starting a "
+            "process for each job instead.", self._process_name, self.warm_worker_failures
+        )
+        self.warm_workers_failed = True
+        while self.pending_jobs:
+            worker_id, data, messages = self.pending_jobs.popleft()
+            self.add_worker(int(worker_id))
+            self.start_job(worker_id=worker_id, data=data, messages=messages)
+
+    def pool_poll_timeout(self) -> Optional[int]:
+        if self.pool_socket is None or not self.pending_jobs:
+            return None
+        remaining = self.warm_workers_check - time.monotonic()
+        return max(0, int(remaining * 1000) + 1)
+
+    def process_pool_timeout(self) -> None:
+        """
+        While jobs are waiting for a worker, periodically check for warm
+        workers that stopped before they were ready
+        """
+
+        now = time.monotonic()
+        if not self.pending_jobs or now < self.warm_workers_check:
+            return
+        self.warm_workers_check = now + warm_worker_check_interval
+        self.warm_worker_failures += self.remove_stopped_warm_workers()
+        self.assign_pending_jobs()
 
     def __len__(self) -> int:
         return len(self.workers)
@@ -846,6 +1509,8 @@ class PublishPullPipelineManager(PullPipelineManager):
         return item in self.workers
 
     def pause(self) -> None:
+        # Jobs yet to start are paused once they start
+        self.paused = True
         for worker_id in self.workers:
             message = [make_filter_from_worker_id(worker_id), b'PAUSE']
             self.controller_socket.send_multipart(message)
@@ -854,6 +1519,7 @@ class PublishPullPipelineManager(PullPipelineManager):
         if worker_id:
             workers = [int(worker_id)]
         else:
+            self.paused = False
             workers = self.workers
         for worker_id in workers:
             message = [make_filter_from_worker_id(worker_id), b'RESUME']
@@ -891,9 +1557,132 @@ class ProcessLoggerPublisher:
         self.logger_socket.close()
 
 
+# A warm worker process is recycled after this many jobs, or after a job that
+# leaves it using more than this many bytes of memory
+warm_worker_max_jobs = 20
+warm_worker_max_rss = 512 * 1024 ** 2
+# How many times warm workers can stop before being assigned a job before
+# their manager falls back to starting a process for each job
+warm_worker_max_failures = 5
+# Seconds between checks for warm workers that stopped while jobs wait for a worker
+warm_worker_check_interval = 0.1
+# How often an idle warm worker checks its manager's process is still
+# running, in milliseconds
+warm_worker_poll_interval = 1000
+
+# When a warm worker in this process was assigned its job
+warm_worker_job_assigned = None  # type: Optional[float]
+
+
+class WorkerStopped(SystemExit):
+    """
+    Exit a worker that was stopped before it finished its work
+    """
+
+    pass
+
+
+def run_worker_job(worker_class: type) -> bool:
+    """
+    Run one job in a warm worker process, using the command line arguments
+    in sys.argv
+
+    :param worker_class: the WorkerInPublishPullPipeline subclass to run
+    :return: True if the job finished and the process can be reused, else
+     False
+    """
+
+    # Create the worker before initializing it, to be able to release what it
+    # left open however its job ended
+    worker = worker_class.__new__(worker_class)
+    try:
+        worker.__init__()
+        finished = True
+    except WorkerStopped:
+        finished = False
+    except SystemExit as e:
+        finished = e.code in (None, 0)
+    finally:
+        logger_publisher = getattr(worker, 'logger_publisher', None)
+        if logger_publisher is not None and \
+                logger_publisher.handler in logging.getLogger().handlers:
+            logger_publisher.close()
+        context = getattr(worker, 'context', None)
+        if context is not None:
+            # Allow time for the last messages to the sink to be sent
+            context.destroy(linger=1000)
+    return finished
+
+
+def run_worker(worker_class: type) -> None:
+    """
+    Run a worker in a publish pull pipeline.
+
+    If the process was started as a warm worker, ask the manager for jobs and
+    run a new instance of the worker for each, so that the modules the worker
+    uses are imported only once. The process exits instead of asking for
+    another job if a job was stopped or did not exit cleanly, or it has run
+    warm_worker_max_jobs jobs, or it uses more than warm_worker_max_rss bytes
+    of memory.
+
+    :param worker_class: the WorkerInPublishPullPipeline subclass to run
+    """
+
+    global warm_worker_job_assigned
+
+    if '--pool' not in sys.argv:
+        worker_class()
+        return
+
+    index = sys.argv.index('--pool')
+    pool_port = sys.argv[index + 1]
+    argv = sys.argv[:index] + sys.argv[index + 2:]
+
+    context = zmq.Context()
+    pool = context.socket(zmq.REQ)
+    pool.identity = str(os.getpid()).encode()
+    pool.connect("tcp://localhost:{}".format(pool_port))
+    process = psutil.Process()
+    parent_pid = os.getppid()
+
+    jobs = 0
+    reuse = True
+    while reuse:
+        pool.send(b'READY')
+        worker_id = None
+        while worker_id is None:
+            if pool.poll(warm_worker_poll_interval):
+                worker_id = pool.recv()
+            elif os.getppid() != parent_pid:
+                # The manager's process is no longer running, so no job will come
+                worker_id = b'EXIT'
+        if worker_id == b'EXIT':
+            break
+        warm_worker_job_assigned = time.time()
+        sys.argv = argv + ['--filter', worker_id.decode()]
+        reuse = run_worker_job(worker_class)
+        jobs += 1
+        reuse = reuse and jobs < warm_worker_max_jobs and \
+                process.memory_info().rss < warm_worker_max_rss
+    else:
+        # Tell the manager this process is exiting, so it can start another
+        pool.send(b'EXITING')
+
+    pool.close(linger=0 if os.getppid() != parent_pid else 1000)
+    context.term()
+
+
 class WorkerProcess():
     def __init__(self, worker_type: str) -> None:
         super().__init__()
+        self.worker_type = worker_type
+        # Timings and other measurements of the work this process does
+        self.metrics = metrics.PipelineMetrics()
+        if warm_worker_job_assigned is None:
+            startup = metrics.process_startup_seconds()
+        else:
+            startup = time.time() - warm_worker_job_assigned
+        self.metrics.record_latency('process startup', startup)
         self.parser = argparse.ArgumentParser()
         self.parser.add_argument("--receive", required=True)
         self.parser.add_argument("--send", required=True)
@@ -923,10 +1712,25 @@ class WorkerProcess():
             context=self.context, name=name, notification_port=notification_port
         )
 
+    def publish_metrics(self) -> None:
+        """
+        Send the metrics recorded so far to the main process, via the logging
+        channel
+        """
+
+        metrics.publish_metrics(self.metrics, self.worker_type)
+
     def send_message_to_sink(self) -> None:
 
         self.sender.send_multipart([self.worker_id, b'data', self.content])
 
+    def send_progress_to_sink(self, content: bytes) -> None:
+        """
+        :param content: progress packed using pack_copy_progress()
+        """
+
+        self.sender.send_multipart([self.worker_id, b'progress', content])
+
     def initialise_process(self) -> None:
         # Wait to receive "START" message
         worker_id, directive, content = self.receiver.recv_multipart()
@@ -973,6 +1777,8 @@ class DaemonProcess(WorkerProcess):
         self.receiver.connect("tcp://localhost:{}".format(args.receive))
 
         self.worker_id = None
+        # Time the metrics were last published, if ever
+        self.metrics_published = None  # type: Optional[float]
 
         self.setup_logging_pub(notification_port=args.logging, name=worker_type)
 
@@ -995,6 +1801,15 @@ class DaemonProcess(WorkerProcess):
         self.sender.send_multipart(
             [make_filter_from_worker_id(DAEMON_WORKER_ID), b'data', self.content]
         )
+        # A daemon runs until the program exits, so publish what it has
+        # recorded as it goes, but not for every result it sends
+        if self.metrics_published is None or \
+                time.time() - self.metrics_published >= DAEMON_METRICS_INTERVAL:
+            self.publish_metrics()
+
+    def publish_metrics(self) -> None:
+        self.metrics_published = time.time()
+        super().publish_metrics()
 
 
 class WorkerInPublishPullPipeline(WorkerProcess):
@@ -1053,7 +1868,7 @@ class WorkerInPublishPullPipeline(WorkerProcess):
                 self.disconnect_logging()
                 # signal to sink that we've terminated before finishing
                 self.sender.send_multipart([self.worker_id, b'cmd', b'STOPPED'])
-                sys.exit(0)
+                raise WorkerStopped()
 
     def check_for_controller_directive(self) -> None:
         try:
@@ -1072,7 +1887,7 @@ class WorkerInPublishPullPipeline(WorkerProcess):
                 self.cleanup_pre_stop()
                 # before finishing, signal to sink that we've terminated
                 self.sender.send_multipart([self.worker_id, b'cmd', b'STOPPED'])
-                sys.exit(0)
+                raise WorkerStopped()
         except zmq.Again:
             pass # Continue working
 
@@ -1084,9 +1899,10 @@ class WorkerInPublishPullPipeline(WorkerProcess):
             self.disconnect_logging()
             # before finishing, signal to sink that we've terminated
             self.sender.send_multipart([self.worker_id, b'cmd', b'STOPPED'])
-            sys.exit(0)
+            raise WorkerStopped()
 
     def disconnect_logging(self) -> None:
+        self.publish_metrics()
         self.logger_publisher.close()
 
     def send_finished_command(self) -> None:
@@ -1096,6 +1912,9 @@ class WorkerInPublishPullPipeline(WorkerProcess):
 class LoadBalancerWorker:
     def __init__(self, worker_type: str) -> None:
         super().__init__()
+        self.worker_type = worker_type
+        self.metrics = metrics.PipelineMetrics()
+        self.metrics.record_latency('process startup', metrics.process_startup_seconds())
         self.parser = argparse.ArgumentParser()
         self.parser.add_argument("--request", required=True)
         self.parser.add_argument("--send", required=True)
@@ -1144,6 +1963,7 @@ class LoadBalancerWorker:
         self.requester.send_multipart([b'', b'', b'STOPPED'])
         self.requester.close()
         self.sender.close()
+        metrics.publish_metrics(self.metrics, self.worker_type)
         self.logger_publisher.close()
         self.context.term()
         logging.debug("%s with pid %s stopped", identity, os.getpid())
@@ -1192,6 +2012,7 @@ class ProcessLoggingManager(QObject):
                 message = self.receiver.recv()
                 record = logging.makeLogRecord(pickle.loads(message))
                 logger.handle(record)
+                metrics.aggregator.handle_record(record)
 
             if info_socket in socks:
                 directive, content = info_socket.recv_multipart()
@@ -1341,9 +2162,10 @@ class CopyFilesResults:
         :param video_temp_dir: temp directory path, used to copy
          videos into until they're renamed
         :param total_downloaded: how many bytes in total have been
-         downloaded
+         downloaded, sent along with the file that was copied if
+         the progress has not already been reported
         :param chunk_downloaded: how many bytes were downloaded since
-         the last message
+         the last progress report
         :param copy_succeeded: whether the copy was successful or not
         :param rpd_file: details of the file that was copied
         :param download_count: a running count of how many files
@@ -1369,6 +2191,56 @@ class CopyFilesResults:
         self.camera_removed = camera_removed
 
 
+class PrefetchArguments:
+    """
+    Pass arguments to the prefetch process
+    """
+
+    def __init__(self, scan_id: int,
+                 device: Device,
+                 files: List[RPDFile],
+                 cache_dirs: CacheDirs,
+                 log_gphoto2: bool) -> None:
+        """
+        :param scan_id: scan id of the camera to prefetch files from
+        :param device: the camera. If it has cache directories, the files
+         are saved in them.
+        :param files: the files to prefetch
+        :param cache_dirs: where to create the cache directories if the
+         camera does not already have them
+        :param log_gphoto2: if True, log libgphoto2 logging messages
+        """
+
+        self.scan_id = scan_id
+        self.device = device
+        self.files = files
+        self.cache_dirs = cache_dirs
+        self.log_gphoto2 = log_gphoto2
+
+
+class PrefetchResults:
+    """
+    Receive results from the prefetch process
+    """
+
+    def __init__(self, scan_id: int,
+                 uid: Optional[bytes]=None,
+                 cache_full_file_name: Optional[str]=None,
+                 cache_dirs: Optional[CacheDirs]=None) -> None:
+        """
+        :param scan_id: scan id of the camera the files are being
+         prefetched from
+        :param uid: uid of the file that was saved in the Download Cache
+        :param cache_full_file_name: where the file was saved
+        :param cache_dirs: the cache directories the process created
+        """
+
+        self.scan_id = scan_id
+        self.uid = uid
+        self.cache_full_file_name = cache_full_file_name
+        self.cache_dirs = cache_dirs
+
+
 class ThumbnailDaemonData:
     """
     Pass arguments to the thumbnail daemon process.
@@ -1426,21 +2298,17 @@ class RenameAndMoveFileResults:
 class OffloadData:
     def __init__(self, thumbnail_rows: Optional[Sequence[ThumbnailDataForProximity]]=None,
                  proximity_seconds: int=None,
-                 rpd_files: Optional[Sequence[RPDFile]]=None,
-                 strip_characters: Optional[bool]=None,
-                 folders_preview: Optional[FoldersPreview]=None) -> None:
+                 subfolder_generation: Optional[SubfolderGenerationData]=None) -> None:
         self.thumbnail_rows = thumbnail_rows
         self.proximity_seconds = proximity_seconds
-        self.rpd_files = rpd_files
-        self.strip_characters = strip_characters
-        self.folders_preview = folders_preview
+        self.subfolder_generation = subfolder_generation
 
 
 class OffloadResults:
     def __init__(self, proximity_groups: Optional[TemporalProximityGroups]=None,
-                 folders_preview: Optional[FoldersPreview]=None) -> None:
+                 folders_preview_delta: Optional[FoldersPreviewDelta]=None) -> None:
         self.proximity_groups = proximity_groups
-        self.folders_preview = folders_preview
+        self.folders_preview_delta = folders_preview_delta
 
 
 class BackupArguments:
@@ -1665,7 +2533,7 @@ class OffloadManager(PushPullDaemonManager):
     """
 
     message = pyqtSignal(TemporalProximityGroups)
-    downloadFolders = pyqtSignal(FoldersPreview)
+    downloadFolders = pyqtSignal(FoldersPreviewDelta)
 
     def __init__(self, logging_port: int) -> None:
         super().__init__(logging_port=logging_port, thread_name=ThreadNames.offload)
@@ -1676,17 +2544,99 @@ class OffloadManager(PushPullDaemonManager):
         data = pickle.loads(self.content)  # type: OffloadResults
         if data.proximity_groups is not None:
             self.message.emit(data.proximity_groups)
-        elif data.folders_preview is not None:
-            self.downloadFolders.emit(data.folders_preview)
+        elif data.folders_preview_delta is not None:
+            self.downloadFolders.emit(data.folders_preview_delta)
+
+
+# Most often the main window is sent scanned files, in seconds
+scan_results_update_interval = 0.2
+
+
+class ScanResultsBuffer:
+    """
+    Coalesces the scanned files sent by the scan processes, so that the main
+    window is sent them in a few large batches a second, rather than as often
+    as a fast device is scanned. The thumbnail rows for the files are created
+    here too, outside the main thread.
+
+    >>> from types import SimpleNamespace
+    >>> from raphodo.constants import FileType
+    >>> def scanned(uid: int, counter: int, sample: Optional[str]=None) -> ScanResults:
+    ...     rpd_file = SimpleNamespace(
+    ...         uid=uid, scan_id=1, modification_time=0.0, name='', extension='jpg',
+    ...         file_type=FileType.photo, previously_downloaded=False)
+    ...     return ScanResults(
+    ...         rpd_files=[rpd_file], file_type_counter=counter, file_size_sum=counter,
+    ...         sample_photo=sample, entire_video_required=False, entire_photo_required=False)
+    >>> b = ScanResultsBuffer()
+    >>> b.add(scanned(1, 1, 'sample'))
+    >>> b.add(scanned(2, 2))
+    >>> len(b)
+    1
+    >>> data, thumbnail_rows = b.pop()[0]
+    >>> [rpd_file.uid for rpd_file in data.rpd_files], [tr.uid for tr in thumbnail_rows]
+    ([1, 2], [1, 2])
+    >>> data.file_type_counter, data.sample_photo
+    (2, 'sample')
+    >>> len(b)
+    0
+    """
+
+    def __init__(self) -> None:
+        self.results = {}  # type: Dict[int, ScanResults]
+        self.thumbnail_rows = {}  # type: Dict[int, List[ThumbnailRow]]
+
+    def __len__(self) -> int:
+        return len(self.results)
+
+    def add(self, data: ScanResults) -> None:
+        scan_id = data.rpd_files[0].scan_id
+        thumbnail_rows = [thumbnail_row(rpd_file) for rpd_file in data.rpd_files]
+        pending = self.results.get(scan_id)
+        if pending is None:
+            self.results[scan_id] = data
+            self.thumbnail_rows[scan_id] = thumbnail_rows
+            return
+
+        pending.rpd_files.extend(data.rpd_files)
+        self.thumbnail_rows[scan_id].extend(thumbnail_rows)
+        # The counters are running totals, so the latest supersede the rest
+        pending.file_type_counter = data.file_type_counter
+        pending.file_size_sum = data.file_size_sum
+        pending.entire_video_required = data.entire_video_required
+        pending.entire_photo_required = data.entire_photo_required
+        if data.sample_photo is not None:
+            pending.sample_photo = data.sample_photo
+        if data.sample_video is not None:
+            pending.sample_video = data.sample_video
+
+    def pop(self) -> List[Tuple[ScanResults, List[ThumbnailRow]]]:
+        """
+        :return: the coalesced results of each device, and their thumbnail
+         rows, emptying the buffer
+        """
+
+        results = [
+            (data, self.thumbnail_rows[scan_id]) for scan_id, data in self.results.items()
+        ]
+        self.results = {}
+        self.thumbnail_rows = {}
+        return results
 
 
 class ScanManager(PublishPullPipelineManager):
     """
     Handles the processes that scan devices (cameras, external devices,
     this computer path)
+
+    Scanned files are coalesced and sent to the main window at most every
+    scan_results_update_interval seconds, so a fast device being scanned
+    does not flood its event loop. Any other message from a scan process
+    is sent only after the scanned files that preceded it.
     """
     scannedFiles = pyqtSignal(
-        'PyQt_PyObject', 'PyQt_PyObject', FileTypeCounter, 'PyQt_PyObject', bool, bool
+        'PyQt_PyObject', 'PyQt_PyObject', 'PyQt_PyObject', FileTypeCounter, 'PyQt_PyObject',
+        bool, bool
     )
     deviceError = pyqtSignal(int, CameraErrorCode)
     deviceDetails = pyqtSignal(int, 'PyQt_PyObject', 'PyQt_PyObject', str)
@@ -1697,25 +2647,48 @@ class ScanManager(PublishPullPipelineManager):
     def __init__(self, logging_port: int) -> None:
         super().__init__(logging_port=logging_port, thread_name=ThreadNames.scan)
         self._process_name = 'Scan Manager'
+        self._warm_workers = 1
         self._process_to_run = 'scan.py'
+        self.scan_results = ScanResultsBuffer()
+        self.scan_results_emitted = 0.0
 
-    def process_sink_data(self) -> None:
-        data = pickle.loads(self.content)  # type: ScanResults
-        if data.rpd_files is not None:
-            assert data.file_type_counter
-            assert data.file_size_sum
-            assert data.entire_video_required is not None
-            assert  data.entire_photo_required is not None
+    def sink_poll_timeout(self) -> Optional[int]:
+        if not self.scan_results:
+            return None
+        remaining = self.scan_results_emitted + scan_results_update_interval - time.monotonic()
+        return max(0, int(remaining * 1000) + 1)
+
+    def process_sink_timeout(self) -> None:
+        self.flush_sink_data()
+
+    def flush_sink_data(self) -> None:
+        if not self.scan_results:
+            return
+        for data, thumbnail_rows in self.scan_results.pop():
             self.scannedFiles.emit(
                 data.rpd_files,
+                thumbnail_rows,
                 (data.sample_photo, data.sample_video),
                 data.file_type_counter,
                 data.file_size_sum,
                 data.entire_video_required,
                 data.entire_photo_required
             )
+        self.scan_results_emitted = time.monotonic()
+
+    def process_sink_data(self) -> None:
+        data = pickle.loads(self.content)  # type: ScanResults
+        if data.rpd_files is not None:
+            assert data.file_type_counter
+            assert data.file_size_sum
+            assert data.entire_video_required is not None
+            assert  data.entire_photo_required is not None
+            self.scan_results.add(data)
+            if time.monotonic() - self.scan_results_emitted >= scan_results_update_interval:
+                self.flush_sink_data()
         else:
             assert data.scan_id is not None
+            self.flush_sink_data()
             if data.error_code is not None:
                 self.deviceError.emit(data.scan_id, data.error_code)
             elif data.optimal_display_name is not None:
@@ -1751,18 +2724,24 @@ class BackupManager(PublishPullPipelineManager):
     def __init__(self, logging_port: int) -> None:
         super().__init__(logging_port=logging_port, thread_name=ThreadNames.backup)
         self._process_name = 'Backup Manager'
+        self._warm_workers = 1
         self._process_to_run = 'backupfile.py'
 
+    def process_sink_progress(self, content: bytes) -> None:
+        scan_id, total_downloaded, chunk_downloaded = unpack_copy_progress(content)
+        assert chunk_downloaded >= 0
+        assert total_downloaded >= 0
+        self.bytesBackedUp.emit(scan_id, chunk_downloaded)
+
     def process_sink_data(self) -> None:
         data = pickle.loads(self.content) # type: BackupResults
-        if data.total_downloaded is not None:
-            assert data.scan_id is not None
-            assert data.chunk_downloaded >= 0
-            assert data.total_downloaded >= 0
-            self.bytesBackedUp.emit(data.scan_id, data.chunk_downloaded)
-        elif data.backup_succeeded is not None:
+        if data.backup_succeeded is not None:
             assert data.do_backup is not None
             assert data.rpd_file is not None
+            if data.total_downloaded is not None:
+                # Progress not yet reported when the file finished backing up
+                assert data.chunk_downloaded >= 0
+                self.bytesBackedUp.emit(data.scan_id, data.chunk_downloaded)
             self.message.emit(
                 data.device_id, data.backup_succeeded, data.do_backup, data.rpd_file,
                 data.backup_full_file_name, data.mdata_exceptions
@@ -1787,22 +2766,33 @@ class CopyFilesManager(PublishPullPipelineManager):
     def __init__(self, logging_port: int) -> None:
         super().__init__(logging_port=logging_port, thread_name=ThreadNames.copy)
         self._process_name = 'Copy Files Manager'
+        self._warm_workers = 1
         self._process_to_run = 'copyfiles.py'
 
-    def process_sink_data(self) -> None:
-        data = pickle.loads(self.content) # type: CopyFilesResults
-        if data.total_downloaded is not None:
-            assert data.scan_id is not None
-            if data.chunk_downloaded < 0:
-                logging.critical("Chunk downloaded is less than zero: %s", data.chunk_downloaded)
-            if data.total_downloaded < 0:
-                logging.critical("Chunk downloaded is less than zero: %s", data.total_downloaded)
+    def emit_bytes_downloaded(self, scan_id: int,
+                              total_downloaded: int,
+                              chunk_downloaded: int) -> None:
+        if chunk_downloaded < 0:
+            logging.critical("Chunk downloaded is less than zero: %s", chunk_downloaded)
+        if total_downloaded < 0:
+            logging.critical("Chunk downloaded is less than zero: %s", total_downloaded)
 
-            self.bytesDownloaded.emit(data.scan_id, data.total_downloaded, data.chunk_downloaded)
+        self.bytesDownloaded.emit(scan_id, total_downloaded, chunk_downloaded)
 
-        elif data.copy_succeeded is not None:
+    def process_sink_progress(self, content: bytes) -> None:
+        self.emit_bytes_downloaded(*unpack_copy_progress(content))
+
+    def process_sink_data(self) -> None:
+        data = pickle.loads(self.content) # type: CopyFilesResults
+        if data.copy_succeeded is not None:
             assert data.rpd_file is not None
             assert data.download_count is not None
+            if data.total_downloaded is not None:
+                # Progress not yet reported when the file finished copying
+                assert data.scan_id is not None
+                self.emit_bytes_downloaded(
+                    data.scan_id, data.total_downloaded, data.chunk_downloaded
+                )
             self.message.emit(
                 data.copy_succeeded, data.rpd_file, data.download_count, data.mdata_exceptions
             )
@@ -1816,4 +2806,30 @@ class CopyFilesManager(PublishPullPipelineManager):
             assert (data.photo_temp_dir is not None and
                     data.video_temp_dir is not None)
             assert data.scan_id is not None
-            self.tempDirs.emit(data.scan_id, data.photo_temp_dir, data.video_temp_dir)
\ No newline at end of file
+            self.tempDirs.emit(data.scan_id, data.photo_temp_dir, data.video_temp_dir)
+
+class PrefetchManager(PublishPullPipelineManager):
+    """
+    Manage the processes that copy files marked for download from cameras
+    into the Download Cache while the user is still selecting them
+
+    Its workers are not kept warm, because each lowers its scheduling
+    priority, which an unprivileged process cannot raise again for a later
+    job.
+    """
+
+    message = pyqtSignal(int, bytes, str)
+    cacheDirs = pyqtSignal(int, CacheDirs)
+
+    def __init__(self, logging_port: int) -> None:
+        super().__init__(logging_port=logging_port, thread_name=ThreadNames.prefetch)
+        self._process_name = 'Prefetch Manager'
+        self._process_to_run = 'prefetch.py'
+
+    def process_sink_data(self) -> None:
+        data = pickle.loads(self.content)  # type: PrefetchResults
+        if data.uid is not None:
+            self.message.emit(data.scan_id, data.uid, data.cache_full_file_name)
+        else:
+            assert data.cache_dirs is not None
+            self.cacheDirs.emit(data.scan_id, data.cache_dirs)
@@ -56,6 +56,22 @@ VENDOR_SHUTTER_COUNT = (
 )
 
 
+def initialize_gexiv2() -> bool:
+    """
+    Initialize exiv2 through GExiv2, which must be done in the main thread
+    before metadata is read from more than one thread at a time.
+
+    :return: True if exiv2 was initialized, else False, in which case
+     metadata should only be read from one thread at a time
+    """
+
+    try:
+        return GExiv2.initialize()
+    except AttributeError:
+        # Versions of GExiv2 older than 0.10.3 lack the function
+        return False
+
+
 def photo_date_time(metadata: GExiv2.Metadata,
                     full_file_name: Optional[str] = None,
                     file_type: Optional[FileType] = None,
@@ -0,0 +1,267 @@
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+A compact copy of the photo and video metadata values used to generate subfolder
+and file names.
+
+Metadata is read from each file when its thumbnail is generated. The metadata
+objects themselves cannot be pickled, so without a record of the values the
+metadata would have to be read again when the file is renamed. The record
+travels with the RPDFile, and offers the same interface as the metadata classes
+for the values it holds.
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+import logging
+from typing import Any, Dict, Iterable, Optional, Set, Sequence
+
+from raphodo.constants import FileType
+from raphodo.generatenameconfig import *
+
+# Metadata level 1 preference values and the record fields they use
+photo_metadata_fields = {
+    APERTURE: 'aperture',
+    ISO: 'iso',
+    EXPOSURE_TIME: 'exposure_time',
+    FOCAL_LENGTH: 'focal_length',
+    CAMERA_MAKE: 'camera_make',
+    CAMERA_MODEL: 'camera_model',
+    SHORT_CAMERA_MODEL: 'short_camera_model',
+    SHORT_CAMERA_MODEL_HYPHEN: 'short_camera_model_hyphen',
+    SERIAL_NUMBER: 'camera_serial',
+    SHUTTER_COUNT: 'shutter_count',
+    FILE_NUMBER: 'file_number',
+    OWNER_NAME: 'owner_name',
+    COPYRIGHT: 'copyright',
+    ARTIST: 'artist',
+}
+
+video_metadata_fields = {
+    CODEC: 'codec',
+    WIDTH: 'width',
+    HEIGHT: 'height',
+    FPS: 'frames_per_second',
+    LENGTH: 'length',
+}
+
+# Values that ExifTool can only provide by being run a second time on the file
+exiftool_string_format_fields = ('exposure_time', 'file_number')
+
+
+def metadata_fields_needed(pref_list: Sequence[str]) -> Set[str]:
+    """
+    Determine which metadata values are used to generate a subfolder or file name
+
+    :param pref_list: subfolder or file name generation preference list
+    :return: set of record fields
+
+    >>> sorted(metadata_fields_needed([DATE_TIME, IMAGE_DATE, 'YYYYMMDD',
+    ...                                TEXT, '-', '',
+    ...                                METADATA, SHORT_CAMERA_MODEL_HYPHEN, LOWERCASE]))
+    ['date_time', 'short_camera_model_hyphen']
+    >>> sorted(metadata_fields_needed([DATE_TIME, VIDEO_DATE, 'HHMM',
+    ...                                METADATA, CODEC, LOWERCASE]))
+    ['codec', 'date_time']
+    >>> sorted(metadata_fields_needed([DATE_TIME, IMAGE_DATE, SUBSECONDS]))
+    ['sub_seconds']
+    >>> sorted(metadata_fields_needed([DATE_TIME, TODAY, 'YYYYMMDD']))
+    []
+    """
+
+    fields = set()  # type: Set[str]
+    for i in range(0, len(pref_list), 3):
+        value, l1, l2 = pref_list[i:i + 3]
+        if value == DATE_TIME and l1 in (IMAGE_DATE, VIDEO_DATE):
+            if l2 == SUBSECONDS:
+                fields.add('sub_seconds')
+            else:
+                fields.add('date_time')
+        elif value == METADATA:
+            if l1 in photo_metadata_fields:
+                fields.add(photo_metadata_fields[l1])
+            elif l1 in video_metadata_fields:
+                fields.add(video_metadata_fields[l1])
+    return fields
+
+
+class MetadataRecord:
+    """
+    Metadata values used to generate subfolder and file names.
+
+    A value of None indicates the value was not recorded, or the file does not
+    have it.
+
+    >>> r = MetadataRecord(dict(camera_model='Canon EOS 5D', iso=None))
+    >>> r.camera_model()
+    'Canon EOS 5D'
+    >>> r.iso(missing='')
+    ''
+    >>> r.aperture(missing=None) is None
+    True
+    >>> r.has_fields({'camera_model'})
+    True
+    >>> r.has_fields({'camera_model', 'iso'})
+    False
+    """
+
+    __slots__ = 'values',
+
+    def __init__(self, values: Dict[str, Any]) -> None:
+        self.values = values
+
+    def __repr__(self) -> str:
+        return 'MetadataRecord({})'.format(self.values)
+
+    def _get(self, field: str, missing: Any) -> Any:
+        value = self.values.get(field)
+        if value is None or value == '':
+            return missing
+        return value
+
+    def has_fields(self, fields: Iterable[str]) -> bool:
+        """
+        :param fields: record fields
+        :return: True if the record has a value for every field
+        """
+
+        return all(self._get(field, None) is not None for field in fields)
+
+    def date_time(self, missing: Optional[str]='', ignore_file_modify_date: bool=False) -> Any:
+        return self._get('date_time', missing)
+
+    def sub_seconds(self, missing='00') -> Any:
+        return self._get('sub_seconds', missing)
+
+    def aperture(self, missing='') -> Any:
+        return self._get('aperture', missing)
+
+    def iso(self, missing='') -> Any:
+        return self._get('iso', missing)
+
+    def exposure_time(self, alternativeFormat=False, missing='') -> Any:
+        # Only the alternative format is used in name generation
+        if not alternativeFormat:
+            return missing
+        return self._get('exposure_time', missing)
+
+    def focal_length(self, missing='') -> Any:
+        return self._get('focal_length', missing)
+
+    def camera_make(self, missing='') -> Any:
+        return self._get('camera_make', missing)
+
+    def camera_model(self, missing='') -> Any:
+        return self._get('camera_model', missing)
+
+    def short_camera_model(self, includeCharacters='', missing='') -> Any:
+        if includeCharacters:
+            return self._get('short_camera_model_hyphen', missing)
+        return self._get('short_camera_model', missing)
+
+    def camera_serial(self, missing='') -> Any:
+        return self._get('camera_serial', missing)
+
+    def shutter_count(self, missing='') -> Any:
+        return self._get('shutter_count', missing)
+
+    def file_number(self, missing='') -> Any:
+        return self._get('file_number', missing)
+
+    def owner_name(self, missing='') -> Any:
+        return self._get('owner_name', missing)
+
+    def copyright(self, missing='') -> Any:
+        return self._get('copyright', missing)
+
+    def artist(self, missing='') -> Any:
+        return self._get('artist', missing)
+
+    def codec(self, stream=0, missing='') -> Any:
+        return self._get('codec', missing)
+
+    def width(self, stream=0, missing='') -> Any:
+        return self._get('width', missing)
+
+    def height(self, stream=0, missing='') -> Any:
+        return self._get('height', missing)
+
+    def frames_per_second(self, stream=0, missing='') -> Any:
+        return self._get('frames_per_second', missing)
+
+    def length(self, missing='') -> Any:
+        return self._get('length', missing)
+
+
+def make_metadata_record(metadata, file_type: FileType, exiftool_only: bool) -> MetadataRecord:
+    """
+    Record the metadata values used to generate subfolder and file names
+
+    :param metadata: photo or video metadata that has been loaded
+    :param file_type: whether the file is a photo or video
+    :param exiftool_only: True if the metadata is read using ExifTool alone
+    :return: the record
+    """
+
+    getters = dict(date_time=lambda: metadata.date_time(missing=None))
+    if file_type == FileType.photo:
+        getters.update(
+            sub_seconds=lambda: metadata.sub_seconds(missing=None),
+            aperture=lambda: metadata.aperture(missing=None),
+            iso=lambda: metadata.iso(missing=None),
+            exposure_time=lambda: metadata.exposure_time(alternativeFormat=True, missing=None),
+            focal_length=lambda: metadata.focal_length(missing=None),
+            camera_make=lambda: metadata.camera_make(missing=None),
+            camera_model=lambda: metadata.camera_model(missing=None),
+            short_camera_model=lambda: metadata.short_camera_model(missing=None),
+            short_camera_model_hyphen=lambda: metadata.short_camera_model(
+                includeCharacters="\-", missing=None
+            ),
+            camera_serial=lambda: metadata.camera_serial(missing=None),
+            shutter_count=lambda: metadata.shutter_count(missing=None),
+            file_number=lambda: metadata.file_number(missing=None),
+            owner_name=lambda: metadata.owner_name(missing=None),
+            copyright=lambda: metadata.copyright(missing=None),
+            artist=lambda: metadata.artist(missing=None),
+        )
+    else:
+        getters.update(
+            codec=lambda: metadata.codec(missing=None),
+            width=lambda: metadata.width(missing=None),
+            height=lambda: metadata.height(missing=None),
+            frames_per_second=lambda: metadata.frames_per_second(missing=None),
+            length=lambda: metadata.length(missing=None),
+        )
+
+    if exiftool_only:
+        # Don't run ExifTool a second time merely to fill in the record. If one of
+        # these values is needed, the metadata will be read again when it is
+        # renamed.
+        for field in exiftool_string_format_fields:
+            getters.pop(field, None)
+
+    values = {}  # type: Dict[str, Any]
+    for field, getter in getters.items():
+        try:
+            values[field] = getter()
+        except Exception:
+            logging.debug("Could not record metadata value %s", field)
+            values[field] = None
+    return MetadataRecord(values)
@@ -0,0 +1,512 @@
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+Lightweight timing instrumentation of the stages of the scan, thumbnail, copy,
+rename and backup pipeline.
+
+Each worker process records latencies, bytes, queue depths and cache lookups
+into its own PipelineMetrics. When the worker finishes its work, it publishes
+its metrics to the main process as a log record, using the existing logging
+channel. The main process merges the metrics of all the workers of each type,
+and writes them to a JSON file in the program's log directory. Among them is
+how long each worker process took to start, i.e. to start the interpreter and
+import its modules.
+
+The main process also traces its own startup: the wall time of each stage of
+the main window's initialization, and when it began.
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+from collections import defaultdict
+from contextlib import contextmanager
+import functools
+import json
+import logging
+import os
+import threading
+import time
+from typing import Any, Callable, Dict, Iterator, List, Optional
+
+import psutil
+
+# Log records carrying metrics have this attribute
+metrics_record_attribute = 'pipeline_metrics'
+
+metrics_file_name = 'pipeline-metrics.json'
+startup_file_name = 'startup-trace.json'
+
+# Upper bounds of the latency histogram buckets in seconds: 1ms, 2ms, 4ms ... ~9 minutes.
+# Latencies greater than the last bound are counted in a final overflow bucket.
+latency_bounds = tuple(0.001 * 2 ** i for i in range(20))
+
+
+class Histogram:
+    """
+    Latency histogram with exponentially sized buckets
+
+    >>> h = Histogram()
+    >>> for latency in (0.0005, 0.003, 0.003, 0.1):
+    ...     h.record(latency)
+    >>> h.count, round(h.max, 4)
+    (4, 0.1)
+    >>> h.percentile(50)
+    0.004
+    >>> h2 = Histogram.from_dict(h.as_dict())
+    >>> h2.merge(h)
+    >>> h2.count, h2.percentile(50)
+    (8, 0.004)
+    """
+
+    def __init__(self) -> None:
+        self.buckets = [0] * (len(latency_bounds) + 1)
+        self.count = 0
+        self.sum = 0.0
+        self.min = None  # type: Optional[float]
+        self.max = None  # type: Optional[float]
+
+    def record(self, seconds: float) -> None:
+        for i, bound in enumerate(latency_bounds):
+            if seconds <= bound:
+                break
+        else:
+            i = len(latency_bounds)
+        self.buckets[i] += 1
+        self.count += 1
+        self.sum += seconds
+        if self.min is None or seconds < self.min:
+            self.min = seconds
+        if self.max is None or seconds > self.max:
+            self.max = seconds
+
+    def merge(self, other: 'Histogram') -> None:
+        self.buckets = [a + b for a, b in zip(self.buckets, other.buckets)]
+        self.count += other.count
+        self.sum += other.sum
+        if other.min is not None and (self.min is None or other.min < self.min):
+            self.min = other.min
+        if other.max is not None and (self.max is None or other.max > self.max):
+            self.max = other.max
+
+    def percentile(self, percent: float) -> Optional[float]:
+        """
+        :param percent: percentile to estimate, e.g. 90
+        :return: upper bound of the bucket the percentile falls in, or the maximum
+         latency if it falls in the overflow bucket, or None if nothing is recorded
+        """
+
+        if not self.count:
+            return None
+        threshold = self.count * percent / 100
+        running = 0
+        for i, count in enumerate(self.buckets):
+            running += count
+            if running >= threshold:
+                if i < len(latency_bounds):
+                    return latency_bounds[i]
+                break
+        return self.max
+
+    def as_dict(self) -> Dict[str, Any]:
+        return dict(
+            count=self.count, sum=self.sum, min=self.min, max=self.max,
+            mean=self.sum / self.count if self.count else None,
+            p50=self.percentile(50), p90=self.percentile(90), p99=self.percentile(99),
+            buckets=self.buckets
+        )
+
+    @classmethod
+    def from_dict(cls, values: Dict[str, Any]) -> 'Histogram':
+        h = cls()
+        h.buckets = list(values['buckets'])
+        h.count = values['count']
+        h.sum = values['sum']
+        h.min = values['min']
+        h.max = values['max']
+        return h
+
+
+class QueueDepth:
+    """
+    Track the depth of a queue each time it is sampled
+    """
+
+    def __init__(self) -> None:
+        self.samples = 0
+        self.sum = 0
+        self.max = 0
+
+    def record(self, depth: int) -> None:
+        self.samples += 1
+        self.sum += depth
+        self.max = max(self.max, depth)
+
+    def merge(self, other: 'QueueDepth') -> None:
+        self.samples += other.samples
+        self.sum += other.sum
+        self.max = max(self.max, other.max)
+
+    def as_dict(self) -> Dict[str, Any]:
+        return dict(
+            samples=self.samples, sum=self.sum, max=self.max,
+            mean=self.sum / self.samples if self.samples else None
+        )
+
+    @classmethod
+    def from_dict(cls, values: Dict[str, Any]) -> 'QueueDepth':
+        q = cls()
+        q.samples = values['samples']
+        q.sum = values['sum']
+        q.max = values['max']
+        return q
+
+
+class PipelineMetrics:
+    """
+    Metrics recorded by one process, or merged from many
+
+    >>> m = PipelineMetrics()
+    >>> with m.time('copy'):
+    ...     pass
+    >>> m.add_bytes('copy', 1024)
+    >>> m.queue_depth('rename', 3)
+    >>> m.cache_lookup('thumbnail cache', hit=True)
+    >>> m.cache_lookup('thumbnail cache', hit=False)
+    >>> d = m.as_dict()
+    >>> d['latency']['copy']['count'], d['bytes'], d['cache']
+    (1, {'copy': 1024}, {'thumbnail cache': {'hits': 1, 'misses': 1, 'hit_rate': 0.5}})
+    >>> merged = PipelineMetrics()
+    >>> merged.merge(d)
+    >>> merged.merge(d)
+    >>> merged.as_dict()['bytes']
+    {'copy': 2048}
+    """
+
+    def __init__(self) -> None:
+        # Metrics may be recorded by worker threads
+        self.lock = threading.Lock()
+        self.reset()
+
+    def reset(self) -> None:
+        self.latency = defaultdict(Histogram)  # type: Dict[str, Histogram]
+        self.bytes = defaultdict(int)  # type: Dict[str, int]
+        self.queues = defaultdict(QueueDepth)  # type: Dict[str, QueueDepth]
+        self.hits = defaultdict(int)  # type: Dict[str, int]
+        self.misses = defaultdict(int)  # type: Dict[str, int]
+
+    def __bool__(self) -> bool:
+        return bool(self.latency or self.bytes or self.queues or self.hits or self.misses)
+
+    def record_latency(self, stage: str, seconds: float) -> None:
+        with self.lock:
+            self.latency[stage].record(seconds)
+
+    @contextmanager
+    def time(self, stage: str) -> Iterator[None]:
+        """
+        Record how long the enclosed block takes to run, even if it raises an
+        exception
+        """
+
+        start = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.record_latency(stage, time.perf_counter() - start)
+
+    def timed(self, stage: str, func: Callable) -> Callable:
+        """
+        :return: func wrapped so that how long each call takes is recorded, e.g.
+         for submitting to a thread pool
+        """
+
+        def timed_func(*args, **kwargs):
+            with self.time(stage):
+                return func(*args, **kwargs)
+        return timed_func
+
+    def add_bytes(self, stage: str, amount: int) -> None:
+        with self.lock:
+            self.bytes[stage] += amount
+
+    def queue_depth(self, queue: str, depth: int) -> None:
+        with self.lock:
+            self.queues[queue].record(depth)
+
+    def cache_lookup(self, cache: str, hit: bool) -> None:
+        with self.lock:
+            if hit:
+                self.hits[cache] += 1
+            else:
+                self.misses[cache] += 1
+
+    def as_dict(self) -> Dict[str, Any]:
+        caches = set(self.hits) | set(self.misses)
+        return dict(
+            latency={stage: h.as_dict() for stage, h in self.latency.items()},
+            bytes=dict(self.bytes),
+            queues={queue: q.as_dict() for queue, q in self.queues.items()},
+            cache={
+                cache: dict(
+                    hits=self.hits[cache], misses=self.misses[cache],
+                    hit_rate=self.hits[cache] / (self.hits[cache] + self.misses[cache])
+                ) for cache in sorted(caches)
+            }
+        )
+
+    def merge(self, values: Dict[str, Any]) -> None:
+        """
+        :param values: metrics in the format returned by as_dict()
+        """
+
+        for stage, h in values['latency'].items():
+            self.latency[stage].merge(Histogram.from_dict(h))
+        for stage, amount in values['bytes'].items():
+            self.bytes[stage] += amount
+        for queue, q in values['queues'].items():
+            self.queues[queue].merge(QueueDepth.from_dict(q))
+        for cache, lookups in values['cache'].items():
+            self.hits[cache] += lookups['hits']
+            self.misses[cache] += lookups['misses']
+
+    def summary(self) -> str:
+        """
+        :return: a short description of the latencies suitable for logging
+        """
+
+        return '; '.join(
+            '%s: %s in %.1fs (p50 %.3fs, p90 %.3fs)' % (
+                stage, h.count, h.sum, h.percentile(50), h.percentile(90)
+            ) for stage, h in sorted(self.latency.items()) if h.count
+        )
+
+
+def process_start_time() -> float:
+    """
+    :return: when this process was created, in seconds since the epoch
+    """
+
+    try:
+        return psutil.Process().create_time()
+    except psutil.Error:
+        return time.time()
+
+
+def process_startup_seconds() -> float:
+    """
+    :return: seconds since this process was created. Called when a process
+     is ready to work, it is the time taken to start the interpreter and
+     import the modules the process needs.
+    """
+
+    return max(0.0, time.time() - process_start_time())
+
+
+def publish_metrics(metrics: PipelineMetrics, worker_type: str) -> None:
+    """
+    Send the metrics recorded by a worker process to the main process, and
+    reset them.
+
+    Must be called before the worker disconnects its logging.
+
+    :param metrics: metrics recorded by the process
+    :param worker_type: the type of worker, e.g. 'CopyFiles'
+    """
+
+    if not metrics:
+        return
+    logging.debug(
+        "Pipeline metrics for %s: %s", worker_type, metrics.summary(),
+        extra={metrics_record_attribute: (worker_type, metrics.as_dict())}
+    )
+    metrics.reset()
+
+
+class MetricsAggregator:
+    """
+    Merge the metrics published by worker processes, in the main process.
+
+    Metrics are received in the thread that receives log messages from the
+    workers, and are written to a JSON file each time they are received.
+    """
+
+    def __init__(self) -> None:
+        self.lock = threading.RLock()
+        self.metrics = defaultdict(PipelineMetrics)  # type: Dict[str, PipelineMetrics]
+        self.path = None  # type: Optional[str]
+
+    def set_directory(self, path: Optional[str]) -> None:
+        """
+        :param path: directory to write the metrics to, or None to not write them
+        """
+
+        if path is None:
+            self.path = None
+        else:
+            self.path = os.path.join(path, metrics_file_name)
+
+    def handle_record(self, record: logging.LogRecord) -> None:
+        """
+        Merge any metrics attached to a log record
+
+        :param record: log record received from a worker
+        """
+
+        value = getattr(record, metrics_record_attribute, None)
+        if value is None:
+            return
+        worker_type, metrics = value
+        with self.lock:
+            self.metrics[worker_type].merge(metrics)
+        self.dump()
+
+    def as_dict(self) -> Dict[str, Any]:
+        with self.lock:
+            return {
+                worker_type: metrics.as_dict() for worker_type, metrics in self.metrics.items()
+            }
+
+    def dump(self) -> None:
+        """
+        Write the metrics merged so far to a JSON file
+        """
+
+        if self.path is None:
+            return
+        with self.lock:
+            values = self.as_dict()
+            try:
+                with open(self.path, 'w') as f:
+                    json.dump(values, f, indent=2, sort_keys=True)
+            except OSError as e:
+                logging.warning("Could not write pipeline metrics to %s: %s", self.path, e)
+
+    def log_summary(self) -> None:
+        with self.lock:
+            for worker_type, metrics in sorted(self.metrics.items()):
+                logging.debug("Pipeline metrics for %s: %s", worker_type, metrics.summary())
+
+
+class StartupTrace:
+    """
+    The wall time of each stage of the main process's startup, and when it
+    began relative to the creation of the process. The time between stages
+    is spent waiting for threads and worker processes to start.
+
+    >>> trace = StartupTrace(process_start=time.time() - 1.0)
+    >>> trace.record('imports', began=0.0, seconds=1.0)
+    >>> @trace.stage
+    ... def initStage2():
+    ...     pass
+    >>> initStage2()
+    >>> trace.mark('main window shown')
+    >>> d = trace.as_dict()
+    >>> [stage['stage'] for stage in d['stages']], d['stages'][1]['began'] >= 1.0
+    (['imports', 'initStage2'], True)
+    >>> list(d['events'])
+    ['main window shown']
+    """
+
+    def __init__(self, process_start: Optional[float]=None) -> None:
+        """
+        :param process_start: when the process was created, in seconds since
+         the epoch. If None, determined when first needed.
+        """
+
+        self.process_start = process_start
+        self.stages = []  # type: List[Dict[str, Any]]
+        self.events = {}  # type: Dict[str, float]
+        self.path = None  # type: Optional[str]
+
+    def elapsed(self) -> float:
+        """
+        :return: seconds since the process was created
+        """
+
+        if self.process_start is None:
+            self.process_start = process_start_time()
+        return time.time() - self.process_start
+
+    def record(self, stage: str, began: float, seconds: float) -> None:
+        """
+        :param stage: name of the stage
+        :param began: seconds after the process was created the stage began
+        :param seconds: how long the stage took
+        """
+
+        self.stages.append(dict(stage=stage, began=began, seconds=seconds))
+        logging.debug("Startup: %s took %.3fs, began at %.3fs", stage, seconds, began)
+
+    def stage(self, func: Callable) -> Callable:
+        """
+        Decorator recording how long each call to func takes, e.g. a Qt slot
+        called during startup. Must be applied beneath any pyqtSlot decorator.
+        """
+
+        @functools.wraps(func)
+        def traced_func(*args, **kwargs):
+            began = self.elapsed()
+            start = time.perf_counter()
+            try:
+                return func(*args, **kwargs)
+            finally:
+                self.record(func.__qualname__, began, time.perf_counter() - start)
+                self.dump()
+        return traced_func
+
+    def mark(self, event: str) -> None:
+        """
+        Record the first time an event occurs, e.g. the main window being shown
+        """
+
+        if event not in self.events:
+            self.events[event] = self.elapsed()
+            logging.info("Startup: %s %.2fs after the program started", event, self.events[event])
+
+    def set_directory(self, path: Optional[str]) -> None:
+        """
+        :param path: directory to write the trace to, or None to not write it
+        """
+
+        if path is None:
+            self.path = None
+        else:
+            self.path = os.path.join(path, startup_file_name)
+
+    def as_dict(self) -> Dict[str, Any]:
+        return dict(stages=self.stages, events=self.events)
+
+    def dump(self) -> None:
+        """
+        Write the trace recorded so far to a JSON file
+        """
+
+        if self.path is None:
+            return
+        try:
+            with open(self.path, 'w') as f:
+                json.dump(self.as_dict(), f, indent=2)
+        except OSError as e:
+            logging.warning("Could not write startup trace to %s: %s", self.path, e)
+
+
+# Used only in the main process
+aggregator = MetricsAggregator()
+startup = StartupTrace()
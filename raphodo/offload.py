@@ -26,6 +26,7 @@ import pickle
 import sys
 import logging
 import locale
+from typing import Dict, Tuple
 try:
     # Use the default locale as defined by the LANG variable
     locale.setlocale(locale.LC_ALL, '')
@@ -36,12 +37,17 @@ from PyQt5.QtGui import QGuiApplication
 from raphodo.interprocess import (DaemonProcess, OffloadData, OffloadResults, DownloadDestination)
 from raphodo.proximity import TemporalProximityGroups
 from raphodo.viewutils import ThumbnailDataForProximity
-from raphodo.folderspreview import FoldersPreview
+
+
+# Limit the number of subfolders kept in the cache of generated subfolders
+subfolder_cache_size = 100000
 
 
 class OffloadWorker(DaemonProcess):
     def __init__(self) -> None:
         super().__init__('Offload')
+        # Subfolders generated for keys returned by FoldersPreview.subfolder_keys()
+        self.subfolder_cache = {}  # type: Dict[Tuple, str]
 
     def run(self) -> None:
         try:
@@ -61,13 +67,18 @@ class OffloadWorker(DaemonProcess):
                     )
                     self.send_message_to_sink()
                 else:
-                    assert data.folders_preview
-                    assert data.rpd_files
-                    data.folders_preview.generate_subfolders(
-                        rpd_files=data.rpd_files, strip_characters=data.strip_characters
+                    generation = data.subfolder_generation
+                    assert generation is not None
+                    assert generation.subfolder_keys
+                    if len(self.subfolder_cache) > subfolder_cache_size:
+                        self.subfolder_cache = {}
+                    delta = generation.folders_preview().generate_subfolders(
+                        subfolder_keys=generation.subfolder_keys,
+                        strip_characters=generation.strip_characters,
+                        cache=self.subfolder_cache
                     )
                     self.content = pickle.dumps(
-                        OffloadResults(folders_preview=data.folders_preview),
+                        OffloadResults(folders_preview_delta=delta),
                         pickle.HIGHEST_PROTOCOL
                     )
                     self.send_message_to_sink()
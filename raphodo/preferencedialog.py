@@ -164,6 +164,15 @@ class PreferencesDialog(QDialog):
             'Changing this setting causes all devices to be scanned again.'
         )
         self.scanSpecificFolders.setToolTip(tip)
+        self.detectDownloadedByContent = QCheckBox(
+            _('Detect previously downloaded files by their contents')
+        )
+        self.detectDownloadedByContent.setToolTip(_(
+            'Detect files that were previously downloaded even if their name or\n'
+            'modification time has since changed, for instance after being copied to\n'
+            'another memory card.\n\n'
+            'Scanning devices is slower, because part of each file must be read.'
+        ))
 
         self.foldersToScanLabel = QLabel(_('Folders to scan:'))
         self.foldersToScan = QNarrowListWidget(minimum_rows=5)
@@ -193,6 +202,7 @@ class PreferencesDialog(QDialog):
         scanLayout.addWidget(self.foldersToScan, 3, 1, 3, 1)
         scanLayout.addWidget(self.addFolderToScan, 3, 2, 1, 1)
         scanLayout.addWidget(self.removeFolderToScan, 4, 2, 1, 1)
+        scanLayout.addWidget(self.detectDownloadedByContent, 6, 0, 1, 3)
         self.scanBox.setLayout(scanLayout)
 
         tip = _('Devices that have been set to automatically ignore or download from.')
@@ -273,6 +283,7 @@ class PreferencesDialog(QDialog):
         # in rapidApp is not triggered
         self.onlyExternal.stateChanged.connect(self.onlyExternalChanged)
         self.scanSpecificFolders.stateChanged.connect(self.noDcimChanged)
+        self.detectDownloadedByContent.stateChanged.connect(self.detectDownloadedByContentChanged)
         self.ignoredPathsRe.stateChanged.connect(self.ignoredPathsReChanged)
 
         devicesLayout = QVBoxLayout()
@@ -367,9 +378,19 @@ class PreferencesDialog(QDialog):
                 'and other programs'
             )
         )
+        self.prefetchFromCameras = QCheckBox(_('Copy marked files from cameras in the background'))
+        self.prefetchFromCameras.setToolTip(
+            _(
+                'Before the download starts, copy the photos and videos marked for download '
+                'from cameras and phones into a cache, so that the download is faster.\n'
+                'The cache uses space in the download folders, and copying uses the battery '
+                'of the camera or phone.'
+            )
+        )
         self.generateThumbnails.stateChanged.connect(self.generateThumbnailsChanged)
         self.useThumbnailCache.stateChanged.connect(self.useThumbnailCacheChanged)
         self.fdoThumbnails.stateChanged.connect(self.fdoThumbnailsChanged)
+        self.prefetchFromCameras.stateChanged.connect(self.prefetchFromCamerasChanged)
         self.maxCores = QComboBox()
         self.maxCores.setEditable(False)
         tip = _('Number of CPU cores used to generate thumbnails.')
@@ -395,6 +416,7 @@ class PreferencesDialog(QDialog):
         performanceBoxLayout.addWidget(self.generateThumbnails)
         performanceBoxLayout.addWidget(self.useThumbnailCache)
         performanceBoxLayout.addWidget(self.fdoThumbnails)
+        performanceBoxLayout.addWidget(self.prefetchFromCameras)
         performanceBoxLayout.addLayout(coresLayout)
         self.performanceBox.setLayout(performanceBoxLayout)
 
@@ -422,6 +444,13 @@ class PreferencesDialog(QDialog):
         self.thumbnailCacheDaysKeep.setSuffix(' ' + _('days'))
         self.thumbnailCacheDaysKeep.setSpecialValueText(_('forever'))
         self.thumbnailCacheDaysKeep.valueChanged.connect(self.thumbnailCacheDaysKeepChanged)
+        self.thumbnailCacheMaxSize = QSpinBox()
+        self.thumbnailCacheMaxSize.setMinimum(0)
+        self.thumbnailCacheMaxSize.setMaximum(1024 * 100)
+        self.thumbnailCacheMaxSize.setSingleStep(256)
+        self.thumbnailCacheMaxSize.setSuffix(' ' + _('MB'))
+        self.thumbnailCacheMaxSize.setSpecialValueText(_('unlimited'))
+        self.thumbnailCacheMaxSize.valueChanged.connect(self.thumbnailCacheMaxSizeChanged)
 
         cacheBoxLayout = QVBoxLayout()
         cacheLayout = QGridLayout()
@@ -436,6 +465,11 @@ class PreferencesDialog(QDialog):
         cacheDays.addWidget(self.thumbnailCacheDaysKeep)
         cacheDays.addWidget(QLabel(_('*')))
         cacheLayout.addLayout(cacheDays, 3, 1, 1, 1)
+        cacheLayout.addWidget(QLabel(_('Maximum cache size:')), 4, 0, 1, 1)
+        cacheMaxSize = QHBoxLayout()
+        cacheMaxSize.addWidget(self.thumbnailCacheMaxSize)
+        cacheMaxSize.addWidget(QLabel(_('*')))
+        cacheLayout.addLayout(cacheMaxSize, 4, 1, 1, 1)
         cacheBoxLayout.addLayout(cacheLayout)
 
         cacheButtons = QDialogButtonBox()
@@ -868,6 +902,7 @@ class PreferencesDialog(QDialog):
     def setDeviceWidgetValues(self) -> None:
         self.onlyExternal.setChecked(self.prefs.only_external_mounts)
         self.scanSpecificFolders.setChecked(self.prefs.scan_specific_folders)
+        self.detectDownloadedByContent.setChecked(self.prefs.detect_downloaded_by_content)
         self.setFoldersToScanWidgetValues()
         self.knownDevices.clear()
         self._addItems('volume_whitelist', KnownDeviceType.volume_whitelist)
@@ -940,6 +975,7 @@ class PreferencesDialog(QDialog):
         self.fdoThumbnails.setChecked(
             self.prefs.save_fdo_thumbnails and self.prefs.generate_thumbnails
         )
+        self.prefetchFromCameras.setChecked(self.prefs.prefetch_from_cameras)
 
         if not check_boxes_only:
             available = available_cpu_count(physical_only=True)
@@ -957,6 +993,7 @@ class PreferencesDialog(QDialog):
         self.thumbnailNumber.setText(thousands(self.thumbnail_cache.no_thumbnails()))
         self.thumbnailSqlSize.setText(format_size_for_user(self.thumbnail_cache.db_size()))
         self.thumbnailCacheDaysKeep.setValue(self.prefs.keep_thumbnails_days)
+        self.thumbnailCacheMaxSize.setValue(self.prefs.max_thumbnail_cache_mb)
 
     @pyqtSlot('PyQt_PyObject')
     def setCacheSize(self, size: int) -> None:
@@ -1116,6 +1153,10 @@ class PreferencesDialog(QDialog):
         if self.rapidApp is not None:
             self.rapidApp.scan_non_cameras_again = True
 
+    @pyqtSlot(int)
+    def detectDownloadedByContentChanged(self, state: int) -> None:
+        self.prefs.detect_downloaded_by_content = state == Qt.Checked
+
     @pyqtSlot(int)
     def ignoredPathsReChanged(self, state: int) -> None:
         self.prefs.use_re_ignored_paths = state == Qt.Checked
@@ -1277,10 +1318,18 @@ class PreferencesDialog(QDialog):
         if self.prefs.generate_thumbnails:
             self.prefs.save_fdo_thumbnails = state == Qt.Checked
 
+    @pyqtSlot(int)
+    def prefetchFromCamerasChanged(self, state: int) -> None:
+        self.prefs.prefetch_from_cameras = state == Qt.Checked
+
     @pyqtSlot(int)
     def thumbnailCacheDaysKeepChanged(self, value: int) -> None:
         self.prefs.keep_thumbnails_days = value
 
+    @pyqtSlot(int)
+    def thumbnailCacheMaxSizeChanged(self, value: int) -> None:
+        self.prefs.max_thumbnail_cache_mb = value
+
     @pyqtSlot(int)
     def maxCoresChanged(self, index: int) -> None:
         if index >= 0:
@@ -1438,7 +1487,8 @@ class PreferencesDialog(QDialog):
         row = self.chooser.currentRow()
         if row == 0:
             for value in ('only_external_mounts', 'scan_specific_folders', 'folders_to_scan',
-                           'ignored_paths', 'use_re_ignored_paths'):
+                           'ignored_paths', 'use_re_ignored_paths',
+                           'detect_downloaded_by_content'):
                 self.prefs.restore(value)
             self.removeAllDeviceClicked()
             self.setDeviceWidgetValues()
@@ -1452,12 +1502,14 @@ class PreferencesDialog(QDialog):
             self.setAutomationWidgetValues()
         elif row == 3:
             for value in ('generate_thumbnails', 'use_thumbnail_cache', 'save_fdo_thumbnails',
-                          'max_cpu_cores', 'keep_thumbnails_days'):
+                          'max_cpu_cores', 'keep_thumbnails_days', 'max_thumbnail_cache_mb',
+                          'prefetch_from_cameras'):
                 self.prefs.restore(value)
             self.setPerformanceValues(check_boxes_only=True)
             self.maxCores.setCurrentText(str(self.prefs.max_cpu_cores))
             self.setPerfomanceEnabled()
             self.thumbnailCacheDaysKeep.setValue(self.prefs.keep_thumbnails_days)
+            self.thumbnailCacheMaxSize.setValue(self.prefs.max_thumbnail_cache_mb)
         elif row == 4:
             for value in ('conflict_resolution', 'backup_duplicate_overwrite'):
                 self.prefs.restore(value)
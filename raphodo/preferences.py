@@ -159,6 +159,11 @@ class DownloadsTodayTracker:
         self.day_start = day_start
         self.downloads_today = downloads_today
 
+        # Parsing the date is relatively slow, and the value is needed every time
+        # a file name that uses Downloads Today is generated, so cache it
+        self._adjusted_today_key = None  # type: Optional[Tuple[str, str]]
+        self._adjusted_today = None  # type: Optional[datetime.datetime]
+
     def get_or_reset_downloads_today(self) -> int:
         """
         Primary method to get the Downloads Today value, because it
@@ -183,18 +188,22 @@ class DownloadsTodayTracker:
         """
 
         hour, minute = self.get_day_start()
-        try:
-            adjusted_today = datetime.datetime.strptime(
-                "%s %s:%s" % (self.downloads_today[0], hour, minute),
-                "%Y-%m-%d %H:%M"
-            )
-        except:
-            logging.critical(
-                "Failed to calculate date adjustment. Download today values "
-                "appear to be corrupted: %s %s:%s",
-                self.downloads_today[0], hour, minute
-            )
-            adjusted_today = None
+        key = (self.downloads_today[0], self.day_start)
+        if key != self._adjusted_today_key:
+            try:
+                self._adjusted_today = datetime.datetime.strptime(
+                    "%s %s:%s" % (self.downloads_today[0], hour, minute),
+                    "%Y-%m-%d %H:%M"
+                )
+            except:
+                logging.critical(
+                    "Failed to calculate date adjustment. Download today values "
+                    "appear to be corrupted: %s %s:%s",
+                    self.downloads_today[0], hour, minute
+                )
+                self._adjusted_today = None
+            self._adjusted_today_key = key
+        adjusted_today = self._adjusted_today
 
         now = datetime.datetime.today()
 
@@ -335,6 +344,7 @@ class Preferences:
         volume_whitelist=[''],
         volume_blacklist=[''],
         camera_blacklist=[''],
+        detect_downloaded_by_content=False,
     )
     backup_defaults = dict(
         backup_files=False,
@@ -358,7 +368,9 @@ class Preferences:
         use_thumbnail_cache=True,
         save_fdo_thumbnails=True,
         max_cpu_cores=max(available_cpu_count(physical_only=True), 2),
-        keep_thumbnails_days=30
+        keep_thumbnails_days=30,
+        max_thumbnail_cache_mb=2048,
+        prefetch_from_cameras=False
     )
     error_defaults = dict(
         conflict_resolution=int(constants.ConflictResolution.skip),
@@ -1044,6 +1056,21 @@ class Preferences:
                 self.add_list_value(key=key, value=value)
 
 
+    def set_max_thumbnail_cache_mb_default(self, new_install: bool) -> None:
+        """
+        Record the maximum size of the Thumbnail Cache the first time this version
+        of the program is run. The cache size is limited by default only for new
+        installations, so that existing users do not suddenly lose thumbnails.
+
+        :param new_install: True if this is the first time the program has run
+        """
+
+        if new_install:
+            self.max_thumbnail_cache_mb = self.defaults['max_thumbnail_cache_mb']
+        else:
+            logging.info("Not limiting the size of the existing Thumbnail Cache")
+            self.max_thumbnail_cache_mb = 0
+
     def validate_max_CPU_cores(self) -> None:
         logging.debug('Validating CPU core count for thumbnail generation...')
         available = available_cpu_count(physical_only=True)
@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+Worker process to copy files marked for download from a camera into its
+Download Cache while the user is still selecting which files to download.
+
+For each camera, there is one of these workers. It runs once thumbnails have
+been generated for the camera, at a low priority, and is paused while
+thumbnails are being generated for another device. When the download starts,
+it is stopped, and files it has copied are moved into place instead of being
+read from the camera.
+
+If the start of a file was kept in the Download Cache while its thumbnail was
+generated, only the rest of the file is read, and appended to it.
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+import os
+import sys
+import logging
+import pickle
+import time
+from operator import attrgetter
+from typing import Optional
+
+import gphoto2 as gp
+
+from raphodo.camera import Camera, CameraProblemEx, gphoto2_python_logging
+from raphodo.interprocess import (
+    WorkerInPublishPullPipeline, PrefetchArguments, PrefetchResults, run_worker
+)
+from raphodo.rpdfile import RPDFile
+from raphodo.utilities import create_temp_dir, CacheDirs, format_size_for_user
+from raphodo.preferences import Preferences
+from raphodo.rescan import RescanCamera
+from raphodo.downloadcache import DownloadCache, cache_dir_name
+
+# How much lower the scheduling priority of this process is than the
+# rest of the program
+prefetch_niceness = 10
+
+
+class PrefetchWorker(WorkerInPublishPullPipeline):
+
+    def __init__(self) -> None:
+        self.camera = None  # type: Optional[Camera]
+        # A file being saved in the Download Cache that is deleted if the
+        # process is stopped
+        self.partial_file = ''
+        super().__init__('Prefetch')
+
+    def cleanup_pre_stop(self) -> None:
+        if self.partial_file:
+            try:
+                os.remove(self.partial_file)
+            except OSError:
+                pass
+        if self.camera is not None and self.camera.camera_initialized:
+            self.camera.free_camera()
+
+    def cache_dirs(self, args: PrefetchArguments) -> Optional[CacheDirs]:
+        """
+        :return: the camera's cache directories, created if need be
+        """
+
+        device = args.device
+        if device.photo_cache_dir and os.path.isdir(device.photo_cache_dir) and \
+                device.video_cache_dir and os.path.isdir(device.video_cache_dir):
+            return CacheDirs(device.photo_cache_dir, device.video_cache_dir)
+
+        prefix = cache_dir_name(device.display_name)
+        photo_cache_dir = create_temp_dir(folder=args.cache_dirs.photo_cache_dir, prefix=prefix)
+        video_cache_dir = create_temp_dir(folder=args.cache_dirs.video_cache_dir, prefix=prefix)
+        if photo_cache_dir is None or video_cache_dir is None:
+            return None
+        cache_dirs = CacheDirs(photo_cache_dir, video_cache_dir)
+        self.content = pickle.dumps(
+            PrefetchResults(scan_id=args.scan_id, cache_dirs=cache_dirs), pickle.HIGHEST_PROTOCOL
+        )
+        self.send_message_to_sink()
+        return cache_dirs
+
+    def cached_chunk_size(self, rpd_file: RPDFile) -> int:
+        """
+        :return: how many bytes at the start of the file were kept in the
+         Download Cache when its thumbnail was generated
+        """
+
+        if not rpd_file.temp_cache_full_file_chunk:
+            return 0
+        try:
+            size = os.path.getsize(rpd_file.temp_cache_full_file_chunk)
+        except OSError:
+            rpd_file.temp_cache_full_file_chunk = ''
+            return 0
+        if not 0 < size <= rpd_file.size:
+            rpd_file.temp_cache_full_file_chunk = ''
+            return 0
+        return size
+
+    def prefetch_file(self, rpd_file: RPDFile, download_cache: DownloadCache,
+                      cached_bytes: int) -> Optional[str]:
+        """
+        Save the file in the Download Cache
+
+        :param cached_bytes: how many bytes at the start of the file are
+         already cached
+        :return: the file's full file name in the Download Cache, or None if
+         it could not be read
+        """
+
+        if cached_bytes:
+            # Append the rest of the file to its cached start. Should the process be
+            # stopped, the cached start of the file is left as it was.
+            cache_full_file_name = rpd_file.temp_cache_full_file_chunk
+        else:
+            cache_full_file_name = download_cache.new_file_name(rpd_file)
+            self.partial_file = cache_full_file_name
+
+        try:
+            self.camera.save_file_by_chunks(
+                dir_name=rpd_file.path,
+                file_name=rpd_file.name,
+                size=rpd_file.size,
+                dest_full_filename=cache_full_file_name,
+                progress_callback=None,
+                check_for_command=self.check_for_controller_directive,
+                return_md5=False,
+                start=cached_bytes
+            )
+        except CameraProblemEx as e:
+            if self.partial_file:
+                try:
+                    os.remove(self.partial_file)
+                except OSError:
+                    pass
+                self.partial_file = ''
+            if e.gp_code in (gp.GP_ERROR_IO_USB_FIND, gp.GP_ERROR_BAD_PARAMETERS):
+                raise
+            logging.warning(
+                "Could not prefetch %s from %s", rpd_file.full_file_name, self.display_name
+            )
+            return None
+
+        self.partial_file = ''
+        download_cache.retain(cache_full_file_name, rpd_file.size - cached_bytes)
+        return cache_full_file_name
+
+    def do_work(self) -> None:
+        args = pickle.loads(self.content)  # type: PrefetchArguments
+
+        if args.log_gphoto2:
+            self.gphoto2_logging = gphoto2_python_logging()
+
+        self.display_name = args.device.display_name
+
+        try:
+            os.nice(prefetch_niceness)
+        except OSError:
+            logging.debug("Could not lower the priority of prefetching from %s", self.display_name)
+
+        cache_dirs = self.cache_dirs(args)
+        if cache_dirs is None:
+            logging.error(
+                "Not prefetching from %s because its Download Cache could not be created",
+                self.display_name
+            )
+            self.disconnect_logging()
+            self.send_finished_command()
+            sys.exit(0)
+
+        download_cache = DownloadCache(cache_dirs.photo_cache_dir, cache_dirs.video_cache_dir)
+        download_cache.add_existing_files()
+        if not download_cache.has_room(min(rpd_file.size for rpd_file in args.files)):
+            logging.info(
+                "Not prefetching from %s because its Download Cache is full (%s)",
+                self.display_name, format_size_for_user(download_cache.size)
+            )
+            self.disconnect_logging()
+            self.send_finished_command()
+            sys.exit(0)
+
+        prefs = Preferences()
+        try:
+            self.camera = Camera(
+                args.device.camera_model, args.device.camera_port,
+                raise_errors=True, specific_folders=prefs.folders_to_scan
+            )
+        except CameraProblemEx:
+            logging.error("Could not initialize camera %s to prefetch files", self.display_name)
+            self.disconnect_logging()
+            self.send_finished_command()
+            sys.exit(0)
+
+        rescan = RescanCamera(camera=self.camera, prefs=prefs)
+        rescan.rescan_camera(rpd_files=args.files)
+        rpd_files = sorted(rescan.rpd_files, key=attrgetter('modification_time'))
+
+        logging.info("Prefetching %s files from %s", len(rpd_files), self.display_name)
+
+        prefetched = 0
+        for rpd_file in rpd_files:  # type: RPDFile
+            self.check_for_controller_directive()
+
+            cached_bytes = self.cached_chunk_size(rpd_file)
+            if not download_cache.has_room(rpd_file.size - cached_bytes):
+                logging.info(
+                    "Stopped prefetching from %s because its Download Cache is full (%s)",
+                    self.display_name, format_size_for_user(download_cache.size)
+                )
+                break
+
+            start = time.perf_counter()
+            try:
+                cache_full_file_name = self.prefetch_file(rpd_file, download_cache, cached_bytes)
+            except CameraProblemEx:
+                logging.error(
+                    "Stopped prefetching because %s could not be accessed", self.display_name
+                )
+                break
+            if cache_full_file_name is not None:
+                self.metrics.record_latency('prefetch', time.perf_counter() - start)
+                self.metrics.add_bytes('prefetch', rpd_file.size - cached_bytes)
+                prefetched += 1
+                self.content = pickle.dumps(
+                    PrefetchResults(
+                        scan_id=args.scan_id, uid=rpd_file.uid,
+                        cache_full_file_name=cache_full_file_name
+                    ),
+                    pickle.HIGHEST_PROTOCOL
+                )
+                self.send_message_to_sink()
+
+        logging.info("Prefetched %s of %s files from %s", prefetched, len(rpd_files),
+                     self.display_name)
+
+        self.camera.free_camera()
+        self.camera = None
+        self.disconnect_logging()
+        self.send_finished_command()
+
+
+if __name__ == "__main__":
+    run_worker(PrefetchWorker)
@@ -180,6 +180,12 @@ class FileCopyProblem(SeriousProblem):
         return escape(_('Unable to copy file %s')) % self.href
 
 
+class BackupVerificationProblem(SeriousProblem):
+    @property
+    def body(self) -> str:
+        return escape(_('Backup of %s is not identical to the downloaded file')) % self.href
+
+
 class FileZeroLengthProblem(SeriousProblem):
     @property
     def body(self) -> str:
@@ -110,7 +110,7 @@ from raphodo.storage import (
 from raphodo.interprocess import (
     ScanArguments, CopyFilesArguments, RenameAndMoveFileData, BackupArguments,
     BackupFileData, OffloadData, ProcessLoggingManager, ThumbnailDaemonData, ThreadNames,
-    OffloadManager, CopyFilesManager, ThumbnailDaemonManager,
+    OffloadManager, CopyFilesManager, ThumbnailDaemonManager, PrefetchManager, PrefetchArguments,
     ScanManager, BackupManager, stop_process_logging_manager, RenameMoveFileManager,
     create_inproc_msg)
 from raphodo.devices import (
@@ -124,11 +124,12 @@ from raphodo.constants import (
     DisplayingFilesOfType, DownloadingFileTypes, RememberThisMessage, RightSideButton,
     CheckNewVersionDialogState, CheckNewVersionDialogResult, RememberThisButtons,
     BackupStatus, CompletedDownloads, disable_version_check, FileManagerType, ScalingAction,
-    ScalingDetected
+    ScalingDetected, DownloadStage
 )
 from raphodo.thumbnaildisplay import (
     ThumbnailView, ThumbnailListModel, ThumbnailDelegate, DownloadStats, MarkedSummary
 )
+from raphodo.thumbnailrows import ThumbnailRow
 from raphodo.devicedisplay import (DeviceModel, DeviceView, DeviceDelegate)
 from raphodo.proximity import (TemporalProximityGroups, TemporalProximity)
 from raphodo.utilities import (
@@ -144,7 +145,7 @@ from raphodo.rpdfile import (
 )
 import raphodo.fileformats as fileformats
 import raphodo.downloadtracker as downloadtracker
-from raphodo.cache import ThumbnailCacheSql
+from raphodo.cache import ThumbnailCacheSql, ThumbnailCacheMaintenance, CacheMaintenanceProgress
 from raphodo.programversions import gexiv2_version, exiv2_version, EXIFTOOL_VERSION
 from raphodo.metadatavideo import pymedia_version_info, libmediainfo_missing
 from raphodo.camera import (
@@ -161,10 +162,13 @@ from raphodo.filebrowse import (
 from raphodo.toggleview import QToggleView
 import raphodo.__about__ as __about__
 import raphodo.iplogging as iplogging
+import raphodo.metrics as metrics
 import raphodo.excepthook as excepthook
 from raphodo.panelview import QPanelView
 from raphodo.computerview import ComputerWidget
-from raphodo.folderspreview import DownloadDestination, FoldersPreview
+from raphodo.folderspreview import (
+    DownloadDestination, FoldersPreview, FoldersPreviewDelta, SubfolderGenerationData
+)
 from raphodo.destinationdisplay import DestinationDisplay
 from raphodo.aboutdialog import AboutDialog
 import raphodo.constants as constants
@@ -280,11 +284,21 @@ class FolderPreviewManager(QObject):
             self._generate_folders(rpd_files=rpd_files)
 
     def _generate_folders(self, rpd_files: List[RPDFile]) -> None:
+        # Files sharing the values used to generate their subfolder need only one
+        # subfolder generated, and subfolders already generated need not be again
+        subfolder_keys = self.folders_preview.subfolder_keys(rpd_files=rpd_files)
+        if not subfolder_keys:
+            return
         if not self.devices.scanning or self.rapidApp.downloadIsRunning():
-            logging.info("Generating provisional download folders for %s files", len(rpd_files))
+            logging.info(
+                "Generating provisional download folders for %s files using %s keys",
+                len(rpd_files), len(subfolder_keys)
+            )
         data = OffloadData(
-            rpd_files=rpd_files, strip_characters=self.prefs.strip_characters,
-            folders_preview=self.folders_preview
+            subfolder_generation=SubfolderGenerationData(
+                folders_preview=self.folders_preview, subfolder_keys=subfolder_keys,
+                strip_characters=self.prefs.strip_characters
+            )
         )
         self.offloaded = True
         self.rapidApp.sendToOffload(data=data)
@@ -320,20 +334,20 @@ class FolderPreviewManager(QObject):
         if rpd_files:
             self.add_rpd_files(rpd_files=rpd_files)
 
-    @pyqtSlot(FoldersPreview)
-    def folders_generated(self, folders_preview: FoldersPreview) -> None:
+    @pyqtSlot(FoldersPreviewDelta)
+    def folders_generated(self, delta: FoldersPreviewDelta) -> None:
         """
-        Receive the folders_preview from the offload process, and
-        handle any tasks that may have been queued in the time it was
+        Receive the changes made to the folders_preview by the offload process,
+        and handle any tasks that may have been queued in the time it was
         being processed in the offload process
 
-        :param folders_preview: the folders_preview as worked on by the
+        :param delta: the changes made to the folders_preview by the
          offload process
         """
 
-        logging.debug("Provisional download folders received")
+        logging.debug("Provisional download folders received: %s", delta)
         self.offloaded = False
-        self.folders_preview = folders_preview
+        self.folders_preview.apply_delta(delta)
 
         dirty = self.folders_preview.dirty
         self.folders_preview.dirty = False
@@ -462,6 +476,7 @@ class RapidWindow(QMainWindow):
     reverifyDownloadedTar = pyqtSignal(str)
     udisks2Unmount = pyqtSignal(str)
 
+    @metrics.startup.stage
     def __init__(self, splash: 'SplashScreen',
                  fractional_scaling: str,
                  scaling_set: str,
@@ -664,8 +679,6 @@ class RapidWindow(QMainWindow):
         if self.prefs.list_not_empty('camera_blacklist'):
             logging.info("Blacklisted cameras: %s", " ; ".join(self.prefs.camera_blacklist))
 
-        self.prefs.verify_file = False
-
         logging.debug("Starting main ExifTool process")
         self.exiftool_process = exiftool.ExifTool()
         self.exiftool_process.start()
@@ -679,10 +692,19 @@ class RapidWindow(QMainWindow):
 
         self.download_paused = False
 
+        # Whether the prefetch manager is ready to start workers, and whether
+        # its workers are paused while thumbnails are generated
+        self.prefetch_manager_started = False
+        self.prefetch_paused = False
+
         self.startThreadControlSockets()
         self.startProcessLogger()
 
     def checkPrefsUpgrade(self) -> None:
+        if not self.prefs.value_is_set('max_thumbnail_cache_mb'):
+            self.prefs.set_max_thumbnail_cache_mb_default(
+                new_install=not len(self.prefs.program_version)
+            )
         if self.prefs.program_version != __about__.__version__:
             previous_version = self.prefs.program_version
             if not len(previous_version):
@@ -729,6 +751,9 @@ class RapidWindow(QMainWindow):
         self.copy_controller = context.socket(zmq.PAIR)
         self.copy_controller.bind(inproc.format(ThreadNames.copy))
 
+        self.prefetch_controller = context.socket(zmq.PAIR)
+        self.prefetch_controller.bind(inproc.format(ThreadNames.prefetch))
+
         self.backup_controller = context.socket(zmq.PAIR)
         self.backup_controller.bind(inproc.format(ThreadNames.backup))
 
@@ -773,6 +798,11 @@ class RapidWindow(QMainWindow):
         )
 
     def startProcessLogger(self) -> None:
+        # Pipeline metrics received from worker processes and the startup trace
+        # are saved alongside the log file
+        log_dir = os.path.dirname(iplogging.full_log_file_path())
+        metrics.aggregator.set_directory(log_dir)
+        metrics.startup.set_directory(log_dir)
         self.loggermq = ProcessLoggingManager()
         self.loggermqThread = QThread()
         self.loggermq.moveToThread(self.loggermqThread)
@@ -783,6 +813,7 @@ class RapidWindow(QMainWindow):
         QTimer.singleShot(0, self.loggermqThread.start)
 
     @pyqtSlot(int)
+    @metrics.startup.stage
     def initStage2(self, logging_port: int) -> None:
         logging.debug("...logging subscription manager started")
         self.logging_port = logging_port
@@ -799,24 +830,29 @@ class RapidWindow(QMainWindow):
             self.prefs.purge_thumbnails = False
             # Recreate the cache on the file system
             ThumbnailCacheSql(create_table_if_not_exists=True)
-        elif self.prefs.optimize_thumbnail_db:
-            cache = ThumbnailCacheSql(create_table_if_not_exists=True)
-            logging.info("Optimizing thumbnail cache...")
-            db, fs, size = cache.optimize()
-            logging.info("...thumbnail cache has been optimized.")
-
-            if db:
-                logging.info("Removed %s files from thumbnail database", db)
-            if fs:
-                logging.info("Removed %s thumbnails from file system", fs)
-            if size:
-                logging.info("Thumbnail database size reduction: %s", format_size_for_user(size))
-
-            self.prefs.optimize_thumbnail_db = False
         else:
             # Recreate the cache on the file system
             t = ThumbnailCacheSql(create_table_if_not_exists=True)
 
+        # Maintain the thumbnail cache in the background, yielding between slices of work
+        # The preference to optimize it is reset only once optimization is completed
+        optimize = self.prefs.optimize_thumbnail_db
+        if optimize:
+            logging.info("Optimizing thumbnail cache in the background...")
+        self.thumbnailCacheMaintenance = ThumbnailCacheMaintenance(
+            days=self.prefs.keep_thumbnails_days,
+            max_size=self.prefs.max_thumbnail_cache_mb * 1024 * 1024,
+            optimize=optimize
+        )
+        self.thumbnailCacheMaintenanceThread = QThread()
+        self.thumbnailCacheMaintenanceThread.started.connect(self.thumbnailCacheMaintenance.start)
+        self.thumbnailCacheMaintenance.progress.connect(self.thumbnailCacheMaintenanceProgress)
+        self.thumbnailCacheMaintenance.finished.connect(self.thumbnailCacheMaintenanceFinished)
+        self.thumbnailCacheMaintenance.moveToThread(self.thumbnailCacheMaintenanceThread)
+        QTimer.singleShot(
+            0, lambda: self.thumbnailCacheMaintenanceThread.start(QThread.LowestPriority)
+        )
+
         # For meaning of 'Devices', see devices.py
         self.devices = DeviceCollection(self.exiftool_process, self)
         self.backup_devices = BackupDeviceCollection(rapidApp=self)
@@ -833,6 +869,7 @@ class RapidWindow(QMainWindow):
         QTimer.singleShot(0, self.thumbnaildaemonmqThread.start)
 
     @pyqtSlot()
+    @metrics.startup.stage
     def initStage3(self) -> None:
         logging.debug("Stage 3 initialization")
 
@@ -850,6 +887,7 @@ class RapidWindow(QMainWindow):
         self.thumbnailView.setItemDelegate(ThumbnailDelegate(rapidApp=self))
 
     @pyqtSlot(int)
+    @metrics.startup.stage
     def initStage4(self, frontend_port: int) -> None:
         logging.debug("Stage 4 initialization")
 
@@ -1036,6 +1074,7 @@ class RapidWindow(QMainWindow):
 
 
     @pyqtSlot()
+    @metrics.startup.stage
     def initStage5(self) -> None:
         logging.debug("...offload manager started")
         self.sendStartToThread(self.offload_controller)
@@ -1066,6 +1105,7 @@ class RapidWindow(QMainWindow):
         QTimer.singleShot(0, self.renameThread.start)
 
     @pyqtSlot()
+    @metrics.startup.stage
     def initStage6(self) -> None:
         logging.debug("...rename manager started")
 
@@ -1093,6 +1133,7 @@ class RapidWindow(QMainWindow):
         QTimer.singleShot(0, self.scanThread.start)
 
     @pyqtSlot()
+    @metrics.startup.stage
     def initStage7(self) -> None:
         logging.debug("...scan manager started")
 
@@ -1116,7 +1157,30 @@ class RapidWindow(QMainWindow):
         logging.debug("Starting copy files manager...")
         QTimer.singleShot(0, self.copyfilesThread.start)
 
+        # Setup the prefetch process. Nothing waits on it being started, because
+        # prefetching is never needed to continue.
+        self.prefetchThread = QThread()
+        self.prefetchmq = PrefetchManager(logging_port=self.logging_port)
+
+        self.prefetchThread.started.connect(self.prefetchmq.run_sink)
+        self.prefetchmq.sinkStarted.connect(self.prefetchManagerStarted)
+        self.prefetchmq.message.connect(self.filePrefetched)
+        self.prefetchmq.cacheDirs.connect(self.thumbnailModel.cacheDirsReceived)
+        self.prefetchmq.workerFinished.connect(self.prefetchFinished)
+        self.prefetchmq.workerStopped.connect(self.prefetchStopped)
+
+        self.prefetchmq.moveToThread(self.prefetchThread)
+
+        QTimer.singleShot(0, self.prefetchThread.start)
+
+    @pyqtSlot()
+    def prefetchManagerStarted(self) -> None:
+        logging.debug("...prefetch manager started")
+        self.prefetch_manager_started = True
+        self.prefetchFromCameras()
+
     @pyqtSlot()
+    @metrics.startup.stage
     def initStage8(self) -> None:
         logging.debug("...copy files manager started")
 
@@ -1137,6 +1201,7 @@ class RapidWindow(QMainWindow):
         QTimer.singleShot(0, self.backupThread.start)
 
     @pyqtSlot()
+    @metrics.startup.stage
     def initStage9(self) -> None:
         logging.debug("...backup manager started")
 
@@ -1245,6 +1310,7 @@ class RapidWindow(QMainWindow):
 
             self.window_show_requested_time = datetime.datetime.now()
             self.show()
+            metrics.startup.mark('main window shown')
             if self.deferred_resize_and_move_until_after_show:
                 self.resizeAndMoveMainWindow()
 
@@ -1454,6 +1520,31 @@ class RapidWindow(QMainWindow):
         delegate = self.thumbnailView.itemDelegate()  # type: ThumbnailDelegate
         delegate.applyJobCode(job_code=job_code)
 
+    @pyqtSlot('PyQt_PyObject')
+    def thumbnailCacheMaintenanceProgress(self, progress: CacheMaintenanceProgress) -> None:
+        if progress.total is None:
+            logging.debug(
+                "Thumbnail cache maintenance: %s (%s)", progress.stage.name, progress.done
+            )
+        else:
+            logging.debug(
+                "Thumbnail cache maintenance: %s (%s of %s)", progress.stage.name,
+                progress.done, progress.total
+            )
+
+    @pyqtSlot('PyQt_PyObject', bool)
+    def thumbnailCacheMaintenanceFinished(self, reclaimed: int, optimized: bool) -> None:
+        if optimized:
+            logging.info("Thumbnail cache optimization finished")
+            self.prefs.optimize_thumbnail_db = False
+        if reclaimed:
+            logging.info(
+                "Thumbnail cache maintenance reclaimed %s", format_size_for_user(reclaimed)
+            )
+        else:
+            logging.debug("Thumbnail cache maintenance finished")
+        self.thumbnailCacheMaintenanceThread.quit()
+
     @pyqtSlot(bool, version_details, version_details, str, bool, bool, bool)
     def newVersionCheckMade(self, success: bool,
                             stable_version: version_details,
@@ -3044,14 +3135,26 @@ Do you want to proceed with the download?
                 self.devices.cameras_to_stop_thumbnailing.add(scan_id)
                 stop_thumbnailing_cmd_issued = True
 
+        # Files already prefetched are in the download, so prefetching can stop
+        stop_prefetching = [
+            scan_id for scan_id in self.download_files.files if scan_id in self.devices.prefetching
+        ]
+        for scan_id in stop_prefetching:
+            logging.debug(
+                "Stopping prefetching from %s because a download is starting",
+                self.devices[scan_id].display_name
+            )
+            self.sendStopWorkerToThread(self.prefetch_controller, scan_id)
+            self.devices.cameras_to_stop_prefetching.add(scan_id)
+
         if self.gvfsControlsMounts:
             mount_points = {}
-            # If a device was being thumbnailed, then it wasn't mounted by GVFS
-            # Therefore filter out the cameras we've already requested their
-            # thumbnailing be stopped
+            # If a device was being thumbnailed or prefetched from, then it wasn't
+            # mounted by GVFS. Therefore filter out the cameras we've already requested
+            # their thumbnailing or prefetching be stopped
             still_to_check = [
                 scan_id for scan_id in self.download_files.camera_access_needed
-                if scan_id not in stop_thumbnailing
+                if scan_id not in stop_thumbnailing and scan_id not in stop_prefetching
             ]
             for scan_id in still_to_check:
                 # This next value is likely *always* True, but check nonetheless
@@ -3074,7 +3177,8 @@ Do you want to proceed with the download?
                         model, port, download_starting=True, mount_point=mount_points[(model, port)]
                     )
 
-        if not camera_unmounts_called and not stop_thumbnailing_cmd_issued:
+        if not camera_unmounts_called and not stop_thumbnailing_cmd_issued and \
+                not stop_prefetching:
             self.startDownloadPhase2()
 
     def startDownloadPhase2(self) -> None:
@@ -3274,7 +3378,7 @@ Do you want to proceed with the download?
                         download_stats.videos_size_in_bytes
 
         if self.prefs.backup_files:
-            download_size += (
+            backup_size = (
                 (
                     len(self.backup_devices.photo_backup_devices) *
                     download_stats.photos_size_in_bytes
@@ -3283,8 +3387,13 @@ Do you want to proceed with the download?
                     download_stats.videos_size_in_bytes
                 )
             )
+        else:
+            backup_size = 0
 
-        self.time_remaining[scan_id] = download_size
+        self.time_remaining.add_device(
+            scan_id=scan_id, copy_size=download_size, backup_size=backup_size,
+            no_files=download_stats.no_photos + download_stats.no_videos
+        )
         self.time_check.set_download_mark()
 
         self.devices.set_device_state(scan_id, DeviceState.downloading)
@@ -3419,7 +3528,7 @@ Do you want to proceed with the download?
             model = self.mapModel(scan_id)
             model.percent_complete[scan_id] = self.download_tracker.get_percent_complete(scan_id)
         self.time_check.increment(bytes_downloaded=chunk_downloaded)
-        self.time_remaining.update(scan_id, bytes_downloaded=chunk_downloaded)
+        self.time_remaining.update(scan_id, DownloadStage.copy, chunk_downloaded)
         self.updateFileDownloadDeviceProgress()
 
     @pyqtSlot(int, 'PyQt_PyObject')
@@ -3465,6 +3574,8 @@ Do you want to proceed with the download?
             )
             return
 
+        self.time_remaining.update(scan_id, DownloadStage.rename, 1)
+
         if rpd_file.mdatatime_caused_ctime_change and scan_id not in \
                 self.thumbnailModel.ctimes_differ:
             self.thumbnailModel.addCtimeDisparity(rpd_file=rpd_file)
@@ -3582,6 +3693,94 @@ Do you want to proceed with the download?
                     device.display_name
                 )
 
+    def prefetchFromCameras(self) -> None:
+        """
+        Copy the files marked for download on each camera that is otherwise
+        idle into its Download Cache, so that when the download starts they
+        are moved into place rather than read from the camera.
+
+        Nothing new is prefetched while thumbnails are being generated.
+        Prefetching paused while they were generated is resumed.
+        """
+
+        if not self.prefetch_manager_started or self.thumbnailModel.generating_thumbnails:
+            return
+
+        self.resumePrefetch()
+
+        if not self.prefs.prefetch_from_cameras or \
+                self.application_state != ApplicationState.normal:
+            return
+
+        for scan_id in self.devices:
+            device = self.devices[scan_id]
+            if (device.device_type != DeviceType.camera or scan_id in self.devices.prefetching
+                    or self.deviceState(scan_id) != DeviceState.idle):
+                continue
+            files = self.thumbnailModel.getFilesToPrefetch(scan_id)
+            if not files:
+                continue
+            logging.debug(
+                "Prefetching %s files marked for download from %s", len(files),
+                device.display_name
+            )
+            prefetch_args = PrefetchArguments(
+                scan_id=scan_id,
+                device=device,
+                files=files,
+                cache_dirs=self.thumbnailModel.getCacheLocations(),
+                log_gphoto2=self.log_gphoto2
+            )
+            self.devices.prefetching.add(scan_id)
+            self.sendStartWorkerToThread(
+                self.prefetch_controller, worker_id=scan_id, data=prefetch_args
+            )
+
+    def pausePrefetch(self) -> None:
+        """
+        Pause prefetching while thumbnails are generated
+        """
+
+        if self.devices.prefetching and not self.prefetch_paused:
+            logging.debug("Pausing prefetching while thumbnails are generated")
+            self.sendPauseToThread(self.prefetch_controller)
+            self.prefetch_paused = True
+
+    def resumePrefetch(self) -> None:
+        if self.prefetch_paused and not self.thumbnailModel.generating_thumbnails:
+            logging.debug("Resuming prefetching")
+            self.sendResumeToThread(self.prefetch_controller)
+            self.prefetch_paused = False
+
+    @pyqtSlot(int, bytes, str)
+    def filePrefetched(self, scan_id: int, uid: bytes, cache_full_file_name: str) -> None:
+        self.thumbnailModel.filePrefetched(uid=uid, cache_full_file_name=cache_full_file_name)
+
+    @pyqtSlot(int)
+    def prefetchFinished(self, scan_id: int) -> None:
+        self.prefetchEnded(scan_id)
+
+    @pyqtSlot(int)
+    def prefetchStopped(self, scan_id: int) -> None:
+        self.prefetchEnded(scan_id)
+
+    def prefetchEnded(self, scan_id: int) -> None:
+        """
+        The prefetch worker finished or was stopped. If a download was
+        waiting for it to release the camera, start the download.
+
+        :param scan_id: scan_id of the camera that was being prefetched from
+        """
+
+        self.devices.prefetching.discard(scan_id)
+        if not self.devices.prefetching:
+            self.prefetch_paused = False
+        if scan_id in self.devices.cameras_to_stop_prefetching:
+            self.devices.cameras_to_stop_prefetching.remove(scan_id)
+            logging.debug("Prefetching stopped for %s", self.devices[scan_id].display_name)
+            if not self.devices.download_start_blocked():
+                self.startDownloadPhase2()
+
     @pyqtSlot(int, 'PyQt_PyObject')
     def backupFileProblems(self, device_id: int, problems: BackingUpProblems) -> None:
         for problem in self.backup_metadata_errors.problems(worker_id=device_id):
@@ -3688,7 +3887,7 @@ Do you want to proceed with the download?
     def backupFileBytesBackedUp(self, scan_id: int, chunk_downloaded: int) -> None:
         self.download_tracker.increment_bytes_backed_up(scan_id, chunk_downloaded)
         self.time_check.increment(bytes_downloaded=chunk_downloaded)
-        self.time_remaining.update(scan_id, bytes_downloaded=chunk_downloaded)
+        self.time_remaining.update(scan_id, DownloadStage.backup, chunk_downloaded)
         self.updateFileDownloadDeviceProgress()
 
     def initializeBackupThumbCache(self) -> None:
@@ -3852,6 +4051,7 @@ Do you want to proceed with the download?
         self.updateProgressBarState()
         self.thumbnailModel.updateDeviceDisplayCheckMark(scan_id=scan_id)
 
+        self.time_remaining.log_stats(scan_id)
         del self.time_remaining[scan_id]
         self.notifyDownloadedFromDevice(scan_id)
         if files_remaining == 0 and self.prefs.auto_unmount:
@@ -3859,6 +4059,8 @@ Do you want to proceed with the download?
 
         if not self.downloadIsRunning():
             logging.debug("Download completed")
+            metrics.aggregator.log_summary()
+            metrics.aggregator.dump()
             self.dl_update_timer.stop()
             self.enablePrefsAndRefresh(enabled=True)
             self.notifyDownloadComplete()
@@ -3928,9 +4130,25 @@ Do you want to proceed with the download?
             downloading = self.devices.downloading_from()
 
             time_remaining = self.time_remaining.time_remaining(self.prefs.detailed_time_remaining)
+            bottleneck = self.time_remaining.bottleneck()
             if (time_remaining is None or
                     time.time() < self.download_start_time + constants.ShowTimeAndSpeedDelay):
                 message = downloading
+            elif self.prefs.detailed_time_remaining and bottleneck is not None:
+                # Translators - in the middle is a unicode em dash - please retain it
+                # This string is displayed in the status bar when the download is running.
+                # The stage is one of copying, renaming or backing up.
+                # Translators: %(variable)s represents Python code, not a plural of the term
+                # variable. You must keep the %(variable)s untranslated, or the program will
+                # crash.
+                message = _(
+                    '%(downloading_from)s — %(time_left)s left (%(speed)s, limited by %(stage)s)'
+                ) % dict(
+                    downloading_from=downloading,
+                    time_left=time_remaining,
+                    speed=download_speed,
+                    stage=downloadtracker.download_stage_name(bottleneck)
+                )
             else:
                 # Translators - in the middle is a unicode em dash - please retain it
                 # This string is displayed in the status bar when the download is running
@@ -4271,15 +4489,22 @@ Do you want to proceed with the download?
 
         return self.devices.device_state[scan_id]
 
-    @pyqtSlot('PyQt_PyObject', 'PyQt_PyObject', FileTypeCounter, 'PyQt_PyObject', bool, bool)
+    @pyqtSlot(
+        'PyQt_PyObject', 'PyQt_PyObject', 'PyQt_PyObject', FileTypeCounter, 'PyQt_PyObject',
+        bool, bool
+    )
     def scanFilesReceived(self, rpd_files: List[RPDFile],
+                          thumbnail_rows: List[ThumbnailRow],
                           sample_files: List[RPDFile],
                           file_type_counter: FileTypeCounter,
                           file_size_sum: FileSizeSum,
                           entire_video_required: Optional[bool],
                           entire_photo_required: Optional[bool]) -> None:
         """
-        Process scanned file information received from the scan process
+        Process scanned file information received from the scan process.
+
+        The scan manager coalesces the files scanned from a device, and
+        creates their thumbnail rows, before sending them here.
         """
 
         # Update scan running totals
@@ -4319,7 +4544,8 @@ Do you want to proceed with the download?
         self.mapModel(scan_id).updateDeviceScan(scan_id)
 
         self.thumbnailModel.addFiles(
-            scan_id=scan_id, rpd_files=rpd_files, generate_thumbnail=not self.autoStart(scan_id)
+            scan_id=scan_id, rpd_files=rpd_files, generate_thumbnail=not self.autoStart(scan_id),
+            thumbnail_rows=thumbnail_rows
         )
         self.folder_preview_manager.add_rpd_files(rpd_files=rpd_files)
 
@@ -4592,6 +4818,8 @@ Do you want to proceed with the download?
                 self.devices.set_device_state(scan_id, DeviceState.thumbnailing)
                 self.updateProgressBarState()
                 self.thumbnailModel.generateThumbnails(scan_id, self.devices[scan_id])
+            else:
+                self.prefetchFromCameras()
             self.displayMessageInStatusBar()
         elif auto_start:
             self.displayMessageInStatusBar()
@@ -4615,6 +4843,7 @@ Do you want to proceed with the download?
             # not generating thumbnails, and auto start is not on
             model.setSpinnerState(scan_id, DeviceState.idle)
             self.displayMessageInStatusBar()
+            self.prefetchFromCameras()
 
     def autoStart(self, scan_id: int) -> bool:
         """
@@ -4692,6 +4921,7 @@ Do you want to proceed with the download?
             self.sendStopToThread(self.scan_controller)
             self.thumbnailModel.stopThumbnailer()
             self.sendStopToThread(self.copy_controller)
+            self.sendStopToThread(self.prefetch_controller)
 
             if self.downloadIsRunning():
                 logging.debug("Exiting while download is running. Cleaning up...")
@@ -4746,6 +4976,10 @@ Do you want to proceed with the download?
         if not self.copyfilesThread.wait(1000):
             self.sendTerminateToThread(self.copy_controller)
 
+        self.prefetchThread.quit()
+        if not self.prefetchThread.wait(1000):
+            self.sendTerminateToThread(self.prefetch_controller)
+
         self.sendStopToThread(self.backup_controller)
         self.backupThread.quit()
         if not self.backupThread.wait(1000):
@@ -4763,6 +4997,15 @@ Do you want to proceed with the download?
             self.newVersionThread.quit()
             self.newVersionThread.wait(100)
 
+        # Any thumbnail cache maintenance not yet done will be done at next startup,
+        # including optimization, which remains requested until it is completed. A
+        # vacuum in progress is interrupted, which leaves the db as it was before. Every
+        # other slice of work checks for the interruption, so waiting is brief.
+        self.thumbnailCacheMaintenanceThread.requestInterruption()
+        self.thumbnailCacheMaintenance.interrupt()
+        self.thumbnailCacheMaintenanceThread.quit()
+        self.thumbnailCacheMaintenanceThread.wait()
+
         self.sendStopToThread(self.thumbnail_deamon_controller)
         self.thumbnaildaemonmqThread.quit()
         if not self.thumbnaildaemonmqThread.wait(2000):
@@ -4779,9 +5022,6 @@ Do you want to proceed with the download?
         self.cleanAllTempDirs()
         logging.debug("Cleaning any device cache dirs and sample video")
         self.devices.delete_cache_dirs_and_sample_video()
-        tc = ThumbnailCacheSql(create_table_if_not_exists=False)
-        logging.debug("Cleaning up Thumbnail cache")
-        tc.cleanup_cache(days=self.prefs.keep_thumbnails_days)
 
         Notify.uninit()
 
@@ -5315,6 +5555,8 @@ Do you want to proceed with the download?
             # TODO need correct check for "is thumbnailing", given is now asynchronous
             elif device_state == DeviceState.thumbnailing:
                 self.thumbnailModel.terminateThumbnailGeneration(scan_id)
+            if scan_id in self.devices.prefetching:
+                self.sendStopWorkerToThread(self.prefetch_controller, scan_id)
 
             if ignore_in_this_program_instantiation:
                 self.devices.ignore_device(scan_id=scan_id)
@@ -6395,6 +6637,10 @@ def critical_startup_error(message: str) -> None:
 
 
 def main():
+    metrics.startup.record(
+        'interpreter start and imports', began=0.0, seconds=metrics.startup.elapsed()
+    )
+
     scaling_action = ScalingAction.not_set
 
     scaling_detected, xsetting_running = any_screen_scaled()
@@ -30,12 +30,15 @@ __copyright__ = "Copyright 2011-2020, Damon Lynch"
 import os
 from datetime import datetime
 from enum import Enum
-from collections import namedtuple
+from collections import namedtuple, deque
+from concurrent.futures import ThreadPoolExecutor, Future
+from itertools import chain
 import errno
 import logging
 import pickle
+import queue
 import sys
-from typing import Union, Tuple, Dict, Optional
+from typing import Union, Tuple, Dict, Optional, List, Set
 import sqlite3
 import locale
 try:
@@ -44,7 +47,7 @@ try:
 except locale.Error:
     pass
 
-
+import zmq
 
 import raphodo.exiftool as exiftool
 import raphodo.generatename as gn
@@ -53,6 +56,8 @@ from raphodo.constants import ConflictResolution, FileType, DownloadStatus, Rena
 from raphodo.interprocess import RenameAndMoveFileData, RenameAndMoveFileResults, DaemonProcess
 from raphodo.rpdfile import RPDFile, Photo, Video
 from raphodo.rpdsql import DownloadedSQL
+from raphodo.metadatarecord import metadata_fields_needed
+from raphodo.metadataphoto import initialize_gexiv2
 from raphodo.utilities import stdchannel_redirected, datetime_roughly_equal, platform_c_maxint
 from raphodo.problemnotification import (
     FileAlreadyExistsProblem, IdentifierAddedProblem, RenamingProblems, make_href,
@@ -211,38 +216,45 @@ def _generate_name(generator: Union[gn.PhotoName, gn.PhotoSubfolder, gn.VideoNam
 
 def generate_subfolder(rpd_file: Union[Photo, Video],
                        et_process: exiftool.ExifTool,
-                       problems: RenamingProblems) -> None:
+                       problems: RenamingProblems,
+                       generator: Optional[Union[gn.PhotoSubfolder,
+                                                 gn.VideoSubfolder]]=None) -> None:
     """
     Generate subfolder names e.g. 2015/201512
     
     :param rpd_file: file to work on
     :param et_process:  the daemon ExifTool process
     :param problems: problems encountered renaming the file
+    :param generator: compiled subfolder generator to use, if any
     """
     
-    if rpd_file.file_type == FileType.photo:
-        generator = gn.PhotoSubfolder(rpd_file.subfolder_pref_list, problems=problems)
-    else:
-        generator = gn.VideoSubfolder(rpd_file.subfolder_pref_list, problems=problems)
+    if generator is None:
+        if rpd_file.file_type == FileType.photo:
+            generator = gn.PhotoSubfolder(rpd_file.subfolder_pref_list, problems=problems)
+        else:
+            generator = gn.VideoSubfolder(rpd_file.subfolder_pref_list, problems=problems)
 
     rpd_file.download_subfolder = _generate_name(generator, rpd_file, et_process, problems)
 
 
 def generate_name(rpd_file: Union[Photo, Video],
                   et_process: exiftool.ExifTool,
-                  problems: RenamingProblems) -> None:
+                  problems: RenamingProblems,
+                  generator: Optional[Union[gn.PhotoName, gn.VideoName]]=None) -> None:
     """
     Generate file names e.g. 20150607-1.cr2
 
     :param rpd_file: file to work on
     :param et_process:  the daemon ExifTool process
     :param problems: problems encountered renaming the file
+    :param generator: compiled file name generator to use, if any
     """
 
-    if rpd_file.file_type == FileType.photo:
-        generator = gn.PhotoName(pref_list=rpd_file.name_pref_list, problems=problems)
-    else:
-        generator = gn.VideoName(pref_list=rpd_file.name_pref_list, problems=problems)
+    if generator is None:
+        if rpd_file.file_type == FileType.photo:
+            generator = gn.PhotoName(pref_list=rpd_file.name_pref_list, problems=problems)
+        else:
+            generator = gn.VideoName(pref_list=rpd_file.name_pref_list, problems=problems)
 
     rpd_file.download_name = _generate_name(generator, rpd_file, et_process, problems)
 
@@ -270,6 +282,9 @@ class RenameMoveFileWorker(DaemonProcess):
         # clarifies any problems with type checking in an IDE
         self.problems = RenamingProblems()
 
+        # Assigned in run()
+        self.workers = None  # type: Optional[ThreadPoolExecutor]
+
     def notify_file_already_exists(self, rpd_file: Union[Photo, Video],
                                    identifier: Optional[str]=None) -> None:
         """
@@ -583,14 +598,22 @@ class RenameMoveFileWorker(DaemonProcess):
         else:
             return True
 
-    def add_unique_identifier(self, rpd_file: Union[Photo, Video]) -> bool:
+    def destination_taken(self, full_file_name: str) -> bool:
+        """
+        :param full_file_name: a potential download file name
+        :return: True if the file already exists, or if it has been assigned to
+         another file that is in the process of being moved
+        """
+
+        return full_file_name in self.reserved_destinations or os.path.exists(full_file_name)
+
+    def add_unique_identifier(self, rpd_file: Union[Photo, Video]) -> str:
         """
         Adds a unique identifier like _1 to a filename, in ever
         incrementing values, until a unique filename is generated.
 
         :param rpd_file: the file being worked on
-        :return: True if the operation was successful, else returns
-         False
+        :return: the identifier that was added
         """
 
         name = os.path.splitext(rpd_file.download_name)
@@ -602,20 +625,11 @@ class RenameMoveFileWorker(DaemonProcess):
             rpd_file.download_full_file_name = os.path.join(
                 rpd_file.download_path, rpd_file.download_name
             )
-
-            try:
-                if os.path.exists(rpd_file.download_full_file_name):
-                    raise OSError(
-                        errno.EEXIST, "File exists: %s" % rpd_file.download_full_file_name
-                    )
-                os.rename(rpd_file.temp_full_file_name, rpd_file.download_full_file_name)
-                self.notify_file_already_exists(rpd_file, identifier)
-                return True
-
-            except OSError as inst:
-                if inst.errno != errno.EEXIST:
-                    self.notify_download_failure_file_error(rpd_file, inst)
-                    return False
+            if not self.destination_taken(rpd_file.download_full_file_name):
+                rpd_file.download_full_base_name = os.path.splitext(
+                    rpd_file.download_full_file_name
+                )[0]
+                return identifier
 
     def sync_raw_jpg(self, rpd_file: Union[Photo, Video]) -> SyncRawJpegResult:
 
@@ -687,7 +701,10 @@ class RenameMoveFileWorker(DaemonProcess):
 
         rpd_file.strip_characters = self.prefs.strip_characters
 
-        generate_subfolder(rpd_file, self.exiftool_process, self.problems)
+        generate_subfolder(
+            rpd_file, self.exiftool_process, self.problems,
+            self.subfolder_generators[rpd_file.file_type]
+        )
 
         if rpd_file.download_subfolder:
             logging.debug("Generated subfolder name %s for file %s",
@@ -700,7 +717,10 @@ class RenameMoveFileWorker(DaemonProcess):
             rpd_file.sequences = self.sequences
 
             # generate the file name
-            generate_name(rpd_file, self.exiftool_process, self.problems)
+            generate_name(
+                rpd_file, self.exiftool_process, self.problems,
+                self.name_generators[rpd_file.file_type]
+            )
 
             if rpd_file.name_generation_problem:
                 logging.warning(
@@ -717,15 +737,69 @@ class RenameMoveFileWorker(DaemonProcess):
 
         return self.check_for_fatal_name_generation_errors(rpd_file)
 
-    def move_file(self, rpd_file: Union[Photo, Video]) -> bool:
+    def prefetch_metadata(self, rpd_file: Union[Photo, Video]) -> None:
         """
-        Having generated the file name and subfolder names, move
-        the file
-        :param rpd_file: photo or video being worked on
-        :return: True if move succeeded, False otherwise
+        Load the file's metadata in a worker thread, ahead of its turn to have
+        its name generated.
+
+        Any problem is ignored here: the metadata will be loaded again when the
+        name is generated, and the problem reported then.
+
+        :param rpd_file: photo or video
+        """
+
+        if rpd_file.use_metadata_record(self.metadata_fields[rpd_file.file_type]):
+            # Values recorded when the thumbnail was generated are all that is needed
+            return
+
+        et_process = self.exiftool_processes.get()
+        try:
+            if load_metadata(rpd_file, et_process, RenamingProblems()):
+                # Values from ExifTool are loaded on first use
+                rpd_file.date_time()
+        except Exception:
+            logging.exception("Error prefetching metadata for %s", rpd_file.full_file_name)
+            rpd_file.metadata = None
+        finally:
+            self.exiftool_processes.put(et_process)
+
+        # The ExifTool process just used will be used by other worker threads,
+        # so any further metadata must be read using the daemon's own process
+        if rpd_file.metadata is not None and hasattr(rpd_file.metadata, 'et_process'):
+            rpd_file.metadata.et_process = self.exiftool_process
+
+    def assign_destination(self, rpd_file: Union[Photo, Video],
+                           download_count: int) -> Tuple[bool, Optional[str]]:
+        """
+        Generate file & subfolder name, resolve any conflict with an existing
+        file, and assign sequence values.
+
+        Files are passed to this method one at a time, in the order they were
+        downloaded, which keeps sequence values identical to those generated
+        when files were processed one after the other. The file itself is not
+        moved.
+
+        Sequence values are incremented assuming the subsequent move will
+        succeed.
+
+        :param rpd_file: photo or video
+        :param download_count: used to track the file being downloaded via a counter
+        :return: whether the file should be moved, and any unique identifier that
+         was added to its name
         """
 
-        move_succeeded = False
+        self.prepare_rpd_file(rpd_file)
+
+        synchronize_raw_jpg = self.must_synchronize_raw_jpg and rpd_file.file_type == FileType.photo
+
+        if synchronize_raw_jpg:
+            sync_result = self.sync_raw_jpg(rpd_file)
+
+            if sync_result.failed:
+                return False, None
+
+        if not self.generate_names(rpd_file, synchronize_raw_jpg):
+            return False, None
 
         rpd_file.download_path = os.path.join(rpd_file.download_folder, rpd_file.download_subfolder)
         rpd_file.download_full_file_name = os.path.join(
@@ -733,6 +807,57 @@ class RenameMoveFileWorker(DaemonProcess):
         )
         rpd_file.download_full_base_name = os.path.splitext(rpd_file.download_full_file_name)[0]
 
+        identifier = None
+        if self.destination_taken(rpd_file.download_full_file_name):
+            if not self.download_file_exists(rpd_file):
+                return False, None
+            identifier = self.add_unique_identifier(rpd_file)
+
+        self.reserved_destinations.add(rpd_file.download_full_file_name)
+
+        logging.debug("Assigned destination for file: %s", download_count)
+
+        if synchronize_raw_jpg:
+            if sync_result.sequence_to_use is None:
+                sequence = self.sequences.create_matched_sequences()
+            else:
+                sequence = sync_result.sequence_to_use
+            self.sync_raw_jpeg.add_download(
+                name=sync_result.photo_name,
+                extension=sync_result.photo_ext,
+                date_time=rpd_file.date_time(),
+                sequence_number_used=sequence)
+
+        if not synchronize_raw_jpg or (synchronize_raw_jpg and
+                                       sync_result.sequence_to_use is None):
+
+            if self.uses_sequence_session_no or self.uses_sequence_letter:
+                self.sequences.increment(
+                    self.uses_sequence_session_no, self.uses_sequence_letter
+                )
+            if self.uses_stored_sequence_no:
+                if self.prefs.stored_sequence_no == self.platform_c_maxint:
+                    # wrap value if it exceeds the maximum size value that Qt can display
+                    # in its spinbox
+                    self.prefs.stored_sequence_no = 0
+                else:
+                    self.prefs.stored_sequence_no += 1
+            self.downloads_today_tracker.increment_downloads_today()
+
+        return True, identifier
+
+    def move_file(self, rpd_file: Union[Photo, Video], identifier: Optional[str]) -> bool:
+        """
+        Having generated the file name and subfolder names, move
+        the file and any associate files, and record the download.
+
+        Runs in a worker thread.
+
+        :param rpd_file: photo or video being worked on
+        :param identifier: unique identifier added to the file name, if any
+        :return: True if move succeeded, False otherwise
+        """
+
         if not os.path.isdir(rpd_file.download_path):
             try:
                 os.makedirs(rpd_file.download_path)
@@ -752,9 +877,10 @@ class RenameMoveFileWorker(DaemonProcess):
 
         # Move temp file to subfolder
 
-        add_unique_identifier = False
         try:
             if os.path.exists(rpd_file.download_full_file_name):
+                # Something other than this program created the file after its name
+                # was assigned
                 raise OSError(errno.EEXIST, "File exists: %s" % rpd_file.download_full_file_name)
             logging.debug(
                 "Renaming %s to %s .....",
@@ -762,91 +888,47 @@ class RenameMoveFileWorker(DaemonProcess):
             )
             os.rename(rpd_file.temp_full_file_name, rpd_file.download_full_file_name)
             logging.debug("....successfully renamed file")
-            move_succeeded = True
-            if rpd_file.status != DownloadStatus.downloaded_with_warning:
-                rpd_file.status = DownloadStatus.downloaded
-        except OSError as inst:
-            if inst.errno == errno.EEXIST:
-                add_unique_identifier = self.download_file_exists(rpd_file)
-            else:
-                self.notify_download_failure_file_error(rpd_file, inst)
         except Exception as inst:
-            # all other errors, including PermissionError
+            # all errors, including PermissionError
             self.notify_download_failure_file_error(rpd_file, inst)
+            return False
 
-        if add_unique_identifier:
-            self.add_unique_identifier(rpd_file)
-
-        return move_succeeded
-
-    def process_file(self, rpd_file: Union[Photo, Video], download_count: int) -> bool:
-        """
-        Generate file & subfolder name, and move (rename) photo / video
-        :param rpd_file: photo or video
-        :param download_count: used to track the file being downloaded via a counter
-        :return: success or otherwise of operation
-        """
-
-        move_succeeded = False
-
-        self.prepare_rpd_file(rpd_file)
-
-        synchronize_raw_jpg = self.must_synchronize_raw_jpg and rpd_file.file_type == FileType.photo
-
-        if synchronize_raw_jpg:
-            sync_result = self.sync_raw_jpg(rpd_file)
-
-            if sync_result.failed:
-                return False
-
-        generation_succeeded = self.generate_names(rpd_file, synchronize_raw_jpg)
-
-        if generation_succeeded:
-            move_succeeded = self.move_file(rpd_file)
-
-            logging.debug("Finished processing file: %s", download_count)
+        if identifier:
+            self.notify_file_already_exists(rpd_file, identifier)
+        elif rpd_file.status != DownloadStatus.downloaded_with_warning:
+            rpd_file.status = DownloadStatus.downloaded
 
-        if move_succeeded:
-            if synchronize_raw_jpg:
-                if sync_result.sequence_to_use is None:
-                    sequence = self.sequences.create_matched_sequences()
-                else:
-                    sequence = sync_result.sequence_to_use
-                self.sync_raw_jpeg.add_download(
-                    name=sync_result.photo_name,
-                    extension=sync_result.photo_ext,
-                    date_time=rpd_file.date_time(),
-                    sequence_number_used=sequence)
-
-            if not synchronize_raw_jpg or (synchronize_raw_jpg and
-                                           sync_result.sequence_to_use is None):
-
-                if self.uses_sequence_session_no or self.uses_sequence_letter:
-                    self.sequences.increment(
-                        self.uses_sequence_session_no, self.uses_sequence_letter
-                    )
-                if self.uses_stored_sequence_no:
-                    if self.prefs.stored_sequence_no == self.platform_c_maxint:
-                        # wrap value if it exceeds the maximum size value that Qt can display
-                        # in its spinbox
-                        self.prefs.stored_sequence_no = 0
-                    else:
-                        self.prefs.stored_sequence_no += 1
-                self.downloads_today_tracker.increment_downloads_today()
+        if rpd_file.temp_thm_full_name:
+            self.move_thm_file(rpd_file)
 
-            if rpd_file.temp_thm_full_name:
-                self.move_thm_file(rpd_file)
+        if rpd_file.temp_audio_full_name:
+            self.move_audio_file(rpd_file)
 
-            if rpd_file.temp_audio_full_name:
-                self.move_audio_file(rpd_file)
+        if rpd_file.temp_xmp_full_name:
+            self.move_xmp_file(rpd_file)
 
-            if rpd_file.temp_xmp_full_name:
-                self.move_xmp_file(rpd_file)
+        if rpd_file.temp_log_full_name:
+            self.move_log_file(rpd_file)
 
-            if rpd_file.temp_log_full_name:
-                self.move_log_file(rpd_file)
+        # Record file as downloaded in SQLite database
+        try:
+            self.downloaded.add_downloaded_file(
+                name=rpd_file.name, size=rpd_file.size,
+                modification_time=rpd_file.modification_time,
+                download_full_file_name=rpd_file.download_full_file_name,
+                fingerprint=rpd_file.fingerprint
+            )
+        except sqlite3.OperationalError as e:
+            # Worker threads in this process each write to the database using
+            # their own connection. SQLite serializes their writes, with each
+            # waiting up to its timeout for the lock. Reaching here means the lock
+            # could not be obtained within that time.
+            logging.error(
+                "Database error adding download file %s: %s. Will not retry.",
+                rpd_file.download_full_file_name, e
+            )
 
-        return move_succeeded
+        return True
 
     def initialise_downloads_today_stored_number(self) -> None:
         """
@@ -865,6 +947,41 @@ class RenameMoveFileWorker(DaemonProcess):
             downloads_today=self.prefs.downloads_today
         )
 
+    def compile_name_generators(self) -> None:
+        """
+        Compile the subfolder and file name generation preferences, which do
+        not change during a download
+        """
+
+        self.subfolder_generators = {
+            FileType.photo: gn.PhotoSubfolder(self.prefs.photo_subfolder, problems=self.problems),
+            FileType.video: gn.VideoSubfolder(self.prefs.video_subfolder, problems=self.problems),
+        }
+        self.name_generators = {
+            FileType.photo: gn.PhotoName(self.prefs.photo_rename, problems=self.problems),
+            FileType.video: gn.VideoName(self.prefs.video_rename, problems=self.problems),
+        }
+        for generator in chain(self.subfolder_generators.values(), self.name_generators.values()):
+            generator.compile()
+
+    def initialise_metadata_fields(self) -> None:
+        """
+        Determine which metadata values are needed to generate subfolder and
+        file names
+        """
+
+        photo_fields = metadata_fields_needed(self.prefs.photo_subfolder) | \
+                       metadata_fields_needed(self.prefs.photo_rename)
+        if self.must_synchronize_raw_jpg:
+            photo_fields.add('date_time')
+        video_fields = metadata_fields_needed(self.prefs.video_subfolder) | \
+                       metadata_fields_needed(self.prefs.video_rename)
+        self.metadata_fields = {FileType.photo: photo_fields, FileType.video: video_fields}
+        logging.debug(
+            "Metadata needed for photos: %s; for videos: %s",
+            ', '.join(sorted(photo_fields)) or 'none', ', '.join(sorted(video_fields)) or 'none'
+        )
+
     def initialise_sequence_number_usage(self) -> None:
         """
         Determine what type of sequence numbers are being used in file name generation
@@ -874,6 +991,143 @@ class RenameMoveFileWorker(DaemonProcess):
         self.uses_sequence_letter = self.prefs.any_pref_uses_sequence_letter_value()
         self.uses_stored_sequence_no = self.prefs.any_pref_uses_stored_sequence_no()
 
+    def start_workers(self) -> None:
+        """
+        Start the threads that load metadata and move files, and the ExifTool
+        processes they use.
+        """
+
+        self.no_workers = max(self.prefs.max_cpu_cores, 1)
+        logging.debug("Using %s rename and move worker threads", self.no_workers)
+
+        self.exiftool_processes = queue.Queue()  # type: queue.Queue
+        self.worker_exiftool_processes = []  # type: List[exiftool.ExifTool]
+        for i in range(self.no_workers):
+            et_process = exiftool.ExifTool()
+            et_process.start()
+            self.worker_exiftool_processes.append(et_process)
+            self.exiftool_processes.put(et_process)
+
+        # Metadata can be prefetched in the worker threads only if exiv2 is
+        # initialized here, in the main thread, before any of them use it
+        self.prefetch_metadata_in_workers = initialize_gexiv2()
+        if not self.prefetch_metadata_in_workers:
+            logging.warning(
+                "Could not initialize exiv2 for use by multiple threads: metadata will be "
+                "loaded only when file names are generated"
+            )
+
+        self.workers = ThreadPoolExecutor(max_workers=self.no_workers)
+
+    def stop_workers(self) -> None:
+        """
+        Wait for any file moves in progress to finish, and then terminate
+        the worker ExifTool processes.
+        """
+
+        self.workers.shutdown(wait=True)
+        for et_process in self.worker_exiftool_processes:
+            et_process.terminate()
+
+    def cleanup_pre_stop(self) -> None:
+        if self.workers is not None:
+            self.stop_workers()
+
+    def send_result(self, rpd_file: Union[Photo, Video],
+                    download_count: int,
+                    move_succeeded: bool) -> None:
+        """
+        Send the result of renaming and moving a file to the main process.
+        """
+
+        rpd_file.metadata = None
+        self.content = pickle.dumps(
+            RenameAndMoveFileResults(
+                move_succeeded=move_succeeded,
+                rpd_file=rpd_file,
+                download_count=download_count
+            ),
+            pickle.HIGHEST_PROTOCOL
+        )
+        self.send_message_to_sink()
+
+        self.files_processed += 1
+        logging.debug("Finished %s. Getting next task.", self.files_processed)
+
+    def assign_next_file(self) -> None:
+        """
+        Generate the name of the oldest file waiting for one, and if
+        successful start moving it in a worker thread.
+        """
+
+        self.metrics.queue_depth('rename awaiting names', len(self.awaiting_names))
+        self.metrics.queue_depth('rename awaiting moves', len(self.awaiting_moves))
+
+        data, prefetch = self.awaiting_names.popleft()  # type: RenameAndMoveFileData, Future
+        rpd_file = data.rpd_file
+
+        if not data.download_succeeded:
+            self.awaiting_moves.append((data, None))
+            return
+
+        if prefetch is not None:
+            with self.metrics.time('rename metadata wait'):
+                prefetch.result()
+        with self.metrics.time('rename name generation'):
+            move, identifier = self.assign_destination(rpd_file, data.download_count)
+        if move:
+            future = self.workers.submit(
+                self.metrics.timed('rename move', self.move_file), rpd_file, identifier
+            )
+        else:
+            self.process_rename_failure(rpd_file)
+            future = None
+        self.awaiting_moves.append((data, future))
+
+    def send_moved_files(self, block: bool) -> None:
+        """
+        Send the results of files that have finished being moved, in the
+        order they were downloaded.
+
+        :param block: if True, wait for the oldest file to finish moving
+        """
+
+        while self.awaiting_moves:
+            data, future = self.awaiting_moves[0]  # type: RenameAndMoveFileData, Future
+            if future is not None:
+                if not (block or future.done()):
+                    return
+                move_succeeded = future.result()
+                self.reserved_destinations.discard(data.rpd_file.download_full_file_name)
+                if not move_succeeded:
+                    self.process_rename_failure(data.rpd_file)
+            else:
+                move_succeeded = False
+            self.awaiting_moves.popleft()
+            self.send_result(data.rpd_file, data.download_count, move_succeeded)
+            block = False
+
+    def process_next_step(self) -> None:
+        """
+        Do the next piece of work while no new message has arrived: generate a
+        name if one is waiting, otherwise wait for the oldest move to finish.
+        """
+
+        if self.awaiting_names:
+            self.assign_next_file()
+            self.send_moved_files(block=False)
+        else:
+            self.send_moved_files(block=True)
+
+    def finish_pending_files(self) -> None:
+        """
+        Generate names for and move every file received so far, and send
+        their results.
+        """
+
+        while self.awaiting_names or self.awaiting_moves:
+            self.process_next_step()
+
     def run(self) -> None:
         """
         Generate subfolder and filename, and attempt to move the file
@@ -884,13 +1138,29 @@ class RenameMoveFileWorker(DaemonProcess):
         If successful, increment sequence values.
 
         Report any success or failure.
+
+        Metadata is loaded and files are moved by a pool of worker threads.
+        Subfolder and file names are always generated in this thread, one file
+        at a time and in download order, so that sequence values and unique
+        identifiers are assigned exactly as if each file was processed in turn.
+        Results are sent in download order.
         """
-        i = 0
+
+        self.files_processed = 0
 
         # Dict of filename keys and int values used to track ints to add as
         # suffixes to duplicate files
         self.duplicate_files = {}
 
+        # Download file names that have been assigned to files not yet moved
+        self.reserved_destinations = set()  # type: Set[str]
+
+        # Files waiting for their names to be generated, and their metadata prefetch:
+        # Tuple[RenameAndMoveFileData, Future]
+        self.awaiting_names = deque()  # type: deque
+        # Files being moved, in download order: Tuple[RenameAndMoveFileData, Optional[Future]]
+        self.awaiting_moves = deque()  # type: deque
+
         self.initialise_downloads_today_stored_number()
 
         self.sequences = gn.Sequences(
@@ -899,18 +1169,24 @@ class RenameMoveFileWorker(DaemonProcess):
 
         with stdchannel_redirected(sys.stderr, os.devnull):
             with exiftool.ExifTool() as self.exiftool_process:
+                self.start_workers()
                 while True:
-                    if i:
-                        logging.debug("Finished %s. Getting next task.", i)
-
-                    # rename file and move to generated subfolder
-                    directive, content = self.receiver.recv_multipart()
+                    if self.awaiting_names or self.awaiting_moves:
+                        try:
+                            directive, content = self.receiver.recv_multipart(zmq.NOBLOCK)
+                        except zmq.Again:
+                            self.process_next_step()
+                            continue
+                    else:
+                        directive, content = self.receiver.recv_multipart()
 
                     self.check_for_command(directive, content)
 
                     data = pickle.loads(content) # type: RenameAndMoveFileData
                     if data.message == RenameAndMoveStatus.download_started:
 
+                        self.finish_pending_files()
+
                         # reinitialize downloads today and stored sequence number
                         # in case the user has updated them via the user interface
                         self.initialise_downloads_today_stored_number()
@@ -923,10 +1199,15 @@ class RenameMoveFileWorker(DaemonProcess):
                         self.initialise_sequence_number_usage()
 
                         self.must_synchronize_raw_jpg = self.prefs.must_synchronize_raw_jpg()
+                        self.initialise_metadata_fields()
 
                         self.problems = RenamingProblems()
 
+                        self.compile_name_generators()
+
                     elif data.message == RenameAndMoveStatus.download_completed:
+                        self.finish_pending_files()
+
                         if len(self.problems):
                             self.content = pickle.dumps(
                                 RenameAndMoveFileResults(problems=self.problems),
@@ -948,45 +1229,16 @@ class RenameMoveFileWorker(DaemonProcess):
                         dl_today = self.downloads_today_tracker.get_or_reset_downloads_today()
                         logging.debug("Downloads today: %s", dl_today)
                         self.send_message_to_sink()
+                        self.publish_metrics()
                     else:
-                        rpd_file = data.rpd_file
-                        download_count = data.download_count
-
-                        if data.download_succeeded:
-                            move_succeeded = self.process_file(rpd_file, download_count)
-                            if not move_succeeded:
-                                self.process_rename_failure(rpd_file)
-                            else:
-                                # Record file as downloaded in SQLite database
-                                try:
-                                    self.downloaded.add_downloaded_file(
-                                        name=rpd_file.name, size=rpd_file.size,
-                                        modification_time=rpd_file.modification_time,
-                                        download_full_file_name=rpd_file.download_full_file_name
-                                    )
-                                except sqlite3.OperationalError as e:
-                                    # This should never happen because this is the only process
-                                    # writing to the database..... but just in case
-                                    logging.error(
-                                        "Database error adding download file %s: %s. Will not "
-                                        "retry.",
-                                        rpd_file.download_full_file_name, e
-                                    )
+                        if data.download_succeeded and self.prefetch_metadata_in_workers:
+                            prefetch = self.workers.submit(
+                                self.metrics.timed('rename metadata', self.prefetch_metadata),
+                                data.rpd_file
+                            )
                         else:
-                            move_succeeded = False
-
-                        rpd_file.metadata = None
-                        self.content = pickle.dumps(
-                            RenameAndMoveFileResults(
-                                move_succeeded=move_succeeded,
-                                rpd_file=rpd_file,
-                                download_count=download_count
-                            ),
-                            pickle.HIGHEST_PROTOCOL
-                        )
-                        self.send_message_to_sink()
-
-                        i += 1
+                            prefetch = None
+                        self.awaiting_names.append((data, prefetch))
 
 
 if __name__ == '__main__':
@@ -38,8 +38,9 @@ from itertools import chain
 import gphoto2 as gp
 
 from raphodo.rpdfile import RPDFile
-from raphodo.camera import Camera, CameraProblemEx
+from raphodo.camera import Camera, CameraProblemEx, storage_of_path
 from raphodo.preferences import ScanPreferences, Preferences
+from raphodo.rpdsql import CameraContentSQL
 
 
 class RescanCamera:
@@ -53,7 +54,16 @@ class RescanCamera:
     Assumes camera already initialized, with specific folders correctly set.
     """
 
-    def __init__(self, camera: Camera, prefs: Preferences) -> None:
+    def __init__(self, camera: Camera,
+                 prefs: Preferences,
+                 camera_content: Optional[CameraContentSQL]=None) -> None:
+        """
+        :param camera: the initialized camera
+        :param prefs: program preferences
+        :param camera_content: the camera content index. If None, use the
+         default.
+        """
+
         self.camera = camera
         if not camera.specific_folder_located:
             logging.warning(
@@ -66,6 +76,10 @@ class RescanCamera:
         self.missing_rpd_files = []  # type: List[RPDFile]
         self.prefs = prefs
         self.scan_preferences = None  # type: Optional[ScanPreferences]
+        self.content_id = camera.content_id
+        self.camera_content = None  # type: Optional[CameraContentSQL]
+        if self.content_id is not None:
+            self.camera_content = camera_content or CameraContentSQL()
 
     def rescan_camera(self, rpd_files: List[RPDFile]) -> None:
         """
@@ -95,6 +109,11 @@ class RescanCamera:
             self.rpd_files = rpd_files
             return
 
+        if self.relocate_files_from_index(rpd_files):
+            return
+
+        previous_paths = [rpd_file.path for rpd_file in rpd_files]
+
         # filename: RPDFile
         self.prev_scanned_files = defaultdict(list)  # type: DefaultDict[str, List[RPDFile]]
         self.scan_preferences = ScanPreferences(self.prefs.ignored_paths)
@@ -109,6 +128,82 @@ class RescanCamera:
 
         self.missing_rpd_files = list(chain(*self.prev_scanned_files.values()))
 
+        if self.camera_content is not None:
+            moves = [
+                (
+                    previous_path, storage_of_path(rpd_file.path), rpd_file.path, rpd_file.name,
+                    rpd_file.modification_time or 0, rpd_file.size
+                ) for previous_path, rpd_file in zip(previous_paths, rpd_files)
+                if previous_path != rpd_file.path
+            ]
+            try:
+                self.camera_content.relocate_files(self.content_id, moves)
+            except Exception as e:
+                logging.warning(
+                    "Could not record relocated files on %s: %s", self.camera.display_name, e
+                )
+
+    def relocate_files_from_index(self, rpd_files: List[RPDFile]) -> bool:
+        """
+        Look up the folders the files are now in using the camera content
+        index, which is updated when another process rescans the camera.
+
+        The index is trusted only if it locates every file, and the first
+        relocated file can be read.
+
+        :param rpd_files: files to relocate. Their paths are updated only if
+         every file is located.
+        :return: True if every file was located
+        """
+
+        if self.camera_content is None:
+            return False
+
+        located = self.camera_content.locate_files(
+            self.content_id, [rpd_file.name for rpd_file in rpd_files]
+        )
+        new_paths = []
+        for rpd_file in rpd_files:
+            candidates = [
+                f for f in located.get(rpd_file.name, [])
+                if f.size == rpd_file.size and (
+                    not rpd_file.modification_time or f.mtime == rpd_file.modification_time
+                )
+            ]
+            if len(candidates) > 1:
+                # Prefer the same storage, e.g. when two memory cards mirror each other
+                storage = storage_of_path(rpd_file.path)
+                candidates = [f for f in candidates if f.storage == storage]
+            if len(candidates) != 1:
+                return False
+            new_paths.append(candidates[0].path)
+
+        moved = [
+            (rpd_file, path) for rpd_file, path in zip(rpd_files, new_paths)
+            if path != rpd_file.path
+        ]
+        if not moved:
+            # The index records the same folders that could not be read
+            return False
+
+        rpd_file, path = moved[0]
+        try:
+            self.camera.get_exif_extract(folder=path, file_name=rpd_file.name)
+        except CameraProblemEx:
+            logging.debug(
+                "Camera content index is out of date for %s", self.camera.display_name
+            )
+            return False
+
+        logging.info(
+            "Relocated %s files on %s using the camera content index",
+            len(moved), self.camera.display_name
+        )
+        for rpd_file, path in moved:
+            rpd_file.path = path
+        self.rpd_files = rpd_files
+        return True
+
     def relocate_files_on_camera(self, path: str) -> None:
         """
         Recursively scan path looking for the folders in which previously located files are
@@ -124,6 +219,17 @@ class RescanCamera:
         except gp.GPhoto2Error as e:
             logging.error("Unable to scan files on camera: error %s", e.code)
 
+        # Files with the same name as more than one previously scanned file are
+        # matched by modification time and size
+        duplicate_names = [
+            name for name, value in files_in_folder
+            if len(self.prev_scanned_files.get(name, ())) > 1
+        ]
+        if duplicate_names:
+            file_info, file_info_errors = self.camera.get_folder_file_info(path, duplicate_names)
+        else:
+            file_info, file_info_errors = {}, {}
+
         for name, value in files_in_folder:
             if name in self.prev_scanned_files:
                 prev_rpd_files = self.prev_scanned_files[name]
@@ -134,14 +240,15 @@ class RescanCamera:
                     for prev_rpd_file in prev_rpd_files:
                         modification_time, size = 0, 0
                         if prev_rpd_file.modification_time:
-                            try:
-                                modification_time, size = self.camera.get_file_info(path, name)
-                            except gp.GPhoto2Error as e:
+                            if name in file_info_errors:
                                 logging.error(
                                     "Unable to access modification_time or size from %s on %s. "
                                     "Error code: %s",
-                                    os.path.join(path, name), self.camera.display_name, e.code
+                                    os.path.join(path, name), self.camera.display_name,
+                                    file_info_errors[name]
                                 )
+                            else:
+                                modification_time, size = file_info[name]
                         if modification_time == prev_rpd_file.modification_time and size == \
                                 prev_rpd_file.size:
                             rpd_file = prev_rpd_file
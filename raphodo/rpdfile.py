@@ -27,7 +27,7 @@ import logging
 import mimetypes
 from collections import Counter, UserDict
 import locale
-from typing import Optional, List, Tuple, Union, Any
+from typing import Optional, List, Tuple, Union, Any, Set
 
 import gi
 
@@ -44,6 +44,7 @@ from raphodo.storage import get_uri, CameraDetails
 import raphodo.metadataphoto as metadataphoto
 import raphodo.metadatavideo as metadatavideo
 import raphodo.metadataexiftool as metadataexiftool
+from raphodo.metadatarecord import MetadataRecord, make_metadata_record
 from raphodo.utilities import thousands, make_internationalized_list, datetime_roughly_equal
 from raphodo.problemnotification import Problem, make_href
 import raphodo.fileformats as fileformats
@@ -408,6 +409,12 @@ class RPDFile:
         self.prev_datetime = prev_datetime
         self.previously_downloaded = prev_full_name is not None
 
+        # Content fingerprint, generated when scanning or copying. See fingerprint.py
+        self.fingerprint = None  # type: Optional[str]
+        # md5 digest of the file's contents, generated when copying if the file is
+        # to be verified
+        self.md5 = None  # type: Optional[str]
+
         self.full_file_name = os.path.join(path, name)
 
         # Used in sample RPD files
@@ -550,6 +557,9 @@ class RPDFile:
 
         self.metadata = None  # type: Optional[Union[metadataphoto.MetaData, metadatavideo.MetaData, metadataexiftool.MetadataExiftool]]
         self.metadata_failure = False  # type: bool
+        # Metadata values used in name generation, which unlike the metadata itself
+        # can be pickled
+        self.metadata_record = None  # type: Optional[MetadataRecord]
 
         # User preference values used for name generation
         self.subfolder_pref_list = []  # type: List[str]
@@ -623,6 +633,36 @@ class RPDFile:
 
         return not datetime_roughly_equal(self._mdatatime, self._mtime)
 
+    def record_metadata(self) -> None:
+        """
+        Record the metadata values used in subfolder and file name generation,
+        so they are available after the metadata is discarded.
+
+        Expects the metadata to have already been loaded.
+        """
+
+        if self.metadata is None or self.metadata_record is not None:
+            return
+        self.metadata_record = make_metadata_record(
+            metadata=self.metadata, file_type=self.file_type,
+            exiftool_only=not isinstance(self.metadata, metadataphoto.MetaData)
+        )
+
+    def use_metadata_record(self, fields: Set[str]) -> bool:
+        """
+        Use the metadata record in place of the metadata, if the record contains
+        every value needed.
+
+        :param fields: metadata record fields that are needed
+        :return: True if the record is being used as the metadata
+        """
+
+        if self.metadata is None and self.metadata_record is not None and \
+                self.metadata_record.has_fields(fields):
+            self.metadata = self.metadata_record
+            return True
+        return False
+
     def date_time(self, missing: Optional[Any] = None) -> datetime:
         """
         Returns the date time as found in the file's metadata, and caches it
@@ -54,6 +54,8 @@ from datetime import datetime
 import tempfile
 import operator
 import locale
+import threading
+from concurrent.futures import ThreadPoolExecutor, wait, FIRST_EXCEPTION
 try:
     # Use the default locale as defined by the LANG variable
     locale.setlocale(locale.LC_ALL, '')
@@ -65,7 +67,7 @@ if sys.version_info < (3,5):
     walk = scandir.walk
 else:
     walk = os.walk
-from typing import List, Dict, Union, Optional, Iterator, Tuple, DefaultDict
+from typing import List, Dict, Union, Optional, Iterator, Tuple, DefaultDict, Set
 
 import gphoto2 as gp
 
@@ -74,18 +76,20 @@ import gphoto2 as gp
 from raphodo.interprocess import ScanArguments
 from raphodo.preferences import ScanPreferences, Preferences
 from raphodo.interprocess import (
-    WorkerInPublishPullPipeline, ScanResults, ScanArguments
+    WorkerInPublishPullPipeline, ScanResults, ScanArguments, run_worker
 )
 from raphodo.camera import (
-    Camera, CameraError, CameraProblemEx, gphoto2_python_logging, gphoto2_named_error
+    Camera, CameraError, CameraProblemEx, gphoto2_python_logging, gphoto2_named_error,
+    storage_of_path
 )
 import raphodo.rpdfile as rpdfile
 from raphodo.constants import (
     DeviceType, FileType, DeviceTimestampTZ, CameraErrorCode, FileExtension,
     ThumbnailCacheDiskStatus, all_tags_offset, ExifSource, all_tags_offset_exiftool
 )
-from raphodo.rpdsql import DownloadedSQL, FileDownloaded
+from raphodo.rpdsql import DownloadedSQL, FileDownloaded, CameraContentSQL
 from raphodo.cache import ThumbnailCacheSql
+from raphodo.fingerprint import file_fingerprint
 from raphodo.utilities import (
     stdchannel_redirected, datetime_roughly_equal, GenerateRandomFileName, format_size_for_user,
     is_snap
@@ -111,6 +115,22 @@ CameraMetadataDetails = namedtuple(
 SampleMetadata = namedtuple('SampleMetadata', 'datetime determined_by')
 
 
+class CameraListingStopped(Exception):
+    """
+    Stop listing a storage on the camera in a thread, because the scan was
+    stopped or listing another storage failed
+    """
+
+    pass
+
+# The contents of a folder on a camera, as listed by the camera. The errors are
+# gphoto2 error codes, or None if the files or subfolders were listed.
+CameraFolderListing = namedtuple(
+    'CameraFolderListing', 'path names file_types file_info file_info_errors files_error '
+                           'folders_error'
+)
+
+
 class ScanWorker(WorkerInPublishPullPipeline):
 
     def __init__(self):
@@ -149,10 +169,13 @@ class ScanWorker(WorkerInPublishPullPipeline):
 
         self.prefs = Preferences()
         self.scan_preferences = ScanPreferences(self.prefs.ignored_paths)
+        self.detect_downloaded_by_content = self.prefs.detect_downloaded_by_content
 
         self.problems = ScanProblems()
 
         self._camera_details = None  # type: Optional[CameraDetails]
+        # Set to stop the storages of a camera being listed
+        self._camera_listing_stopped = threading.Event()
 
         self._et_process = None  # type: Optional[ExifTool]
 
@@ -253,6 +276,7 @@ class ScanWorker(WorkerInPublishPullPipeline):
 
         if not terminated:
             if self.file_batch:
+                self.detect_downloaded_content()
                 # Send any remaining files, including the sample photo or video
                 self.content = pickle.dumps(
                     ScanResults(
@@ -366,7 +390,8 @@ class ScanWorker(WorkerInPublishPullPipeline):
             for dir_name, name in self.walk_file_system(path):
                 self.dir_name = dir_name
                 self.file_name = name
-                self.process_file()
+                with self.metrics.time('scan file'):
+                    self.process_file()
 
     def scan_camera(self, scan_arguments: ScanArguments) -> None:
         """
@@ -448,6 +473,18 @@ class ScanWorker(WorkerInPublishPullPipeline):
             self._camera_directories_for_file = defaultdict(list)
             self._camera_photos_videos_by_type = \
                 defaultdict(list)  # type: DefaultDict[FileExtension, List[CameraMetadataDetails]]
+            # Every photo and video located, including duplicates
+            self._camera_located_files = \
+                []  # type: List[Tuple[FileInfo, CameraMetadataDetails, FileExtension]]
+
+            # What was on the camera's storage when it was last scanned, and what is on it now
+            self.camera_content_id = self.camera.content_id
+            if self.camera_content_id is not None:
+                self.camera_content = CameraContentSQL()
+            self._camera_content_previous = \
+                {}  # type: Dict[str, Dict[str, Dict[str, Tuple[int, int]]]]
+            self._camera_content_current = \
+                defaultdict(list)  # type: DefaultDict[str, List[Tuple[str, str, int, int]]]
 
             specific_folders = self.camera.specific_folders
 
@@ -459,9 +496,13 @@ class ScanWorker(WorkerInPublishPullPipeline):
                     for folder in folders:
                         self._folder_identifiers[folder] = idx + 1
 
+            with self.metrics.time('scan camera listing'):
+                storage_listings = self.list_camera_storages(specific_folders)
+
             # locate photos and videos, identifying duplicate files
             # identify candidates for extracting metadata
-            for idx, folders in enumerate(specific_folders):
+            for idx, (folders, folder_listings) in enumerate(
+                    zip(specific_folders, storage_listings)):
                 # Setup camera details for each storage space in the camera
                 self.camera_details = idx
                 # Now initialize the problems container, if not already done so
@@ -469,16 +510,17 @@ class ScanWorker(WorkerInPublishPullPipeline):
                     self.problems.name = self.camera_display_name
                     self.problems.uri = get_uri(camera_details=self.camera_details)
 
-                for specific_folder in folders:
-                    logging.debug(
-                        "Scanning %s on %s", specific_folder, self.camera.display_name
-                    )
+                for specific_folder, listings in zip(folders, folder_listings):
                     folder_identifier = self._folder_identifiers.get(specific_folder)
                     if specific_folder_prefs is None:
                         basedir = specific_folder
                     else:
                         basedir = os.path.dirname(specific_folder)
-                    self.locate_files_on_camera(specific_folder, folder_identifier, basedir)
+                    for listing in listings:
+                        self.locate_files_on_camera(listing, folder_identifier, basedir)
+
+            self.identify_unique_camera_files()
+            self.record_camera_content()
 
             # extract camera metadata
             if self._camera_photos_videos_by_type:
@@ -486,18 +528,166 @@ class ScanWorker(WorkerInPublishPullPipeline):
 
             # now, process each file
             for self.dir_name, self.file_name in self._camera_folders_and_files:
-                self.process_file()
+                with self.metrics.time('scan file'):
+                    self.process_file()
         else:
             logging.warning(
                 "Unable to detect any specific folders (like DCIM) on %s", self.display_name
             )
 
-    def locate_files_on_camera(self, path: str, folder_identifier: int, basedir: str) -> None:
+    def list_camera_storages(self,
+                             specific_folders: List[List[str]]
+                             ) -> List[List[List[CameraFolderListing]]]:
+        """
+        List the contents of the specific folders on each of the camera's
+        storages.
+
+        If the camera can service requests to its storages concurrently, each
+        storage is listed in its own thread. Otherwise the storages are listed
+        in turn.
+
+        :param specific_folders: the specific folders on each storage
+        :return: for each storage, for each specific folder, the listing of
+         the folder and its subfolders
+        """
+
+        def list_storage(folders: List[str]) -> List[List[CameraFolderListing]]:
+            storage_listings = []
+            for specific_folder in folders:
+                logging.debug("Scanning %s on %s", specific_folder, self.camera.display_name)
+                listings = []  # type: List[CameraFolderListing]
+                storage_listings.append(listings)
+                try:
+                    self.list_camera_folder(specific_folder, listings)
+                except CameraListingStopped:
+                    break
+            return storage_listings
+
+        if len(specific_folders) < 2 or not self.camera.concurrent_storage_requests:
+            return [list_storage(folders) for folders in specific_folders]
+
+        logging.debug(
+            "Listing %s storages on %s concurrently", len(specific_folders), self.display_name
+        )
+        self._camera_listing_stopped.clear()
+        with ThreadPoolExecutor(max_workers=len(specific_folders)) as executor:
+            futures = [executor.submit(list_storage, folders) for folders in specific_folders]
+            try:
+                pending = futures
+                while pending:
+                    done, pending = wait(pending, timeout=0.1, return_when=FIRST_EXCEPTION)
+                    if any(future.exception() is not None for future in done):
+                        break
+                    self.check_for_controller_directive()
+            finally:
+                # Stop listing the other storages if the camera was removed, or
+                # the scan was stopped
+                self._camera_listing_stopped.set()
+        return [future.result() for future in futures]
+
+    def list_camera_folder(self, path: str, listings: List[CameraFolderListing]) -> None:
+        """
+        Recursively list the files and folders in path on the camera, and the
+        modification time and size of its photos and videos.
+
+        Apart from the camera content index, does not change the state of the
+        scan, so it can be called from more than one thread at once for
+        different storages. Problems are reported when the listings are
+        processed.
+
+        We ignore all folders that contain a file .nomedia
+
+        :param path: the path on the camera to list
+        :param listings: the listing of path and each of its subfolders is
+         appended, in the order they are to be processed
+        """
+
+        self.check_camera_listing_directive()
+
+        names = []  # type: List[str]
+        file_types = []  # type: List[Optional[FileType]]
+        file_info = {}  # type: Dict[str, Tuple[int, int]]
+        file_info_errors = {}  # type: Dict[str, int]
+        files_error = folders_error = None
+        try:
+            files_in_folder = self.camera.camera.folder_list_files(path, self.camera.context)
+        except gp.GPhoto2Error as e:
+            logging.error(
+                "Unable to scan files on %s: %s", self.display_name, gphoto2_named_error(e.code)
+            )
+            if e.code in (gp.GP_ERROR_IO_USB_FIND, gp.GP_ERROR_BAD_PARAMETERS):
+                logging.error("%s removed while listing files during scan", self.display_name)
+                raise CameraError(CameraErrorCode.inaccessible)
+            files_error = e.code
+        else:
+            names = [name for name, value in files_in_folder]
+
+        if names:
+            if '.nomedia' in names:
+                # do nothing with this folder
+                logging.debug("Ignoring %s because it contains a .nomedia file", path)
+                return
+            file_types = [
+                fileformats.file_type(os.path.splitext(name)[1][1:].lower()) for name in names
+            ]
+            with self.metrics.time('scan camera file info'):
+                file_info, file_info_errors = self.get_camera_file_info(
+                    path, [
+                        name for name, file_type in zip(names, file_types)
+                        if file_type is not None
+                    ]
+                )
+
+        folders = []
+        try:
+            for name, value in self.camera.camera.folder_list_folders(path, self.camera.context):
+                if self.scan_preferences.scan_this_path(os.path.join(path, name)):
+                    folders.append(name)
+        except gp.GPhoto2Error as e:
+            logging.error(
+                "Unable to list folders on %s: %s", self.display_name,
+                gphoto2_named_error(e.code)
+            )
+            if e.code in (gp.GP_ERROR_IO_USB_FIND, gp.GP_ERROR_BAD_PARAMETERS):
+                logging.error("%s removed while listing folders during scan", self.display_name)
+                raise CameraError(code=CameraErrorCode.inaccessible)
+            folders_error = e.code
+
+        listings.append(
+            CameraFolderListing(
+                path=path, names=names, file_types=file_types, file_info=file_info,
+                file_info_errors=file_info_errors, files_error=files_error,
+                folders_error=folders_error
+            )
+        )
+
+        # recurse over subfolders
+        for name in folders:
+            self.list_camera_folder(os.path.join(path, name), listings)
+
+    def check_camera_listing_directive(self) -> None:
+        """
+        Check to see if the process has received a command to terminate or
+        pause while listing the camera.
+
+        In a thread listing one of the camera's storages, the main thread
+        handles commands, so instead raise CameraListingStopped if the listing
+        was stopped.
         """
-        Scans the memory card(s) on the camera for photos, videos,
-        audio files, and video thumbnail (THM) files. Looks only in the
-        camera's DCIM folders, which are assumed to have already been
-        located.
+
+        if threading.current_thread() is threading.main_thread():
+            self.check_for_controller_directive()
+        elif self._camera_listing_stopped.is_set():
+            raise CameraListingStopped()
+
+    def locate_files_on_camera(self, listing: CameraFolderListing,
+                               folder_identifier: int,
+                               basedir: str) -> None:
+        """
+        Processes the listing of a folder on the memory card(s) on the
+        camera, looking for photos, videos, audio files, and video
+        thumbnail (THM) files. Looks only in the camera's DCIM folders,
+        which are assumed to have already been located.
 
         We cannot assume file names are unique on any one memory card,
         as although it's unlikely, it's possible that a file with
@@ -525,10 +715,11 @@ class ScanWorker(WorkerInPublishPullPipeline):
         For duplicate files, we record both directories the file is
         stored on.
 
-        We ignore all folders that contain a file .nomedia
+        Duplicate files are identified after every storage has been
+        listed. See identify_unique_camera_files().
 
-        :param path: the path on the camera to analyze for files and
-         folders
+        :param listing: the contents of a folder on the camera, listed by
+         list_camera_folder()
         :param folder_identifier: if not None, then indicates (1) the
          camera being scanned has more than one memory card, and (2)
          the simple numeric identifier of the memory card being
@@ -537,32 +728,20 @@ class ScanWorker(WorkerInPublishPullPipeline):
          libgphoto2
         """
 
-        files_in_folder = []
-        names = []
-        try:
-            files_in_folder = self.camera.camera.folder_list_files(path, self.camera.context)
-        except gp.GPhoto2Error as e:
-            logging.error(
-                "Unable to scan files on %s: %s", self.display_name, gphoto2_named_error(e.code)
-            )
+        path = listing.path
+        if listing.files_error is not None:
             uri = get_uri(path=path, camera_details=self.camera_details)
-            self.problems.append(CameraDirectoryReadProblem(uri=uri, name=path, gp_code=e.code))
-            if e.code in (gp.GP_ERROR_IO_USB_FIND, gp.GP_ERROR_BAD_PARAMETERS):
-                logging.error("%s removed while listing files during scan", self.display_name)
-                raise CameraError(CameraErrorCode.inaccessible)
+            self.problems.append(
+                CameraDirectoryReadProblem(uri=uri, name=path, gp_code=listing.files_error)
+            )
 
-        if files_in_folder:
-            # Distinguish the file type for every file in the folder
-            names = [name for name, value in files_in_folder]
-            if '.nomedia' in names:
-                # do nothing with this folder
-                logging.debug("Ignoring %s because it contains a .nomedia file", path)
-                return
-            split_names = [os.path.splitext(name) for name in names]
-            # Remove the period from the extension
-            exts = [ext[1:] for name, ext in split_names]
-            exts_lower = [ext.lower() for ext in exts]
-            ext_types = [fileformats.extension_type(ext) for ext in exts_lower]
+        # Distinguish the file type for every file in the folder
+        names = listing.names
+        split_names = [os.path.splitext(name) for name in names]
+        # Remove the period from the extension
+        exts = [ext[1:] for name, ext in split_names]
+        exts_lower = [ext.lower() for ext in exts]
+        ext_types = [fileformats.extension_type(ext) for ext in exts_lower]
 
         for idx, name in enumerate(names):
             # Check to see if the process has received a command to terminate
@@ -574,24 +753,23 @@ class ScanWorker(WorkerInPublishPullPipeline):
             ext = exts[idx]
             ext_lower = exts_lower[idx]
             ext_type = ext_types[idx]
-            file_type = fileformats.file_type(ext_lower)
+            file_type = listing.file_types[idx]
 
             if file_type is not None:
                 # file is a photo or video
-                file_is_unique = True
-                try:
-                    modification_time, size = self.camera.get_file_info(path, name)
-                except gp.GPhoto2Error as e:
+                if name in listing.file_info_errors:
+                    gp_code = listing.file_info_errors[name]
                     logging.error(
                         "Unable to access modification_time or size from %s on %s. Error: %s",
-                        os.path.join(path, name), self.display_name, gphoto2_named_error(e.code)
+                        os.path.join(path, name), self.display_name, gphoto2_named_error(gp_code)
                     )
                     modification_time, size = 0, 0
                     uri = get_uri(
                         full_file_name=os.path.join(path, name), camera_details=self.camera_details
                     )
-                    self.problems.append(CameraFileInfoProblem(uri=uri, gp_code=e.code))
+                    self.problems.append(CameraFileInfoProblem(uri=uri, gp_code=gp_code))
                 else:
+                    modification_time, size = listing.file_info[name]
                     if size <= 0:
                         full_file_name = os.path.join(path, name)
                         logging.error(
@@ -618,28 +796,16 @@ class ScanWorker(WorkerInPublishPullPipeline):
                         # simple numeric identifier i.e. 1 or 2.
                         self._folder_identifers_for_file[cf].append(folder_identifier)
 
-                    if name in self._camera_file_names:
-                        for existing_file_info in self._camera_file_names[name]:
-                            # Don't compare file modification time in this
-                            # comparison, because files can be written to
-                            # different cards several seconds apart when
-                            # the write speeds of the cards differ
-                            if existing_file_info.size == size:
-                                file_is_unique = False
-                                break
-                    if file_is_unique:
-                        file_info = FileInfo(
-                            path=path, modification_time=modification_time,
-                            size=size, file_type=file_type, base_name=base_name,
-                            ext_lower=ext_lower
-                        )
-                        metadata_details = CameraMetadataDetails(
-                            path=path, name=name, size=size, extension=ext_lower,
-                            mtime=modification_time, file_type=file_type
-                        )
-                        self._camera_file_names[name].append(file_info)
-                        self._camera_folders_and_files.append([path, name])
-                        self._camera_photos_videos_by_type[ext_type].append(metadata_details)
+                    file_info = FileInfo(
+                        path=path, modification_time=modification_time,
+                        size=size, file_type=file_type, base_name=base_name,
+                        ext_lower=ext_lower
+                    )
+                    metadata_details = CameraMetadataDetails(
+                        path=path, name=name, size=size, extension=ext_lower,
+                        mtime=modification_time, file_type=file_type
+                    )
+                    self._camera_located_files.append((file_info, metadata_details, ext_type))
             else:
                 # this file on the camera is not a photo or video
                 if ext_lower in fileformats.AUDIO_EXTENSIONS:
@@ -661,25 +827,106 @@ class ScanWorker(WorkerInPublishPullPipeline):
                             camera_details=self.camera_details
                         )
                         self.problems.append(UnhandledFileProblem(name=name, uri=uri))
-        folders = []
-        try:
-            for name, value in self.camera.camera.folder_list_folders(path, self.camera.context):
-                if self.scan_preferences.scan_this_path(os.path.join(path, name)):
-                    folders.append(name)
-        except gp.GPhoto2Error as e:
-            logging.error(
-                "Unable to list folders on %s: %s", self.display_name,
-                gphoto2_named_error(e.code)
-            )
+
+        if listing.folders_error is not None:
             uri = get_uri(path=path, camera_details=self.camera_details)
-            self.problems.append(CameraDirectoryReadProblem(uri=uri, name=path, gp_code=e.code))
-            if e.code in (gp.GP_ERROR_IO_USB_FIND, gp.GP_ERROR_BAD_PARAMETERS):
-                logging.error("%s removed while listing folders during scan", self.display_name)
-                raise CameraError(code=CameraErrorCode.inaccessible)
+            self.problems.append(
+                CameraDirectoryReadProblem(uri=uri, name=path, gp_code=listing.folders_error)
+            )
 
-        # recurse over subfolders
-        for name in folders:
-            self.locate_files_on_camera(os.path.join(path, name), folder_identifier, basedir)
+    def identify_unique_camera_files(self) -> None:
+        """
+        Identify which of the photos and videos located on the camera are
+        unique, and which duplicate a file found earlier, e.g. on the other
+        memory card of a camera that writes every file to both its cards.
+
+        Files are matched on name and size using a set of the files already
+        seen. Modification times are not compared, because files can be
+        written to different cards several seconds apart when the write
+        speeds of the cards differ.
+        """
+
+        seen = set()  # type: Set[CameraFile]
+        for file_info, metadata_details, ext_type in self._camera_located_files:
+            name = metadata_details.name
+            cf = CameraFile(name=name, size=file_info.size)
+            if cf in seen:
+                continue
+            seen.add(cf)
+            self._camera_file_names[name].append(file_info)
+            self._camera_folders_and_files.append([file_info.path, name])
+            self._camera_photos_videos_by_type[ext_type].append(metadata_details)
+
+    def get_camera_file_info(self, path: str,
+                             names: List[str]) -> Tuple[Dict[str, Tuple[int, int]],
+                                                        Dict[str, int]]:
+        """
+        Get the modification time and size of the photos and videos in a folder
+        on the camera.
+
+        If the camera cannot return the information of every file in a folder
+        in one request, and the folder contains the same files as when the
+        camera was last scanned, use the information recorded then. The file
+        most recently modified is checked to guard against a memory card having
+        been reformatted and refilled with files of the same names.
+
+        :param path: the folder on the camera
+        :param names: the photos and videos in the folder
+        :return: dictionary of file name to tuple of modification time and
+         file size, and dictionary of file name to gphoto2 error code for
+         the files whose information could not be retrieved
+        """
+
+        storage = storage_of_path(path)
+        file_info = None  # type: Optional[Dict[str, Tuple[int, int]]]
+        file_info_errors = {}  # type: Dict[str, int]
+
+        if self.camera_content_id is not None and names and not self.camera.bulk_file_info:
+            if storage not in self._camera_content_previous:
+                self._camera_content_previous[storage] = self.camera_content.storage_listing(
+                    self.camera_content_id, storage
+                )
+            previous = self._camera_content_previous[storage].get(path)
+            if previous and len(previous) == len(names) and previous.keys() >= set(names):
+                newest = max(names, key=lambda name: previous[name][0])
+                try:
+                    unchanged = self.camera.get_file_info(path, newest) == previous[newest]
+                except gp.GPhoto2Error:
+                    unchanged = False
+                self.metrics.cache_lookup('camera content index', hit=unchanged)
+                if unchanged:
+                    logging.debug(
+                        "Using recorded information of %s files in unchanged folder %s on %s",
+                        len(names), path, self.display_name
+                    )
+                    file_info = {name: previous[name] for name in names}
+
+        if file_info is None:
+            file_info, file_info_errors = self.camera.get_folder_file_info(
+                path, names, check_for_command=self.check_camera_listing_directive
+            )
+
+        self._camera_content_current[storage].extend(
+            (path, name, mtime, size) for name, (mtime, size) in file_info.items()
+        )
+        return file_info, file_info_errors
+
+    def record_camera_content(self) -> None:
+        """
+        Record what was found on each storage on the camera, for the next scan
+        and for workers that need to relocate files
+        """
+
+        if self.camera_content_id is None:
+            return
+        for storage, files in self._camera_content_current.items():
+            try:
+                self.camera_content.replace_storage(self.camera_content_id, storage, files)
+            except Exception as e:
+                logging.warning(
+                    "Could not record the content of %s on %s: %s",
+                    storage, self.display_name, e
+                )
 
     def identify_camera_tz_and_sample_files(self) -> None:
         """
@@ -897,6 +1144,17 @@ class ScanWorker(WorkerInPublishPullPipeline):
                     problem=problem
                 )
 
+                if downloaded is None and self.detect_downloaded_by_content:
+                    if self.download_from_camera:
+                        rpd_file.fingerprint = self.camera.get_fingerprint(
+                            self.dir_name, self.file_name, size
+                        )
+                    else:
+                        try:
+                            rpd_file.fingerprint = file_fingerprint(file, size)
+                        except OSError as e:
+                            logging.warning("Could not generate fingerprint for %s: %s", file, e)
+
                 self.file_batch.append(rpd_file)
 
                 if (not self.prepared_sample_photo and
@@ -935,6 +1193,7 @@ class ScanWorker(WorkerInPublishPullPipeline):
                     self.prepared_sample_video = True
 
                 if len(self.file_batch) == self.batch_size:
+                    self.detect_downloaded_content()
                     self.content = pickle.dumps(
                         ScanResults(
                             rpd_files=self.file_batch,
@@ -952,6 +1211,39 @@ class ScanWorker(WorkerInPublishPullPipeline):
                     self.sample_photo = None
                     self.sample_video = None
 
+    def detect_downloaded_content(self) -> None:
+        """
+        Identify files in the batch of scanned files that have not been downloaded
+        before under their current name, but whose content has been downloaded
+        before, e.g. from another memory card, or from a memory card that has since
+        been reformatted.
+
+        The database is queried once for the entire batch.
+        """
+
+        rpd_files = [
+            rpd_file for rpd_file in self.file_batch
+            if rpd_file.fingerprint is not None and not rpd_file.previously_downloaded
+        ]
+        if not rpd_files:
+            return
+
+        with self.metrics.time('scan duplicate detection'):
+            downloaded = self.downloaded.files_downloaded_by_fingerprint(
+                [rpd_file.fingerprint for rpd_file in rpd_files]
+            )
+        for rpd_file in rpd_files:
+            file_downloaded = downloaded.get(rpd_file.fingerprint)
+            if file_downloaded is not None:
+                logging.debug(
+                    "%s was previously downloaded as %s", rpd_file.full_file_name,
+                    file_downloaded.download_name
+                )
+                rpd_file.prev_full_name = file_downloaded.download_name
+                rpd_file.prev_datetime = file_downloaded.download_datetime
+                rpd_file.previously_downloaded = True
+                self.no_previously_downloaded += 1
+
     def send_message_to_sink(self) -> None:
         try:
             logging.debug(
@@ -1050,8 +1342,21 @@ class ScanWorker(WorkerInPublishPullPipeline):
                     )
 
             mtime = int(self.adjusted_mtime(float(modification_time)))
+            saved = 0
+            if looped and os.path.isfile(temp_name):
+                saved = os.path.getsize(temp_name)
             try:
-                self.camera.save_file_chunk(path, name, chunk_size, temp_name, mtime)
+                if saved:
+                    # Read only what the first attempt did not
+                    if saved < size:
+                        self.camera.save_file_by_chunks(
+                            dir_name=path, file_name=name, size=size,
+                            dest_full_filename=temp_name, progress_callback=None,
+                            check_for_command=self.check_for_controller_directive, start=saved
+                        )
+                        os.utime(temp_name, times=(mtime, mtime))
+                else:
+                    self.camera.save_file_chunk(path, name, chunk_size, temp_name, mtime)
             except CameraProblemEx as e:
                 if e.code == CameraErrorCode.read:
                     uri = get_uri(
@@ -1645,6 +1950,6 @@ def trace_calls(frame, event, arg):
 if __name__ == "__main__":
     if os.getenv('RPD_SCAN_DEBUG') is not None:
         sys.settrace(trace_calls)
-    scan = ScanWorker()
+    run_worker(ScanWorker)
 
 
@@ -0,0 +1,494 @@
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+A simulated camera that serves a directory tree, for testing and benchmarking
+the camera code paths without a physical device.
+
+SimulatedCamera implements the subset of the gphoto2.Camera interface that
+camera.Camera uses, so every code path above it -- scanning, thumbnailing,
+rescanning and copying -- runs unmodified. Each request to the camera costs a
+configurable latency, and the data it transfers costs time according to a
+configurable bandwidth, so the round trips of PTP / MTP over USB are modelled.
+Requests are serialized, as they are on a real USB link.
+
+A simulated camera is selected by its port, which has the form:
+
+    simulated:/path/to/tree?latency=3&bandwidth=30&proplist=1&concurrent=0
+
+where latency is the cost of each request in milliseconds and bandwidth is in
+MB per second (0 for unlimited). If proplist is 1, the default, the camera can
+return the information of every file in a folder in one request, as PTP's
+GetObjectPropList does; if 0, the information of each file must be requested
+separately. If the tree contains folders named like
+store_00010001, each is a separate storage, e.g. for a camera with two memory
+card slots. Otherwise the whole tree is the camera's only storage. If
+concurrent is 1, requests to different storages are serviced at the same time,
+each over its own link; if 0, the default, all requests share one link.
+
+To make simulated cameras appear when cameras are autodetected, list their
+ports in the environment variable RPD_SIMULATED_CAMERAS, separated by
+semicolons.
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+from collections import Counter, namedtuple
+import hashlib
+import logging
+import os
+import re
+import threading
+import time
+from typing import Dict, List, Optional, Tuple
+
+import gphoto2 as gp
+
+simulated_camera_port_prefix = 'simulated:'
+simulated_camera_model = 'Simulated Camera'
+simulated_cameras_env = 'RPD_SIMULATED_CAMERAS'
+
+# Typical of PTP over USB 2.0
+default_latency_ms = 3.0
+default_bandwidth_mbs = 30.0
+
+# Approximate size of the information sent for each file or folder in a listing
+listing_entry_bytes = 64
+
+storage_folder_re = re.compile(r'store_[0-9a-fA-F]{8}$')
+default_storage_folder = 'store_00010001'
+
+
+# Path of the tree the camera serves, latency in seconds, bandwidth in bytes
+# per second, whether file information can be listed in bulk, and whether
+# storages can be accessed concurrently
+SimulatedPort = namedtuple('SimulatedPort', 'path, latency, bandwidth, proplist, concurrent')
+
+
+def is_simulated_camera_port(port: str) -> bool:
+    return port.startswith(simulated_camera_port_prefix)
+
+
+def parse_simulated_camera_port(port: str) -> SimulatedPort:
+    """
+    :param port: port of the simulated camera
+    :return: the configuration of the simulated camera
+
+    >>> parse_simulated_camera_port('simulated:/dev/shm/card?latency=5&bandwidth=40')
+    ... # doctest: +NORMALIZE_WHITESPACE
+    SimulatedPort(path='/dev/shm/card', latency=0.005, bandwidth=40000000.0, proplist=True,
+                  concurrent=False)
+    >>> parse_simulated_camera_port('simulated:/dev/shm/card').latency
+    0.003
+    >>> parse_simulated_camera_port('simulated:/tmp/a?b?bandwidth=0&proplist=0&concurrent=1')
+    ... # doctest: +NORMALIZE_WHITESPACE
+    SimulatedPort(path='/tmp/a?b', latency=0.003, bandwidth=0.0, proplist=False,
+                  concurrent=True)
+    >>> parse_simulated_camera_port('simulated:/tmp/card?speed=1')
+    Traceback (most recent call last):
+    ...
+    ValueError: Unknown simulated camera option: speed
+    """
+
+    assert is_simulated_camera_port(port)
+    path = port[len(simulated_camera_port_prefix):]
+    options = {}  # type: Dict[str, float]
+    path, sep, query = path.rpartition('?')
+    if not sep:
+        path = query
+        query = ''
+    for option in filter(None, query.split('&')):
+        key, value = option.split('=')
+        if key not in ('latency', 'bandwidth', 'proplist', 'concurrent'):
+            raise ValueError('Unknown simulated camera option: {}'.format(key))
+        options[key] = float(value)
+    return SimulatedPort(
+        path=path,
+        latency=options.get('latency', default_latency_ms) / 1000,
+        bandwidth=options.get('bandwidth', default_bandwidth_mbs) * 1000000,
+        proplist=bool(options.get('proplist', 1)),
+        concurrent=bool(options.get('concurrent', 0))
+    )
+
+
+def simulated_camera_port(path: str,
+                          latency_ms: float=default_latency_ms,
+                          bandwidth_mbs: float=default_bandwidth_mbs,
+                          proplist: bool=True,
+                          concurrent: bool=False) -> str:
+    """
+    >>> simulated_camera_port('/dev/shm/card', 5, 40)
+    'simulated:/dev/shm/card?latency=5&bandwidth=40&proplist=1&concurrent=0'
+    """
+
+    return '{}{}?latency={:g}&bandwidth={:g}&proplist={:d}&concurrent={:d}'.format(
+        simulated_camera_port_prefix, os.path.abspath(path), latency_ms, bandwidth_mbs,
+        proplist, concurrent
+    )
+
+
+def simulated_cameras() -> List[Tuple[str, str]]:
+    """
+    :return: model and port of each simulated camera listed in the environment
+    """
+
+    ports = os.getenv(simulated_cameras_env, '')
+    return [
+        (simulated_camera_model, port) for port in ports.split(';')
+        if is_simulated_camera_port(port)
+    ]
+
+
+class SimulatedLink:
+    """
+    The connection to the camera, which carries one request at a time
+    """
+
+    def __init__(self, latency: float, bandwidth: float) -> None:
+        """
+        :param latency: time each request takes in seconds, regardless of
+         how much data it transfers
+        :param bandwidth: bytes per second, or 0 for unlimited
+        """
+
+        self.latency = latency
+        self.bandwidth = bandwidth
+        self.lock = threading.Lock()
+        self.requests = Counter()  # type: Counter
+        self.bytes_transferred = 0
+        self.busy = 0.0
+
+    def request(self, operation: str, size: int=0) -> None:
+        """
+        Wait for as long as the request would take over the link
+
+        :param operation: the kind of request, for the statistics
+        :param size: bytes transferred by the request
+        """
+
+        duration = self.latency
+        if self.bandwidth:
+            duration += size / self.bandwidth
+        with self.lock:
+            if duration:
+                time.sleep(duration)
+            self.requests[operation] += 1
+            self.bytes_transferred += size
+            self.busy += duration
+
+    def statistics(self) -> Dict[str, object]:
+        with self.lock:
+            return dict(
+                requests=dict(self.requests), bytes=self.bytes_transferred, busy=self.busy
+            )
+
+
+class SimulatedFileInfoFile:
+    def __init__(self, mtime: int, size: int) -> None:
+        self.mtime = mtime
+        self.size = size
+
+
+class SimulatedFileInfo:
+    def __init__(self, mtime: int, size: int) -> None:
+        self.file = SimulatedFileInfoFile(mtime, size)
+
+
+class SimulatedCameraFile:
+    """
+    The subset of gphoto2.CameraFile that camera.Camera uses
+    """
+
+    def __init__(self, data: bytes) -> None:
+        self.data = data
+
+    def get_data_and_size(self) -> bytes:
+        return self.data
+
+    def save(self, filename: str) -> None:
+        try:
+            with open(filename, 'wb') as f:
+                f.write(self.data)
+        except OSError:
+            raise gp.GPhoto2Error(gp.GP_ERROR_IO_WRITE)
+
+
+class SimulatedStorageInfo:
+    def __init__(self, basedir: str, description: str, path: str) -> None:
+        self.fields = (
+            gp.GP_STORAGEINFO_BASE | gp.GP_STORAGEINFO_DESCRIPTION |
+            gp.GP_STORAGEINFO_MAXCAPACITY | gp.GP_STORAGEINFO_FREESPACEKBYTES
+        )
+        self.basedir = basedir
+        self.description = description
+        stat = os.statvfs(path)
+        self.capacitykbytes = stat.f_blocks * stat.f_frsize // 1024
+        self.freekbytes = stat.f_bavail * stat.f_frsize // 1024
+
+
+class SimulatedAbilities:
+    def __init__(self, model: str) -> None:
+        self.model = model
+        # Embedded thumbnails cannot be fetched, so thumbnails are always
+        # extracted from the files themselves
+        self.file_operations = gp.GP_FILE_OPERATION_NONE
+
+
+class SimulatedWidget:
+    """
+    The subset of gphoto2.CameraWidget needed to find the camera's model name
+    """
+
+    def __init__(self, name: str, widget_type: int, value: Optional[str]=None,
+                 children: Optional[List['SimulatedWidget']]=None) -> None:
+        self.name = name
+        self.widget_type = widget_type
+        self.value = value
+        self.children = children or []
+
+    def get_name(self) -> str:
+        return self.name
+
+    def get_type(self) -> int:
+        return self.widget_type
+
+    def get_value(self) -> Optional[str]:
+        return self.value
+
+    def count_children(self) -> int:
+        return len(self.children)
+
+    def get_child(self, index: int) -> 'SimulatedWidget':
+        return self.children[index]
+
+
+class SimulatedCamera:
+    """
+    A camera that serves a directory tree over a simulated link.
+
+    Implements the gphoto2.Camera methods used by camera.Camera and the scan
+    and rescan code. The context parameters are accepted and ignored. Errors
+    are raised as gphoto2.GPhoto2Error, as python-gphoto2 does.
+    """
+
+    def __init__(self, model: str, port: str) -> None:
+        self.model = model
+        self.port = port
+        config = parse_simulated_camera_port(port)
+        self.path = config.path
+        self.proplist = config.proplist
+        # Read by camera.Camera
+        self.concurrent_storage_requests = config.concurrent
+        self.link = SimulatedLink(config.latency, config.bandwidth)
+        # Storage folder: link used for requests to the storage
+        self.storage_links = {}  # type: Dict[str, SimulatedLink]
+        # Stable for the tree the camera serves
+        self.serial_number = hashlib.md5(
+            os.path.abspath(self.path).encode()
+        ).hexdigest()[:16]
+        self.storages = {}  # type: Dict[str, str]
+        self.initialized = False
+
+    def init(self, context=None) -> None:
+        if not os.path.isdir(self.path):
+            logging.error("Simulated camera tree %s does not exist", self.path)
+            raise gp.GPhoto2Error(gp.GP_ERROR_IO_USB_FIND)
+        self.link.request('init')
+        stores = sorted(
+            name for name in os.listdir(self.path)
+            if storage_folder_re.match(name) and os.path.isdir(os.path.join(self.path, name))
+        )
+        if stores:
+            self.storages = {name: os.path.join(self.path, name) for name in stores}
+        else:
+            self.storages = {default_storage_folder: self.path}
+        if self.concurrent_storage_requests:
+            self.storage_links = {
+                name: SimulatedLink(self.link.latency, self.link.bandwidth)
+                for name in self.storages
+            }
+        self.initialized = True
+        logging.debug(
+            "Simulated camera serving %s with %s storage(s), %.1fms latency and %s bandwidth",
+            self.path, len(self.storages), self.link.latency * 1000,
+            '{:.1f}MB/s'.format(self.link.bandwidth / 1000000) if self.link.bandwidth
+            else 'unlimited'
+        )
+
+    def exit(self, context=None) -> None:
+        self.initialized = False
+
+    def statistics(self) -> Dict[str, object]:
+        """
+        :return: the requests made and bytes transferred so far. If storages
+         are accessed concurrently, busy is the sum of the time each link was
+         busy.
+        """
+
+        statistics = self.link.statistics()
+        for link in self.storage_links.values():
+            link_statistics = link.statistics()
+            statistics['requests'] = dict(
+                Counter(statistics['requests']) + Counter(link_statistics['requests'])
+            )
+            statistics['bytes'] += link_statistics['bytes']
+            statistics['busy'] += link_statistics['busy']
+        return statistics
+
+    def _link(self, folder: str) -> SimulatedLink:
+        """
+        :param folder: absolute path on the camera
+        :return: the link over which requests about the folder are made
+        """
+
+        storage = folder.strip('/').split('/')[0]
+        return self.storage_links.get(storage, self.link)
+
+    def local_path(self, folder: str, name: Optional[str]=None) -> str:
+        """
+        :param folder: absolute path on the camera, e.g. /store_00010001/DCIM
+        :param name: file or folder name in folder
+        :return: the path in the tree being served
+        """
+
+        parts = [part for part in folder.split('/') if part]
+        if name is not None:
+            parts.append(name)
+        if not parts or parts[0] not in self.storages or '..' in parts:
+            raise gp.GPhoto2Error(gp.GP_ERROR_DIRECTORY_NOT_FOUND)
+        return os.path.join(self.storages[parts[0]], *parts[1:])
+
+    def _listing(self, folder: str, dirs: bool) -> List[Tuple[str, None]]:
+        if folder.rstrip('/') == '':
+            names = list(self.storages) if dirs else []
+        else:
+            path = self.local_path(folder)
+            try:
+                names = [entry.name for entry in os.scandir(path) if entry.is_dir() == dirs]
+            except OSError:
+                raise gp.GPhoto2Error(gp.GP_ERROR_DIRECTORY_NOT_FOUND)
+        self._link(folder).request(
+            'folder_list_folders' if dirs else 'folder_list_files',
+            len(names) * listing_entry_bytes
+        )
+        # python-gphoto2 returns a CameraList, which iterates as name value pairs
+        return [(name, None) for name in sorted(names)]
+
+    def folder_list_folders(self, folder: str, context=None) -> List[Tuple[str, None]]:
+        return self._listing(folder, dirs=True)
+
+    def folder_list_files(self, folder: str, context=None) -> List[Tuple[str, None]]:
+        return self._listing(folder, dirs=False)
+
+    def _stat(self, folder: str, name: str) -> os.stat_result:
+        try:
+            return os.stat(self.local_path(folder, name))
+        except OSError:
+            raise gp.GPhoto2Error(gp.GP_ERROR_FILE_NOT_FOUND)
+
+    def file_get_info(self, folder: str, name: str, context=None) -> SimulatedFileInfo:
+        stat = self._stat(folder, name)
+        self._link(folder).request('file_get_info', listing_entry_bytes)
+        return SimulatedFileInfo(int(stat.st_mtime), stat.st_size)
+
+    def folder_list_files_info(self, folder: str,
+                               context=None) -> List[Tuple[str, int, int]]:
+        """
+        Not part of the gphoto2.Camera interface. Lists the files in a folder
+        with their information in one request, like PTP's GetObjectPropList.
+
+        :return: name, modification time and size of each file
+        """
+
+        if not self.proplist:
+            raise gp.GPhoto2Error(gp.GP_ERROR_NOT_SUPPORTED)
+        path = self.local_path(folder)
+        try:
+            entries = [entry for entry in os.scandir(path) if entry.is_file()]
+            files = [
+                (entry.name, int(entry.stat().st_mtime), entry.stat().st_size)
+                for entry in entries
+            ]
+        except OSError:
+            raise gp.GPhoto2Error(gp.GP_ERROR_DIRECTORY_NOT_FOUND)
+        self._link(folder).request('folder_list_files_info', len(files) * listing_entry_bytes)
+        return sorted(files)
+
+    def _read(self, folder: str, name: str, offset: int, size: int) -> bytes:
+        try:
+            with open(self.local_path(folder, name), 'rb') as f:
+                f.seek(offset)
+                return f.read(size)
+        except OSError:
+            raise gp.GPhoto2Error(gp.GP_ERROR_FILE_NOT_FOUND)
+
+    def file_read(self, folder: str, name: str, file_type: int, offset: int,
+                  buf, context=None) -> int:
+        """
+        Read part of a file into buf, like PTP's GetPartialObject
+
+        :return: bytes read
+        """
+
+        if file_type != gp.GP_FILE_TYPE_NORMAL:
+            raise gp.GPhoto2Error(gp.GP_ERROR_NOT_SUPPORTED)
+        view = memoryview(buf)
+        data = self._read(folder, name, offset, len(view))
+        self._link(folder).request('file_read', len(data))
+        view[:len(data)] = data
+        return len(data)
+
+    def file_get(self, folder: str, name: str, file_type: int,
+                 context=None) -> SimulatedCameraFile:
+        if file_type == gp.GP_FILE_TYPE_NORMAL:
+            data = self._read(folder, name, 0, self._stat(folder, name).st_size)
+        elif file_type == gp.GP_FILE_TYPE_EXIF:
+            # The start of image marker and the APP1 segment of a JPEG
+            data = self._read(folder, name, 0, 6)
+            if data[:4] != b'\xff\xd8\xff\xe1':
+                raise gp.GPhoto2Error(gp.GP_ERROR_NOT_SUPPORTED)
+            data = self._read(folder, name, 0, 4 + data[4] * 256 + data[5])
+        else:
+            raise gp.GPhoto2Error(gp.GP_ERROR_NOT_SUPPORTED)
+        self._link(folder).request('file_get', len(data))
+        return SimulatedCameraFile(data)
+
+    def get_abilities(self) -> SimulatedAbilities:
+        return SimulatedAbilities(self.model)
+
+    def get_config(self, context=None) -> SimulatedWidget:
+        self.link.request('get_config')
+        return SimulatedWidget(
+            'main', gp.GP_WIDGET_WINDOW, children=[
+                SimulatedWidget(
+                    'status', gp.GP_WIDGET_SECTION, children=[
+                        SimulatedWidget('cameramodel', gp.GP_WIDGET_TEXT, self.model),
+                        SimulatedWidget('serialnumber', gp.GP_WIDGET_TEXT, self.serial_number),
+                    ]
+                )
+            ]
+        )
+
+    def get_storageinfo(self, context=None) -> List[SimulatedStorageInfo]:
+        self.link.request('get_storageinfo')
+        return [
+            SimulatedStorageInfo(
+                '/{}'.format(name), 'Simulated storage {}'.format(i + 1), path
+            ) for i, (name, path) in enumerate(sorted(self.storages.items()))
+        ]
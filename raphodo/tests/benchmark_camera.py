@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+Benchmark the camera access patterns of scanning, metadata extraction, copying
+and rescanning against a simulated camera, without a physical device.
+
+Each operation is reported with how long it took and how many requests it made
+to the camera, so the effect of the chunk size, the amount of each file read
+to extract its metadata, and the rescan strategy can be compared for a given
+latency and bandwidth.
+
+Usage: python3 -m raphodo.tests.benchmark_camera [options] [number of files]
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+import argparse
+import logging
+import os
+import shutil
+import tempfile
+import time
+from types import SimpleNamespace
+from typing import Dict, List, Tuple
+
+from raphodo.camera import Camera
+from raphodo.preferences import Preferences
+from raphodo.rescan import RescanCamera
+from raphodo.rpdsql import CameraContentSQL
+from raphodo.simulatedcamera import simulated_camera_model, simulated_camera_port
+from raphodo.tests.synthetic_device import add_device_arguments, create_device, default_root
+from raphodo.utilities import format_size_for_user
+
+# Folder, file name, modification time and size
+CameraFile = Tuple[str, str, int, int]
+
+
+class Measure:
+    """
+    Time an operation, and count the requests it makes to the camera
+    """
+
+    def __init__(self, camera: Camera, description: str) -> None:
+        self.camera = camera
+        self.description = description
+        self.size = 0
+
+    def __enter__(self) -> 'Measure':
+        self.before = self.camera.camera.statistics()
+        self.start = time.perf_counter()
+        return self
+
+    def __exit__(self, *exc) -> None:
+        seconds = time.perf_counter() - self.start
+        after = self.camera.camera.statistics()
+        requests = sum(after['requests'].values()) - sum(self.before['requests'].values())
+        rate = ''
+        if self.size:
+            rate = ', {}/s'.format(format_size_for_user(self.size / seconds))
+        print('{:<32} {:>8.2f}s {:>8} requests{}'.format(
+            self.description, seconds, requests, rate
+        ))
+
+
+def list_files(camera: Camera, path: str, files: List[CameraFile], bulk: bool) -> None:
+    """
+    Recursively list the files in path, with their modification times and
+    sizes, as the scan does
+
+    :param bulk: if True, get the information of all the files in a folder at
+     once, else get each file's information in turn
+    """
+
+    names = [name for name, value in camera.camera.folder_list_files(path, camera.context)]
+    if bulk:
+        file_info, errors = camera.get_folder_file_info(path, names)
+    else:
+        file_info = {name: camera.get_file_info(path, name) for name in names}
+    for name in names:
+        modification_time, size = file_info[name]
+        files.append((path, name, modification_time, size))
+    for name, value in camera.camera.folder_list_folders(path, camera.context):
+        list_files(camera, os.path.join(path, name), files, bulk)
+
+
+def benchmark_listing(camera: Camera) -> List[CameraFile]:
+    for bulk, description in ((False, 'List files, file by file'), (True, 'List files')):
+        files = []  # type: List[CameraFile]
+        with Measure(camera, description):
+            for folders in camera.specific_folders:
+                for folder in folders:
+                    list_files(camera, folder, files, bulk)
+    return files
+
+
+def benchmark_extracts(camera: Camera, files: List[CameraFile], sizes: List[int]) -> None:
+    """
+    Read the start of each file, as is done to extract metadata and thumbnails
+    """
+
+    for size in sizes:
+        with Measure(camera, 'Read first {} of {} files'.format(
+                format_size_for_user(size), len(files))):
+            for folder, name, modification_time, file_size in files:
+                camera.get_exif_extract(folder, name, min(size, file_size))
+
+
+def benchmark_jpeg_headers(camera: Camera, files: List[CameraFile]) -> None:
+    """
+    Parse the markers at the start of each jpeg to read its exif
+    """
+
+    jpegs = [(folder, name) for folder, name, *_ in files if name.lower().endswith('.jpg')]
+    with Measure(camera, 'Parse exif of {} jpegs'.format(len(jpegs))):
+        for folder, name in jpegs:
+            camera.get_exif_extract_from_jpeg_manual_parse(folder, name)
+
+
+def benchmark_copy(camera: Camera, files: List[CameraFile], chunk_sizes: List[int],
+                   dest_dir: str) -> None:
+    for chunk_size in chunk_sizes:
+        with Measure(camera, 'Copy {} files, {} chunks'.format(
+                len(files), format_size_for_user(chunk_size))) as measure:
+            for folder, name, modification_time, size in files:
+                camera.save_file_by_chunks(
+                    dir_name=folder, file_name=name, size=size,
+                    dest_full_filename=os.path.join(dest_dir, name), progress_callback=None,
+                    check_for_command=lambda: None, chunk_size=chunk_size
+                )
+                measure.size += size
+
+
+def benchmark_rescan(camera: Camera, files: List[CameraFile], work_dir: str) -> None:
+    """
+    Move the files' folders on the camera, as iOS does, and relocate them, first
+    by walking the camera's folders and then by using the camera content index
+    the walk updated
+    """
+
+    moved = []  # type: List[Tuple[str, str]]
+    for folder in sorted({folder for folder, *_ in files}):
+        path = camera.camera.local_path(folder)
+        moved.append((path, '{}-moved'.format(path)))
+    for src, dest in moved:
+        os.rename(src, dest)
+
+    camera_content = CameraContentSQL(work_dir)
+    try:
+        for description in ('Rescan {} moved files', 'Rescan {} using index'):
+            rpd_files = [
+                SimpleNamespace(
+                    path=folder, name=name, modification_time=modification_time, size=size
+                ) for folder, name, modification_time, size in files
+            ]
+            # Keep the user's camera content index untouched
+            rescan = RescanCamera(
+                camera=camera, prefs=Preferences(), camera_content=camera_content
+            )
+            with Measure(camera, description.format(len(files))):
+                rescan.rescan_camera(rpd_files)
+            print('{:<32} {:>9} relocated, {} missing'.format(
+                '', len(rescan.rpd_files), len(rescan.missing_rpd_files)
+            ))
+    finally:
+        for src, dest in moved:
+            os.rename(dest, src)
+
+
+def sizes_in_kib(value: str) -> List[int]:
+    """
+    >>> sizes_in_kib('64, 1024')
+    [65536, 1048576]
+    """
+
+    return [int(size) * 1024 for size in value.split(',')]
+
+
+def parser_options() -> argparse.ArgumentParser:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0].strip())
+    parser.add_argument(
+        'files', type=int, nargs='?', default=1000,
+        help="Number of photos and videos on the camera (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--tree', help="Serve this directory tree instead of creating a synthetic card. "
+                       "It may contain storage folders named like store_00010001."
+    )
+    parser.add_argument(
+        '--latency', type=float, default=3.0,
+        help="Milliseconds each request to the camera takes (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--bandwidth', type=float, default=30.0,
+        help="MB/s transferred by the camera, 0 for unlimited (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--no-proplist', action='store_true',
+        help="Simulate a camera that cannot list the information of all the files in a "
+             "folder at once"
+    )
+    parser.add_argument(
+        '--extract-sizes', type=sizes_in_kib, default='1,64,512',
+        help="Comma separated KiB read from the start of each file (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--chunk-sizes', type=sizes_in_kib, default='256,1024,4096',
+        help="Comma separated KiB of each chunk when copying files (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--copy-files', type=int, default=100,
+        help="How many files to read and copy (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--no-rescan', action='store_true', help="Do not benchmark rescanning moved files"
+    )
+    parser.add_argument('--verbose', action='store_true', help="Show log messages")
+    add_device_arguments(parser)
+    return parser
+
+
+def main() -> None:
+    args = parser_options().parse_args()
+    logging.basicConfig(
+        format='%(levelname)s: %(message)s',
+        level=logging.DEBUG if args.verbose else logging.CRITICAL
+    )
+
+    work_dir = tempfile.mkdtemp(prefix='rpd-camera-benchmark-', dir=default_root())
+    try:
+        if args.tree:
+            tree = args.tree
+        else:
+            tree = os.path.join(work_dir, 'card')
+            summary = create_device(
+                tree, args.files, mix=args.mix, seed=args.seed, size_scale=args.size_scale,
+                files_per_folder=args.files_per_folder
+            )
+            print('Created {} files ({})'.format(
+                sum(summary.files.values()), format_size_for_user(summary.size)
+            ))
+        dest_dir = os.path.join(work_dir, 'copies')
+        os.makedirs(dest_dir)
+
+        port = simulated_camera_port(
+            tree, args.latency, args.bandwidth, proplist=not args.no_proplist
+        )
+        print('Simulated camera: {}\n'.format(port))
+        camera = Camera(
+            simulated_camera_model, port, raise_errors=True,
+            specific_folders=Preferences().folders_to_scan
+        )
+        if not camera.camera_has_folders_to_scan():
+            print('No folders to scan were located in {}'.format(tree))
+            return
+
+        files = benchmark_listing(camera)
+        sample = files[:args.copy_files]
+        benchmark_extracts(camera, sample, args.extract_sizes)
+        benchmark_jpeg_headers(camera, sample)
+        benchmark_copy(camera, sample, args.chunk_sizes, dest_dir)
+        if not args.no_rescan and not args.tree:
+            benchmark_rescan(camera, files, work_dir)
+
+        statistics = camera.camera.statistics()  # type: Dict
+        camera.free_camera()
+        print('\nTotal: {} requests, {} transferred, link busy {:.2f}s'.format(
+            sum(statistics['requests'].values()), format_size_for_user(statistics['bytes']),
+            statistics['busy']
+        ))
+    finally:
+        shutil.rmtree(work_dir, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    main()
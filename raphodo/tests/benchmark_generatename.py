@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+Compare the time taken to generate subfolder and file names by interpreting the
+preference list for every file, as was done before, against using a compiled
+generator.
+
+Usage: python3 -m raphodo.tests.benchmark_generatename [number of files]
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+import builtins
+import sys
+from timeit import timeit
+
+if not hasattr(builtins, '_'):
+    builtins._ = lambda s: s
+
+import raphodo.generatename as gn
+from raphodo.generatenameconfig import (
+    PHOTO_RENAME_COMPLEX, PHOTO_RENAME_SIMPLE, PHOTO_SUBFOLDER_MENU_DEFAULTS_CONV
+)
+from raphodo.preferences import DownloadsTodayTracker
+from raphodo.rpdfile import SamplePhoto
+
+
+def benchmark(generator_class, pref_list, no_files: int) -> None:
+    sequences = gn.Sequences(
+        DownloadsTodayTracker(day_start='03:00', downloads_today=['', '0']),
+        stored_sequence_no=0
+    )
+    rpd_file = SamplePhoto(sequences=sequences)
+    rpd_file.strip_characters = True
+
+    def interpreted():
+        generator_class(pref_list).generate_name(rpd_file)
+
+    compiled_generator = generator_class(pref_list)
+    compiled_generator.compile()
+
+    def compiled():
+        compiled_generator.generate_name(rpd_file)
+
+    assert generator_class(pref_list).generate_name(rpd_file) == \
+           compiled_generator.generate_name(rpd_file)
+
+    interpreted_time = timeit(interpreted, number=no_files)
+    compiled_time = timeit(compiled, number=no_files)
+    print(
+        '{:<14} {:>2} components: interpreted {:.3f}s, compiled {:.3f}s ({:.1f}x)'.format(
+            generator_class.__name__, len(pref_list) // 3, interpreted_time, compiled_time,
+            interpreted_time / compiled_time
+        )
+    )
+
+
+if __name__ == '__main__':
+    if len(sys.argv) > 1:
+        no_files = int(sys.argv[1])
+    else:
+        no_files = 10000
+
+    print('Generating names for {} files'.format(no_files))
+    benchmark(gn.PhotoSubfolder, PHOTO_SUBFOLDER_MENU_DEFAULTS_CONV[0], no_files)
+    benchmark(gn.PhotoName, PHOTO_RENAME_SIMPLE, no_files)
+    benchmark(gn.PhotoName, PHOTO_RENAME_COMPLEX, no_files)
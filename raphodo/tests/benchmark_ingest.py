@@ -0,0 +1,800 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+Headless end-to-end benchmark of scanning, thumbnail generation, copying,
+renaming and backing up files from synthetic memory cards.
+
+The worker processes, and the managers in the main process that control them,
+are run just as they are by the program, but without the main window. Scanning
+and thumbnail generation run to completion before the download starts, after
+which files are copied, renamed and backed up concurrently, as they are in the
+program.
+
+The benchmark runs in its own directory, by default on a tmpfs, which holds the
+cards, the download and backup destinations, and the program's configuration,
+caches and download history, so the user's are neither used nor altered. To
+benchmark a particular file system, e.g. a loop device, use --root.
+
+With --camera, each card is served by a simulated camera whose latency and
+bandwidth mimic PTP / MTP over USB, so the camera code paths are exercised
+without a physical device. See simulatedcamera.py.
+
+The throughput of each stage and the latencies recorded by the workers can be
+saved as JSON, and compared against a previous run to catch regressions.
+
+Usage: python3 -m raphodo.tests.benchmark_ingest [options]
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+import argparse
+from collections import OrderedDict, defaultdict
+import datetime
+import json
+import logging
+import os
+import shutil
+import sys
+import tempfile
+import time
+from typing import Any, Dict, List, Optional, Set, Tuple
+
+import zmq
+from PyQt5.QtCore import QObject, QThread, QTimer, pyqtSlot
+from PyQt5.QtGui import QGuiApplication, QPixmap
+
+from raphodo.cache import ThumbnailCacheSql
+from raphodo.constants import (
+    BackupStatus, DeviceType, DownloadStatus, FileType, RenameAndMoveStatus
+)
+from raphodo.devices import Device
+from raphodo.interprocess import (
+    BackupArguments, BackupFileData, BackupManager, CopyFilesArguments, CopyFilesManager,
+    ProcessLoggingManager, RenameAndMoveFileData, RenameMoveFileManager, ScanArguments,
+    ScanManager, ThreadNames, create_inproc_msg, stop_process_logging_manager
+)
+import raphodo.metrics as metrics
+from raphodo.preferences import Preferences
+from raphodo.rpdfile import FileTypeCounter, RPDFile
+from raphodo.simulatedcamera import simulated_camera_model, simulated_camera_port
+from raphodo.tests.synthetic_device import (
+    DeviceSummary, add_device_arguments, create_device, default_root
+)
+from raphodo.thumbnailer import Thumbnailer
+from raphodo.utilities import CacheDirs, available_cpu_count, format_size_for_user
+
+# Set in the environment of the benchmark once it is isolated from the user's
+# configuration, caches and data
+benchmark_dir_env = 'RPD_BENCHMARK_DIR'
+
+stages = ('scan', 'thumbnails', 'copy', 'rename', 'backup')
+
+
+class StageTiming:
+    """
+    Throughput of one stage of the pipeline, measured from when the first file
+    reaches the stage to when the last file leaves it
+    """
+
+    def __init__(self) -> None:
+        self.start = None  # type: Optional[float]
+        self.end = None  # type: Optional[float]
+        self.files = 0
+        self.bytes = 0
+        self.failures = 0
+
+    def begin(self) -> None:
+        if self.start is None:
+            self.start = time.perf_counter()
+
+    def add(self, size: int, succeeded: bool=True) -> None:
+        if succeeded:
+            self.files += 1
+            self.bytes += size
+        else:
+            self.failures += 1
+        self.end = time.perf_counter()
+
+    def finish(self) -> None:
+        self.end = time.perf_counter()
+
+    def as_dict(self) -> Dict[str, Any]:
+        if self.start is None or self.end is None:
+            seconds = None
+        else:
+            seconds = self.end - self.start
+        return dict(
+            files=self.files,
+            bytes=self.bytes,
+            failures=self.failures,
+            seconds=seconds,
+            files_per_second=self.files / seconds if seconds else None,
+            mb_per_second=self.bytes / seconds / 1000000 if seconds else None,
+        )
+
+
+class IngestBenchmark(QObject):
+    """
+    Plays the part of the main window: starts the managers and their worker
+    processes, and passes each file from stage to stage
+    """
+
+    def __init__(self, app: QGuiApplication,
+                 cards: List[DeviceSummary],
+                 backup_paths: List[str],
+                 prefs: Preferences,
+                 generate_thumbnails: bool,
+                 no_extractors: int,
+                 timeout: int,
+                 camera_ports: Optional[List[str]]=None) -> None:
+        super().__init__()
+        self.app = app
+        self.cards = cards
+        # Port of the simulated camera serving each card, if the cards are not
+        # scanned as volumes
+        self.camera_ports = camera_ports
+        self.backup_paths = backup_paths
+        self.prefs = prefs
+        self.generate_thumbnails = generate_thumbnails
+        self.no_extractors = no_extractors
+
+        self.timings = OrderedDict((stage, StageTiming()) for stage in stages)
+        self.devices = {}  # type: Dict[int, Device]
+        self.rpd_files = defaultdict(dict)  # type: Dict[int, Dict[bytes, RPDFile]]
+        self.entire_video_required = {}  # type: Dict[int, bool]
+        self.entire_photo_required = {}  # type: Dict[int, bool]
+        self.scanning = set()  # type: Set[int]
+        self.thumbnailing = set()  # type: Set[int]
+        self.thumbnails_expected = 0
+        self.thumbnails_received = 0
+        self.copying = set()  # type: Set[int]
+        self.copied = 0
+        self.renamed = 0
+        self.backups_sent = 0
+        self.backups_received = 0
+        self.download_completed = False
+        self.succeeded = False
+        self.logging_port = None  # type: Optional[int]
+
+        self.thumbnailer = None  # type: Optional[Thumbnailer]
+        # Inproc controller socket and thread of each manager that has been started
+        self.threads = []  # type: List[Tuple[zmq.Socket, QThread]]
+        # Thumbnails for files that cannot be processed are never received.
+        # Stop waiting for them when no thumbnail has arrived for a while.
+        self.thumbnail_idle_timer = QTimer(self)
+        self.thumbnail_idle_timer.setSingleShot(True)
+        self.thumbnail_idle_timer.setInterval(5000)
+        self.thumbnail_idle_timer.timeout.connect(self.thumbnailsIdle)
+
+        self.timeout_timer = QTimer(self)
+        self.timeout_timer.setSingleShot(True)
+        self.timeout_timer.setInterval(timeout * 1000)
+        self.timeout_timer.timeout.connect(self.timedOut)
+
+        self.startThreadControlSockets()
+
+    def startThreadControlSockets(self) -> None:
+        context = zmq.Context.instance()
+        inproc = "inproc://{}"
+
+        self.rename_controller = context.socket(zmq.PAIR)
+        self.rename_controller.bind(inproc.format(ThreadNames.rename))
+
+        self.scan_controller = context.socket(zmq.PAIR)
+        self.scan_controller.bind(inproc.format(ThreadNames.scan))
+
+        self.copy_controller = context.socket(zmq.PAIR)
+        self.copy_controller.bind(inproc.format(ThreadNames.copy))
+
+        self.backup_controller = context.socket(zmq.PAIR)
+        self.backup_controller.bind(inproc.format(ThreadNames.backup))
+
+    def sendToThread(self, socket: zmq.Socket, cmd: bytes,
+                     worker_id: Optional[int]=None, data: Any=None) -> None:
+        socket.send_multipart(create_inproc_msg(cmd, worker_id=worker_id, data=data))
+
+    def start(self) -> None:
+        self.timeout_timer.start()
+        self.loggermq = ProcessLoggingManager()
+        self.loggermqThread = QThread()
+        self.loggermq.moveToThread(self.loggermqThread)
+        self.loggermqThread.started.connect(self.loggermq.startReceiver)
+        self.loggermq.ready.connect(self.startRenameManager)
+        QTimer.singleShot(0, self.loggermqThread.start)
+
+    @pyqtSlot(int)
+    def startRenameManager(self, logging_port: int) -> None:
+        self.logging_port = logging_port
+        self.renameThread = QThread()
+        self.renamemq = RenameMoveFileManager(logging_port=logging_port)
+        self.renameThread.started.connect(self.renamemq.run_sink)
+        self.renamemq.sinkStarted.connect(self.startScanManager)
+        self.renamemq.message.connect(self.fileRenamedAndMoved)
+        self.renamemq.sequencesUpdate.connect(self.sequencesUpdated)
+        self.renamemq.moveToThread(self.renameThread)
+        self.threads.append((self.rename_controller, self.renameThread))
+        QTimer.singleShot(0, self.renameThread.start)
+
+    @pyqtSlot()
+    def startScanManager(self) -> None:
+        self.sendToThread(self.rename_controller, b'START')
+        self.scanThread = QThread()
+        self.scanmq = ScanManager(logging_port=self.logging_port)
+        self.scanThread.started.connect(self.scanmq.run_sink)
+        self.scanmq.sinkStarted.connect(self.startCopyFilesManager)
+        self.scanmq.scannedFiles.connect(self.scanFilesReceived)
+        self.scanmq.workerFinished.connect(self.scanFinished)
+        self.scanmq.fatalError.connect(self.scanFinished)
+        self.scanmq.moveToThread(self.scanThread)
+        self.threads.append((self.scan_controller, self.scanThread))
+        QTimer.singleShot(0, self.scanThread.start)
+
+    @pyqtSlot()
+    def startCopyFilesManager(self) -> None:
+        self.copyfilesThread = QThread()
+        self.copyfilesmq = CopyFilesManager(logging_port=self.logging_port)
+        self.copyfilesThread.started.connect(self.copyfilesmq.run_sink)
+        self.copyfilesmq.sinkStarted.connect(self.startBackupManager)
+        self.copyfilesmq.message.connect(self.copyfilesDownloaded)
+        self.copyfilesmq.workerFinished.connect(self.copyfilesFinished)
+        self.copyfilesmq.moveToThread(self.copyfilesThread)
+        self.threads.append((self.copy_controller, self.copyfilesThread))
+        QTimer.singleShot(0, self.copyfilesThread.start)
+
+    @pyqtSlot()
+    def startBackupManager(self) -> None:
+        self.backupThread = QThread()
+        self.backupmq = BackupManager(logging_port=self.logging_port)
+        self.backupThread.started.connect(self.backupmq.run_sink)
+        self.backupmq.sinkStarted.connect(self.startThumbnailer)
+        self.backupmq.message.connect(self.fileBackedUp)
+        self.backupmq.moveToThread(self.backupThread)
+        self.threads.append((self.backup_controller, self.backupThread))
+        QTimer.singleShot(0, self.backupThread.start)
+
+    @pyqtSlot()
+    def startThumbnailer(self) -> None:
+        for device_id, path in enumerate(self.backup_paths):
+            self.sendToThread(
+                self.backup_controller, b'START_WORKER', worker_id=device_id,
+                data=BackupArguments(path, os.path.basename(path))
+            )
+
+        if self.generate_thumbnails:
+            ThumbnailCacheSql(create_table_if_not_exists=True)
+            self.thumbnailer = Thumbnailer(
+                parent=self, no_workers=self.no_extractors, logging_port=self.logging_port,
+                log_gphoto2=False
+            )
+            self.thumbnailer.frontend_port.connect(self.startScan)
+            self.thumbnailer.thumbnailReceived.connect(self.thumbnailReceived)
+            self.thumbnailer.workerFinished.connect(self.thumbnailsFinished)
+        else:
+            self.startScan()
+
+    @pyqtSlot()
+    def startScan(self) -> None:
+        logging.info("Scanning %s devices", len(self.cards))
+        self.timings['scan'].begin()
+        for scan_id, card in enumerate(self.cards):
+            device = Device()
+            if self.camera_ports:
+                device.set_download_from_camera(simulated_camera_model, self.camera_ports[scan_id])
+            else:
+                device.set_download_from_volume(card.path, os.path.basename(card.path))
+            self.devices[scan_id] = device
+            self.scanning.add(scan_id)
+            self.sendToThread(
+                self.scan_controller, b'START_WORKER', worker_id=scan_id,
+                data=ScanArguments(device=device, ignore_other_types=False, log_gphoto2=False)
+            )
+
+    @pyqtSlot('PyQt_PyObject', 'PyQt_PyObject', FileTypeCounter, 'PyQt_PyObject', bool, bool)
+    def scanFilesReceived(self, rpd_files: List[RPDFile],
+                          sample_files,
+                          file_type_counter,
+                          file_size_sum,
+                          entire_video_required: bool,
+                          entire_photo_required: bool) -> None:
+        for rpd_file in rpd_files:
+            self.rpd_files[rpd_file.scan_id][rpd_file.uid] = rpd_file
+            self.timings['scan'].add(rpd_file.size)
+        if rpd_files:
+            scan_id = rpd_files[0].scan_id
+            self.entire_video_required[scan_id] = entire_video_required
+            self.entire_photo_required[scan_id] = entire_photo_required
+
+    @pyqtSlot(int)
+    def scanFinished(self, scan_id: int) -> None:
+        if scan_id not in self.scanning:
+            return
+        self.scanning.remove(scan_id)
+        if self.scanning:
+            return
+        self.timings['scan'].finish()
+        if self.generate_thumbnails:
+            self.startThumbnails()
+        else:
+            self.startDownload()
+
+    def startThumbnails(self) -> None:
+        logging.info("Generating thumbnails")
+        self.timings['thumbnails'].begin()
+        cache_dirs = CacheDirs(
+            self.prefs.photo_download_folder, self.prefs.video_download_folder
+        )
+        for scan_id, files in self.rpd_files.items():
+            self.thumbnailing.add(scan_id)
+            self.thumbnails_expected += len(files)
+            device = self.devices[scan_id]
+            # As determined in ThumbnailListModel.generateThumbnails()
+            need_video_cache_dir = need_photo_cache_dir = False
+            if device.device_type == DeviceType.camera:
+                need_video_cache_dir = self.entire_video_required[scan_id] or any(
+                    rpd_file.file_type == FileType.video for rpd_file in files.values()
+                )
+                need_photo_cache_dir = self.entire_photo_required[scan_id]
+            self.thumbnailer.generateThumbnails(
+                scan_id, list(files.values()), device.name(),
+                self.prefs.proximity_seconds, cache_dirs, need_photo_cache_dir,
+                need_video_cache_dir, device.camera_model, device.camera_port,
+                self.entire_video_required[scan_id], self.entire_photo_required[scan_id]
+            )
+        if not self.thumbnailing:
+            self.thumbnailsDone()
+
+    @pyqtSlot(RPDFile, QPixmap)
+    def thumbnailReceived(self, rpd_file: RPDFile, thumbnail: QPixmap) -> None:
+        if self.thumbnails_expected < 0:
+            # Thumbnail generation has already been given up on
+            return
+        # The file now carries the metadata read while generating its thumbnail
+        self.rpd_files[rpd_file.scan_id][rpd_file.uid] = rpd_file
+        self.thumbnails_received += 1
+        self.timings['thumbnails'].add(rpd_file.size, not thumbnail.isNull())
+        if self.thumbnail_idle_timer.isActive():
+            self.thumbnail_idle_timer.start()
+        if self.thumbnails_received == self.thumbnails_expected:
+            self.thumbnailsDone()
+
+    @pyqtSlot(int)
+    def thumbnailsFinished(self, scan_id: int) -> None:
+        # Extractors may still be working on files the worker passed to them
+        self.thumbnailing.discard(scan_id)
+        if not self.thumbnailing and self.thumbnails_received < self.thumbnails_expected:
+            self.thumbnail_idle_timer.start()
+
+    @pyqtSlot()
+    def thumbnailsIdle(self) -> None:
+        logging.warning(
+            "%s thumbnails were not received",
+            self.thumbnails_expected - self.thumbnails_received
+        )
+        self.thumbnailsDone()
+
+    def thumbnailsDone(self) -> None:
+        if self.timings['thumbnails'].end is None:
+            self.timings['thumbnails'].finish()
+        self.thumbnail_idle_timer.stop()
+        # Ignore any thumbnails that arrive late
+        self.thumbnails_expected = -1
+        self.startDownload()
+
+    def startDownload(self) -> None:
+        logging.info("Downloading")
+        self.download_start_datetime = datetime.datetime.now()
+        self.timings['copy'].begin()
+
+        self.sendToThread(
+            self.rename_controller, b'SEND_TO_WORKER',
+            data=RenameAndMoveFileData(message=RenameAndMoveStatus.download_started)
+        )
+        self.sendBackupMessage(BackupStatus.backup_started)
+
+        for scan_id, files in self.rpd_files.items():
+            rpd_files = list(files.values())
+            for rpd_file in rpd_files:
+                rpd_file.status = DownloadStatus.download_pending
+                rpd_file.generate_thumbnail = False
+            has_photos = any(rpd_file.file_type == FileType.photo for rpd_file in rpd_files)
+            has_videos = any(rpd_file.file_type == FileType.video for rpd_file in rpd_files)
+            self.copying.add(scan_id)
+            self.sendToThread(
+                self.copy_controller, b'START_WORKER', worker_id=scan_id,
+                data=CopyFilesArguments(
+                    scan_id=scan_id,
+                    device=self.devices[scan_id],
+                    photo_download_folder=self.prefs.photo_download_folder if has_photos else None,
+                    video_download_folder=self.prefs.video_download_folder if has_videos else None,
+                    files=rpd_files,
+                    verify_file=self.prefs.verify_file,
+                    generate_thumbnails=False,
+                    log_gphoto2=False
+                )
+            )
+
+        if not self.copying:
+            self.checkDownloadCompleted()
+
+    def sendBackupMessage(self, message: BackupStatus) -> None:
+        for device_id in range(len(self.backup_paths)):
+            self.sendToThread(
+                self.backup_controller, b'SEND_TO_WORKER', worker_id=device_id,
+                data=BackupFileData(message=message)
+            )
+
+    @pyqtSlot(bool, RPDFile, int, 'PyQt_PyObject')
+    def copyfilesDownloaded(self, download_succeeded: bool,
+                            rpd_file: RPDFile,
+                            download_count: int,
+                            mdata_exceptions) -> None:
+        self.copied += 1
+        self.timings['copy'].add(rpd_file.size, download_succeeded)
+        self.timings['rename'].begin()
+
+        rpd_file.download_start_time = self.download_start_datetime
+        if rpd_file.file_type == FileType.photo:
+            rpd_file.generate_extension_case = self.prefs.photo_extension
+        else:
+            rpd_file.generate_extension_case = self.prefs.video_extension
+
+        self.sendToThread(
+            self.rename_controller, b'SEND_TO_WORKER',
+            data=RenameAndMoveFileData(
+                rpd_file=rpd_file, download_count=download_count,
+                download_succeeded=download_succeeded
+            )
+        )
+
+    @pyqtSlot(int)
+    def copyfilesFinished(self, scan_id: int) -> None:
+        self.copying.discard(scan_id)
+        if not self.copying:
+            self.timings['copy'].finish()
+            self.checkDownloadCompleted()
+
+    @pyqtSlot(bool, RPDFile, int)
+    def fileRenamedAndMoved(self, move_succeeded: bool,
+                            rpd_file: RPDFile,
+                            download_count: int) -> None:
+        self.renamed += 1
+        self.timings['rename'].add(rpd_file.size, move_succeeded)
+
+        if move_succeeded and self.backup_paths:
+            self.timings['backup'].begin()
+            for device_id in range(len(self.backup_paths)):
+                self.backups_sent += 1
+                self.sendToThread(
+                    self.backup_controller, b'SEND_TO_WORKER', worker_id=device_id,
+                    data=BackupFileData(
+                        rpd_file=rpd_file,
+                        move_succeeded=move_succeeded,
+                        do_backup=True,
+                        path_suffix=None,
+                        backup_duplicate_overwrite=False,
+                        verify_file=self.prefs.verify_file,
+                        download_count=download_count,
+                        save_fdo_thumbnail=False
+                    )
+                )
+        self.checkDownloadCompleted()
+
+    @pyqtSlot(int, bool, bool, RPDFile, str, 'PyQt_PyObject')
+    def fileBackedUp(self, device_id: int,
+                     backup_succeeded: bool,
+                     do_backup: bool,
+                     rpd_file: RPDFile,
+                     backup_full_file_name: str,
+                     mdata_exceptions) -> None:
+        self.backups_received += 1
+        self.timings['backup'].add(rpd_file.size, backup_succeeded)
+        self.checkDownloadCompleted()
+
+    def checkDownloadCompleted(self) -> None:
+        if self.download_completed or self.copying or self.renamed < self.copied or \
+                self.backups_received < self.backups_sent:
+            return
+
+        self.download_completed = True
+        # The workers publish their metrics when told the download is complete
+        self.sendToThread(
+            self.rename_controller, b'SEND_TO_WORKER',
+            data=RenameAndMoveFileData(message=RenameAndMoveStatus.download_completed)
+        )
+        self.sendBackupMessage(BackupStatus.backup_completed)
+
+    @pyqtSlot(int, list)
+    def sequencesUpdated(self, stored_sequence_no: int, downloads_today: List[str]) -> None:
+        self.succeeded = True
+        # Allow time for the metrics sent on the logging channel to arrive
+        QTimer.singleShot(1000, self.stop)
+
+    @pyqtSlot()
+    def timedOut(self) -> None:
+        logging.error(
+            "Benchmark did not complete within %s seconds", self.timeout_timer.interval() // 1000
+        )
+        self.stop()
+
+    @pyqtSlot()
+    def stop(self) -> None:
+        self.timeout_timer.stop()
+        if self.thumbnailer is not None:
+            self.thumbnailer.stop()
+
+        for controller, thread in self.threads:
+            self.sendToThread(controller, b'STOP')
+        for controller, thread in self.threads:
+            thread.quit()
+            if not thread.wait(1000):
+                self.sendToThread(controller, b'TERMINATE')
+
+        if self.logging_port is not None:
+            stop_process_logging_manager(info_port=self.logging_port)
+        self.loggermqThread.quit()
+        self.loggermqThread.wait()
+        self.app.quit()
+
+    def report(self, cards: List[DeviceSummary]) -> Dict[str, Any]:
+        return dict(
+            devices=len(cards),
+            files=sum(sum(card.files.values()) for card in cards),
+            bytes=sum(card.size for card in cards),
+            backup_devices=len(self.backup_paths),
+            completed=self.succeeded,
+            stages=OrderedDict(
+                (stage, timing.as_dict()) for stage, timing in self.timings.items()
+                if timing.start is not None
+            ),
+            workers=metrics.aggregator.as_dict()
+        )
+
+
+def find_regressions(report: Dict[str, Any],
+                     baseline: Dict[str, Any],
+                     tolerance: float) -> List[str]:
+    """
+    Compare the throughput of each stage against a previous run
+
+    :param report: results of this run
+    :param baseline: results of a previous run
+    :param tolerance: fraction by which the throughput may fall before it is
+     considered a regression
+    :return: description of each regression
+
+    >>> baseline = dict(stages=dict(copy=dict(files_per_second=100.0)))
+    >>> find_regressions(dict(stages=dict(copy=dict(files_per_second=95.0))), baseline, 0.1)
+    []
+    >>> find_regressions(dict(stages=dict(copy=dict(files_per_second=80.0))), baseline, 0.1)
+    ['copy: 80.0 files/s, baseline 100.0 files/s (-20%)']
+    >>> find_regressions(dict(stages=dict()), baseline, 0.1)
+    ['copy: did not run']
+    """
+
+    regressions = []
+    for stage, previous in baseline['stages'].items():
+        before = previous.get('files_per_second')
+        if not before:
+            continue
+        now = report['stages'].get(stage, {}).get('files_per_second')
+        if not now:
+            regressions.append('{}: did not run'.format(stage))
+        elif now < before * (1 - tolerance):
+            regressions.append(
+                '{}: {:.1f} files/s, baseline {:.1f} files/s ({:+.0%})'.format(
+                    stage, now, before, now / before - 1
+                )
+            )
+    return regressions
+
+
+def print_report(report: Dict[str, Any]) -> None:
+    print(
+        '\n{} files ({}) on {} devices, {} backup devices'.format(
+            report['files'], format_size_for_user(report['bytes']), report['devices'],
+            report['backup_devices']
+        )
+    )
+    camera = report.get('camera')
+    if camera:
+        print('Simulated cameras: {:g}ms latency, {:g}MB/s'.format(
+            camera['latency_ms'], camera['bandwidth_mbs']
+        ))
+    print('{:<11} {:>8} {:>9} {:>9} {:>10} {:>8}'.format(
+        'Stage', 'Files', 'Failures', 'Seconds', 'Files/s', 'MB/s'
+    ))
+    for stage, values in report['stages'].items():
+        print('{:<11} {:>8} {:>9} {:>9.2f} {:>10.1f} {:>8.1f}'.format(
+            stage, values['files'], values['failures'], values['seconds'] or 0,
+            values['files_per_second'] or 0, values['mb_per_second'] or 0
+        ))
+
+    for worker_type, values in sorted(report['workers'].items()):
+        worker_metrics = metrics.PipelineMetrics()
+        worker_metrics.merge(values)
+        summary = worker_metrics.summary()
+        if summary:
+            print('\n{}: {}'.format(worker_type, summary.replace('; ', '\n    ')))
+
+
+def restart_in_benchmark_dir(work_dir: str) -> None:
+    """
+    Run the benchmark again in an environment whose configuration, cache and
+    data directories are inside the benchmark directory.
+
+    The directories are determined when the program's modules are first
+    imported, which is why the benchmark must be restarted.
+    """
+
+    env = os.environ
+    env[benchmark_dir_env] = work_dir
+    for variable, directory in (
+            ('XDG_CONFIG_HOME', 'config'), ('XDG_CACHE_HOME', 'cache'),
+            ('XDG_DATA_HOME', 'data')):
+        env[variable] = os.path.join(work_dir, directory)
+        os.makedirs(env[variable])
+    env.setdefault('QT_QPA_PLATFORM', 'offscreen')
+    sys.stdout.flush()
+    os.execv(
+        sys.executable, [sys.executable, '-m', 'raphodo.tests.benchmark_ingest'] + sys.argv[1:]
+    )
+
+
+def parser_options() -> argparse.ArgumentParser:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0].strip())
+    parser.add_argument(
+        'files', type=int, nargs='?', default=1000,
+        help="Number of photos and videos on each device (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--devices', type=int, default=1, help="Number of devices (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--backups', type=int, default=1,
+        help="Number of backup destinations (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--no-thumbnails', action='store_true', help="Do not generate thumbnails"
+    )
+    parser.add_argument(
+        '--extractors', type=int, default=max(available_cpu_count(physical_only=True), 2),
+        help="Number of thumbnail extractor processes (default: %(default)s)"
+    )
+    parser.add_argument('--verify', action='store_true', help="Verify copied files")
+    parser.add_argument(
+        '--camera', action='store_true',
+        help="Serve each device from a simulated camera instead of a volume"
+    )
+    parser.add_argument(
+        '--latency', type=float, default=3.0,
+        help="Milliseconds each request to a simulated camera takes (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--bandwidth', type=float, default=30.0,
+        help="MB/s transferred by a simulated camera, 0 for unlimited (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--root', default=default_root(),
+        help="Directory in which to create the benchmark directory (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--keep', action='store_true', help="Do not remove the benchmark directory"
+    )
+    parser.add_argument(
+        '--timeout', type=int, default=3600,
+        help="Seconds to wait for the benchmark to complete (default: %(default)s)"
+    )
+    parser.add_argument('--json', help="Save the results to this file")
+    parser.add_argument('--baseline', help="Results of a previous run to compare against")
+    parser.add_argument(
+        '--tolerance', type=float, default=0.15,
+        help="Fraction by which the throughput of a stage may fall below the baseline "
+             "before it is reported as a regression (default: %(default)s)"
+    )
+    parser.add_argument('--verbose', action='store_true', help="Show worker log messages")
+    add_device_arguments(parser)
+    return parser
+
+
+def main() -> int:
+    args = parser_options().parse_args()
+
+    if benchmark_dir_env not in os.environ:
+        work_dir = tempfile.mkdtemp(prefix='rpd-benchmark-', dir=args.root)
+        restart_in_benchmark_dir(work_dir)
+    work_dir = os.environ[benchmark_dir_env]
+
+    # The log messages of the worker processes are handled by the root logger
+    handler = logging.StreamHandler()
+    handler.setLevel(logging.DEBUG if args.verbose else logging.WARNING)
+    handler.setFormatter(logging.Formatter('%(levelname)s: %(message)s'))
+    logging.getLogger().addHandler(handler)
+    logging.getLogger().setLevel(logging.DEBUG)
+
+    try:
+        print('Benchmark directory: {}'.format(work_dir))
+        cards = []  # type: List[DeviceSummary]
+        start = time.perf_counter()
+        for card_no in range(1, args.devices + 1):
+            cards.append(
+                create_device(
+                    os.path.join(work_dir, 'card{}'.format(card_no)), args.files,
+                    mix=args.mix, card_no=card_no, seed=args.seed, size_scale=args.size_scale,
+                    files_per_folder=args.files_per_folder
+                )
+            )
+        print('Created {} devices in {:.1f}s'.format(args.devices, time.perf_counter() - start))
+        if args.camera:
+            camera_ports = [
+                simulated_camera_port(card.path, args.latency, args.bandwidth) for card in cards
+            ]
+        else:
+            camera_ports = None
+
+        prefs = Preferences()
+        prefs.photo_download_folder = os.path.join(work_dir, 'Pictures')
+        prefs.video_download_folder = os.path.join(work_dir, 'Videos')
+        prefs.verify_file = args.verify
+        prefs.sync()
+        backup_paths = [
+            os.path.join(work_dir, 'backup{}'.format(i)) for i in range(1, args.backups + 1)
+        ]
+        for path in [prefs.photo_download_folder, prefs.video_download_folder] + backup_paths:
+            os.makedirs(path, exist_ok=True)
+
+        app = QGuiApplication(sys.argv)
+        benchmark = IngestBenchmark(
+            app=app, cards=cards, backup_paths=backup_paths, prefs=prefs,
+            generate_thumbnails=not args.no_thumbnails, no_extractors=args.extractors,
+            timeout=args.timeout, camera_ports=camera_ports
+        )
+        QTimer.singleShot(0, benchmark.start)
+        app.exec_()
+
+        report = benchmark.report(cards)
+        if args.camera:
+            report['camera'] = dict(latency_ms=args.latency, bandwidth_mbs=args.bandwidth)
+        print_report(report)
+
+        if args.json:
+            with open(args.json, 'w') as f:
+                json.dump(report, f, indent=2)
+
+        if not report['completed']:
+            return 2
+
+        if args.baseline:
+            with open(args.baseline) as f:
+                baseline = json.load(f)
+            regressions = find_regressions(report, baseline, args.tolerance)
+            if regressions:
+                print('\nRegressions:\n    {}'.format('\n    '.join(regressions)))
+                return 1
+            print('\nNo regressions against {}'.format(args.baseline))
+        return 0
+    finally:
+        if not args.keep:
+            shutil.rmtree(work_dir, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
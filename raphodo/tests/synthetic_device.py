@@ -0,0 +1,505 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+Generate synthetic memory cards for benchmarking and testing.
+
+A card has a camera style DCIM layout, e.g. DCIM/100SYNTH/IMG_0001.JPG, and
+contains a reproducible mix of JPEG, RAW (DNG), HEIF and MP4 files, with THM
+files alongside videos and XMP sidecars alongside some photos.
+
+JPEG, DNG and THM files are valid images with Exif metadata. MP4 files have a
+movie header with the creation date. HEIF files have only a file type box, so
+their metadata cannot be read. Each file is padded to a configurable size.
+
+Usage: python3 -m raphodo.tests.synthetic_device PATH [number of files]
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2020, Damon Lynch"
+
+import argparse
+from bisect import bisect
+from collections import Counter, namedtuple, OrderedDict
+from datetime import datetime, timedelta
+from itertools import accumulate
+import os
+import random
+import struct
+import tempfile
+from typing import Any, Dict, List, Optional, Sequence, Tuple
+
+from PyQt5.QtCore import QBuffer, QByteArray, QIODevice
+from PyQt5.QtGui import QColor, QImage
+
+
+# Kind of file: (file name prefix, extension, default size in bytes)
+FileKind = namedtuple('FileKind', 'prefix, extension, size')
+
+file_kinds = OrderedDict(
+    jpeg=FileKind('IMG_', 'JPG', 128 * 1024),
+    raw=FileKind('IMG_', 'DNG', 512 * 1024),
+    heif=FileKind('IMG_', 'HEIC', 96 * 1024),
+    mp4=FileKind('MVI_', 'MP4', 1024 * 1024),
+)
+
+default_mix = 'jpeg=60,raw=25,heif=5,mp4=10'
+
+DeviceSummary = namedtuple('DeviceSummary', 'path, files, associates, size')
+
+# Seconds between 1904-01-01, the epoch used in MP4 files, and 1970-01-01
+mp4_epoch_offset = 2082844800
+
+# Tiff field types
+BYTE = 1
+ASCII = 2
+SHORT = 3
+LONG = 4
+RATIONAL = 5
+
+
+def parse_mix(mix: str) -> Dict[str, int]:
+    """
+    Parse the relative proportions of the kinds of file to generate
+
+    :param mix: comma separated kind=weight pairs
+    :return: weight of each kind
+
+    >>> parse_mix('jpeg=3, mp4=1')
+    {'jpeg': 3, 'mp4': 1}
+    >>> parse_mix('gif=1')
+    Traceback (most recent call last):
+    ...
+    ValueError: Unknown kind of file: gif
+    """
+
+    weights = {}  # type: Dict[str, int]
+    for part in mix.split(','):
+        kind, weight = part.strip().split('=')
+        if kind not in file_kinds:
+            raise ValueError('Unknown kind of file: {}'.format(kind))
+        weights[kind] = int(weight)
+    return weights
+
+
+def default_root() -> str:
+    """
+    :return: a tmpfs backed directory if one is writable, so that the device
+     under test is memory rather than the disk, else the temporary directory
+    """
+
+    if os.path.isdir('/dev/shm') and os.access('/dev/shm', os.W_OK):
+        return '/dev/shm'
+    return tempfile.gettempdir()
+
+
+def _field_data(field_type: int, value: Any) -> bytes:
+    if field_type == ASCII:
+        return value.encode() + b'\0'
+    if field_type == BYTE:
+        return bytes(value)
+    if field_type == RATIONAL:
+        return struct.pack('<II', *value)
+    fmt = '<H' if field_type == SHORT else '<I'
+    return b''.join(struct.pack(fmt, v) for v in value)
+
+
+def _field_count(field_type: int, data: bytes) -> int:
+    return len(data) // {BYTE: 1, ASCII: 1, SHORT: 2, LONG: 4, RATIONAL: 8}[field_type]
+
+
+def _ifd_size(fields: Sequence[Tuple[int, int, Any]]) -> int:
+    """
+    :return: size of an IFD including the values that do not fit in its entries
+    """
+
+    size = 2 + 12 * len(fields) + 4
+    for field_type, value in ((f[1], f[2]) for f in fields):
+        length = len(_field_data(field_type, value))
+        if length > 4:
+            size += length + length % 2
+    return size
+
+
+def _pack_ifd(fields: Sequence[Tuple[int, int, Any]], offset: int, next_ifd: int=0) -> bytes:
+    """
+    :param fields: tag, field type and value of each entry
+    :param offset: offset of the IFD from the start of the Tiff header
+    :param next_ifd: offset of the next IFD, or 0 if there is none
+    :return: the IFD followed by the values that do not fit in its entries
+    """
+
+    entries = [struct.pack('<H', len(fields))]
+    values = []  # type: List[bytes]
+    value_offset = offset + 2 + 12 * len(fields) + 4
+    for tag, field_type, value in sorted(fields, key=lambda f: f[0]):
+        data = _field_data(field_type, value)
+        count = _field_count(field_type, data)
+        if len(data) <= 4:
+            entries.append(struct.pack('<HHI', tag, field_type, count) + data.ljust(4, b'\0'))
+        else:
+            entries.append(struct.pack('<HHII', tag, field_type, count, value_offset))
+            if len(data) % 2:
+                data += b'\0'
+            values.append(data)
+            value_offset += len(data)
+    entries.append(struct.pack('<I', next_ifd))
+    return b''.join(entries + values)
+
+
+def make_tiff(make: str, model: str, when: datetime,
+              ifd0: Optional[List[Tuple[int, int, Any]]]=None,
+              preview: Optional[bytes]=None) -> bytes:
+    """
+    Create a little endian Tiff structure with an Exif IFD
+
+    :param make: camera make
+    :param model: camera model
+    :param when: date time the photo was taken
+    :param ifd0: additional fields for the first IFD
+    :param preview: JPEG preview image, referred to by the first IFD
+    :return: the Tiff structure, followed by the preview if there is one
+
+    >>> tiff = make_tiff('Synthetic', 'Card 1', datetime(2020, 6, 1, 9, 0, 0))
+    >>> tiff[:4]
+    b'II*\\x00'
+    >>> b'2020:06:01 09:00:00' in tiff
+    True
+    """
+
+    date_time = when.strftime('%Y:%m:%d %H:%M:%S')
+    sub_seconds = '{:02d}'.format(when.microsecond // 10000)
+    fields = [
+        (0x010f, ASCII, make),
+        (0x0110, ASCII, model),
+        (0x0132, ASCII, date_time),
+        (0x8769, LONG, (0,)),
+    ] + (ifd0 or [])
+    if preview is not None:
+        fields.extend([(0x0111, LONG, (0,)), (0x0117, LONG, (len(preview),))])
+    exif_fields = [
+        (0x829a, RATIONAL, (1, 125)),
+        (0x829d, RATIONAL, (28, 10)),
+        (0x8827, SHORT, (200,)),
+        (0x9003, ASCII, date_time),
+        (0x9004, ASCII, date_time),
+        (0x9291, ASCII, sub_seconds),
+        (0x920a, RATIONAL, (50, 1)),
+    ]
+
+    ifd0_offset = 8
+    exif_offset = ifd0_offset + _ifd_size(fields)
+    preview_offset = exif_offset + _ifd_size(exif_fields)
+
+    # Fill in the offsets now they are known
+    def set_offset(tag: int, value: int) -> None:
+        for i, field in enumerate(fields):
+            if field[0] == tag:
+                fields[i] = (tag, LONG, (value,))
+
+    set_offset(0x8769, exif_offset)
+    set_offset(0x0111, preview_offset)
+
+    return b''.join(
+        (
+            b'II*\0', struct.pack('<I', ifd0_offset),
+            _pack_ifd(fields, ifd0_offset),
+            _pack_ifd(exif_fields, exif_offset),
+            preview or b'',
+        )
+    )
+
+
+def make_jpeg(width: int, height: int, color: QColor,
+              exif: Optional[bytes]=None, quality: int=85) -> bytes:
+    """
+    :param width: image width
+    :param height: image height
+    :param color: color to fill the image with
+    :param exif: Tiff structure to insert in an APP1 segment
+    :param quality: JPEG quality
+    :return: the JPEG image
+    """
+
+    image = QImage(width, height, QImage.Format_RGB32)
+    image.fill(color)
+    buffer = QByteArray()
+    device = QBuffer(buffer)
+    device.open(QIODevice.WriteOnly)
+    image.save(device, 'JPEG', quality)
+    jpeg = bytes(buffer)
+    if exif is None:
+        return jpeg
+
+    # Replace any JFIF APP0 segment with the Exif APP1 segment
+    body = jpeg[2:]
+    if body[:2] == b'\xff\xe0':
+        body = body[2 + struct.unpack('>H', body[2:4])[0]:]
+    app1 = b'Exif\0\0' + exif
+    return b'\xff\xd8\xff\xe1' + struct.pack('>H', len(app1) + 2) + app1 + body
+
+
+def make_mp4(when: datetime, duration_ms: int) -> bytes:
+    """
+    :return: the file type box and a movie box holding only a movie header
+
+    >>> mp4 = make_mp4(datetime(2020, 6, 1, 9, 0, 0), 5000)
+    >>> mp4[4:12], len(mp4)
+    (b'ftypisom', 140)
+    """
+
+    ftyp = b'isom' + struct.pack('>I', 0x200) + b'isommp42'
+    ftyp = struct.pack('>I', len(ftyp) + 8) + b'ftyp' + ftyp
+    created = int(when.timestamp()) + mp4_epoch_offset
+    mvhd = struct.pack('>IIIII', 0, created, created, 1000, duration_ms)
+    # Rate, volume, reserved, identity matrix, pre-defined, next track id
+    mvhd += struct.pack('>IH10x', 0x00010000, 0x0100)
+    mvhd += struct.pack('>9I', 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000)
+    mvhd += bytes(24) + struct.pack('>I', 2)
+    mvhd = struct.pack('>I', len(mvhd) + 8) + b'mvhd' + mvhd
+    moov = struct.pack('>I', len(mvhd) + 8) + b'moov' + mvhd
+    return ftyp + moov
+
+
+def make_heif() -> bytes:
+    """
+    :return: a file type box only
+    """
+
+    ftyp = b'heic' + struct.pack('>I', 0) + b'mif1heic'
+    return struct.pack('>I', len(ftyp) + 8) + b'ftyp' + ftyp
+
+
+def make_xmp(when: datetime, label: str) -> bytes:
+    return (
+        '<?xpacket begin="﻿" id="W5M0MpCehiHzreSzNTczkc9d"?>\n'
+        '<x:xmpmeta xmlns:x="adobe:ns:meta/">\n'
+        ' <rdf:RDF xmlns:rdf="http://www.w3.org/1999/02/22-rdf-syntax-ns#">\n'
+        '  <rdf:Description rdf:about=""\n'
+        '    xmlns:xmp="http://ns.adobe.com/xap/1.0/"\n'
+        '    xmp:CreateDate="{}"\n'
+        '    xmp:Label="{}"/>\n'
+        ' </rdf:RDF>\n'
+        '</x:xmpmeta>\n'
+        '<?xpacket end="w"?>\n'.format(when.strftime('%Y-%m-%dT%H:%M:%S'), label)
+    ).encode()
+
+
+class SyntheticCard:
+    """
+    Writes the files of one synthetic memory card
+    """
+
+    def __init__(self, path: str,
+                 card_no: int=1,
+                 seed: int=0,
+                 size_scale: float=1.0,
+                 start: Optional[datetime]=None) -> None:
+        """
+        :param path: root of the card, which is created if it does not exist
+        :param card_no: used to make the camera model unique to each card
+        :param seed: seed for the random choices, so the card can be recreated
+        :param size_scale: multiplier of the default size of each kind of file
+        :param start: date time of the first file
+        """
+
+        self.path = path
+        self.rng = random.Random('{}-{}'.format(seed, card_no))
+        self.make = 'Synthetic'
+        self.model = 'Card {}'.format(card_no)
+        self.size_scale = size_scale
+        self.when = start or datetime(2020, 6, 1, 9, 0, 0)
+        # Padding is a block of random bytes stamped with the file number, so
+        # that every file is unique without generating all its content
+        self.padding = bytes(self.rng.getrandbits(8) for _ in range(64 * 1024))
+
+    def next_time(self) -> datetime:
+        """
+        Photos are mostly taken seconds apart, with occasional long breaks,
+        so the timeline has distinct groups
+        """
+
+        if self.rng.random() < 0.02:
+            gap = self.rng.uniform(3600, 3 * 3600)
+        else:
+            gap = self.rng.expovariate(1 / 8)
+        self.when += timedelta(seconds=gap)
+        return self.when
+
+    def color(self) -> QColor:
+        return QColor(self.rng.randrange(256), self.rng.randrange(256), self.rng.randrange(256))
+
+    def padded(self, content: bytes, size: int, file_no: int) -> bytes:
+        """
+        Pad the file to the requested size, after the end of the image data
+        """
+
+        missing = size - len(content)
+        if missing <= 0:
+            return content
+        stamp = struct.pack('<I', file_no)
+        blocks, remainder = divmod(missing, len(self.padding))
+        block = stamp + self.padding[len(stamp):]
+        return content + block * blocks + block[:remainder]
+
+    def write(self, full_file_name: str, content: bytes, when: datetime) -> None:
+        with open(full_file_name, 'wb') as f:
+            f.write(content)
+        timestamp = when.timestamp()
+        os.utime(full_file_name, (timestamp, timestamp))
+
+    def file_content(self, kind: str, when: datetime, file_no: int) -> bytes:
+        size = int(file_kinds[kind].size * self.size_scale)
+        if kind == 'jpeg':
+            exif = make_tiff(self.make, self.model, when)
+            content = make_jpeg(640, 480, self.color(), exif)
+        elif kind == 'raw':
+            preview = make_jpeg(320, 240, self.color())
+            ifd0 = [
+                (0x00fe, LONG, (1,)),
+                (0x0100, SHORT, (320,)),
+                (0x0101, SHORT, (240,)),
+                (0x0102, SHORT, (8, 8, 8)),
+                (0x0103, SHORT, (7,)),
+                (0x0106, SHORT, (6,)),
+                (0x0115, SHORT, (3,)),
+                (0x0116, SHORT, (240,)),
+                (0xc612, BYTE, (1, 4, 0, 0)),
+                (0xc614, ASCII, '{} {}'.format(self.make, self.model)),
+            ]
+            content = make_tiff(self.make, self.model, when, ifd0, preview)
+        elif kind == 'heif':
+            content = make_heif()
+        else:
+            content = make_mp4(when, self.rng.randrange(2000, 60000))
+        return self.padded(content, size, file_no)
+
+    def create(self, no_files: int,
+               weights: Dict[str, int],
+               files_per_folder: int=500,
+               xmp_fraction: float=0.1) -> DeviceSummary:
+        """
+        :param no_files: how many photos and videos to create
+        :param weights: relative proportion of each kind of file
+        :param files_per_folder: how many photos and videos in each DCIM folder
+        :param xmp_fraction: proportion of photos with an XMP sidecar
+        :return: summary of what was created
+        """
+
+        kinds = list(weights)
+        cumulative = list(accumulate(weights[kind] for kind in kinds))
+        files = Counter()  # type: Counter
+        associates = Counter()  # type: Counter
+        size = 0
+        folder = None  # type: Optional[str]
+        for file_no in range(no_files):
+            if file_no % files_per_folder == 0:
+                folder = os.path.join(
+                    self.path, 'DCIM', '{:03d}SYNTH'.format(100 + file_no // files_per_folder)
+                )
+                os.makedirs(folder, exist_ok=True)
+            kind = kinds[bisect(cumulative, self.rng.randrange(cumulative[-1]))]
+            when = self.next_time()
+            # Camera file numbers run from 0001 to 9999
+            base_name = '{}{:04d}'.format(file_kinds[kind].prefix, file_no % 9999 + 1)
+            content = self.file_content(kind, when, file_no)
+            self.write(
+                os.path.join(folder, '{}.{}'.format(base_name, file_kinds[kind].extension)),
+                content, when
+            )
+            files[kind] += 1
+            size += len(content)
+
+            if kind == 'mp4':
+                thm = make_jpeg(160, 120, self.color(), make_tiff(self.make, self.model, when))
+                self.write(os.path.join(folder, '{}.THM'.format(base_name)), thm, when)
+                associates['thm'] += 1
+            elif self.rng.random() < xmp_fraction:
+                xmp = make_xmp(when, 'Synthetic')
+                self.write(os.path.join(folder, '{}.XMP'.format(base_name)), xmp, when)
+                associates['xmp'] += 1
+
+        return DeviceSummary(self.path, files, associates, size)
+
+
+def create_device(path: str, no_files: int,
+                  mix: str=default_mix,
+                  card_no: int=1,
+                  seed: int=0,
+                  size_scale: float=1.0,
+                  files_per_folder: int=500,
+                  xmp_fraction: float=0.1) -> DeviceSummary:
+    """
+    Create a synthetic memory card.
+
+    See SyntheticCard and SyntheticCard.create() for the meaning of the
+    parameters.
+    """
+
+    card = SyntheticCard(path=path, card_no=card_no, seed=seed, size_scale=size_scale)
+    return card.create(
+        no_files=no_files, weights=parse_mix(mix), files_per_folder=files_per_folder,
+        xmp_fraction=xmp_fraction
+    )
+
+
+def add_device_arguments(parser: argparse.ArgumentParser) -> None:
+    """
+    Add the arguments that control how synthetic cards are created
+    """
+
+    parser.add_argument(
+        '--mix', default=default_mix,
+        help="Relative proportion of each kind of file (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--size-scale', type=float, default=1.0,
+        help="Multiply the default size of each kind of file by this value: {}".format(
+            ', '.join(
+                '{} {}KiB'.format(kind, file_kind.size // 1024)
+                for kind, file_kind in file_kinds.items()
+            )
+        )
+    )
+    parser.add_argument(
+        '--files-per-folder', type=int, default=500,
+        help="Photos and videos in each DCIM folder (default: %(default)s)"
+    )
+    parser.add_argument(
+        '--seed', type=int, default=0, help="Seed for random choices (default: %(default)s)"
+    )
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Create a synthetic memory card')
+    parser.add_argument('path', help="Directory in which to create the card")
+    parser.add_argument('files', type=int, nargs='?', default=1000, help="Number of files")
+    add_device_arguments(parser)
+    args = parser.parse_args()
+
+    summary = create_device(
+        args.path, args.files, mix=args.mix, seed=args.seed, size_scale=args.size_scale,
+        files_per_folder=args.files_per_folder
+    )
+    print(
+        'Created {} in {}: {}; associated files: {}'.format(
+            summary.size, summary.path, dict(summary.files), dict(summary.associates)
+        )
+    )
@@ -0,0 +1,154 @@
+#!/usr/bin/python3
+__author__ = 'Damon Lynch'
+
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+import multiprocessing
+import os
+import shutil
+import tempfile
+import unittest
+from typing import List, Tuple
+
+from raphodo.cache import ThumbnailPacks
+
+
+def thumbnail(n: int, size: int=100) -> bytes:
+    """
+    :return: data beginning with the JPEG start of image marker, unique to n
+    """
+
+    body = '{:08d}'.format(n).encode()
+    return b'\xff\xd8' + (body * (size // len(body) + 1))[:size - 2]
+
+
+class SmallPacks(ThumbnailPacks):
+    max_pack_size = 1000
+
+
+def append_thumbnails(cache_dir: str, first: int, count: int) -> List[Tuple[int, int, int]]:
+    packs = SmallPacks(cache_dir)
+    locations = []
+    for n in range(first, first + count):
+        pack, offset = packs.append(thumbnail(n))
+        locations.append((n, pack, offset))
+    packs.close()
+    return locations
+
+
+class ThumbnailPacksTest(unittest.TestCase):
+    def setUp(self):
+        self.cache_dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.cache_dir)
+
+    def test_round_trip(self):
+        packs = ThumbnailPacks(self.cache_dir)
+        locations = [(n, packs.append(thumbnail(n, 100 + n))) for n in range(10)]
+        for n, (pack, offset) in locations:
+            self.assertEqual(packs.read(pack, offset, 100 + n), thumbnail(n, 100 + n))
+        self.assertEqual(packs.packs(), [1])
+        self.assertTrue(packs.is_pack_name(os.path.basename(packs.pack_name(1))))
+        packs.close()
+
+    def test_read_invalid(self):
+        packs = ThumbnailPacks(self.cache_dir)
+        pack, offset = packs.append(thumbnail(1))
+        # Beyond the end of the pack file
+        self.assertIsNone(packs.read(pack, offset, 200))
+        # Not the start of a thumbnail
+        self.assertIsNone(packs.read(pack, offset + 1, 50))
+        # No such pack file
+        self.assertIsNone(packs.read(pack + 1, 0, 100))
+        packs.close()
+
+    def test_roll_over(self):
+        packs = SmallPacks(self.cache_dir)
+        locations = [(n, packs.append(thumbnail(n))) for n in range(25)]
+        self.assertEqual(packs.packs(), [1, 2, 3])
+        # A pack file is rolled over once it reaches its maximum size
+        self.assertEqual([location for n, location in locations[:10]],
+                         [(1, offset) for offset in range(0, 1000, 100)])
+        self.assertEqual(locations[10][1], (2, 0))
+        self.assertEqual(locations[24][1], (3, 400))
+        for n, (pack, offset) in locations:
+            self.assertEqual(packs.read(pack, offset, 100), thumbnail(n))
+        packs.close()
+
+    def test_reader_sees_appends_of_other_instance(self):
+        writer = ThumbnailPacks(self.cache_dir)
+        reader = ThumbnailPacks(self.cache_dir)
+        pack, offset = writer.append(thumbnail(1))
+        self.assertEqual(reader.read(pack, offset, 100), thumbnail(1))
+        # The reader's memory map is remapped to include what was appended since
+        pack, offset = writer.append(thumbnail(2))
+        self.assertEqual(reader.read(pack, offset, 100), thumbnail(2))
+        self.assertEqual(reader.read(pack, 0, 100), thumbnail(1))
+        writer.close()
+        reader.close()
+
+    def test_append_after_remove(self):
+        packs = ThumbnailPacks(self.cache_dir)
+        packs.append(thumbnail(1))
+        packs.remove(1)
+        self.assertEqual(packs.packs(), [])
+        pack, offset = packs.append(thumbnail(2))
+        self.assertEqual((pack, offset), (1, 0))
+        self.assertEqual(packs.read(pack, offset, 100), thumbnail(2))
+        packs.close()
+
+    def test_append_after_remove_by_other_instance(self):
+        writer = SmallPacks(self.cache_dir)
+        for n in range(15):
+            writer.append(thumbnail(n))
+        self.assertEqual(writer.packs(), [1, 2])
+        # Another process, e.g. one optimizing the cache, removes the pack file
+        # being appended to
+        other = SmallPacks(self.cache_dir)
+        other.remove(2)
+        pack, offset = writer.append(thumbnail(100))
+        self.assertEqual((pack, offset), (2, 0))
+        self.assertEqual(writer.packs(), [1, 2])
+        self.assertEqual(other.read(pack, offset, 100), thumbnail(100))
+        writer.close()
+        other.close()
+
+    def test_concurrent_appends(self):
+        processes = 4
+        count = 50
+        with multiprocessing.Pool(processes) as pool:
+            results = pool.starmap(
+                append_thumbnails,
+                [(self.cache_dir, i * count, count) for i in range(processes)]
+            )
+        locations = [location for result in results for location in result]
+        self.assertEqual(len({(pack, offset) for n, pack, offset in locations}),
+                         processes * count)
+        packs = SmallPacks(self.cache_dir)
+        for n, pack, offset in locations:
+            self.assertEqual(packs.read(pack, offset, 100), thumbnail(n))
+        sizes = [packs.size(pack) for pack in packs.packs()]
+        self.assertEqual(sum(sizes), processes * count * 100)
+        self.assertTrue(all(size <= SmallPacks.max_pack_size for size in sizes))
+        packs.close()
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,144 @@
+#!/usr/bin/python3
+__author__ = 'Damon Lynch'
+
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+import datetime
+import pickle
+import unittest
+from types import SimpleNamespace
+from typing import List
+
+from raphodo.constants import FileType
+from raphodo.folderspreview import (
+    FoldersPreview, PreviewFile, SubfolderGenerationData, SubfolderPreviewKeys
+)
+from raphodo.generatenameconfig import (
+    DATE_TIME, IMAGE_DATE, FILENAME, EXTENSION, UPPERCASE, JOB_CODE, DEFAULT_SUBFOLDER_PREFS,
+    LIST_DATE_TIME_L2, NAME, ORIGINAL_CASE
+)
+
+
+def make_file(name: str, ctime: datetime.datetime) -> SimpleNamespace:
+    """
+    :return: a scanned file, with every attribute of PreviewFile and more
+    """
+
+    return SimpleNamespace(
+        ctime=ctime.timestamp(), modification_time=ctime.timestamp() + 30, name=name,
+        full_file_name='/media/card/DCIM/{}'.format(name), download_start_time=None,
+        strip_characters=True, job_code=None, name_generation_problem=False,
+        scan_id=0, file_type=FileType.photo
+    )
+
+
+class SubfolderPreviewKeysTest(unittest.TestCase):
+    """
+    The subfolder generated from a key must be the subfolder generated from each
+    file sharing the key
+    """
+
+    files = [
+        make_file('IMG_0001.JPG', datetime.datetime(2020, 3, 15, 0, 5)),
+        make_file('IMG_0002.CR2', datetime.datetime(2020, 3, 15, 23, 55)),
+        make_file('IMG_0003.JPG', datetime.datetime(2020, 3, 16, 9, 41, 7)),
+    ]
+
+    def check_subfolders(self, pref_list: List[str], expected: List[str]) -> None:
+        preview_keys = SubfolderPreviewKeys(pref_list=pref_list, file_type=FileType.photo)
+        subfolders = [
+            preview_keys.generate(key=preview_keys.key(rpd_file), strip_characters=True)
+            for rpd_file in self.files
+        ]
+        self.assertEqual(subfolders, expected)
+        self.assertEqual(
+            subfolders, [preview_keys.generator.generate_name(rpd_file) for rpd_file in self.files]
+        )
+
+    def test_date(self):
+        self.check_subfolders(
+            DEFAULT_SUBFOLDER_PREFS, ['2020/20200315', '2020/20200315', '2020/20200316']
+        )
+
+    def test_time(self):
+        self.check_subfolders(
+            [DATE_TIME, IMAGE_DATE, LIST_DATE_TIME_L2[19]], ['000500', '235500', '094107']
+        )
+
+    def test_extension(self):
+        self.check_subfolders([FILENAME, EXTENSION, UPPERCASE], ['JPG', 'CR2', 'JPG'])
+
+    def test_name(self):
+        self.check_subfolders(
+            [FILENAME, NAME, ORIGINAL_CASE], ['IMG_0001', 'IMG_0002', 'IMG_0003']
+        )
+
+    def test_job_code(self):
+        # Job codes are not known until files are downloaded
+        self.check_subfolders([JOB_CODE, '', ''], ['', '', ''])
+
+    def test_preview_file_attributes(self):
+        preview_file = PreviewFile(
+            ctime=None, modification_time=None, name='file.jpg', download_start_time=None,
+            strip_characters=False
+        )
+        self.assertEqual(
+            {attribute: getattr(preview_file, attribute) for attribute in PreviewFile.__slots__},
+            dict(
+                ctime=None, modification_time=None, name='file.jpg', full_file_name='file.jpg',
+                download_start_time=None, strip_characters=False, job_code=None,
+                name_generation_problem=False
+            )
+        )
+
+
+class SubfolderGenerationDataTest(unittest.TestCase):
+    def test_folders_preview(self):
+        folders_preview = FoldersPreview()
+        folders_preview.photo_download_folder = '/home/user/Pictures'
+        folders_preview.photo_download_folder_valid = True
+        folders_preview.photo_subfolder = DEFAULT_SUBFOLDER_PREFS
+        folders_preview.generated_photo_subfolders.add('2020/20200315')
+        folders_preview.created_photo_subfolders[0].add('/home/user/Pictures/2020')
+        files = SubfolderPreviewKeysTest.files
+        subfolder_keys = folders_preview.subfolder_keys(files)
+        self.assertEqual(len(folders_preview.generated_keys), 2)
+
+        data = SubfolderGenerationData(
+            folders_preview=folders_preview, subfolder_keys=subfolder_keys,
+            strip_characters=True
+        )
+        data = pickle.loads(pickle.dumps(data, pickle.HIGHEST_PROTOCOL))
+        offload_preview = data.folders_preview()
+        self.assertEqual(data.subfolder_keys, subfolder_keys)
+        for attribute in (
+                'photo_download_folder', 'video_download_folder', 'photo_download_folder_valid',
+                'video_download_folder_valid', 'photo_subfolder', 'video_subfolder',
+                'generated_photo_subfolders', 'generated_video_subfolders',
+                'created_photo_subfolders', 'created_video_subfolders'):
+            self.assertEqual(
+                getattr(offload_preview, attribute), getattr(folders_preview, attribute),
+                attribute
+            )
+        # Used only in the main process
+        self.assertEqual(offload_preview.generated_keys, set())
+
+
+if __name__ == '__main__':
+    unittest.main()
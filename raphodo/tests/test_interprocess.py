@@ -0,0 +1,284 @@
+#!/usr/bin/python3
+__author__ = 'Damon Lynch'
+
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+import unittest
+from collections import deque, namedtuple
+from unittest import mock
+
+from PyQt5.QtCore import QObject
+
+from raphodo.interprocess import LRUQueue, PublishPullPipelineManager, warm_worker_max_failures
+
+VirtualMemory = namedtuple('VirtualMemory', 'total available')
+
+GiB = 1024 ** 3
+
+
+class FakeProcessManager:
+    def __init__(self, no_workers: int, running: int) -> None:
+        self.no_workers = no_workers
+        self.workers = list(range(running))
+        self.added = 0
+
+    def add_tuned_worker(self) -> None:
+        self.workers.append(len(self.workers))
+        self.added += 1
+
+    def reap_retired_workers(self) -> None:
+        pass
+
+    def rss(self):
+        return [100 * 1024 ** 2 for worker in self.workers]
+
+
+class FakeMonitor:
+    def __init__(self, busy: float, waiting: float, active: float) -> None:
+        self.measurements = busy, waiting, active
+
+    def sample(self, workers: int):
+        return self.measurements
+
+    def blocked(self) -> None:
+        pass
+
+
+class FakeStream:
+    def __init__(self) -> None:
+        self.sent = []
+        self.receiving = True
+
+    def send_multipart(self, msg) -> None:
+        self.sent.append(msg)
+
+    def stop_on_recv(self) -> None:
+        self.receiving = False
+
+
+class FakeLoop:
+    def __init__(self) -> None:
+        self.timeouts = []
+
+    def add_timeout(self, deadline, callback) -> None:
+        self.timeouts.append(callback)
+
+
+class TuneWorkersTest(unittest.TestCase):
+    def make_queue(self, running: int, idle: int, busy: float, waiting: float,
+                   active: float) -> LRUQueue:
+        queue = LRUQueue.__new__(LRUQueue)
+        queue.worker_type = 'Test'
+        queue.process_manager = FakeProcessManager(no_workers=8, running=running)
+        queue.workers = deque(str(i).encode() for i in range(idle))
+        queue.terminating = False
+        queue.retiring_workers = set()
+        queue.max_workers = 8
+        queue.min_workers = 2
+        queue.monitor = FakeMonitor(busy, waiting, active)
+        queue.backend = FakeStream()
+        queue.frontend = FakeStream()
+        queue.loop = FakeLoop()
+        return queue
+
+    def tune(self, queue: LRUQueue, cpu_percent: float=20.0,
+             available: int=8 * GiB) -> None:
+        with mock.patch('raphodo.interprocess.psutil.cpu_percent', return_value=cpu_percent), \
+                mock.patch(
+                    'raphodo.interprocess.psutil.virtual_memory',
+                    return_value=VirtualMemory(total=16 * GiB, available=available)
+                ):
+            queue.tune_workers()
+
+    def assertUnchanged(self, queue: LRUQueue) -> None:
+        self.assertEqual(queue.process_manager.added, 0)
+        self.assertEqual(queue.backend.sent, [])
+        self.assertEqual(queue.retiring_workers, set())
+
+    def test_no_work_keeps_workers(self):
+        queue = self.make_queue(running=8, idle=8, busy=0.0, waiting=0.0, active=0.0)
+        self.tune(queue)
+        self.assertUnchanged(queue)
+        self.assertEqual(queue.loop.timeouts, [queue.tune_workers])
+
+    def test_end_of_work_keeps_workers(self):
+        queue = self.make_queue(running=8, idle=8, busy=0.1, waiting=0.0, active=0.4)
+        self.tune(queue)
+        self.assertUnchanged(queue)
+
+    def test_waiting_work_adds_worker(self):
+        queue = self.make_queue(running=4, idle=0, busy=0.95, waiting=0.8, active=1.0)
+        self.tune(queue)
+        self.assertEqual(queue.process_manager.added, 1)
+        self.assertEqual(queue.backend.sent, [])
+
+    def test_busy_cpus_do_not_add_worker(self):
+        queue = self.make_queue(running=4, idle=0, busy=0.95, waiting=0.8, active=1.0)
+        self.tune(queue, cpu_percent=95.0)
+        self.assertUnchanged(queue)
+
+    def test_maximum_workers_not_exceeded(self):
+        queue = self.make_queue(running=8, idle=0, busy=1.0, waiting=1.0, active=1.0)
+        self.tune(queue)
+        self.assertUnchanged(queue)
+
+    def test_idle_workers_with_work_retires_worker(self):
+        queue = self.make_queue(running=6, idle=4, busy=0.3, waiting=0.0, active=1.0)
+        self.tune(queue)
+        self.assertEqual(queue.backend.sent, [[b'0', b'', b'cmd', b'STOP']])
+        self.assertEqual(queue.retiring_workers, {b'0'})
+        self.assertEqual(list(queue.workers), [b'1', b'2', b'3'])
+        self.assertTrue(queue.frontend.receiving)
+        # The worker being retired is no longer counted
+        self.tune(queue)
+        self.assertEqual(len(queue.retiring_workers), 2)
+
+    def test_minimum_workers_kept(self):
+        queue = self.make_queue(running=2, idle=2, busy=0.1, waiting=0.0, active=1.0)
+        self.tune(queue, available=GiB // 2)
+        self.assertUnchanged(queue)
+
+    def test_memory_pressure_retires_worker(self):
+        queue = self.make_queue(running=4, idle=1, busy=0.95, waiting=0.8, active=1.0)
+        self.tune(queue, available=GiB // 2)
+        self.assertEqual(queue.retiring_workers, {b'0'})
+        # No idle worker remains to take work
+        self.assertFalse(queue.frontend.receiving)
+
+    def test_terminating_does_not_tune(self):
+        queue = self.make_queue(running=4, idle=0, busy=0.95, waiting=0.8, active=1.0)
+        queue.terminating = True
+        self.tune(queue)
+        self.assertUnchanged(queue)
+        self.assertEqual(queue.loop.timeouts, [])
+
+
+class FakePoolSocket:
+    def __init__(self) -> None:
+        self.received = deque()
+        self.sent = []
+
+    def recv_multipart(self):
+        return self.received.popleft()
+
+    def send_multipart(self, msg) -> None:
+        self.sent.append(msg)
+
+
+class FakeWarmProcess:
+    def __init__(self, pid: int) -> None:
+        self.pid = pid
+
+
+class WarmWorkerTest(unittest.TestCase):
+    """
+    Jobs are queued until a warm worker is ready, rather than blocking the sink
+    """
+
+    def make_manager(self) -> PublishPullPipelineManager:
+        manager = PublishPullPipelineManager.__new__(PublishPullPipelineManager)
+        QObject.__init__(manager)
+        manager._process_name = 'Test'
+        manager._warm_workers = 1
+        manager.terminating = False
+        manager.paused = False
+        manager.workers = []
+        manager.processes = {}
+        manager.warm_processes = {}
+        manager.pool_socket = FakePoolSocket()
+        manager.idle_workers = deque()
+        manager.busy_workers = set()
+        manager.pending_jobs = deque()
+        manager.warm_workers_check = 0.0
+        manager.warm_worker_failures = 0
+        manager.warm_workers_failed = False
+        manager.pids = iter(range(100, 200))
+        manager.started_jobs = []
+        manager.cold_workers = []
+        manager._start_process = lambda command_line: FakeWarmProcess(next(manager.pids))
+        manager._get_command_line = lambda worker_id: ''
+        manager.start_job = lambda worker_id, data, messages: manager.started_jobs.append(
+            (worker_id, data) + tuple(messages)
+        )
+        manager.add_worker = lambda worker_id: manager.cold_workers.append(worker_id)
+        return manager
+
+    def ready(self, manager: PublishPullPipelineManager, identity: bytes) -> None:
+        manager.pool_socket.received.append([identity, b'', b'READY'])
+        manager.process_pool_message()
+
+    def test_job_waits_for_ready_worker(self):
+        manager = self.make_manager()
+        manager.add_warm_workers()
+        self.assertEqual(list(manager.warm_processes), [b'100'])
+        manager.start_worker(b'1', b'job 1')
+        manager.start_worker(b'2', b'job 2')
+        # Nothing blocks, and a worker is started for each waiting job
+        self.assertEqual(manager.started_jobs, [])
+        self.assertEqual(len(manager.warm_processes), 3)
+        self.assertIsNotNone(manager.pool_poll_timeout())
+
+        self.ready(manager, b'100')
+        self.assertEqual(manager.started_jobs, [(b'1', b'job 1')])
+        self.assertEqual(manager.pool_socket.sent, [[b'100', b'', b'1']])
+        self.assertEqual(manager.workers, [1])
+        self.ready(manager, b'101')
+        self.assertEqual(manager.started_jobs, [(b'1', b'job 1'), (b'2', b'job 2')])
+        self.assertIsNone(manager.pool_poll_timeout())
+        self.assertEqual(manager.busy_workers, {b'100', b'101'})
+
+    def test_idle_worker_assigned_immediately(self):
+        manager = self.make_manager()
+        manager.add_warm_workers()
+        self.ready(manager, b'100')
+        manager.start_worker(b'1', b'job 1')
+        self.assertEqual(manager.started_jobs, [(b'1', b'job 1')])
+        self.assertEqual(list(manager.pending_jobs), [])
+
+    def test_stopped_workers_fall_back_to_process_per_job(self):
+        manager = self.make_manager()
+        manager.start_worker(b'1', b'job 1')
+        manager.remove_stopped_warm_workers = lambda: warm_worker_max_failures
+        with self.assertLogs(level='ERROR'):
+            manager.process_pool_timeout()
+        self.assertTrue(manager.warm_workers_failed)
+        self.assertEqual(manager.cold_workers, [1])
+        self.assertEqual(manager.started_jobs, [(b'1', b'job 1')])
+        self.assertEqual(list(manager.pending_jobs), [])
+
+    def test_message_to_waiting_job(self):
+        manager = self.make_manager()
+        manager.start_worker(b'1', b'job 1')
+        manager.send_message_to_worker(data=b'more', worker_id=b'1')
+        self.ready(manager, b'100')
+        self.assertEqual(manager.started_jobs, [(b'1', b'job 1', b'more')])
+
+    def test_stop_waiting_job(self):
+        manager = self.make_manager()
+        stopped = []
+        manager.workerStopped.connect(stopped.append)
+        manager.start_worker(b'1', b'job 1')
+        manager.stop_worker(b'1')
+        self.assertEqual(stopped, [1])
+        self.ready(manager, b'100')
+        self.assertEqual(manager.started_jobs, [])
+
+
+if __name__ == '__main__':
+    unittest.main()
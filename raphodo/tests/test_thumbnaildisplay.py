@@ -0,0 +1,119 @@
+#!/usr/bin/python3
+__author__ = 'Damon Lynch'
+
+# Copyright (C) 2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+import random
+import unittest
+import uuid
+from typing import List, Sequence
+
+from PyQt5.QtCore import Qt, QAbstractListModel
+
+from raphodo.constants import FileType, Sort, Show
+from raphodo.thumbnailrows import ThumbnailRow, ThumbnailRowsIndex, UidRows
+from raphodo.thumbnaildisplay import ThumbnailListModel
+
+
+def make_rows(count: int, rng: random.Random) -> List[ThumbnailRow]:
+    rows = []
+    for i in range(count):
+        previously_downloaded = rng.random() < 0.2
+        rows.append(
+            ThumbnailRow(
+                uid=uuid.UUID(int=rng.getrandbits(128)).bytes, scan_id=0,
+                mtime=float(rng.randrange(1000)), marked=not previously_downloaded,
+                file_name='IMG_{:04}.JPG'.format(rng.randrange(10000)), extension='jpg',
+                file_type=FileType.photo, downloaded=False,
+                previously_downloaded=previously_downloaded, job_code=False,
+                proximity_col1=-1, proximity_col2=-1
+            )
+        )
+    return rows
+
+
+class InsertRowsTest(unittest.TestCase):
+    """
+    Rows inserted into the model as files are scanned must be in the order in
+    which a refresh of the whole view would put them
+    """
+
+    def make_model(self, sort_by: Sort, sort_order: Qt.SortOrder,
+                   show: Show) -> ThumbnailListModel:
+        # Only the parts of the model used to insert rows
+        model = ThumbnailListModel.__new__(ThumbnailListModel)
+        QAbstractListModel.__init__(model)
+        model.tindex = ThumbnailRowsIndex()
+        model.tindex.add_or_update_device(scan_id=0, device_name='Camera')
+        model.rows = []
+        model.uid_to_row = UidRows()
+        model.sort_by = sort_by
+        model.sort_order = sort_order
+        model.show = show
+        model.proximity_col1 = []
+        model.proximity_col2 = []
+        return model
+
+    def check_insertions(self, sort_by: Sort, sort_order: Qt.SortOrder,
+                         show: Show=Show.all,
+                         counts: Sequence[int]=(1, 5, 20, 3, 50, 1, 10)) -> None:
+        rng = random.Random(sort_by.value * 10 + int(sort_order))
+        model = self.make_model(sort_by, sort_order, show)
+        # Batches of rows sort before, between and after the rows already displayed
+        for count in counts:
+            thumbnail_rows = make_rows(count, rng)
+            model.tindex.add_thumbnail_rows(thumbnail_rows)
+            model._insertRows(thumbnail_rows)
+
+            expected = model.tindex.get_view(
+                sort_by=sort_by, sort_order=sort_order, show=show,
+                proximity_col1=[], proximity_col2=[]
+            )
+            self.assertEqual(model.rows, expected)
+            self.assertEqual(model.rowCount(), len(expected))
+            self.assertEqual(
+                dict(model.uid_to_row.items()),
+                {row[0]: idx for idx, row in enumerate(model.rows)}
+            )
+
+    def test_modification_time_ascending(self):
+        self.check_insertions(Sort.modification_time, Qt.AscendingOrder)
+
+    def test_modification_time_descending(self):
+        self.check_insertions(Sort.modification_time, Qt.DescendingOrder)
+
+    def test_filename_ascending(self):
+        self.check_insertions(Sort.filename, Qt.AscendingOrder)
+
+    def test_filename_descending(self):
+        self.check_insertions(Sort.filename, Qt.DescendingOrder)
+
+    def test_filename_new_only(self):
+        self.check_insertions(Sort.filename, Qt.AscendingOrder, Show.new_only)
+
+    def test_more_insertions_than_recorded(self):
+        # The map of uids to rows is rebuilt once it has recorded its maximum
+        # number of insertions
+        self.check_insertions(
+            Sort.filename, Qt.DescendingOrder, counts=[3] * (UidRows.max_insertions + 5)
+        )
+
+
+if __name__ == '__main__':
+    unittest.main()
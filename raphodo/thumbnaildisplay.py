@@ -24,7 +24,7 @@ import os
 import sys
 import datetime
 from collections import (namedtuple, defaultdict, deque)
-from operator import attrgetter
+from operator import attrgetter, itemgetter
 import subprocess
 import shlex
 import logging
@@ -69,7 +69,7 @@ from raphodo.utilities import (
     CacheDirs, make_internationalized_list, format_size_for_user, runs, arrow_locale
 )
 from raphodo.thumbnailer import Thumbnailer
-from raphodo.rpdsql import ThumbnailRowsSQL, ThumbnailRow
+from raphodo.thumbnailrows import ThumbnailRowsIndex, ThumbnailRow, thumbnail_row, UidRows
 from raphodo.viewutils import ThumbnailDataForProximity, scaledIcon
 from raphodo.proximity import TemporalProximityState
 from raphodo.rpdsql import DownloadedSQL
@@ -96,11 +96,13 @@ class AddBuffer:
     """
     Buffers thumbnail rows for display.
 
-    Add thumbnail rows to the listview is a relatively expensive operation, as the
-    model must be reset. Buffer the rows here, and then when big enough, flush it.
+    Adding thumbnail rows to the listview is a relatively expensive operation, as
+    sort positions must be determined and the view notified. Buffer the rows here,
+    and then when big enough, flush it.
     """
 
     min_buffer_length = 10
+    max_buffer_length = 1000
 
     def __init__(self):
         self.initialize()
@@ -120,10 +122,10 @@ class AddBuffer:
 
     def reset(self, buffer_length: int) -> None:
         self.initialize()
-        self.buffer_length = buffer_length
+        self.set_buffer_length(buffer_length)
 
     def set_buffer_length(self, length: int) -> None:
-        self.buffer_length = max(self.min_buffer_length, length)
+        self.buffer_length = min(max(self.min_buffer_length, length), self.max_buffer_length)
 
     def extend(self, scan_id: int, thumbnail_rows: Sequence[ThumbnailRow]) -> None:
         self.buffer[scan_id].extend(thumbnail_rows)
@@ -193,16 +195,16 @@ class ThumbnailListModel(QAbstractListModel):
         # uid: RPDFile
         self.rpd_files = {}  # type: Dict[bytes, RPDFile]
 
-        # In memory database to hold all thumbnail rows
-        self.tsql = ThumbnailRowsSQL()
+        # In memory index to hold all thumbnail rows
+        self.tindex = ThumbnailRowsIndex()
 
-        # Rows used to render the thumbnail view - contains query result of the DB
+        # Rows used to render the thumbnail view - contains query result of the index
         # Each list element corresponds to a row in the thumbnail view such that
         # index 0 in the list is row 0 in the view
         # [(uid, marked)]
         self.rows = []  # type: List[Tuple[bytes, bool]]
         # {uid: row}
-        self.uid_to_row = {}  # type: Dict[bytes, int]
+        self.uid_to_row = UidRows()
 
         size = QSize(106, 106)
         self.photo_icon = scaledIcon(':/thumbnail/photo.svg').pixmap(size)
@@ -237,35 +239,37 @@ class ThumbnailListModel(QAbstractListModel):
     @pyqtSlot(int)
     def thumbnailWorkerFinished(self, scan_id: int) -> None:
         self.generating_thumbnails.remove(scan_id)
+        self.rapidApp.prefetchFromCameras()
 
     @pyqtSlot(int)
     def thumbnailWorkerStopped(self, scan_id: int) -> None:
         self.generating_thumbnails.remove(scan_id)
         self.rapidApp.thumbnailGenerationStopped(scan_id=scan_id)
+        self.rapidApp.resumePrefetch()
 
     def logState(self) -> None:
         logging.debug("-- Thumbnail Model --")
 
-        db_length = self.tsql.get_count()
+        db_length = self.tindex.get_count()
         db_length_and_buffer_length = db_length + len(self.add_buffer)
         if (len(self.thumbnails) != db_length_and_buffer_length or
                 db_length_and_buffer_length != len(self.rpd_files)):
-            logging.error("Conflicting values: %s thumbnails; %s database rows; %s rpd_files",
+            logging.error("Conflicting values: %s thumbnails; %s index rows; %s rpd_files",
                           len(self.thumbnails), db_length, len(self.rpd_files))
         else:
             logging.debug("%s thumbnails (%s marked)",
-                          db_length, self.tsql.get_count(marked=True))
+                          db_length, self.tindex.get_count(marked=True))
 
         logging.debug("%s not downloaded; %s downloaded; %s previously downloaded",
-                      self.tsql.get_count(downloaded=False),
-                      self.tsql.get_count(downloaded=True),
-                      self.tsql.get_count(previously_downloaded=True))
+                      self.tindex.get_count(downloaded=False),
+                      self.tindex.get_count(downloaded=True),
+                      self.tindex.get_count(previously_downloaded=True))
 
         if self.total_thumbs_to_generate:
             logging.debug("%s to be generated; %s generated", self.total_thumbs_to_generate,
                           self.thumbnails_generated)
 
-        scan_ids = self.tsql.get_all_devices()
+        scan_ids = self.tindex.get_all_devices()
         active_devices = ', '.join(self.rapidApp.devices[scan_id].display_name
                                    for scan_id in scan_ids
                                    if scan_id not in self.removed_devices)
@@ -285,10 +289,10 @@ class ThumbnailListModel(QAbstractListModel):
             if self.thumbnails.get(uid) is None:
                 raise KeyError('Missing key in thumbnails at row {}'.format(idx))
 
-        [self.tsql.validate_uid(uid=row[0]) for row in self.rows]
+        [self.tindex.validate_uid(uid=row[0]) for row in self.rows]
         for uid, row in self.uid_to_row.items():
             assert self.rows[row][0] == uid
-        for uid in self.tsql.get_uids():
+        for uid in self.tindex.get_uids():
             assert uid in self.rpd_files
             assert uid in self.thumbnails
         logging.debug("...thumbnail model looks okay")
@@ -309,12 +313,12 @@ class ThumbnailListModel(QAbstractListModel):
         if not suppress_signal:
             self.layoutAboutToBeChanged.emit()
 
-        self.rows = self.tsql.get_view(
+        self.rows = self.tindex.get_view(
             sort_by=self.sort_by, sort_order=self.sort_order,
             show=self.show, proximity_col1=self.proximity_col1,
             proximity_col2=self.proximity_col2
         )
-        self.uid_to_row = {row[0]: idx for idx, row in enumerate(self.rows)}
+        self.uid_to_row.reset(self.rows)
 
         if not suppress_signal:
             self.layoutChanged.emit()
@@ -581,13 +585,13 @@ class ThumbnailListModel(QAbstractListModel):
             return False
         uid = self.rows[row][0]
         if role == Qt.CheckStateRole:
-            self.tsql.set_marked(uid=uid, marked=value)
+            self.tindex.set_marked(uid=uid, marked=value)
             self.rows[row] = (uid, value == True)
             self.dataChanged.emit(index, index)
             return True
         elif role == Roles.job_code:
             self.rpd_files[uid].job_code = value
-            self.tsql.set_job_code_assigned(uids=[uid], job_code=True)
+            self.tindex.set_job_code_assigned(uids=[uid], job_code=True)
             self.dataChanged.emit(index, index)
             return True
         return False
@@ -608,11 +612,11 @@ class ThumbnailListModel(QAbstractListModel):
         if role == Roles.previously_downloaded:
             logging.debug("Manually setting %s files as previously downloaded", len(uids))
             # Set the files as unmarked
-            self.tsql.set_list_marked(uids=uids, marked=False)
+            self.tindex.set_list_marked(uids=uids, marked=False)
             for row, uid in zip(rows, uids):
                 self.rows[row] = (uid, False)
             # Set the files as previously downloaded
-            self.tsql.set_list_previously_downloaded(uids=uids, previously_downloaded=value)
+            self.tindex.set_list_previously_downloaded(uids=uids, previously_downloaded=value)
             d = DownloadedSQL()
             now = datetime.datetime.now()
             for uid in uids:
@@ -641,7 +645,7 @@ class ThumbnailListModel(QAbstractListModel):
         :param job_code: job code to assign
         """
 
-        uids = self.tsql.get_uids(marked=True, job_code=False)
+        uids = self.tindex.get_uids(marked=True, job_code=False)
         logging.debug("Assigning job code to %s files because a download was initiated", len(uids))
         for uid in uids:
             self.rpd_files[uid].job_code = job_code
@@ -649,7 +653,7 @@ class ThumbnailListModel(QAbstractListModel):
             rows.sort()
             for first, last in runs(rows):
                 self.dataChanged.emit(self.index(first, 0), self.index(last, 0))
-        self.tsql.set_job_code_assigned(uids=uids, job_code=True)
+        self.tindex.set_job_code_assigned(uids=uids, job_code=True)
 
     def updateDisplayPostDataChange(self, scan_id: Optional[int]=None):
         if scan_id is not None:
@@ -665,7 +669,7 @@ class ThumbnailListModel(QAbstractListModel):
         """
         Removes Python list rows only, i.e. self.rows.
 
-        Does not touch database or other variables.
+        Does not touch index or other variables.
         """
 
         self.beginRemoveRows(QModelIndex(), position, position + rows - 1)
@@ -675,14 +679,23 @@ class ThumbnailListModel(QAbstractListModel):
 
     def addOrUpdateDevice(self, scan_id: int) -> None:
         device_name = self.rapidApp.devices[scan_id].display_name
-        self.tsql.add_or_update_device(scan_id=scan_id, device_name=device_name)
+        self.tindex.add_or_update_device(scan_id=scan_id, device_name=device_name)
+
+    def addFiles(self, scan_id: int,
+                 rpd_files: List[RPDFile],
+                 generate_thumbnail: bool,
+                 thumbnail_rows: Optional[Sequence[ThumbnailRow]]=None) -> None:
+        """
+        :param scan_id: the device the files were scanned from
+        :param rpd_files: the scanned files
+        :param generate_thumbnail: whether to generate thumbnails for the files
+        :param thumbnail_rows: the files' thumbnail rows, if already created
+         outside the main thread
+        """
 
-    def addFiles(self, scan_id: int, rpd_files: List[RPDFile], generate_thumbnail: bool) -> None:
         if not rpd_files:
             return
 
-        thumbnail_rows = deque(maxlen=len(rpd_files))
-
         for rpd_file in rpd_files:
             uid = rpd_file.uid
             self.rpd_files[uid] = rpd_file
@@ -692,26 +705,12 @@ class ThumbnailListModel(QAbstractListModel):
             else:
                 self.thumbnails[uid] = self.video_icon
 
-            if generate_thumbnail:
-                self.total_thumbs_to_generate += 1
-                self.no_thumbnails_by_scan[rpd_file.scan_id] += 1
-
-            tr = ThumbnailRow(
-                uid=uid,
-                scan_id=rpd_file.scan_id,
-                mtime=rpd_file.modification_time,
-                marked=not rpd_file.previously_downloaded,
-                file_name=rpd_file.name,
-                extension=rpd_file.extension,
-                file_type=rpd_file.file_type,
-                downloaded=False,
-                previously_downloaded=rpd_file.previously_downloaded,
-                job_code=False,
-                proximity_col1=-1,
-                proximity_col2=-1
-            )
+        if generate_thumbnail:
+            self.total_thumbs_to_generate += len(rpd_files)
+            self.no_thumbnails_by_scan[scan_id] += len(rpd_files)
 
-            thumbnail_rows.append(tr)
+        if thumbnail_rows is None:
+            thumbnail_rows = [thumbnail_row(rpd_file) for rpd_file in rpd_files]
 
         self.add_buffer.extend(scan_id=scan_id, thumbnail_rows=thumbnail_rows)
 
@@ -729,18 +728,95 @@ class ThumbnailListModel(QAbstractListModel):
 
     def flushAddBuffer(self):
         if len(self.add_buffer):
-            self.beginResetModel()
+            thumbnail_rows = [tr for buffer in self.add_buffer.buffer.values() for tr in buffer]
 
             for buffer in self.add_buffer.buffer.values():
-                self.tsql.add_thumbnail_rows(thumbnail_rows=buffer)
-            self.refresh(suppress_signal=True)
+                self.tindex.add_thumbnail_rows(thumbnail_rows=buffer)
+
+            # When sorting by checked state, the rows are not re-sorted when the user
+            # checks or unchecks a file, so the view cannot be bisected. When the view is
+            # empty or small relative to the new rows, a reset is no more expensive.
+            if (not self.rows or self.sort_by == Sort.checked_state or
+                    len(thumbnail_rows) > len(self.rows)):
+                self.beginResetModel()
+                self.refresh(suppress_signal=True)
+                self.endResetModel()
+                self._resetRememberSelection()
+            else:
+                self._insertRows(thumbnail_rows)
 
             self.add_buffer.reset(buffer_length=len(self.rows))
 
-            self.endResetModel()
-
             self._resetHighlightingValues()
-            self._resetRememberSelection()
+
+    def _insertionRow(self, key: tuple) -> int:
+        """
+        Binary search of the displayed rows for where a row with this sort key
+        belongs.
+
+        :param key: sort key as returned by ThumbnailRowsIndex.sort_key()
+        :return: row to insert at
+        """
+
+        ascending = self.sort_order == Qt.AscendingOrder
+        lo = 0
+        hi = len(self.rows)
+        while lo < hi:
+            mid = (lo + hi) // 2
+            mid_key = self.tindex.sort_key(self.rows[mid][0], self.sort_by, self.sort_order)
+            if ascending:
+                before = key < mid_key
+            else:
+                before = mid_key < key
+            if before:
+                hi = mid
+            else:
+                lo = mid + 1
+        return lo
+
+    def _insertRows(self, thumbnail_rows: List[ThumbnailRow]) -> None:
+        """
+        Insert newly added rows into the view in their sorted position, notifying
+        the view of each contiguous range of inserted rows. Where each new row goes is
+        found using a binary search of the displayed rows, and uid_to_row records the
+        insertions rather than renumbering the rows after them, so the work is
+        proportional to the number of rows being added, not the number displayed.
+
+        :param thumbnail_rows: rows that have already been added to the index
+        """
+
+        # New rows have yet to be assigned a Timeline cell, so are not displayed when
+        # the Timeline is filtering the display
+        if self.proximity_col1 or self.proximity_col2:
+            return
+
+        if self.show == Show.new_only:
+            thumbnail_rows = [tr for tr in thumbnail_rows if not tr.previously_downloaded]
+        if not thumbnail_rows:
+            return
+
+        new_rows = [
+            (self.tindex.sort_key(tr.uid, self.sort_by, self.sort_order), (tr.uid, tr.marked))
+            for tr in thumbnail_rows
+        ]
+        new_rows.sort(key=itemgetter(0), reverse=self.sort_order == Qt.DescendingOrder)
+
+        # Group the new rows by where they go in the existing rows
+        groups = []  # type: List[Tuple[int, List[Tuple[bytes, bool]]]]
+        for key, row in new_rows:
+            position = self._insertionRow(key)
+            if groups and groups[-1][0] == position:
+                groups[-1][1].append(row)
+            else:
+                groups.append((position, [row]))
+
+        # Insert in reverse, so earlier insertion positions remain valid
+        for position, rows in reversed(groups):
+            self.beginInsertRows(QModelIndex(), position, position + len(rows) - 1)
+            self.rows[position:position] = rows
+            self.endInsertRows()
+
+        self.uid_to_row.insert(groups, self.rows)
 
     def getMarkedSummary(self) -> MarkedSummary:
         """
@@ -799,6 +875,11 @@ class ThumbnailListModel(QAbstractListModel):
                 DownloadStatus.not_downloaded, DownloadStatus.download_pending):
             # Only update the rpd_file if the file has not already been downloaded
             # TODO consider merging this no matter what the status
+            prefetched = self.rpd_files[uid].cache_full_file_name
+            if prefetched and not rpd_file.cache_full_file_name:
+                # The file was prefetched after this thumbnail was requested
+                rpd_file.cache_full_file_name = prefetched
+                rpd_file.temp_cache_full_file_chunk = ''
             self.rpd_files[uid] = rpd_file
 
         if not thumbnail.isNull():
@@ -822,11 +903,12 @@ class ThumbnailListModel(QAbstractListModel):
                 logging.info('Finished thumbnail generation for %s', device.name())
 
                 if scan_id in self.ctimes_differ:
-                    uids = self.tsql.get_uids_for_device(scan_id=scan_id)
+                    uids = self.tindex.get_uids_for_device(scan_id=scan_id)
                     rpd_files = [self.rpd_files[uid] for uid in uids]
                     self.rapidApp.folder_preview_manager.add_rpd_files(rpd_files=rpd_files)
                     self.processCtimeDisparity(scan_id=scan_id)
                 log_state = True
+                self.rapidApp.prefetchFromCameras()
 
             if self.thumbnails_generated == self.total_thumbs_to_generate:
                 self.thumbnails_generated = 0
@@ -903,15 +985,16 @@ class ThumbnailListModel(QAbstractListModel):
 
         if scan_id not in self.removed_devices:
             self.generating_thumbnails.add(scan_id)
+            self.rapidApp.pausePrefetch()
             self.rapidApp.updateProgressBarState()
             cache_dirs = self.getCacheLocations()
-            uids = self.tsql.get_uids_for_device(scan_id=scan_id)
+            uids = self.tindex.get_uids_for_device(scan_id=scan_id)
             rpd_files = list((self.rpd_files[uid] for uid in uids))
 
             need_video_cache_dir = need_photo_cache_dir = False
             if device.device_type == DeviceType.camera:
                 need_video_cache_dir = device.entire_video_required or \
-                    self.tsql.any_files_of_type(scan_id, FileType.video)
+                    self.tindex.any_files_of_type(scan_id, FileType.video)
                 # defer check to see if ExifTool is needed until later
                 need_photo_cache_dir = device.entire_photo_required
 
@@ -944,7 +1027,7 @@ class ThumbnailListModel(QAbstractListModel):
                 no_rows = last - first + 1
                 self.removeRows(first, no_rows)
 
-            self.uid_to_row = {row[0]: idx for idx, row in enumerate(self.rows)}
+            self.uid_to_row.reset(self.rows)
 
     def purgeRpdFiles(self, uids: List[bytes]) -> None:
         for uid in uids:
@@ -964,7 +1047,7 @@ class ThumbnailListModel(QAbstractListModel):
 
         Two aspects to this task:
          1. remove files list of rows which drive the list view display
-         2. remove files from backend DB and from thumbnails and rpd_files lists.
+         2. remove files from backend index and from thumbnails and rpd_files lists.
 
         :param scan_id: if None, keep_downloaded_files must be False
         :param keep_downloaded_files: don't remove thumbnails if they represent
@@ -974,7 +1057,7 @@ class ThumbnailListModel(QAbstractListModel):
         """
 
         if scan_id is None and not keep_downloaded_files:
-            files_removed = self.tsql.any_files()
+            files_removed = self.tindex.any_files()
             logging.debug("Clearing all thumbnails for all devices")
             self.initialize()
             return files_removed
@@ -982,9 +1065,9 @@ class ThumbnailListModel(QAbstractListModel):
             assert scan_id is not None
 
             if not keep_downloaded_files:
-                files_removed = self.tsql.any_files(scan_id=scan_id)
+                files_removed = self.tindex.any_files(scan_id=scan_id)
             else:
-                files_removed = self.tsql.any_files_to_download(scan_id=scan_id)
+                files_removed = self.tindex.any_files_to_download(scan_id=scan_id)
 
             if keep_downloaded_files:
                 logging.debug("Clearing all non-downloaded thumbnails for scan id %s", scan_id)
@@ -998,11 +1081,11 @@ class ThumbnailListModel(QAbstractListModel):
 
             self._deleteRows(uids)
 
-            # Delete from DB and thumbnails and rpd_files lists
+            # Delete from index and thumbnails and rpd_files lists
             if keep_downloaded_files:
-                uids = self.tsql.get_uids(scan_id=scan_id, downloaded=False)
+                uids = self.tindex.get_uids(scan_id=scan_id, downloaded=False)
             else:
-                uids = self.tsql.get_uids(scan_id=scan_id)
+                uids = self.tindex.get_uids(scan_id=scan_id)
 
             logging.debug("Removing %s thumbnail and rpd_files rows", len(uids))
             self.purgeRpdFiles(uids)
@@ -1016,9 +1099,9 @@ class ThumbnailListModel(QAbstractListModel):
             self.add_buffer.set_buffer_length(len(self.rows))
 
             if keep_downloaded_files:
-                self.tsql.delete_files_by_scan_id(scan_id=scan_id, downloaded=False)
+                self.tindex.delete_files_by_scan_id(scan_id=scan_id, downloaded=False)
             else:
-                self.tsql.delete_files_by_scan_id(scan_id=scan_id)
+                self.tindex.delete_files_by_scan_id(scan_id=scan_id)
 
             self.removed_devices.add(scan_id)
 
@@ -1026,8 +1109,8 @@ class ThumbnailListModel(QAbstractListModel):
                 self.recalculateThumbnailsPercentage(scan_id=scan_id)
             self.rapidApp.displayMessageInStatusBar()
 
-            if self.tsql.get_count(scan_id=scan_id) == 0:
-                self.tsql.delete_device(scan_id=scan_id)
+            if self.tindex.get_count(scan_id=scan_id) == 0:
+                self.tindex.delete_device(scan_id=scan_id)
 
             if scan_id in self.ctimes_differ:
                 self.ctimes_differ.remove(scan_id)
@@ -1045,12 +1128,12 @@ class ThumbnailListModel(QAbstractListModel):
 
         # Now get uids of all downloaded files, regardless of whether they're
         # displayed at the moment
-        uids = self.tsql.get_uids(downloaded=True)
+        uids = self.tindex.get_uids(downloaded=True)
         logging.debug("Removing %s thumbnail and rpd_files rows", len(uids))
         self.purgeRpdFiles(uids)
 
-        # Delete the files from the internal database that drives the display
-        self.tsql.delete_uids(uids)
+        # Delete the files from the internal index that drives the display
+        self.tindex.delete_uids(uids)
 
     def filesAreMarkedForDownload(self, scan_id: Optional[int]=None) -> bool:
         """
@@ -1062,32 +1145,32 @@ class ThumbnailListModel(QAbstractListModel):
         they intend to download, else False.
         """
 
-        return self.tsql.any_files_marked(scan_id=scan_id)
+        return self.tindex.any_files_marked(scan_id=scan_id)
 
     def getNoFilesMarkedForDownload(self) -> int:
-        return self.tsql.get_count(marked=True)
+        return self.tindex.get_count(marked=True)
 
     def getNoHiddenFiles(self) -> int:
         if self.rapidApp.showOnlyNewFiles():
-            return self.tsql.get_count(previously_downloaded=True, downloaded=False)
+            return self.tindex.get_count(previously_downloaded=True, downloaded=False)
         else:
             return 0
 
     def getNoFilesAndTypesMarkedForDownload(self) -> FileTypeCounter:
-        no_photos = self.tsql.get_count(marked=True, file_type=FileType.photo)
-        no_videos = self.tsql.get_count(marked=True, file_type=FileType.video)
+        no_photos = self.tindex.get_count(marked=True, file_type=FileType.photo)
+        no_videos = self.tindex.get_count(marked=True, file_type=FileType.video)
         f = FileTypeCounter()
         f[FileType.photo] = no_photos
         f[FileType.video] = no_videos
         return f
 
     def getSizeOfFilesMarkedForDownload(self, file_type: FileType) -> int:
-        uids = self.tsql.get_uids(marked=True, file_type=file_type)
+        uids = self.tindex.get_uids(marked=True, file_type=file_type)
         return sum(self.rpd_files[uid].size for uid in uids)
 
     def getNoFilesAvailableForDownload(self) -> FileTypeCounter:
-        no_photos = self.tsql.get_count(downloaded=False, file_type=FileType.photo)
-        no_videos = self.tsql.get_count(downloaded=False, file_type=FileType.video)
+        no_photos = self.tindex.get_count(downloaded=False, file_type=FileType.photo)
+        no_videos = self.tindex.get_count(downloaded=False, file_type=FileType.video)
         f = FileTypeCounter()
         f[FileType.photo] = no_photos
         f[FileType.video] = no_videos
@@ -1105,10 +1188,10 @@ class ThumbnailListModel(QAbstractListModel):
             return self.getDisplayedCounter()
 
     def getCountNotPreviouslyDownloadedAvailableForDownload(self) -> int:
-        return self.tsql.get_count(previously_downloaded=False, downloaded=False)
+        return self.tindex.get_count(previously_downloaded=False, downloaded=False)
 
     def getAllDownloadableRPDFiles(self) -> List[RPDFile]:
-        uids = self.tsql.get_uids(downloaded=False)
+        uids = self.tindex.get_uids(downloaded=False)
         return [self.rpd_files[uid] for uid in uids]
 
     def getFilesMarkedForDownload(self, scan_id: Optional[int]) -> DownloadFiles:
@@ -1136,7 +1219,7 @@ class ThumbnailListModel(QAbstractListModel):
         camera_access_needed = defaultdict(bool)
         download_photos = download_videos = False
 
-        uids = self.tsql.get_uids(scan_id=scan_id, marked=True, downloaded=False,
+        uids = self.tindex.get_uids(scan_id=scan_id, marked=True, downloaded=False,
                                   exclude_scan_ids=exclude_scan_ids)
 
         for uid in uids:
@@ -1182,6 +1265,37 @@ class ThumbnailListModel(QAbstractListModel):
             camera_access_needed=camera_access_needed
         )
 
+    def getFilesToPrefetch(self, scan_id: int) -> List[RPDFile]:
+        """
+        :param scan_id: the camera to prefetch files from
+        :return: files marked for download that were not previously
+         downloaded, and are not already in the Download Cache
+        """
+
+        uids = self.tindex.get_uids(
+            scan_id=scan_id, marked=True, downloaded=False, previously_downloaded=False
+        )
+        rpd_files = (self.rpd_files[uid] for uid in uids)
+        return [
+            rpd_file for rpd_file in rpd_files
+            if rpd_file.from_camera and not rpd_file.cache_full_file_name and
+            rpd_file.status == DownloadStatus.not_downloaded
+        ]
+
+    def filePrefetched(self, uid: bytes, cache_full_file_name: str) -> None:
+        """
+        Record that a file was copied into the Download Cache, so the download
+        moves it into place instead of reading it from the camera.
+
+        :param uid: the file's uid
+        :param cache_full_file_name: where the file is in the Download Cache
+        """
+
+        rpd_file = self.rpd_files.get(uid)  # type: RPDFile
+        if rpd_file is not None and rpd_file.status == DownloadStatus.not_downloaded:
+            rpd_file.cache_full_file_name = cache_full_file_name
+            rpd_file.temp_cache_full_file_chunk = ''
+
     def sendToDaemonThumbnailer(self, rpd_file: RPDFile) -> bool:
         """
         Determine if the file needs to be sent for thumbnail generation
@@ -1210,7 +1324,7 @@ class ThumbnailListModel(QAbstractListModel):
         for row in rows:
             uid = self.rows[row][0]
             self.rows[row] = (uid, False)
-        self.tsql.set_list_marked(uids=uids, marked=False)
+        self.tindex.set_list_marked(uids=uids, marked=False)
 
         for uid in uids:
             self.rpd_files[uid].status = DownloadStatus.download_pending
@@ -1245,7 +1359,7 @@ class ThumbnailListModel(QAbstractListModel):
         :return the number of files that have not yet been downloaded
         """
 
-        return self.tsql.get_count(scan_id=scan_id, downloaded=False)
+        return self.tindex.get_count(scan_id=scan_id, downloaded=False)
 
     def updateSelectionAfterProximityChange(self) -> None:
         if self._selectionModel().hasSelection():
@@ -1346,7 +1460,7 @@ class ThumbnailListModel(QAbstractListModel):
         """
 
         uids = self.getDisplayedUids(marked=not check_all, file_type=file_type, scan_id=scan_id)
-        self.tsql.set_list_marked(uids=uids, marked=check_all)
+        self.tindex.set_list_marked(uids=uids, marked=check_all)
         rows = [self.uid_to_row[uid] for uid in uids]
         for row in rows:
             self.rows[row] = (self.rows[row][0], check_all)
@@ -1369,7 +1483,7 @@ class ThumbnailListModel(QAbstractListModel):
             col2id = [col2id]
         else:
             col1id = [col1id]
-        uids = self.tsql.get_uids(proximity_col1=col1id, proximity_col2=col2id)
+        uids = self.tindex.get_uids(proximity_col1=col1id, proximity_col2=col2id)
         file_types = (self.rpd_files[uid].file_type for uid in uids)
         return FileTypeCounter(file_types).summarize_file_count()[0]
 
@@ -1377,13 +1491,13 @@ class ThumbnailListModel(QAbstractListModel):
                          marked: Optional[bool]=None,
                          file_type: Optional[FileType]=None,
                          downloaded: Optional[bool]=False) -> List[bytes]:
-        return self.tsql.get_uids(scan_id=scan_id, downloaded=downloaded, show=self.show,
+        return self.tindex.get_uids(scan_id=scan_id, downloaded=downloaded, show=self.show,
                                   proximity_col1=self.proximity_col1,
                                   proximity_col2=self.proximity_col2,
                                   marked=marked, file_type=file_type)
 
     def getFirstUidFromUidList(self, uids: List[bytes]) -> Optional[bytes]:
-        return self.tsql.get_first_uid_from_uid_list(
+        return self.tindex.get_first_uid_from_uid_list(
             sort_by=self.sort_by, sort_order=self.sort_order,
             show=self.show, proximity_col1=self.proximity_col1,
             proximity_col2=self.proximity_col2,
@@ -1392,15 +1506,15 @@ class ThumbnailListModel(QAbstractListModel):
 
     def getDisplayedCount(self, scan_id: Optional[int] = None,
                           marked: Optional[bool] = None) -> int:
-        return self.tsql.get_count(scan_id=scan_id, downloaded=False, show=self.show,
+        return self.tindex.get_count(scan_id=scan_id, downloaded=False, show=self.show,
                                    proximity_col1=self.proximity_col1,
                                    proximity_col2=self.proximity_col2, marked=marked)
 
     def getDisplayedCounter(self) -> FileTypeCounter:
-        no_photos = self.tsql.get_count(downloaded=False, file_type=FileType.photo, show=self.show,
+        no_photos = self.tindex.get_count(downloaded=False, file_type=FileType.photo, show=self.show,
                                    proximity_col1=self.proximity_col1,
                                    proximity_col2=self.proximity_col2)
-        no_videos = self.tsql.get_count(downloaded=False, file_type=FileType.video, show=self.show,
+        no_videos = self.tindex.get_count(downloaded=False, file_type=FileType.video, show=self.show,
                                    proximity_col1=self.proximity_col1,
                                    proximity_col2=self.proximity_col2)
         f = FileTypeCounter()
@@ -1421,7 +1535,7 @@ class ThumbnailListModel(QAbstractListModel):
         if not exclude_scan_ids:
             exclude_scan_ids = None
 
-        uid = self.tsql.get_single_file_of_type(file_type=file_type,
+        uid = self.tindex.get_single_file_of_type(file_type=file_type,
                                                 exclude_scan_ids=exclude_scan_ids)
         if uid is not None:
             return self.rpd_files[uid]
@@ -1450,7 +1564,7 @@ class ThumbnailListModel(QAbstractListModel):
         """
 
         if device_type == DeviceType.camera:
-            uid = self.tsql.get_single_file_of_type(
+            uid = self.tindex.get_single_file_of_type(
                 scan_id=scan_id, file_type=file_type, downloaded=True
             )
             if uid is not None:
@@ -1458,7 +1572,7 @@ class ThumbnailListModel(QAbstractListModel):
             else:
                 # try find a *downloaded* file from another camera
 
-                # could determine which devices to exclude in SQL but it's a little simpler
+                # could determine which devices to exclude in the index but it's a little simpler
                 # here
                 devices = self.rapidApp.devices
                 exclude_scan_ids = [s_id for s_id, device in devices.items()
@@ -1467,7 +1581,7 @@ class ThumbnailListModel(QAbstractListModel):
                 if not exclude_scan_ids:
                     exclude_scan_ids = None
 
-                uid = self.tsql.get_single_file_of_type(
+                uid = self.tindex.get_single_file_of_type(
                     file_type=file_type, downloaded=True, exclude_scan_ids=exclude_scan_ids
                 )
                 if uid is not None:
@@ -1476,7 +1590,7 @@ class ThumbnailListModel(QAbstractListModel):
                     return self._getSampleFileNonCamera(file_type=file_type)
 
         else:
-            uid = self.tsql.get_single_file_of_type(scan_id=scan_id, file_type=file_type)
+            uid = self.tindex.get_single_file_of_type(scan_id=scan_id, file_type=file_type)
             if uid is not None:
                 return self.rpd_files[uid]
             else:
@@ -1576,7 +1690,7 @@ class ThumbnailListModel(QAbstractListModel):
 
         uid = rpd_file.uid
         self.rpd_files[uid] = rpd_file
-        self.tsql.set_downloaded(uid=uid, downloaded=True)
+        self.tindex.set_downloaded(uid=uid, downloaded=True)
         row = self.uid_to_row.get(uid)
 
         if row is not None:
@@ -1587,7 +1701,7 @@ class ThumbnailListModel(QAbstractListModel):
         :return True if any files remain that are not downloaded, else
          returns False
         """
-        return self.tsql.any_files_to_download(scan_id)
+        return self.tindex.any_files_to_download(scan_id)
 
     def dataForProximityGeneration(self) -> List[ThumbnailDataForProximity]:
         return [ThumbnailDataForProximity(uid=rpd_file.uid,
@@ -1603,7 +1717,7 @@ class ThumbnailListModel(QAbstractListModel):
         Relevant columns are col 1 and col 2.
         """
 
-        self.tsql.assign_proximity_groups(col1_col2_uid)
+        self.tindex.assign_proximity_groups(col1_col2_uid)
 
     def setProximityGroupFilter(self, col1: Optional[Sequence[int]],
                                 col2: Optional[Sequence[int]]) -> None:
@@ -1625,10 +1739,10 @@ class ThumbnailListModel(QAbstractListModel):
          not displayed because they are filtered
         """
 
-        return self.tsql.get_count(marked=True) != self.getDisplayedCount(marked=True)
+        return self.tindex.get_count(marked=True) != self.getDisplayedCount(marked=True)
 
     def anyFileNotPreviouslyDownloaded(self, uids: List[bytes]) -> bool:
-        return self.tsql.any_not_previously_downloaded(uids=uids)
+        return self.tindex.any_not_previously_downloaded(uids=uids)
 
     def getFileDownloadsCompleted(self) -> FileTypeCounter:
         """
@@ -1638,8 +1752,8 @@ class ThumbnailListModel(QAbstractListModel):
 
         return FileTypeCounter(
             {
-                FileType.photo: self.tsql.get_count(downloaded=True, file_type=FileType.photo),
-                FileType.video: self.tsql.get_count(downloaded=True, file_type=FileType.video)
+                FileType.photo: self.tindex.get_count(downloaded=True, file_type=FileType.photo),
+                FileType.video: self.tindex.get_count(downloaded=True, file_type=FileType.video)
             }
         )
 
@@ -1648,7 +1762,7 @@ class ThumbnailListModel(QAbstractListModel):
         :return: True if any files have been downloaded (including failures)
         """
 
-        return self.tsql.any_files_download_completed()
+        return self.tindex.any_files_download_completed()
 
     def jobCodeNeeded(self) -> bool:
         """
@@ -1656,7 +1770,7 @@ class ThumbnailListModel(QAbstractListModel):
          assigned to them
         """
 
-        return self.tsql.any_marked_file_no_job_code()
+        return self.tindex.any_marked_file_no_job_code()
 
     def getNoFilesJobCodeNeeded(self) -> FileTypeCounter:
         """
@@ -1666,9 +1780,9 @@ class ThumbnailListModel(QAbstractListModel):
 
         no_photos = no_videos = 0
         if self.prefs.file_type_uses_job_code(FileType.photo):
-            no_photos = self.tsql.get_count(marked=True, file_type=FileType.photo, job_code=False)
+            no_photos = self.tindex.get_count(marked=True, file_type=FileType.photo, job_code=False)
         if self.prefs.file_type_uses_job_code(FileType.video):
-            no_videos = self.tsql.get_count(marked=True, file_type=FileType.video, job_code=False)
+            no_videos = self.tindex.get_count(marked=True, file_type=FileType.video, job_code=False)
 
         f = FileTypeCounter()
         f[FileType.photo] = no_photos
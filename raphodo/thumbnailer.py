@@ -50,6 +50,7 @@ class ThumbnailManagerPara(PublishPullPipelineManager):
     def __init__(self, logging_port: int, thread_name: str) -> None:
         super().__init__(logging_port=logging_port, thread_name=thread_name)
         self._process_name = 'Thumbnail Manager'
+        self._warm_workers = 1
         self._process_to_run = 'thumbnailpara.py'
         self._worker_id = 0
 
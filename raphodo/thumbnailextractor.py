@@ -463,8 +463,10 @@ class ThumbnailExtractor(LoadBalancerWorker):
             rpd_file=rpd_file, full_file_name=full_file_name, raw_bytes=raw_bytes,
             force_exiftool=force_exiftool
         )
-        if rpd_file.metadata is not None and rpd_file.date_time() is None:
-            rpd_file.mdatatime = 0.0
+        if rpd_file.metadata is not None:
+            if rpd_file.date_time() is None:
+                rpd_file.mdatatime = 0.0
+            rpd_file.record_metadata()
 
     def load_photo_metadata(self, rpd_file: Photo, force_exiftool: bool,
                         full_file_name: Optional[str]=None,
@@ -493,6 +495,7 @@ class ThumbnailExtractor(LoadBalancerWorker):
             rpd_file.load_metadata(full_file_name=full_file_name, et_process=self.exiftool_process)
         if rpd_file.date_time() is None:
             rpd_file.mdatatime = 0.0
+        rpd_file.record_metadata()
 
     def get_video_rotation(self, rpd_file: Video, full_file_name: str) -> Optional[str]:
         """
@@ -589,8 +592,9 @@ class ThumbnailExtractor(LoadBalancerWorker):
                     force_exiftool=data.force_exiftool
                 )
                 orientation = rpd_file.metadata.orientation()
-                os.remove(data.secondary_full_file_name)
-                rpd_file.temp_cache_full_file_chunk = ''
+                if data.secondary_full_file_name != rpd_file.temp_cache_full_file_chunk:
+                    # Not kept in the Download Cache
+                    os.remove(data.secondary_full_file_name)
 
         elif task == ExtractionTask.load_from_exif_buffer:
             thumbnail_details = self.get_from_buffer(rpd_file, data.exif_buffer, processing)
@@ -51,6 +51,7 @@ import os
 import sys
 import logging
 import pickle
+import time
 from collections import deque
 from operator import attrgetter
 from typing import Optional, Tuple, Set
@@ -71,7 +72,7 @@ except ImportError:
 from raphodo.rpdfile import RPDFile
 from raphodo.interprocess import (
     WorkerInPublishPullPipeline, GenerateThumbnailsArguments, GenerateThumbnailsResults,
-    ThumbnailExtractorArgument
+    ThumbnailExtractorArgument, run_worker
 )
 from raphodo.constants import (
     FileType, ThumbnailSize, ThumbnailCacheStatus, ThumbnailCacheDiskStatus, ExtractionTask,
@@ -82,16 +83,12 @@ from raphodo.camera import (
     Camera, CameraProblemEx, gphoto2_python_logging
 )
 from raphodo.cache import ThumbnailCacheSql, FdoCacheLarge
-from raphodo.utilities import (GenerateRandomFileName, create_temp_dir, CacheDirs)
+from raphodo.utilities import (create_temp_dir, CacheDirs)
 from raphodo.preferences import Preferences
 from raphodo.rescan import RescanCamera
 from raphodo.fileformats import use_exiftool_on_photo
 from raphodo.heif import have_heif_module
-
-
-def cache_dir_name(device_name: str) -> str:
-    """Generate a directory name for a temporary file cache"""
-    return 'rpd-cache-{}-'.format(device_name[:10].replace(' ', '_'))
+from raphodo.downloadcache import DownloadCache, cache_dir_name
 
 
 def split_list(alist: list, wanted_parts=2):
@@ -212,7 +209,7 @@ class GetThumbnailFromCache:
         # Attempt to get thumbnail from Thumbnail Cache
         # (see cache.py for definitions of various caches)
         if self.thumbnail_cache is not None and use_thumbnail_cache:
-            get_thumbnail = self.thumbnail_cache.get_thumbnail_path(
+            get_thumbnail = self.thumbnail_cache.get_thumbnail_data(
                 full_file_name=rpd_file.full_file_name,
                 mtime=rpd_file.modification_time,
                 size=rpd_file.size,
@@ -230,8 +227,7 @@ class GetThumbnailFromCache:
                         rpd_file.thumbnail_status = ThumbnailCacheStatus.orientation_unknown
                     else:
                         rpd_file.thumbnail_status = ThumbnailCacheStatus.ready
-                    with open(get_thumbnail.path, 'rb') as thumbnail:
-                        thumbnail_bytes = thumbnail.read()
+                    thumbnail_bytes = get_thumbnail.data
 
         # Attempt to get thumbnail from large FDO Cache if not found in Thumbnail Cache
         # and it's not being downloaded directly from a camera (if it's from a camera, it's
@@ -352,22 +348,20 @@ def preprocess_thumbnail_from_disk(rpd_file: RPDFile,
 class GenerateThumbnails(WorkerInPublishPullPipeline):
 
     def __init__(self) -> None:
-        self.random_file_name = GenerateRandomFileName()
+        self.download_cache = None  # type: Optional[DownloadCache]
         super().__init__('Thumbnails')
 
     def cache_full_size_file_from_camera(self, rpd_file: RPDFile) -> bool:
         """
         Get the file from the camera chunk by chunk and cache it.
 
+        If the Download Cache is over budget, the file is cached only until
+        its thumbnail has been generated. See discard_files_over_budget().
+
         :return: True if operation succeeded, False otherwise
         """
-        if rpd_file.file_type == FileType.photo:
-            cache_dir = self.photo_cache_dir
-        else:
-            cache_dir = self.video_cache_dir
-        cache_full_file_name = os.path.join(
-            cache_dir, self.random_file_name.name(extension=rpd_file.extension)
-        )
+
+        cache_full_file_name = self.download_cache.new_file_name(rpd_file)
         try:
             self.camera.save_file_by_chunks(
                 dir_name=rpd_file.path,
@@ -376,35 +370,61 @@ class GenerateThumbnails(WorkerInPublishPullPipeline):
                 dest_full_filename=cache_full_file_name,
                 progress_callback=None,
                 check_for_command=self.check_for_controller_directive,
-                return_file_bytes=False
+                return_md5=False
             )
         except CameraProblemEx as e:
             # TODO report error
             return False
         else:
+            self.download_cache.retain(cache_full_file_name, rpd_file.size)
             rpd_file.cache_full_file_name = cache_full_file_name
             return True
 
-    def cache_file_chunk_from_camera(self, rpd_file: RPDFile, offset: int) -> bool:
-        if rpd_file.file_type == FileType.photo:
-            cache_dir = self.photo_cache_dir
-        else:
-            cache_dir = self.video_cache_dir
-        cache_full_file_name = os.path.join(
-            cache_dir, self.random_file_name.name(extension=rpd_file.extension)
-        )
+    def cache_file_chunk_from_camera(self, rpd_file: RPDFile, offset: int) -> Optional[str]:
+        """
+        Get the start of the file from the camera and cache it.
+
+        If the Download Cache has room for it, the chunk is kept for the
+        download, and is recorded in rpd_file.temp_cache_full_file_chunk.
+        Otherwise it should be deleted once it has been used.
+
+        :param offset: how much of the file to get
+        :return: full file name of the chunk, or None if it could not be read
+        """
+
+        cache_full_file_name = self.download_cache.new_file_name(rpd_file)
         try:
-            self.camera.save_file_chunk(
+            bytes_read = self.camera.save_file_chunk(
                 dir_name=rpd_file.path,
                 file_name=rpd_file.name,
                 chunk_size_in_bytes=min(offset, rpd_file.size),
                 dest_full_filename=cache_full_file_name
             )
-            rpd_file.temp_cache_full_file_chunk = cache_full_file_name
-            return True
         except CameraProblemEx as e:
             # TODO problem reporting
-            return False
+            return None
+        if self.download_cache.retain(cache_full_file_name, bytes_read):
+            rpd_file.temp_cache_full_file_chunk = cache_full_file_name
+        return cache_full_file_name
+
+    def discard_files_over_budget(self, rpd_file: RPDFile,
+                                  full_file_name_to_work_on: str,
+                                  file_to_work_on_is_temporary: bool) -> bool:
+        """
+        Stop recording a complete file read from the camera as cached if the
+        Download Cache is over budget, so the download reads it from the
+        camera again.
+
+        :return: whether the file to work on is temporary, i.e. should be
+         deleted once the thumbnail has been generated
+        """
+
+        if self.download_cache is not None and rpd_file.cache_full_file_name and \
+                self.download_cache.is_over_budget(rpd_file.cache_full_file_name):
+            if full_file_name_to_work_on == rpd_file.cache_full_file_name:
+                file_to_work_on_is_temporary = True
+            rpd_file.cache_full_file_name = ''
+        return file_to_work_on_is_temporary
 
     def extract_photo_video_from_camera(self,
                                         rpd_file: RPDFile,
@@ -447,13 +467,17 @@ class GenerateThumbnails(WorkerInPublishPullPipeline):
                 else:
                     offset = max(offset, datetime_offset.get(rpd_file.extension))
 
-            if offset and self.cache_file_chunk_from_camera(rpd_file, offset):
+            chunk_full_file_name = None
+            if offset:
+                chunk_full_file_name = self.cache_file_chunk_from_camera(rpd_file, offset)
+            if chunk_full_file_name is not None:
                 if rpd_file.file_type == FileType.photo:
                     task = ExtractionTask.load_from_bytes_metadata_from_temp_extract
                 else:
                     task = ExtractionTask.extract_from_file_and_load_metadata
-                    file_to_work_on_is_temporary = True
-                full_file_name_to_work_on = rpd_file.temp_cache_full_file_chunk
+                    # Delete the chunk once used, unless the Download Cache keeps it
+                    file_to_work_on_is_temporary = not rpd_file.temp_cache_full_file_chunk
+                full_file_name_to_work_on = chunk_full_file_name
         if task == ExtractionTask.undetermined:
             if self.cache_full_size_file_from_camera(rpd_file):
                 task = ExtractionTask.extract_from_file_and_load_metadata
@@ -575,6 +599,7 @@ class GenerateThumbnails(WorkerInPublishPullPipeline):
                     prefix=cache_dir_name(self.device_name)
                 )
                 cache_dirs = CacheDirs(self.photo_cache_dir, self.video_cache_dir)
+                self.download_cache = DownloadCache(self.photo_cache_dir, self.video_cache_dir)
                 self.content = pickle.dumps(
                     GenerateThumbnailsResults(
                         scan_id=arguments.scan_id,
@@ -614,8 +639,17 @@ class GenerateThumbnails(WorkerInPublishPullPipeline):
             # Attempt to get thumbnail from Thumbnail Cache
             # (see cache.py for definitions of various caches)
 
+            start = time.perf_counter()
             cache_search = thumbnail_caches.get_from_cache(rpd_file)
             task, thumbnail_bytes, full_file_name_to_work_on, origin = cache_search
+            self.metrics.record_latency('thumbnail cache lookup', time.perf_counter() - start)
+            in_thumb_cache = task != ExtractionTask.undetermined and \
+                             origin == ThumbnailCacheOrigin.thumbnail_cache
+            self.metrics.cache_lookup('thumbnail cache', hit=in_thumb_cache)
+            if not in_thumb_cache:
+                self.metrics.cache_lookup(
+                    'fdo cache', hit=task != ExtractionTask.undetermined
+                )
             if task != ExtractionTask.undetermined:
                 if origin == ThumbnailCacheOrigin.thumbnail_cache:
                     from_thumb_cache += 1
@@ -760,13 +794,17 @@ class GenerateThumbnails(WorkerInPublishPullPipeline):
                                 if offset is None and rpd_file.size < 4000000:
                                     offset = rpd_file.size
 
-                            if rpd_file.mdatatime or not offset:
-                                task = ExtractionTask.load_from_bytes
-                            elif self.cache_file_chunk_from_camera(rpd_file, offset):
+                            chunk_full_file_name = None
+                            if not rpd_file.mdatatime and offset:
+                                chunk_full_file_name = self.cache_file_chunk_from_camera(
+                                    rpd_file, offset
+                                )
+                            if chunk_full_file_name is not None:
                                 task = ExtractionTask.load_from_bytes_metadata_from_temp_extract
-                                secondary_full_file_name = rpd_file.temp_cache_full_file_chunk
+                                secondary_full_file_name = chunk_full_file_name
                             else:
-                                # For some reason was unable to download part of the video file
+                                # No need to get the metadata time, or for some reason
+                                # was unable to download part of the video file
                                 task = ExtractionTask.load_from_bytes
 
                             try:
@@ -794,6 +832,10 @@ class GenerateThumbnails(WorkerInPublishPullPipeline):
                         else:
                             full_file_name_to_work_on = rpd_file.full_file_name
 
+            file_to_work_on_is_temporary = self.discard_files_over_budget(
+                rpd_file, full_file_name_to_work_on, file_to_work_on_is_temporary
+            )
+
             if task == ExtractionTask.bypass:
                 self.content = pickle.dumps(
                     GenerateThumbnailsResults(rpd_file=rpd_file, thumbnail_bytes=thumbnail_bytes),
@@ -823,6 +865,8 @@ class GenerateThumbnails(WorkerInPublishPullPipeline):
                     pickle.HIGHEST_PROTOCOL)
                 self.frontend.send_multipart([b'data', self.content])
 
+            self.metrics.record_latency('thumbnail preparation', time.perf_counter() - start)
+
         if arguments.camera:
             self.camera.free_camera()
             # Delete our temporary cache directories if they are empty
@@ -856,4 +900,4 @@ class GenerateThumbnails(WorkerInPublishPullPipeline):
 
 
 if __name__ == "__main__":
-    generate_thumbnails = GenerateThumbnails()
+    run_worker(GenerateThumbnails)
@@ -0,0 +1,796 @@
+# Copyright (C) 2015-2020 Damon Lynch <damonlynch@gmail.com>
+
+# This file is part of Rapid Photo Downloader.
+#
+# Rapid Photo Downloader is free software: you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Rapid Photo Downloader is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Rapid Photo Downloader.  If not,
+# see <http://www.gnu.org/licenses/>.
+
+"""
+In memory columnar index of the thumbnail rows displayed in the main window.
+
+Each row is assigned a row id when it is added. Values used for sorting are held
+in one list per column, indexed by row id. Values used for filtering are held in
+byte masks, one byte per row id, in which a byte is 1 if the row has that value
+and 0 otherwise. Masks are combined by converting them to integers and using
+bitwise operations, which Python does in C, and a filter result is counted with
+bytes.count(). The integer value of each mask is cached until the mask changes.
+
+Sort orders are computed when first needed and then kept up to date as rows are
+added.
+
+Deleted rows have all their mask bytes set to zero, meaning they drop out of every
+filter without their row ids needing to be reassigned. When deleted rows outnumber
+the rows still in use, the index is compacted.
+"""
+
+__author__ = 'Damon Lynch'
+__copyright__ = "Copyright 2015-2020, Damon Lynch"
+
+from bisect import bisect_right
+from collections import namedtuple, defaultdict
+from typing import Optional, List, Tuple, Sequence, Dict, Set, Iterator, Iterable
+import logging
+
+from PyQt5.QtCore import Qt
+
+from raphodo.constants import FileType, Sort, Show
+
+
+ThumbnailRow = namedtuple(
+    'ThumbnailRow',
+    'uid, scan_id, mtime, marked, file_name, extension, file_type, downloaded, '
+    'previously_downloaded, job_code, proximity_col1, proximity_col2'
+)
+
+
+def thumbnail_row(rpd_file) -> ThumbnailRow:
+    """
+    :param rpd_file: a newly scanned photo or video
+    :return: the thumbnail row to display it
+
+    >>> from types import SimpleNamespace
+    >>> rpd_file = SimpleNamespace(
+    ...     uid=b'1', scan_id=0, modification_time=1.0, name='IMG_1.JPG', extension='jpg',
+    ...     file_type=FileType.photo, previously_downloaded=True)
+    >>> tr = thumbnail_row(rpd_file)
+    >>> tr.marked, tr.previously_downloaded, tr.downloaded
+    (False, True, False)
+    """
+
+    return ThumbnailRow(
+        uid=rpd_file.uid,
+        scan_id=rpd_file.scan_id,
+        mtime=rpd_file.modification_time,
+        marked=not rpd_file.previously_downloaded,
+        file_name=rpd_file.name,
+        extension=rpd_file.extension,
+        file_type=rpd_file.file_type,
+        downloaded=False,
+        previously_downloaded=rpd_file.previously_downloaded,
+        job_code=False,
+        proximity_col1=-1,
+        proximity_col2=-1
+    )
+
+# When adding more than this proportion of the rows already in the index, it's quicker
+# to recompute a sort order than to insert the new rows into it
+_sort_insert_ratio = 8
+
+# Compact the index only once there are at least this many deleted rows
+_min_deleted_to_compact = 1024
+
+
+def mask_rids(mask: bytes) -> Iterator[int]:
+    """
+    Generate row ids that are set in the mask, in order
+
+    >>> list(mask_rids(b'\\x00\\x01\\x01\\x00\\x01'))
+    [1, 2, 4]
+    >>> list(mask_rids(b''))
+    []
+    """
+
+    find = mask.find
+    rid = find(1)
+    while rid >= 0:
+        yield rid
+        rid = find(1, rid + 1)
+
+
+def rids_mask(rids: Iterable[int], length: int) -> bytearray:
+    """
+    Create a mask in which the row ids are set
+
+    >>> rids_mask([0, 3], 5)
+    bytearray(b'\\x01\\x00\\x00\\x01\\x00')
+    """
+
+    mask = bytearray(length)
+    for rid in rids:
+        mask[rid] = 1
+    return mask
+
+
+class ThumbnailRowsIndex:
+    """
+    In memory index of thumbnail rows displayed in main window.
+
+    >>> import uuid
+    >>> t = ThumbnailRowsIndex()
+    >>> t.add_or_update_device(scan_id=0, device_name='1D X')
+    >>> uids = [uuid.uuid4().bytes for i in range(3)]
+    >>> t.add_thumbnail_rows([
+    ...     ThumbnailRow(uids[0], 0, 3.0, True, 'IMG_1.CR2', 'cr2', FileType.photo, False,
+    ...                  False, False, -1, -1),
+    ...     ThumbnailRow(uids[1], 0, 1.0, False, 'IMG_2.JPG', 'jpg', FileType.photo, False,
+    ...                  True, False, -1, -1),
+    ...     ThumbnailRow(uids[2], 0, 2.0, True, 'MVI_3.MP4', 'mp4', FileType.video, False,
+    ...                  False, False, -1, -1)])
+    >>> t.get_count(), t.get_count(marked=True), t.get_count(show=Show.new_only)
+    (3, 2, 2)
+    >>> [uids.index(uid) for uid, marked in t.get_view(
+    ...     Sort.modification_time, Qt.AscendingOrder, Show.all)]
+    [1, 2, 0]
+    >>> [uids.index(uid) for uid, marked in t.get_view(
+    ...     Sort.filename, Qt.DescendingOrder, Show.new_only)]
+    [2, 0]
+    >>> t.set_list_marked(uids, marked=False)
+    >>> t.any_files_marked()
+    False
+    >>> t.any_files_with_extensions(scan_id=0, extensions=['nef', 'mp4'])
+    True
+    >>> t.delete_uids(uids[:2])
+    >>> t.get_uids(file_type=FileType.photo)
+    []
+    >>> t.get_uids(file_type=FileType.video, return_file_name=True)
+    ['MVI_3.MP4']
+    """
+
+    def __init__(self) -> None:
+        self._initialize()
+
+    def _initialize(self) -> None:
+        # {scan_id: device_name}
+        self.devices = {}  # type: Dict[int, str]
+
+        # {uid: row id}
+        self.uid_to_rid = {}  # type: Dict[bytes, int]
+
+        # Columns, indexed by row id
+        self.uids = []  # type: List[Optional[bytes]]
+        self.scan_ids = []  # type: List[int]
+        self.mtimes = []  # type: List[float]
+        self.file_names = []  # type: List[str]
+        self.extensions = []  # type: List[str]
+        self.file_types = []  # type: List[FileType]
+        self.proximity_col1 = []  # type: List[int]
+        self.proximity_col2 = []  # type: List[int]
+
+        # Masks, indexed by row id
+        self.alive = bytearray()
+        self.marked = bytearray()
+        self.downloaded = bytearray()
+        self.previously_downloaded = bytearray()
+        self.job_code = bytearray()
+        self.scan_id_masks = {}  # type: Dict[int, bytearray]
+        self.file_type_masks = {
+            FileType.photo: bytearray(), FileType.video: bytearray()
+        }  # type: Dict[FileType, bytearray]
+
+        # Sets of row ids, for values that are filtered on in combination
+        self.extension_rids = defaultdict(set)  # type: Dict[str, Set[int]]
+        self.proximity_col1_rids = defaultdict(set)  # type: Dict[int, Set[int]]
+        self.proximity_col2_rids = defaultdict(set)  # type: Dict[int, Set[int]]
+
+        # {id(mask): int.from_bytes(mask)}
+        self.mask_values = {}  # type: Dict[int, int]
+
+        # {(sort_by, sort_order): (sort keys, row ids)}
+        self.sort_orders = {}  # type: Dict[Tuple[Sort, Qt.SortOrder], Tuple[List, List[int]]]
+
+        self.no_deleted = 0
+
+    def __len__(self) -> int:
+        return len(self.uid_to_rid)
+
+    def _masks(self) -> List[bytearray]:
+        return [self.alive, self.marked, self.downloaded, self.previously_downloaded,
+                self.job_code] + list(self.file_type_masks.values()) + \
+               list(self.scan_id_masks.values())
+
+    def _mask_value(self, mask: bytearray) -> int:
+        key = id(mask)
+        value = self.mask_values.get(key)
+        if value is None:
+            value = int.from_bytes(mask, 'little')
+            self.mask_values[key] = value
+        return value
+
+    def _mask_changed(self, mask: bytearray) -> None:
+        self.mask_values.pop(id(mask), None)
+
+    def add_or_update_device(self, scan_id: int, device_name: str) -> None:
+        logging.debug('Adding or updating device %s (%s)', device_name, scan_id)
+        if self.devices.get(scan_id) != device_name:
+            self._drop_sort_orders(Sort.device)
+        self.devices[scan_id] = device_name
+        if scan_id not in self.scan_id_masks:
+            self.scan_id_masks[scan_id] = bytearray(len(self.uids))
+
+    def get_all_devices(self) -> List[int]:
+        return list(self.devices.keys())
+
+    def add_thumbnail_rows(self, thumbnail_rows: Sequence[ThumbnailRow]) -> None:
+        """
+        Add a list of rows to the index of thumbnail rows
+        """
+
+        logging.debug("Adding %s rows to index", len(thumbnail_rows))
+        no_rows = len(thumbnail_rows)
+        if not no_rows:
+            return
+
+        first_rid = len(self.uids)
+
+        for scan_id in {row.scan_id for row in thumbnail_rows}:
+            if scan_id not in self.scan_id_masks:
+                self.scan_id_masks[scan_id] = bytearray(first_rid)
+
+        self.mask_values = {}
+        padding = bytes(no_rows)
+        for mask in self._masks():
+            mask.extend(padding)
+
+        for rid, row in enumerate(thumbnail_rows, start=first_rid):
+            if row.uid in self.uid_to_rid:
+                raise KeyError('UID already exists in index')
+            self.uid_to_rid[row.uid] = rid
+            self.uids.append(row.uid)
+            self.scan_ids.append(row.scan_id)
+            self.mtimes.append(row.mtime)
+            self.file_names.append(row.file_name)
+            self.extensions.append(row.extension)
+            self.file_types.append(row.file_type)
+            self.proximity_col1.append(row.proximity_col1)
+            self.proximity_col2.append(row.proximity_col2)
+
+            self.alive[rid] = 1
+            self.marked[rid] = 1 if row.marked else 0
+            self.downloaded[rid] = 1 if row.downloaded else 0
+            self.previously_downloaded[rid] = 1 if row.previously_downloaded else 0
+            self.job_code[rid] = 1 if row.job_code else 0
+            self.scan_id_masks[row.scan_id][rid] = 1
+            self.file_type_masks[row.file_type][rid] = 1
+
+            self.extension_rids[row.extension].add(rid)
+            self.proximity_col1_rids[row.proximity_col1].add(rid)
+            self.proximity_col2_rids[row.proximity_col2].add(rid)
+
+        self._add_to_sort_orders(range(first_rid, first_rid + no_rows))
+
+    def sort_key(self, uid: bytes, sort_by: Sort, sort_order: Qt.SortOrder) -> tuple:
+        """
+        :return: the value the row is sorted on, such that rows returned by get_view()
+         are ordered by this key, ascending or descending according to the sort order.
+        """
+
+        return self._sort_key(self.uid_to_rid[uid], sort_by, sort_order)
+
+    def _sort_key(self, rid: int, sort_by: Sort, sort_order: Qt.SortOrder) -> tuple:
+        # Rows with identical values are always in the order they were added
+        tie = rid if sort_order == Qt.AscendingOrder else -rid
+        mtime = self.mtimes[rid]
+        if sort_by == Sort.modification_time:
+            return mtime, tie
+        elif sort_by == Sort.checked_state:
+            return self.marked[rid], mtime, tie
+        elif sort_by == Sort.filename:
+            return self.file_names[rid], mtime, tie
+        elif sort_by == Sort.extension:
+            return self.extensions[rid], mtime, tie
+        elif sort_by == Sort.file_type:
+            return int(self.file_types[rid]), mtime, tie
+        else:
+            assert sort_by == Sort.device
+            return self.devices.get(self.scan_ids[rid], ''), mtime, tie
+
+    def _sort_order(self, sort_by: Sort, sort_order: Qt.SortOrder) -> List[int]:
+        """
+        :return: every row id (including deleted rows) in ascending order of
+         their sort key
+        """
+
+        entry = self.sort_orders.get((sort_by, sort_order))
+        if entry is None:
+            keys = [self._sort_key(rid, sort_by, sort_order) for rid in range(len(self.uids))]
+            rids = sorted(range(len(keys)), key=keys.__getitem__)
+            keys = [keys[rid] for rid in rids]
+            entry = keys, rids
+            self.sort_orders[(sort_by, sort_order)] = entry
+        return entry[1]
+
+    def _add_to_sort_orders(self, rids: range) -> None:
+        if len(rids) * _sort_insert_ratio > rids.start:
+            self.sort_orders = {}
+            return
+
+        for (sort_by, sort_order), (keys, order) in self.sort_orders.items():
+            for rid in rids:
+                key = self._sort_key(rid, sort_by, sort_order)
+                position = bisect_right(keys, key)
+                keys.insert(position, key)
+                order.insert(position, rid)
+
+    def _drop_sort_orders(self, sort_by: Sort) -> None:
+        for sort_order in (Qt.AscendingOrder, Qt.DescendingOrder):
+            self.sort_orders.pop((sort_by, sort_order), None)
+
+    def _proximity_mask(self, values: List[int], rids: Dict[int, Set[int]]) -> int:
+        mask = bytearray(len(self.uids))
+        for value in values:
+            if value in rids:
+                for rid in rids[value]:
+                    mask[rid] = 1
+        return int.from_bytes(mask, 'little')
+
+    def _filter(self, scan_id: Optional[int]=None,
+                show: Optional[Show]=None,
+                previously_downloaded: Optional[bool]=None,
+                downloaded: Optional[bool]=None,
+                job_code: Optional[bool]=None,
+                file_type: Optional[FileType]=None,
+                marked: Optional[bool]=None,
+                extensions: Optional[List[str]]=None,
+                proximity_col1: Optional[List[int]]=None,
+                proximity_col2: Optional[List[int]]=None,
+                exclude_scan_ids: Optional[List[int]]=None,
+                uids: Optional[List[bytes]]=None) -> int:
+        """
+        Apply the filter criteria.
+
+        :return: the combined mask as an integer, with bit 8 x row id set for
+         each matching row
+        """
+
+        alive = self._mask_value(self.alive)
+        result = alive
+
+        def apply(mask: bytearray, value: bool) -> None:
+            nonlocal result
+            m = self._mask_value(mask)
+            result &= m if value else alive ^ m
+
+        if scan_id is not None:
+            if scan_id not in self.scan_id_masks:
+                return 0
+            apply(self.scan_id_masks[scan_id], True)
+
+        if marked is not None:
+            apply(self.marked, marked)
+
+        if file_type is not None:
+            apply(self.file_type_masks[file_type], True)
+
+        if show == Show.new_only:
+            apply(self.previously_downloaded, False)
+        elif previously_downloaded is not None:
+            apply(self.previously_downloaded, previously_downloaded)
+
+        if downloaded is not None:
+            apply(self.downloaded, downloaded)
+
+        if job_code is not None:
+            apply(self.job_code, job_code)
+
+        if extensions is not None:
+            rids = (rid for extension in extensions for rid in self.extension_rids.get(
+                extension, ()))
+            result &= int.from_bytes(rids_mask(rids, len(self.uids)), 'little')
+
+        if uids is not None:
+            rids = (self.uid_to_rid[uid] for uid in uids if uid in self.uid_to_rid)
+            result &= int.from_bytes(rids_mask(rids, len(self.uids)), 'little')
+
+        if exclude_scan_ids is not None:
+            for exclude in exclude_scan_ids:
+                if exclude in self.scan_id_masks:
+                    apply(self.scan_id_masks[exclude], False)
+
+        if proximity_col1:
+            result &= self._proximity_mask(proximity_col1, self.proximity_col1_rids)
+        if proximity_col2:
+            result &= self._proximity_mask(proximity_col2, self.proximity_col2_rids)
+
+        return result
+
+    def _filter_mask(self, **kwargs) -> bytes:
+        """
+        Apply the filter criteria.
+
+        :return: mask with one byte per row id, which is 1 for each matching row
+        """
+
+        return self._filter(**kwargs).to_bytes(len(self.uids), 'little')
+
+    def get_view(self, sort_by: Sort,
+                 sort_order: Qt.SortOrder,
+                 show: Show,
+                 proximity_col1: Optional[List[int]] = None,
+                 proximity_col2: Optional[List[int]] = None) -> List[Tuple[bytes, bool]]:
+
+        mask = self._filter_mask(
+            show=show, proximity_col1=proximity_col1, proximity_col2=proximity_col2
+        )
+        order = self._sort_order(sort_by, sort_order)
+        if sort_order == Qt.DescendingOrder:
+            order = reversed(order)
+        uids = self.uids
+        marked = self.marked
+        return [(uids[rid], marked[rid] == 1) for rid in order if mask[rid]]
+
+    def get_first_uid_from_uid_list(self, sort_by: Sort,
+                                    sort_order: Qt.SortOrder,
+                                    show: Show,
+                                    uids: List[bytes],
+                                    proximity_col1: Optional[List[int]] = None,
+                                    proximity_col2: Optional[List[int]] = None) -> Optional[bytes]:
+        """
+        Given a list of uids, and sort and filtering criteria, return the first
+        uid that the user will have displayed -- if any are displayed.
+        """
+
+        mask = self._filter_mask(
+            show=show, proximity_col1=proximity_col1, proximity_col2=proximity_col2, uids=uids
+        )
+        rids = list(mask_rids(mask))
+        if not rids:
+            return None
+
+        def key(rid: int) -> tuple:
+            return self._sort_key(rid, sort_by, sort_order)
+
+        if sort_order == Qt.AscendingOrder:
+            return self.uids[min(rids, key=key)]
+        else:
+            return self.uids[max(rids, key=key)]
+
+    def get_uids(self, scan_id: Optional[int]=None,
+                 show: Optional[Show]=None,
+                 previously_downloaded: Optional[bool]=None,
+                 downloaded: Optional[bool]=None,
+                 job_code: Optional[bool]=None,
+                 file_type: Optional[FileType]=None,
+                 marked: Optional[bool]=None,
+                 proximity_col1: Optional[List[int]]=None,
+                 proximity_col2: Optional[List[int]]=None,
+                 exclude_scan_ids: Optional[List[int]]=None,
+                 return_file_name=False) -> List[bytes]:
+
+        mask = self._filter_mask(
+            scan_id=scan_id, show=show,
+            previously_downloaded=previously_downloaded,
+            downloaded=downloaded, file_type=file_type,
+            job_code=job_code,
+            marked=marked, proximity_col1=proximity_col1,
+            proximity_col2=proximity_col2,
+            exclude_scan_ids=exclude_scan_ids
+        )
+
+        if return_file_name:
+            column = self.file_names
+        else:
+            column = self.uids
+        return [column[rid] for rid in mask_rids(mask)]
+
+    def get_count(self, scan_id: Optional[int]=None,
+                  show: Optional[Show]=None,
+                  previously_downloaded: Optional[bool]=None,
+                  downloaded: Optional[bool]=None,
+                  job_code: Optional[bool]=None,
+                  file_type: Optional[FileType]=None,
+                  marked: Optional[bool] = None,
+                  proximity_col1: Optional[List[int]]=None,
+                  proximity_col2: Optional[List[int]]=None) -> int:
+
+        if (scan_id is show is previously_downloaded is downloaded is job_code is file_type is
+                marked is None and not proximity_col1 and not proximity_col2):
+            return len(self.uid_to_rid)
+
+        return self._filter_mask(
+            scan_id=scan_id, show=show,
+            previously_downloaded=previously_downloaded,
+            downloaded=downloaded, job_code=job_code,
+            file_type=file_type,
+            marked=marked, proximity_col1=proximity_col1,
+            proximity_col2=proximity_col2
+        ).count(1)
+
+    def validate_uid(self, uid: bytes) -> None:
+        if uid not in self.uid_to_rid:
+            raise KeyError('UID does not exist in index')
+
+    def set_marked(self, uid: bytes, marked: bool) -> None:
+        self.marked[self.uid_to_rid[uid]] = 1 if marked else 0
+        self._mask_changed(self.marked)
+        self._drop_sort_orders(Sort.checked_state)
+
+    def set_all_marked_as_unmarked(self, scan_id: int=None) -> None:
+        if scan_id is None:
+            self.marked[:] = bytes(len(self.marked))
+        else:
+            for rid in mask_rids(self.scan_id_masks.get(scan_id, b'')):
+                self.marked[rid] = 0
+        self._mask_changed(self.marked)
+        self._drop_sort_orders(Sort.checked_state)
+
+    def _set_list_values(self, uids: List[bytes], mask: bytearray, value: bool) -> None:
+        uid_to_rid = self.uid_to_rid
+        value = 1 if value else 0
+        for uid in uids:
+            mask[uid_to_rid[uid]] = value
+        self._mask_changed(mask)
+
+    def set_list_marked(self, uids: List[bytes], marked: bool) -> None:
+        logging.debug('Setting marked to %s on %s uids', marked, len(uids))
+        self._set_list_values(uids=uids, mask=self.marked, value=marked)
+        self._drop_sort_orders(Sort.checked_state)
+
+    def set_list_previously_downloaded(self, uids: List[bytes],
+                                       previously_downloaded: bool) -> None:
+        logging.debug(
+            'Setting previously downloaded to %s on %s uids', previously_downloaded, len(uids)
+        )
+        self._set_list_values(
+            uids=uids, mask=self.previously_downloaded, value=previously_downloaded
+        )
+
+    def set_downloaded(self, uid: bytes, downloaded: bool) -> None:
+        self.downloaded[self.uid_to_rid[uid]] = 1 if downloaded else 0
+        self._mask_changed(self.downloaded)
+
+    def set_job_code_assigned(self, uids: List[bytes], job_code: bool) -> None:
+        self._set_list_values(uids=uids, mask=self.job_code, value=job_code)
+
+    def assign_proximity_groups(self, groups: Sequence[Tuple[int, int, bytes]]) -> None:
+        logging.debug('Assigning %s proximity groups', len(groups))
+        uid_to_rid = self.uid_to_rid
+        for col1, col2, uid in groups:
+            rid = uid_to_rid[uid]
+            self.proximity_col1_rids[self.proximity_col1[rid]].discard(rid)
+            self.proximity_col2_rids[self.proximity_col2[rid]].discard(rid)
+            self.proximity_col1[rid] = col1
+            self.proximity_col2[rid] = col2
+            self.proximity_col1_rids[col1].add(rid)
+            self.proximity_col2_rids[col2].add(rid)
+
+    def get_uids_for_device(self, scan_id: int) -> List[bytes]:
+        return [self.uids[rid] for rid in mask_rids(self.scan_id_masks.get(scan_id, b''))]
+
+    def any_files_marked(self, scan_id: Optional[int]=None) -> bool:
+        return self._filter(scan_id=scan_id, marked=True) != 0
+
+    def any_files_to_download(self, scan_id: Optional[int]=None) -> bool:
+        return self._filter(scan_id=scan_id, downloaded=False) != 0
+
+    def any_files_download_completed(self) -> bool:
+        return self._filter(downloaded=True) != 0
+
+    def any_files(self, scan_id: Optional[int]=None) -> bool:
+        """
+        Determine if there are any files associated with this scan_id, of if no scan_id
+        is specified, any file at all
+
+        :param scan_id: optional device to check
+        :return: True if found, else False
+        """
+
+        if scan_id is None:
+            return len(self.uid_to_rid) > 0
+        return 1 in self.scan_id_masks.get(scan_id, b'')
+
+    def any_files_with_extensions(self, scan_id: int, extensions: List[str]) -> bool:
+        return self._filter(scan_id=scan_id, extensions=extensions) != 0
+
+    def any_files_of_type(self, scan_id: int, file_type: FileType) -> bool:
+        return self._filter(scan_id=scan_id, file_type=file_type) != 0
+
+    def get_single_file_of_type(self, file_type: FileType,
+                                downloaded: Optional[bool] = None,
+                                scan_id: Optional[int]=None,
+                                exclude_scan_ids: Optional[List[int]] = None) -> Optional[bytes]:
+        mask = self._filter_mask(
+            scan_id=scan_id, downloaded=downloaded, file_type=file_type,
+            exclude_scan_ids=exclude_scan_ids
+        )
+        rid = mask.find(1)
+        if rid < 0:
+            return None
+        return self.uids[rid]
+
+    def any_marked_file_no_job_code(self) -> bool:
+        return self._filter(marked=True, job_code=False) != 0
+
+    def any_not_previously_downloaded(self, uids: List[bytes]) -> bool:
+        """
+
+        :param uids: list of UIDs to check
+        :return: True if any of the files associated with the UIDs have not been
+         previously downloaded
+        """
+
+        uid_to_rid = self.uid_to_rid
+        previously_downloaded = self.previously_downloaded
+        return any(
+            not previously_downloaded[uid_to_rid[uid]] for uid in uids if uid in uid_to_rid
+        )
+
+    def _delete_rids(self, rids: List[int]) -> None:
+        self.mask_values = {}
+        masks = self._masks()
+        for rid in rids:
+            del self.uid_to_rid[self.uids[rid]]
+            self.uids[rid] = None
+            for mask in masks:
+                mask[rid] = 0
+            self.extension_rids[self.extensions[rid]].discard(rid)
+            self.proximity_col1_rids[self.proximity_col1[rid]].discard(rid)
+            self.proximity_col2_rids[self.proximity_col2[rid]].discard(rid)
+
+        self.no_deleted += len(rids)
+        if self.no_deleted >= _min_deleted_to_compact and self.no_deleted > len(self.uid_to_rid):
+            self._compact()
+
+    def _compact(self) -> None:
+        """
+        Reassign row ids so there are no deleted rows
+        """
+
+        logging.debug(
+            'Compacting thumbnail rows index: removing %s deleted rows', self.no_deleted
+        )
+        rows = [
+            ThumbnailRow(
+                uid=self.uids[rid], scan_id=self.scan_ids[rid], mtime=self.mtimes[rid],
+                marked=self.marked[rid] == 1, file_name=self.file_names[rid],
+                extension=self.extensions[rid], file_type=self.file_types[rid],
+                downloaded=self.downloaded[rid] == 1,
+                previously_downloaded=self.previously_downloaded[rid] == 1,
+                job_code=self.job_code[rid] == 1, proximity_col1=self.proximity_col1[rid],
+                proximity_col2=self.proximity_col2[rid]
+            ) for rid in mask_rids(self.alive)
+        ]
+        devices = self.devices
+        self._initialize()
+        for scan_id, device_name in devices.items():
+            self.add_or_update_device(scan_id=scan_id, device_name=device_name)
+        self.add_thumbnail_rows(rows)
+
+    def delete_uids(self, uids: List[bytes]) -> None:
+        """
+        Deletes thumbnails from the index
+        :param uids: list of uids to delete
+        """
+
+        logging.debug('Deleting %s files from index', len(uids))
+        self._delete_rids([self.uid_to_rid[uid] for uid in uids if uid in self.uid_to_rid])
+
+    def delete_files_by_scan_id(self, scan_id: int, downloaded: Optional[bool]=None) -> None:
+        mask = self._filter_mask(scan_id=scan_id, downloaded=downloaded)
+        rids = list(mask_rids(mask))
+        logging.debug('Deleting %s files from index for scan id %s', len(rids), scan_id)
+        self._delete_rids(rids)
+
+    def delete_device(self, scan_id: int) -> None:
+        logging.debug('Deleting device %s from index', scan_id)
+        self.devices.pop(scan_id, None)
+        self._drop_sort_orders(Sort.device)
+        mask = self.scan_id_masks.get(scan_id)
+        if mask is not None and 1 not in mask:
+            self._mask_changed(mask)
+            del self.scan_id_masks[scan_id]
+
+
+class UidRows:
+    """
+    Map of uid to the row it is displayed in.
+
+    When rows are inserted, the rows of those already displayed are not renumbered.
+    Instead each insertion is recorded, and the row of a uid is found by adjusting
+    the row recorded for it by the insertions made since. Updating the map is
+    therefore proportional to the number of rows inserted, not the number displayed.
+    After a number of insertions the map is rebuilt, so lookups remain quick.
+
+    >>> uid_rows = UidRows()
+    >>> uid_rows.reset([(b'a', True), (b'c', True)])
+    >>> rows = [(b'a', True), (b'b', True), (b'c', True), (b'd', True)]
+    >>> uid_rows.insert([(1, [(b'b', True)]), (2, [(b'd', True)])], rows)
+    >>> [uid_rows[uid] for uid in (b'a', b'b', b'c', b'd')]
+    [0, 1, 2, 3]
+    >>> rows[0:0] = [(b'e', True)]
+    >>> uid_rows.insert([(0, [(b'e', True)])], rows)
+    >>> sorted(uid_rows.items())
+    [(b'a', 1), (b'b', 2), (b'c', 3), (b'd', 4), (b'e', 0)]
+    >>> b'f' in uid_rows, uid_rows.get(b'f')
+    (False, None)
+    """
+
+    # Rebuild the map after this many insertions
+    max_insertions = 32
+
+    def __init__(self) -> None:
+        # uid: (row, number of insertions made when the row was recorded)
+        self.rows = {}  # type: Dict[bytes, Tuple[int, int]]
+        # For each insertion, the rows at which rows were inserted, in ascending
+        # order and numbered as they were before the insertion, and the cumulative
+        # count of rows inserted at each
+        self.insertions = []  # type: List[Tuple[List[int], List[int]]]
+
+    def reset(self, rows: Sequence[Tuple[bytes, bool]]) -> None:
+        """
+        Rebuild the map from the rows displayed
+
+        :param rows: the rows displayed, as (uid, marked)
+        """
+
+        self.rows = {row[0]: (idx, 0) for idx, row in enumerate(rows)}
+        self.insertions = []
+
+    def insert(self, groups: Sequence[Tuple[int, Sequence[Tuple[bytes, bool]]]],
+               rows: Sequence[Tuple[bytes, bool]]) -> None:
+        """
+        Record the insertion of rows
+
+        :param groups: the rows inserted, grouped by the row they were inserted at,
+         which is numbered as it was before the insertion. Must be in ascending order.
+        :param rows: the rows displayed, including those inserted
+        """
+
+        if len(self.insertions) >= self.max_insertions:
+            self.reset(rows)
+            return
+
+        generation = len(self.insertions) + 1
+        positions = []
+        ends = []
+        inserted = 0
+        for position, group in groups:
+            for idx, row in enumerate(group, start=position + inserted):
+                self.rows[row[0]] = (idx, generation)
+            inserted += len(group)
+            positions.append(position)
+            ends.append(inserted)
+        self.insertions.append((positions, ends))
+
+    def __getitem__(self, uid: bytes) -> int:
+        row, generation = self.rows[uid]
+        for positions, ends in self.insertions[generation:]:
+            idx = bisect_right(positions, row)
+            if idx:
+                row += ends[idx - 1]
+        return row
+
+    def get(self, uid: bytes, default: Optional[int]=None) -> Optional[int]:
+        if uid in self.rows:
+            return self[uid]
+        return default
+
+    def __contains__(self, uid: bytes) -> bool:
+        return uid in self.rows
+
+    def __len__(self) -> int:
+        return len(self.rows)
+
+    def items(self) -> Iterator[Tuple[bytes, int]]:
+        for uid in self.rows:
+            yield uid, self[uid]